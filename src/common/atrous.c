@@ -0,0 +1,469 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2023 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/atrous.h"
+#include "common/imagebuf.h"
+#include "common/math.h"
+#include "control/conf.h"
+#include "control/control.h"     // needed by dwt.h
+#include "common/dwt.h"          // for dwt_interleave_rows
+
+// a tile or the full frame: pixel (x0, y0) of the image is at p, rows are 'stride' pixels apart
+typedef struct _atrous_buf_t
+{
+  float *p;
+  int x0;
+  int y0;
+  size_t stride;
+} _atrous_buf_t;
+
+static inline float *_px(const _atrous_buf_t *const b, const int ch, const int x, const int y)
+{
+  return b->p + (size_t)ch * ((size_t)(y - b->y0) * b->stride + (x - b->x0));
+}
+
+// distance of the outermost taps of a scale
+static inline int _radius(const dt_atrous_t *const a, const int scale)
+{
+  return a->filter == DT_ATROUS_BSPLINE ? 1 << scale : 2 << scale;
+}
+
+// rows and columns needed around the pixels produced by the scales first .. last-1
+static int _halo(const dt_atrous_t *const a, const int first, const int last)
+{
+  int halo = 0;
+  for(int s = first; s < last; s++) halo += _radius(a, s);
+  return halo;
+}
+
+// edge of the tiles: two tile buffers take about 1MB, a typical per core L2 cache
+static int _tile_size(const dt_atrous_t *const a)
+{
+  const int size = sqrtf((1 << 20) / (2.0f * sizeof(float) * a->ch));
+  return size & ~31;
+}
+
+static inline void _bspline_hat(const float *const restrict vsum, const float *const restrict in,
+                                float *const restrict coarse, float *const restrict detail, const int ch,
+                                const size_t k, const size_t center, const size_t left, const size_t right)
+{
+  for(int c = 0; c < ch; c++)
+  {
+    // renormalize by the total weight of all numbers added together; 'detail' is the difference between the
+    // original input and 'coarse'
+    const float hat = (2.f * vsum[ch * center + c] + vsum[ch * left + c] + vsum[ch * right + c]) / 16.f;
+    coarse[ch * k + c] = hat;
+    detail[ch * k + c] = in[ch * k + c] - hat;
+  }
+}
+
+// columns xa .. xb-1 of row y: a weighted sum of the row with the ones 'scale' pixels above and below, then of
+// each pixel of that sum with the ones 'scale' pixels to the left and right. beyond the image edges we use
+// reflection, i.e. we move as many rows or columns in from the edge as we would have been beyond it.
+static inline void _bspline_row(const dt_atrous_t *const a, const int scale, const int ch,
+                                const _atrous_buf_t *const src, const _atrous_buf_t *const dst,
+                                const int y, const int xa, const int xb,
+                                float *const restrict vsum, float *const restrict detail)
+{
+  const int width = a->width;
+  const int height = a->height;
+  const int rv = MIN(1 << scale, height - 1);
+  const int rh = MIN(1 << scale, width - 1);
+  const int above = abs(y - rv);
+  const int below = (y + rv < height) ? (y + rv) : 2 * (height - 1) - (y + rv);
+
+  // the vertical sums are needed up to 'rh' columns beyond the ones we produce, reflected ones included
+  const int va = MAX(0, xa - rh);
+  const int vb = MIN(width, xb + rh);
+  const float *const restrict center = _px(src, ch, va, y);
+  const float *const restrict up = _px(src, ch, va, above);
+  const float *const restrict down = _px(src, ch, va, below);
+  const size_t nv = (size_t)ch * (vb - va);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(size_t k = 0; k < nv; k++)
+    vsum[k] = 2.f * center[k] + up[k] + down[k];
+
+  const float *const restrict in = _px(src, ch, xa, y);
+  float *const restrict coarse = _px(dst, ch, xa, y);
+  const int mid0 = CLAMP(rh, xa, xb);
+  const int mid1 = CLAMP(width - rh, mid0, xb);
+  for(int x = xa; x < mid0; x++)
+  {
+    const int right = (x + rh < width) ? (x + rh) : 2 * width - 2 - (x + rh);
+    _bspline_hat(vsum, in, coarse, detail, ch, x - xa, x - va, abs(x - rh) - va, right - va);
+  }
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int x = mid0; x < mid1; x++)
+    _bspline_hat(vsum, in, coarse, detail, ch, x - xa, x - va, x - rh - va, x + rh - va);
+  for(int x = mid1; x < xb; x++)
+  {
+    const int right = (x + rh < width) ? (x + rh) : 2 * width - 2 - (x + rh);
+    _bspline_hat(vsum, in, coarse, detail, ch, x - xa, x - va, abs(x - rh) - va, right - va);
+  }
+}
+
+static inline void _eaw_weight(const dt_aligned_pixel_t c1,
+                               const dt_aligned_pixel_t c2,
+                               const dt_aligned_pixel_t sharpen,
+                               dt_aligned_pixel_t weight)
+{
+/* Computes the vector
+ * (wl, wc, wc, 1)
+ *
+ * where:
+ * wl = exp(-sharpen*SQR(c1[0] - c2[0]))
+ * wc = exp(-sharpen*(SQR(c1[1] - c2[1]) + SQR(c1[2] - c2[2]))
+ */
+  dt_aligned_pixel_t square;
+  for_each_channel(c) square[c] = c1[c] - c2[c];
+  for_each_channel(c) square[c] = square[c] * square[c];	// { d1, d2, d3, ? }
+  const dt_aligned_pixel_t square2 = { square[0], square[2], square[1], square[3] }; // { d1, d3, d2, ? }
+  dt_aligned_pixel_t added;
+  for_each_channel(c)
+    added[c] = square[c] + square2[c];				// { d1+d1, d2+d3, d2+d3, ? }
+  dt_aligned_pixel_t sharpened;
+  for_each_channel(c)
+    sharpened[c] = sharpen[c] * added[c];			// { -s*d1,  -s*(d2+d3), -s*(d2+d3), 0 }
+  dt_vector_exp(sharpened, weight);				// { wl, wc, wc, 1 }
+}
+
+static inline float _dn_weight(const float *c1, const float *c2, const float inv_sigma2)
+{
+  // 3d distance based on color
+  dt_aligned_pixel_t sqr;
+  for_each_channel(c)
+  {
+    const float diff = c1[c] - c2[c];
+    sqr[c] = diff * diff;
+  }
+  const float dot = (sqr[0] + sqr[1] + sqr[2]) * inv_sigma2;
+  const float var
+      = 0.02f; // FIXME: this should ideally depend on the image before noise stabilizing transforms!
+  const float off2 = 9.0f; // (3 sigma)^2
+  return fast_mexp2f(MAX(0, dot * var - off2));
+}
+
+// columns xa .. xb-1 of row y through the 5x5 b-spline, with taps 'scale' pixels apart and weighted by how
+// similar they are to the center pixel. beyond the image edges we use the nearest pixel.
+static inline void _eaw_row(const dt_atrous_t *const a, const int scale, const dt_atrous_filter_t filter,
+                            const _atrous_buf_t *const src, const _atrous_buf_t *const dst,
+                            const int y, const int xa, const int xb, float *const restrict detail)
+{
+  static const float filter_weights[25] =
+    {
+      1.0f / 256.0f,  4.0f / 256.0f,  6.0f / 256.0f,  4.0f / 256.0f, 1.0f / 256.0f,
+      4.0f / 256.0f, 16.0f / 256.0f, 24.0f / 256.0f, 16.0f / 256.0f, 4.0f / 256.0f,
+      6.0f / 256.0f, 24.0f / 256.0f, 36.0f / 256.0f, 24.0f / 256.0f, 6.0f / 256.0f,
+      4.0f / 256.0f, 16.0f / 256.0f, 24.0f / 256.0f, 16.0f / 256.0f, 4.0f / 256.0f,
+      1.0f / 256.0f,  4.0f / 256.0f,  6.0f / 256.0f,  4.0f / 256.0f, 1.0f / 256.0f
+    };
+  const int mult = 1 << scale;
+  const int width = a->width;
+  const int height = a->height;
+  const float sharpen = a->sharpen[scale];
+  const dt_aligned_pixel_t vsharpen = { -0.5f * sharpen, -sharpen, -sharpen, 0.0f };
+
+  const float *rows[5];
+  for(int jj = 0; jj < 5; jj++)
+    rows[jj] = _px(src, 4, src->x0, CLAMP(y + mult * (jj - 2), 0, height - 1));
+  float *const restrict coarse = _px(dst, 4, xa, y);
+
+  for(int x = xa; x < xb; x++)
+  {
+    size_t cols[5];
+    for(int ii = 0; ii < 5; ii++)
+      cols[ii] = (size_t)4 * (CLAMP(x + mult * (ii - 2), 0, width - 1) - src->x0);
+    const float *const px = _px(src, 4, x, y);
+
+    dt_aligned_pixel_t sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+    dt_aligned_pixel_t wgt = { 0.0f, 0.0f, 0.0f, 0.0f };
+    size_t filter_idx = 0;
+    for(int jj = 0; jj < 5; jj++)
+      for(int ii = 0; ii < 5; ii++)
+      {
+        const float *const px2 = rows[jj] + cols[ii];
+        const float f = filter_weights[filter_idx++];
+        if(filter == DT_ATROUS_EAW)
+        {
+          dt_aligned_pixel_t wp;
+          _eaw_weight(px, px2, vsharpen, wp);
+          dt_aligned_pixel_t w;
+          for_four_channels(c,aligned(px2))
+          {
+            w[c] = f * wp[c];
+            wgt[c] += w[c];
+            sum[c] += w[c] * px2[c];
+          }
+        }
+        else
+        {
+          const float w = f * _dn_weight(px, px2, sharpen);
+          for_each_channel(c,aligned(px2))
+          {
+            wgt[c] += w;
+            sum[c] += w * px2[c];
+          }
+        }
+      }
+
+    dt_aligned_pixel_t det;
+    for_each_channel(c)
+    {
+      sum[c] /= wgt[c];
+      det[c] = px[c] - sum[c];
+    }
+    copy_pixel(coarse + 4 * (x - xa), sum);
+    copy_pixel(detail + 4 * (x - xa), det);
+  }
+}
+
+// the filter and channel count are constants in each call of the inlined row functions
+static void _atrous_row(const dt_atrous_t *const a, const int scale,
+                        const _atrous_buf_t *const src, const _atrous_buf_t *const dst,
+                        const int y, const int xa, const int xb,
+                        float *const restrict vsum, float *const restrict detail)
+{
+  if(a->filter == DT_ATROUS_EAW)
+    _eaw_row(a, scale, DT_ATROUS_EAW, src, dst, y, xa, xb, detail);
+  else if(a->filter == DT_ATROUS_EAW_DN)
+    _eaw_row(a, scale, DT_ATROUS_EAW_DN, src, dst, y, xa, xb, detail);
+  else if(a->ch == 1)
+    _bspline_row(a, scale, 1, src, dst, y, xa, xb, vsum, detail);
+  else
+    _bspline_row(a, scale, 4, src, dst, y, xa, xb, vsum, detail);
+}
+
+int dt_atrous_fused_scales(const dt_atrous_t *const a)
+{
+  const int forced = dt_conf_get_int("memory/wavelet_fused_scales");
+  if(forced >= 0) return MIN(forced, a->scales);
+
+  // the halo recomputed around each tile is the price of keeping the coarse images in cache. the b-spline
+  // is bound by memory bandwidth and affords a lot of it, the edge-avoiding filters are bound by their
+  // arithmetic and hardly any.
+  const float max_overhead = a->filter == DT_ATROUS_BSPLINE ? 0.5f : 0.1f;
+  const int tile = _tile_size(a);
+  const int tw = MIN(tile, a->width);
+  const int th = MIN(tile, a->height);
+  int fused = 0;
+  for(int n = 1; n <= a->scales; n++)
+  {
+    if(_halo(a, 1, n) > tile / 2) break;
+    float work = 0.0f;
+    for(int s = 0; s < n; s++)
+    {
+      const int margin = _halo(a, s + 1, n);
+      work += (float)MIN(tw + 2 * margin, a->width) * MIN(th + 2 * margin, a->height);
+    }
+    if(work > (1.0f + max_overhead) * n * tw * th) break;
+    fused = n;
+  }
+  return fused;
+}
+
+// scales 0 .. fused-1 of one tile: the coarse images live in the two tile buffers, each band of the tile
+// interior is handed to a->band, and the residual is added to 'out' or, when full frame passes follow, stored
+// to 'residual'
+static void _atrous_tile(const dt_atrous_t *const a, const float *const in, float *const out,
+                         float *const residual, const int fused, const int tx, const int ty, const int tile,
+                         const int halo, float *const tilebuf, const size_t tilesize,
+                         float *const vsum, float *const detail)
+{
+  const int width = a->width;
+  const int height = a->height;
+  const int ch = a->ch;
+  const int tx1 = MIN(tx + tile, width);
+  const int ty1 = MIN(ty + tile, height);
+  const int count = tx1 - tx;
+  const int bx = MAX(0, tx - halo);
+  const int by = MAX(0, ty - halo);
+  const size_t stride = MIN(tx1 + halo, width) - bx;
+
+  _atrous_buf_t src = { (float *)in, 0, 0, width };
+  const _atrous_buf_t buf[2] = { { tilebuf, bx, by, stride }, { tilebuf + tilesize, bx, by, stride } };
+
+  for(int y = ty; y < ty1; y++)
+    memset(out + (size_t)ch * ((size_t)y * width + tx), 0, sizeof(float) * ch * count);
+
+  for(int s = 0; s < fused; s++)
+  {
+    // the later scales need this many rows and columns around the tile
+    const int margin = _halo(a, s + 1, fused);
+    const int xa = MAX(0, tx - margin);
+    const int xb = MIN(width, tx1 + margin);
+    const int ya = MAX(0, ty - margin);
+    const int yb = MIN(height, ty1 + margin);
+    for(int y = ya; y < yb; y++)
+    {
+      _atrous_row(a, s, &src, &buf[s & 1], y, xa, xb, vsum, detail);
+      if(a->band && y >= ty && y < ty1)
+        a->band(detail + (size_t)ch * (tx - xa), out + (size_t)ch * ((size_t)y * width + tx),
+                tx, y, count, s, a->data);
+    }
+    src = buf[s & 1];
+  }
+
+  for(int y = ty; y < ty1; y++)
+  {
+    const float *const restrict coarse = _px(&src, ch, tx, y);
+    const size_t offset = (size_t)ch * ((size_t)y * width + tx);
+    if(residual)
+      memcpy(residual + offset, coarse, sizeof(float) * ch * count);
+    else
+    {
+      float *const restrict o = out + offset;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(size_t k = 0; k < (size_t)ch * count; k++)
+        o[k] += coarse[k];
+    }
+  }
+}
+
+// one scale over the whole image, 'scratch' has room for two rows of each thread
+static void _atrous_frame(const dt_atrous_t *const a, const int scale, const float *const in,
+                          float *const coarse, float *const detail, float *const accum,
+                          float *const scratch, const size_t padded_size)
+{
+  const int width = a->width;
+  const int height = a->height;
+  const int ch = a->ch;
+  const int mult = 1 << scale;
+  const _atrous_buf_t src = { (float *)in, 0, 0, width };
+  const _atrous_buf_t dst = { coarse, 0, 0, width };
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(a, scale, src, dst, detail, accum, scratch, padded_size, width, height, ch, mult) \
+  schedule(static)
+#endif
+  for(int rowid = 0; rowid < height; rowid++)
+  {
+    // interleave the rows so that those 'mult' apart, which the filter taps read, are still in cache
+    const int y = dwt_interleave_rows(rowid, height, mult);
+    float *const vsum = dt_get_perthread(scratch, padded_size);
+    const size_t offset = (size_t)ch * y * width;
+    float *const drow = detail ? detail + offset : vsum + (size_t)ch * width;
+    _atrous_row(a, scale, &src, &dst, y, 0, width, vsum, drow);
+    if(a->band)
+      a->band(drow, accum ? accum + offset : NULL, 0, y, width, scale, a->data);
+  }
+}
+
+gboolean dt_atrous_decompose(const dt_atrous_t *const a, const int scale, const float *const in,
+                             float *const coarse, float *const detail)
+{
+  size_t padded_size;
+  float *const scratch = dt_alloc_perthread_float((size_t)2 * a->ch * a->width, &padded_size);
+  if(!scratch)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[dt_atrous_decompose] unable to alloc working memory\n");
+    return FALSE;
+  }
+  _atrous_frame(a, scale, in, coarse, detail, NULL, scratch, padded_size);
+  dt_free_align(scratch);
+  return TRUE;
+}
+
+gboolean dt_atrous_synthesize(const dt_atrous_t *const a, const float *const in, float *const out)
+{
+  const int width = a->width;
+  const int height = a->height;
+  const int ch = a->ch;
+  const size_t nfloats = (size_t)ch * width * height;
+
+  if(a->scales <= 0)
+  {
+    dt_iop_image_copy_by_size(out, in, width, height, ch);
+    return TRUE;
+  }
+
+  const int fused = dt_atrous_fused_scales(a);
+  const int tile = _tile_size(a);
+  const int halo = _halo(a, 1, fused);
+  const size_t tilesize = (size_t)ch * MIN(tile + 2 * halo, width) * MIN(tile + 2 * halo, height);
+  const size_t rowsize = (size_t)ch * width;
+
+  // per thread: the vertical sums and the details of a row, then the two tile buffers
+  size_t padded_size;
+  float *const scratch = dt_alloc_perthread_float(2 * rowsize + (fused > 0 ? 2 * tilesize : 0), &padded_size);
+  float *coarse[2] = { NULL, NULL };
+  if(fused < a->scales)
+  {
+    coarse[0] = dt_alloc_align_float(nfloats);
+    coarse[1] = dt_alloc_align_float(nfloats);
+  }
+  if(!scratch || (fused < a->scales && (!coarse[0] || !coarse[1])))
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[dt_atrous_synthesize] unable to alloc working memory\n");
+    dt_free_align(scratch);
+    dt_free_align(coarse[0]);
+    dt_free_align(coarse[1]);
+    return FALSE;
+  }
+
+  if(fused > 0)
+  {
+    const int tiles_x = (width + tile - 1) / tile;
+    const int tiles_y = (height + tile - 1) / tile;
+    float *const residual = coarse[0];
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(a, in, out, residual, fused, tile, halo, tilesize, rowsize, scratch, padded_size, \
+                      tiles_x, tiles_y) \
+  schedule(dynamic)
+#endif
+    for(int t = 0; t < tiles_x * tiles_y; t++)
+    {
+      float *const buf = dt_get_perthread(scratch, padded_size);
+      _atrous_tile(a, in, out, residual, fused, (t % tiles_x) * tile, (t / tiles_x) * tile, tile, halo,
+                   buf + 2 * rowsize, tilesize, buf, buf + rowsize);
+    }
+  }
+  else
+    dt_iop_image_fill(out, 0.0f, width, height, ch);
+
+  if(fused < a->scales)
+  {
+    const float *src = fused > 0 ? coarse[0] : in;
+    for(int s = fused; s < a->scales; s++)
+    {
+      float *const dst = coarse[(s - fused + (fused > 0)) & 1];
+      _atrous_frame(a, s, src, dst, NULL, out, scratch, padded_size);
+      src = dst;
+    }
+    // add in the final residue
+    dt_iop_image_add_image(out, src, width, height, ch);
+  }
+
+  dt_free_align(scratch);
+  dt_free_align(coarse[0]);
+  dt_free_align(coarse[1]);
+  return TRUE;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
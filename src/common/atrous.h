@@ -0,0 +1,79 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2023 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/darktable.h"
+
+/* shared à-trous wavelet engine used by eaw.c and dwt.c
+ *
+ * an image is decomposed into bands by repeatedly filtering the coarse image with a kernel whose taps are
+ * spread 2^scale pixels apart. dt_atrous_synthesize() fuses the decomposition, the per-band processing and
+ * the synthesis: the first scales are run one cache-sized tile at a time, including the halo the later
+ * scales need, so that the intermediate coarse images never leave the cache. the remaining scales, whose
+ * halo would cost more than the memory traffic saved, are run as full frame passes.
+ */
+
+typedef enum dt_atrous_filter_t
+{
+  DT_ATROUS_BSPLINE = 0, // separable 1-2-1 hat, mirrored borders, 1 or 4 channels (dwt.c)
+  DT_ATROUS_EAW = 1,     // 5x5 b-spline, edge-avoiding weights on luma and chroma, clamped borders, 4 channels
+  DT_ATROUS_EAW_DN = 2   // 5x5 b-spline, edge-avoiding weights on the color distance, clamped borders, 4 channels
+} dt_atrous_filter_t;
+
+/* per-band processing: called once per row of each band, possibly from several threads at once, with the
+ * detail coefficients of 'count' pixels starting at image position (x, y). 'accum' points to the same pixels
+ * of the synthesized image, it is NULL for dt_atrous_decompose().
+ */
+typedef void(dt_atrous_band_func)(const float *const restrict detail, float *const restrict accum,
+                                   const int x, const int y, const int count, const int scale, void *data);
+
+typedef struct dt_atrous_t
+{
+  dt_atrous_filter_t filter;
+  int ch;
+  int width;
+  int height;
+  int scales;
+  const float *sharpen;      // per scale: edge sensitivity for DT_ATROUS_EAW, 1/sigma^2 for DT_ATROUS_EAW_DN
+  dt_atrous_band_func *band; // may be NULL
+  void *data;                // passed to band
+} dt_atrous_t;
+
+/* number of leading scales dt_atrous_synthesize() runs in tiles, from the filter cost and the image size.
+ * the memory/wavelet_fused_scales config key overrides it when not negative, 0 disables the tiling. */
+int dt_atrous_fused_scales(const dt_atrous_t *const a);
+
+/* decomposes 'in' into a->scales bands and writes to 'out' the residual plus whatever a->band has added to
+ * its accumulator for each band. 'in' and 'out' must not overlap. returns FALSE, leaving 'out' alone, if
+ * the working memory can't be allocated.
+ */
+gboolean dt_atrous_synthesize(const dt_atrous_t *const a, const float *const in, float *const out);
+
+/* one full frame pass of 'scale': writes the filtered image to 'coarse' and, unless NULL, in - coarse to
+ * 'detail', calling a->band for each row if set. none of the buffers may overlap. returns FALSE if out of
+ * memory.
+ */
+gboolean dt_atrous_decompose(const dt_atrous_t *const a, const int scale, const float *const in,
+                             float *const coarse, float *const detail);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -37,6 +37,9 @@
 // mode (only 1mpix there).
 #define DT_COMMON_BILATERAL_MAX_RES_S 3000
 #define DT_COMMON_BILATERAL_MAX_RES_R 50
+// number of floats per brick of the blur along y and of the slab merge, small
+// enough that the rows touched by the 5-tap filter stay in L1
+#define DT_COMMON_BILATERAL_BRICK 512
 
 void dt_bilateral_grid_size(dt_bilateral_t *b,
                             const int width,
@@ -184,6 +187,7 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   b->sliceheight = (height + b->numslices - 1) / b->numslices;
   b->slicerows = (b->size_y + b->numslices - 1) / b->numslices + 2;
   b->buf = dt_calloc_align_float(b->size_x * b->size_z * b->numslices * b->slicerows);
+  b->buf16 = NULL;
   if(!b->buf)
   {
     dt_print(DT_DEBUG_ALWAYS,
@@ -210,8 +214,9 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
   float *const buf = b->buf;
 
   if(!buf) return;
+  dt_times_t start = { 0 };
+  dt_get_perf_times(&start);
   // splat into downsampled grid
-  const int nthreads = dt_get_num_threads();
   const size_t offsets[8] =
   {
     0,
@@ -272,28 +277,44 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
     }
   }
 
-  // merge the per-thread results into the final result
-  for(int slice = 1 ; slice < nthreads; slice++)
+  // merge the per-thread results into the final result. a grid column (x,z) of a slab only
+  // ever adds to the same column of the final grid, so the merge runs in parallel over
+  // blocks of columns while the slabs are still accumulated in order within each block.
+  const int numslices = b->numslices;
+  const int slicerows = b->slicerows;
+  const int sliceheight = b->sliceheight;
+  const int size_y = b->size_y;
+  const float sigma_s_inv = b->sigma_s_inv;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, oy, numslices, slicerows, sliceheight, size_y, sigma_s_inv) \
+  schedule(static)
+#endif
+  for(int i0 = 0; i0 < oy; i0 += DT_COMMON_BILATERAL_BRICK)
   {
-    // compute the first row of the final grid which this slice splats
-    const int destrow = (int)(slice * b->sliceheight * b->sigma_s_inv);
-    float *dest = buf + destrow * oy;
-    // now iterate over the grid rows splatted for this slice
-    for(int j = slice * b->slicerows; j < (slice+1)*b->slicerows; j++)
+    const int i1 = MIN(i0 + DT_COMMON_BILATERAL_BRICK, oy);
+    for(int slice = 1; slice < numslices; slice++)
     {
-      float *src = buf + j * oy;
-      for(int i = 0; i < oy; i++)
+      // compute the first row of the final grid which this slice splats
+      const int destrow = (int)(slice * sliceheight * sigma_s_inv);
+      float *dest = buf + (size_t)destrow * oy;
+      // now iterate over the grid rows splatted for this slice
+      for(int j = slice * slicerows; j < (slice+1) * slicerows; j++)
       {
-        dest[i] += src[i];
+        float *const src = buf + (size_t)j * oy;
+        for(int i = i0; i < i1; i++)
+          dest[i] += src[i];
+        dest += oy;
+        // clear elements in the part of the buffer which holds the
+        // final result now that we've read the partial result, since
+        // we'll be adding to those locations later
+        if(j < size_y)
+          memset(src + i0, '\0', sizeof(float) * (i1 - i0));
       }
-      dest += oy;
-      // clear elements in the part of the buffer which holds the
-      // final result now that we've read the partial result, since
-      // we'll be adding to those locations later
-      if(j < b->size_y)
-        memset(buf + j*oy, '\0', sizeof(float) * oy);
     }
   }
+  dt_show_times_f(&start, "[bilateral] splat", "%dx%d into %zux%zux%zu grid",
+                  b->width, b->height, b->size_x, b->size_y, b->size_z);
 }
 
 #ifdef _OPENMP
@@ -397,6 +418,43 @@ static void blur_line(float *buf,
 }
 
 
+// blur along one grid axis with the same gaussian as blur_line(), for len samples spaced by
+// stride, where each sample is a run of n contiguous floats. the inner loop then streams
+// through memory instead of striding through the grid. tmp holds 4*n floats of scratch.
+static inline void blur_brick(float *const buf,
+                              const size_t stride,
+                              const int len,
+                              const int n,
+                              float *const tmp)
+{
+  const float w0 = 6.f / 16.f;
+  const float w1 = 4.f / 16.f;
+  const float w2 = 1.f / 16.f;
+  float *m2 = tmp;           // unfiltered values two samples back
+  float *m1 = tmp + n;       // unfiltered values one sample back
+  float *cur = tmp + 2 * n;
+  const float *const zero = tmp + 3 * n;
+  memset(tmp, 0, sizeof(float) * 4 * n);
+  for(int k = 0; k < len; k++)
+  {
+    float *const row = buf + k * stride;
+    const float *const p1 = k + 1 < len ? row + stride : zero;
+    const float *const p2 = k + 2 < len ? row + 2 * stride : zero;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int i = 0; i < n; i++)
+    {
+      cur[i] = row[i];
+      row[i] = w0 * row[i] + w1 * (m1[i] + p1[i]) + w2 * (m2[i] + p2[i]);
+    }
+    float *const t = m2;
+    m2 = m1;
+    m1 = cur;
+    cur = t;
+  }
+}
+
 void dt_bilateral_blur(const dt_bilateral_t *b)
 {
   if(!b || !b->buf)
@@ -405,14 +463,113 @@ void dt_bilateral_blur(const dt_bilateral_t *b)
   const int ox = b->size_z;
   const int oy = b->size_x * b->size_z;
   const int oz = 1;
-  // gaussian up to 3 sigma
-  blur_line(b->buf, oz, oy, ox, b->size_z, b->size_y, b->size_x);
-  // gaussian up to 3 sigma
-  blur_line(b->buf, oz, ox, oy, b->size_z, b->size_x, b->size_y);
+  dt_times_t start = { 0 };
+  dt_get_perf_times(&start);
+
+  // the x and y passes work on bricks of whole z columns, as z is the contiguous axis
+  const int size_x = b->size_x;
+  const int size_y = b->size_y;
+  const int size_z = b->size_z;
+  const int nthreads = dt_get_num_threads();
+  const int brick_x = CLAMPS(DT_COMMON_BILATERAL_BRICK / size_z, 1,
+                             (size_x + 2 * nthreads - 1) / (2 * nthreads));
+  const int brick_n = brick_x * size_z;
+  size_t padded_size;
+  float *const tmpbuf = dt_alloc_perthread_float(4 * brick_n, &padded_size);
+  float *const buf = b->buf;
+  if(tmpbuf)
+  {
+    // gaussian up to 3 sigma along x, one grid row at a time
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, tmpbuf, padded_size, ox, oy, size_x, size_y, size_z) \
+  schedule(static)
+#endif
+    for(int j = 0; j < size_y; j++)
+      blur_brick(buf + (size_t)j * oy, ox, size_x, size_z, dt_get_perthread(tmpbuf, padded_size));
+
+    // gaussian up to 3 sigma along y, on bricks of brick_x grid columns
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, tmpbuf, padded_size, brick_x, oy, size_x, size_y, size_z) \
+  schedule(static)
+#endif
+    for(int x0 = 0; x0 < size_x; x0 += brick_x)
+    {
+      const int n = MIN(brick_x, size_x - x0) * size_z;
+      blur_brick(buf + (size_t)x0 * size_z, oy, size_y, n, dt_get_perthread(tmpbuf, padded_size));
+    }
+    dt_free_align(tmpbuf);
+  }
+  else
+  {
+    // gaussian up to 3 sigma
+    blur_line(b->buf, oz, oy, ox, b->size_z, b->size_y, b->size_x);
+    // gaussian up to 3 sigma
+    blur_line(b->buf, oz, ox, oy, b->size_z, b->size_x, b->size_y);
+  }
   // -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x)
   blur_line_z(b->buf, ox, oy, oz, b->size_x, b->size_y, b->size_z);
+  dt_show_times_f(&start, "[bilateral] blur", "%zux%zux%zu grid", b->size_x, b->size_y, b->size_z);
+}
+
+static inline uint16_t _float_to_bf16(const float f)
+{
+  union { float f; uint32_t u; } v = { .f = f };
+  // round to nearest even on the dropped mantissa bits
+  v.u += 0x7fff + ((v.u >> 16) & 1);
+  return v.u >> 16;
+}
+
+static inline float _bf16_to_float(const uint16_t h)
+{
+  union { uint32_t u; float f; } v = { .u = (uint32_t)h << 16 };
+  return v.f;
+}
+
+void dt_bilateral_compact(dt_bilateral_t *b)
+{
+  if(!b || !b->buf || b->buf16) return;
+
+  const size_t size = b->size_x * b->size_y * b->size_z;
+  uint16_t *const buf16 = dt_alloc_align(64, size * sizeof(uint16_t));
+  if(!buf16) return;
+  const float *const buf = b->buf;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(buf, buf16, size) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < size; k++)
+    buf16[k] = _float_to_bf16(buf[k]);
+  b->buf16 = buf16;
 }
 
+// trilinear interpolation of the grid around gi, from the 16-bit copy if there is one
+static inline float _grid_trilinear(const dt_bilateral_t *const b,
+                                    const size_t gi,
+                                    const float xf,
+                                    const float yf,
+                                    const float zf)
+{
+  const size_t ox = b->size_z;
+  const size_t oy = b->size_x * b->size_z;
+  const size_t oz = 1;
+  const size_t offsets[8] = { 0, ox, oy, ox + oy, oz, ox + oz, oy + oz, ox + oy + oz };
+  float v[8];
+  if(b->buf16)
+    for(int k = 0; k < 8; k++) v[k] = _bf16_to_float(b->buf16[gi + offsets[k]]);
+  else
+    for(int k = 0; k < 8; k++) v[k] = b->buf[gi + offsets[k]];
+  return v[0] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
+       + v[1] * (xf) * (1.0f - yf) * (1.0f - zf)
+       + v[2] * (1.0f - xf) * (yf) * (1.0f - zf)
+       + v[3] * (xf) * (yf) * (1.0f - zf)
+       + v[4] * (1.0f - xf) * (1.0f - yf) * (zf)
+       + v[5] * (xf) * (1.0f - yf) * (zf)
+       + v[6] * (1.0f - xf) * (yf) * (zf)
+       + v[7] * (xf) * (yf) * (zf);
+}
 
 #ifdef _OPENMP
 #pragma omp declare simd aligned(out, in :64)
@@ -424,17 +581,15 @@ void dt_bilateral_slice(const dt_bilateral_t *const b,
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = b->size_z;
-  const int oy = b->size_x * b->size_z;
-  const int oz = 1;
-  float *const buf = b->buf;
   const int width = b->width;
   const int height = b->height;
 
-  if(!buf) return;
+  if(!b->buf) return;
+  dt_times_t start = { 0 };
+  dt_get_perf_times(&start);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, out, norm, ox, oy, oz, height, width, buf)  \
+  dt_omp_firstprivate(b, in, out, norm, height, width)  \
   schedule(static) collapse(2)
 #endif
   for(int j = 0; j < height; j++)
@@ -446,20 +601,14 @@ void dt_bilateral_slice(const dt_bilateral_t *const b,
       const float L = in[index];
       // trilinear lookup:
       const size_t gi = image_to_grid(b, i, j, L, &xf, &yf, &zf);
-      const float Lout = fmaxf( 0.0f, L
-                         + norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                   + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf)));
+      const float Lout = fmaxf(0.0f, L + norm * _grid_trilinear(b, gi, xf, yf, zf));
       // copy color and mask, then update L
       copy_pixel(out + index, in + index);
       out[index] = Lout;
     }
   }
+  dt_show_times_f(&start, "[bilateral] slice", "%dx%d from %s grid",
+                  width, height, b->buf16 ? "16-bit" : "float");
 }
 
 #ifdef _OPENMP
@@ -472,17 +621,15 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b,
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = b->size_z;
-  const int oy = b->size_x * b->size_z;
-  const int oz = 1;
-  float *const buf = b->buf;
   const int width = b->width;
   const int height = b->height;
 
-  if(!buf) return;
+  if(!b->buf) return;
+  dt_times_t start = { 0 };
+  dt_get_perf_times(&start);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, out, norm, oy, oz, ox, buf, width, height)  \
+  dt_omp_firstprivate(b, in, out, norm, height, width)  \
   schedule(static) collapse(2)
 #endif
   for(int j = 0; j < height; j++)
@@ -494,28 +641,25 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b,
       const float L = in[index];
       // trilinear lookup:
       const size_t gi = image_to_grid(b, i, j, L, &xf, &yf, &zf);
-      const float Lout = norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                 + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
+      const float Lout = norm * _grid_trilinear(b, gi, xf, yf, zf);
       out[index] = MAX(0.0f, out[index] + Lout);
     }
   }
+  dt_show_times_f(&start, "[bilateral] slice to output", "%dx%d from %s grid",
+                  width, height, b->buf16 ? "16-bit" : "float");
 }
 
 void dt_bilateral_free(dt_bilateral_t *b)
 {
   if(!b) return;
   dt_free_align(b->buf);
+  dt_free_align(b->buf16);
   free(b);
 }
 
 #undef DT_COMMON_BILATERAL_MAX_RES_S
 #undef DT_COMMON_BILATERAL_MAX_RES_R
+#undef DT_COMMON_BILATERAL_BRICK
 
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <stddef.h> // for size_t
+#include <stdint.h> // for uint16_t
 
 typedef struct dt_bilateral_t
 {
@@ -28,6 +29,7 @@ typedef struct dt_bilateral_t
   float sigma_s, sigma_r;
   float sigma_s_inv, sigma_r_inv;  // reciprocals of sigma_s and sigma_r to avoid divisions
   float *buf __attribute__((aligned(64)));
+  uint16_t *buf16; // optional 16-bit copy of the blurred grid, see dt_bilateral_compact()
 } __attribute__((packed)) dt_bilateral_t;
 
 size_t dt_bilateral_memory_use(const int width,      // width of input image
@@ -62,6 +64,11 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in);
 
 void dt_bilateral_blur(const dt_bilateral_t *b);
 
+// convert the blurred grid to 16-bit floats (bfloat16), halving the memory traffic of the
+// slicing step at the cost of about 3 significant digits of precision. call between
+// dt_bilateral_blur() and dt_bilateral_slice(), falls back to the float grid on failure.
+void dt_bilateral_compact(dt_bilateral_t *b);
+
 void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, float *out, const float detail);
 
 void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *const in, float *out,
@@ -33,6 +33,7 @@
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 
+__DT_CLONE_TARGETS__
 static void _blur_horizontal_1ch(float *const restrict buf,
     const int height,
     const int width,
@@ -96,6 +97,7 @@ static void _blur_horizontal_1ch(float *const restrict buf,
   return;
 }
 
+__DT_CLONE_TARGETS__
 static void _blur_horizontal_2ch(float *const restrict buf,
     const int height,
     const int width,
@@ -232,25 +234,27 @@ static void store_scaled_4wide(float *const restrict out,
     out[c] = in[c] / scale;
 }
 
-static void _sub_16wide(float *const restrict accum,
-                        const float *const restrict values)
+static void _sub_Nwide(const size_t N,
+                       float *const restrict accum,
+                       const float *const restrict values)
 {
 #ifdef _OPENMP
-#pragma omp simd aligned(accum : 64) aligned(values : 16)
+#pragma omp simd aligned(accum : 64)
 #endif
-  for(size_t c = 0; c < 16; c++)
+  for(size_t c = 0; c < N; c++)
     accum[c] -= values[c];
 }
 
-// copy 16 floats from a possibly-unaligned buffer into aligned temporary space, and also add to accumulator
-static void _load_add_16wide(float *const restrict out,
+// copy N floats from a possibly-unaligned buffer into temporary space, and also add to accumulator
+static void _load_add_Nwide(const size_t N,
+    float *const restrict out,
     float *const restrict accum,
     const float *const restrict in)
 {
 #ifdef _OPENMP
-#pragma omp simd aligned(accum, out : 64)
+#pragma omp simd aligned(accum : 64)
 #endif
-  for(size_t c = 0; c < 16; c++)
+  for(size_t c = 0; c < N; c++)
   {
     const float v = in[c];
     accum[c] += v;
@@ -373,6 +377,7 @@ static void store_scaled_Nwide(const size_t N,
 }
 
 
+__DT_CLONE_TARGETS__
 static void _blur_horizontal_4ch(float *const restrict buf,
     const size_t height,
     const size_t width,
@@ -540,73 +545,6 @@ static void _blur_horizontal_Nch_Kahan(const size_t N,
   return;
 }
 
-// invoked inside an OpenMP parallel for, so no need to parallelize
-static void _blur_vertical_1wide(float *const restrict buf,
-    const size_t height,
-    const size_t width,
-    const size_t radius,
-    float *const restrict scratch)
-{
-  // To improve cache hit rates, we copy the final result from the scratch space back to the original
-  // location in the buffer as soon as we finish the final read of the buffer.  To reduce the working
-  // set and further improve cache hits, we can treat the scratch space as a circular buffer and cycle
-  // through it repeatedly.  To use a simple bitmask instead of a division, the size we cycle through
-  // needs to be the power of two larger than the window size (2*radius+1).
-  size_t mask = 1;
-  for(size_t r = (2*radius+1); r > 1 ; r >>= 1) mask = (mask << 1) | 1;
-
-  float L = 0.0f;
-  size_t hits = 0;
-  // add up the left half of the window
-  for(size_t y = 0; y < MIN(radius, height); y++)
-  {
-    hits++;
-    const float v = buf[y*width];
-    L += v;
-    scratch[y&mask] = v;
-  }
-  // process up to the point where we start removing values from the moving average
-  size_t y;
-  for(y = 0; y <= radius && y + radius < height; y++)
-  {
-    // weirdly, changing any of the 'np' or 'op' variables in this function to 'size_t' yields a substantial slowdown!
-    const int np = y + radius;
-    hits++;
-    const float v = buf[np*width];
-    L += v;
-    scratch[np&mask] = v;
-    buf[y*width] = L / hits;
-  }
-  // if radius > height/2, we have pixels for which we can neither add new values (y+radius >= height) nor
-  //  remove old values (y-radius < 0)
-  for(; y <= radius && y < height; y++)
-  {
-    buf[y*width] = L / hits;
-  }
-  // process the bulk of the column
-  for( ; y + radius < height; y++)
-  {
-    const int np = y + radius;
-    const int op = y - radius - 1;
-    L -= scratch[op&mask];
-    const float v = buf[np*width];
-    L += v;
-    scratch[np&mask] = v;
-    // update the means
-    buf[y*width] = L / hits;
-  }
-  // process the end of the column, where we don't have any more values to add to the mean
-  for( ; y < height; y++)
-  {
-    const int op = y - radius - 1;
-    hits--;
-    L -= scratch[op&mask];
-    // update the means
-    buf[y*width] = L / hits;
-  }
-  return;
-}
-
 // invoked inside an OpenMP parallel for, so no need to parallelize
 static void _blur_vertical_1wide_Kahan(float *const restrict buf,
     const size_t height,
@@ -675,65 +613,6 @@ static void _blur_vertical_1wide_Kahan(float *const restrict buf,
   return;
 }
 
-// invoked inside an OpenMP parallel for, so no need to parallelize
-static void _blur_vertical_4wide(float *const restrict buf,
-    const size_t height,
-    const size_t width,
-    const size_t radius,
-    float *const restrict scratch)
-{
-  // To improve cache hit rates, we copy the final result from the scratch space back to the original
-  // location in the buffer as soon as we finish the final read of the buffer.  To reduce the working
-  // set and further improve cache hits, we can treat the scratch space as a circular buffer and cycle
-  // through it repeatedly.  To use a simple bitmask instead of a division, the size we cycle through
-  // needs to be the power of two larger than the window size (2*radius+1).
-  size_t mask = 1;
-  for(size_t r = (2*radius+1); r > 1 ; r >>= 1) mask = (mask << 1) | 1;
-
-  dt_aligned_pixel_t L = { 0, 0, 0, 0 };
-  size_t hits = 0;
-  // add up the left half of the window
-  for(size_t y = 0; y < MIN(radius, height); y++)
-  {
-    hits++;
-    _load_add_4wide(scratch + 4*(y&mask), L, buf + y * width);
-  }
-  // process the blur up to the point where we start removing values
-  size_t y;
-  for(y = 0; y <= radius && y + radius < height; y++)
-  {
-    // weirdly, changing any of the 'np' or 'op' variables in this function to 'size_t' yields a substantial slowdown!
-    const int np = y + radius;
-    hits++;
-    _load_add_4wide(scratch + 4*(np&mask), L, buf + np*width);
-    store_scaled_4wide(buf + y*width, L, hits);
-  }
-  // if radius > height/2, we have pixels for which we can neither add new values (y+radius >= height) nor
-  //  remove old values (y-radius < 0)
-  for(; y <= radius && y < height; y++)
-  {
-    store_scaled_4wide(buf + y*width, L, hits);
-  }
-  // process the blur for the bulk of the column
-  for( ; y + radius < height; y++)
-  {
-    const int np = y + radius;
-    const int op = y - radius - 1;
-    _sub_4wide(L, scratch + 4*(op&mask));
-    _load_add_4wide(scratch + 4*(np&mask), L, buf + np*width);
-    store_scaled_4wide(buf + y*width, L, hits);
-  }
-  // process the blur for the end of the scan line, where we don't have any more values to add to the mean
-  for( ; y < height; y++)
-  {
-    const int op = y - radius - 1;
-    hits--;
-    _sub_4wide(L, scratch + 4*(op&mask));
-    store_scaled_4wide(buf + y*width, L, hits);
-  }
-  return;
-}
-
 // invoked inside an OpenMP parallel for, so no need to parallelize
 static void _blur_vertical_4wide_Kahan(float *const restrict buf,
     const size_t height,
@@ -795,7 +674,7 @@ static void _blur_vertical_4wide_Kahan(float *const restrict buf,
 }
 
 // invoked inside an OpenMP parallel for, so no need to parallelize
-static void _blur_vertical_16wide(float *const restrict buf,
+static void _blur_vertical_16wide_Kahan(float *const restrict buf,
     const size_t height,
     const size_t width,
     const size_t radius,
@@ -810,12 +689,13 @@ static void _blur_vertical_16wide(float *const restrict buf,
   for(size_t r = (2*radius+1); r > 1 ; r >>= 1) mask = (mask << 1) | 1;
 
   float DT_ALIGNED_ARRAY L[16] = { 0, 0, 0, 0 };
+  float DT_ALIGNED_ARRAY comp[16] = { 0, 0, 0, 0 };
   float hits = 0;
   // add up the left half of the window
   for(size_t y = 0; y < MIN(radius, height); y++)
   {
     hits++;
-    _load_add_16wide(scratch + 16 * (y&mask), L, buf + y*width);
+    _load_add_16wide_Kahan(scratch + 16 * (y&mask), L, buf + y*width, comp);
   }
   // process the blur up to the point where we start removing values from the moving average
   size_t y;
@@ -824,7 +704,7 @@ static void _blur_vertical_16wide(float *const restrict buf,
     // weirdly, changing any of the 'np' or 'op' variables in this function to 'size_t' yields a substantial slowdown!
     const int np = y + radius;
     hits++;
-    _load_add_16wide(scratch + 16 * (np&mask), L, buf + np*width);
+    _load_add_16wide_Kahan(scratch + 16 * (np&mask), L, buf + np*width, comp);
     store_scaled_16wide(buf + y*width, L, hits);
   }
   // if radius > height/2, we have pixels for which we can neither add new values (y+radius >= height) nor
@@ -838,8 +718,8 @@ static void _blur_vertical_16wide(float *const restrict buf,
   {
     const int np = y + radius;
     const int op = y - radius - 1;
-    _sub_16wide(L, scratch + 16*(op&mask));
-    _load_add_16wide(scratch + 16*(np&mask), L, buf + np*width);
+    _sub_16wide_Kahan(L, scratch + 16*(op&mask), comp);
+    _load_add_16wide_Kahan(scratch + 16*(np&mask), L, buf + np*width, comp);
     // update the means
     store_scaled_16wide(buf + y*width, L, hits);
   }
@@ -848,71 +728,95 @@ static void _blur_vertical_16wide(float *const restrict buf,
   {
     const int op = y - radius - 1;
     hits--;
-    _sub_16wide(L, scratch + 16*(op&mask));
+    _sub_16wide_Kahan(L, scratch + 16*(op&mask), comp);
     // update the means
     store_scaled_16wide(buf + y*width, L, hits);
   }
   return;
 }
 
+// determine the size of the scratch buffer needed for vertical passes of the box-mean filter
+// filter_window = 2**ceil(lg2(2*radius+1))
+static size_t _compute_effective_height(const size_t height, const size_t radius)
+{
+  size_t eff_height = 2;
+  for(size_t r = (2*radius+1); r > 1 ; r >>= 1) eff_height <<= 1;
+  eff_height = MIN(eff_height,height);
+  return eff_height;
+}
+
+// widest strip of columns the vertical pass works on at once, and the largest ring buffer (in floats) we allow
+// for one strip before narrowing it, which keeps the ring buffer in L2
+#define BOX_STRIP_MAX 256
+#define BOX_STRIP_CACHE (64 * 1024)
+
+// width of the strips of columns processed by the vertical pass: as wide as possible, so that each step down
+// the image reads whole runs of cache lines from a row, but small enough to keep the ring buffer cached and to
+// leave at least two strips per thread
+static size_t _vertical_strip_width(const size_t width, const size_t eff_height)
+{
+  size_t strip = BOX_STRIP_MAX;
+  while(strip > 16 && (strip * eff_height > BOX_STRIP_CACHE || width < 2 * strip * dt_get_num_threads()))
+    strip >>= 1;
+  return strip;
+}
+
 // invoked inside an OpenMP parallel for, so no need to parallelize
-static void _blur_vertical_16wide_Kahan(float *const restrict buf,
+__DT_CLONE_TARGETS__
+static void _blur_vertical_strip(float *const restrict buf,
     const size_t height,
     const size_t width,
     const size_t radius,
+    const size_t N,
     float *const restrict scratch)
 {
-  // To improve cache hit rates, we copy the final result from the scratch space back to the original
-  // location in the buffer as soon as we finish the final read of the buffer.  To reduce the working
-  // set and further improve cache hits, we can treat the scratch space as a circular buffer and cycle
-  // through it repeatedly.  To use a simple bitmask instead of a division, the size we cycle through
-  // needs to be the power of two larger than the window size (2*radius+1).
+  // Same scheme as the narrower Kahan versions above, on a strip of N <= BOX_STRIP_MAX columns: the scratch
+  // space is a circular buffer of the last 2**ceil(lg2(2*radius+1)) rows of the strip, and the results are
+  // written back as soon as the final read of a row is done.
   size_t mask = 1;
   for(size_t r = (2*radius+1); r > 1 ; r >>= 1) mask = (mask << 1) | 1;
 
-  float DT_ALIGNED_ARRAY L[16] = { 0, 0, 0, 0 };
-  float DT_ALIGNED_ARRAY comp[16] = { 0, 0, 0, 0 };
+  float DT_ALIGNED_ARRAY L[BOX_STRIP_MAX] = { 0.0f };
   float hits = 0;
   // add up the left half of the window
   for(size_t y = 0; y < MIN(radius, height); y++)
   {
     hits++;
-    _load_add_16wide_Kahan(scratch + 16 * (y&mask), L, buf + y*width, comp);
+    _load_add_Nwide(N, scratch + N * (y&mask), L, buf + y*width);
   }
   // process the blur up to the point where we start removing values from the moving average
   size_t y;
   for(y = 0; y <= radius && y + radius < height; y++)
   {
-    // weirdly, changing any of the 'np' or 'op' variables in this function to 'size_t' yields a substantial slowdown!
     const int np = y + radius;
     hits++;
-    _load_add_16wide_Kahan(scratch + 16 * (np&mask), L, buf + np*width, comp);
-    store_scaled_16wide(buf + y*width, L, hits);
+    _load_add_Nwide(N, scratch + N * (np&mask), L, buf + np*width);
+    store_scaled_Nwide(N, buf + y*width, L, hits);
   }
   // if radius > height/2, we have pixels for which we can neither add new values (y+radius >= height) nor
   //  remove old values (y-radius < 0)
   for(; y <= radius && y < height; y++)
   {
-    store_scaled_16wide(buf + y*width, L, hits);
+    store_scaled_Nwide(N, buf + y*width, L, hits);
   }
   // process the blur for the bulk of the column
   for( ; y + radius < height; y++)
   {
     const int np = y + radius;
     const int op = y - radius - 1;
-    _sub_16wide_Kahan(L, scratch + 16*(op&mask), comp);
-    _load_add_16wide_Kahan(scratch + 16*(np&mask), L, buf + np*width, comp);
+    _sub_Nwide(N, L, scratch + N*(op&mask));
+    _load_add_Nwide(N, scratch + N*(np&mask), L, buf + np*width);
     // update the means
-    store_scaled_16wide(buf + y*width, L, hits);
+    store_scaled_Nwide(N, buf + y*width, L, hits);
   }
   // process the blur for the end of the scan line, where we don't have any more values to add to the mean
   for( ; y < height; y++)
   {
     const int op = y - radius - 1;
     hits--;
-    _sub_16wide_Kahan(L, scratch + 16*(op&mask), comp);
+    _sub_Nwide(N, L, scratch + N*(op&mask));
     // update the means
-    store_scaled_16wide(buf + y*width, L, hits);
+    store_scaled_Nwide(N, buf + y*width, L, hits);
   }
   return;
 }
@@ -924,41 +828,20 @@ static void _blur_vertical_1ch(float *const restrict buf,
                                float *const restrict scanlines,
                                const size_t padded_size)
 {
+  const size_t strip = _vertical_strip_width(width, _compute_effective_height(height, radius));
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(radius, height, width, padded_size, buf, scanlines) \
+  dt_omp_firstprivate(radius, height, width, padded_size, buf, scanlines, strip) \
   schedule(static)
 #endif
-  for(int x = 0; x < width; x += 16)
+  for(size_t x = 0; x < width; x += strip)
   {
     float *const restrict scratch = dt_get_perthread(scanlines,padded_size);
-    if(x + 16 <= width)
-    {
-      _blur_vertical_16wide(buf + x, height, width, radius, scratch);
-    }
-    else
-    {
-      // handle the leftover 1..15 columns, first in groups of four, then the final 0..3 singly
-      int col = x;
-      for( ; col < (width & ~3); col += 4)
-        _blur_vertical_4wide(buf + col, height, width, radius, scratch);
-      for( ; col < width; col++)
-        _blur_vertical_1wide(buf + col, height, width, radius, scratch);
-    }
+    _blur_vertical_strip(buf + x, height, width, radius, MIN(strip, width - x), scratch);
   }
   return;
 }
 
-// determine the size of the scratch buffer needed for vertical passes of the box-mean filter
-// filter_window = 2**ceil(lg2(2*radius+1))
-static size_t _compute_effective_height(const size_t height, const size_t radius)
-{
-  size_t eff_height = 2;
-  for(size_t r = (2*radius+1); r > 1 ; r >>= 1) eff_height <<= 1;
-  eff_height = MIN(eff_height,height);
-  return eff_height;
-}
-
 static void dt_box_mean_1ch(float *const buf,
                             const size_t height,
                             const size_t width,
@@ -967,9 +850,9 @@ static void dt_box_mean_1ch(float *const buf,
 {
   // scratch space needed per thread:
   //   width floats to store one row during horizontal pass
-  //   16*filter_window floats for vertical pass
+  //   strip*filter_window floats for vertical pass
   const size_t eff_height = _compute_effective_height(height,radius);
-  const size_t size = MAX(width,16*eff_height);
+  const size_t size = MAX(width, _vertical_strip_width(width, eff_height) * eff_height);
   size_t padded_size;
   float *const restrict scanlines = dt_alloc_perthread_float(size, &padded_size);
 
@@ -990,9 +873,9 @@ static void dt_box_mean_4ch(float *const buf,
 {
   // scratch space needed per thread:
   //   4*width floats to store one row during horizontal pass
-  //   16*filter_window floats for vertical pass
+  //   strip*filter_window floats for vertical pass
   const size_t eff_height = _compute_effective_height(height,radius);
-  const size_t size = MAX(4*width,16*eff_height);
+  const size_t size = MAX(4*width, _vertical_strip_width(4*width, eff_height) * eff_height);
   size_t padded_size;
   float *const restrict scanlines = dt_alloc_perthread_float(size, &padded_size);
 
@@ -1081,7 +964,7 @@ static inline void box_mean_2ch(float *const restrict in,
   // by convolving along columns and rows separately (complexity O(2 × radius) instead of O(radius²)).
 
   const size_t eff_height = _compute_effective_height(height, radius);
-  const size_t Ndim = MAX(4*width,16*eff_height);
+  const size_t Ndim = MAX(4*width, _vertical_strip_width(2*width, eff_height) * eff_height);
   size_t padded_size;
   float *const restrict temp = dt_alloc_perthread_float(Ndim, &padded_size);
   if(temp == NULL) return;
@@ -85,6 +85,11 @@
 #include <locale.h>
 #include <limits.h>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef HAVE_GRAPHICSMAGICK
 #include <magick/api.h>
 #elif defined HAVE_IMAGEMAGICK
@@ -1316,6 +1321,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     dt_configure_runtime_performance(last_configure_version, config_info);
 
   dt_get_sysresource_level();
+  dt_alloc_policy_init();
   res->mipmap_memory = _get_mipmap_size();
   // initialize collection query
   darktable.collection = dt_collection_new(NULL);
@@ -1800,6 +1806,95 @@ void dt_print_nts(dt_debug_thread_t thread, const char *msg, ...)
   fflush(stdout);
 }
 
+// placement policy for large buffers, set up by dt_alloc_policy_init()
+static struct
+{
+  gboolean hugepages;
+  dt_alloc_numa_t numa;
+  unsigned long nodemask;
+} _alloc_policy = { FALSE, DT_ALLOC_NUMA_DEFAULT, 0 };
+
+#define DT_ALLOC_LARGE (16lu * 1024lu * 1024lu)
+#define DT_HUGEPAGE_SIZE (2lu * 1024lu * 1024lu)
+#define DT_MPOL_INTERLEAVE 3
+
+static int _numa_nodes(unsigned long *mask)
+{
+  int nodes = 0;
+  *mask = 0;
+#ifdef __linux__
+  for(int node = 0; node < (int)(8 * sizeof(unsigned long)); node++)
+  {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+    if(g_file_test(path, G_FILE_TEST_IS_DIR))
+    {
+      *mask |= 1lu << node;
+      nodes++;
+    }
+  }
+#endif
+  return nodes;
+}
+
+void dt_alloc_policy_init()
+{
+#ifdef __linux__
+  _alloc_policy.hugepages = dt_conf_get_bool("memory/hugepages");
+#endif
+
+  const char *numa = dt_conf_get_string_const("memory/numa_placement");
+  dt_alloc_numa_t policy = DT_ALLOC_NUMA_DEFAULT;
+  if(!g_strcmp0(numa, "first touch"))     policy = DT_ALLOC_NUMA_FIRSTTOUCH;
+  else if(!g_strcmp0(numa, "interleave")) policy = DT_ALLOC_NUMA_INTERLEAVE;
+
+  // placement only matters with more than one memory node
+  const int nodes = _numa_nodes(&_alloc_policy.nodemask);
+  _alloc_policy.numa = nodes > 1 ? policy : DT_ALLOC_NUMA_DEFAULT;
+
+  dt_print(DT_DEBUG_MEMORY,
+           "[dt_alloc_policy_init] huge pages %s, %d memory nodes, placement `%s'%s\n",
+           _alloc_policy.hugepages ? "on" : "off", nodes, numa ? numa : "default",
+           nodes > 1 || policy == DT_ALLOC_NUMA_DEFAULT ? "" : " ignored");
+}
+
+// write one byte per page, split the same way as image loops with schedule(static) split
+// their rows. the kernel places each page on the memory node of the thread writing it first.
+static void _alloc_first_touch(char *const mem, const size_t size)
+{
+  const size_t pagesize = 4096;
+  const size_t pages = size / pagesize;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(mem, pages, pagesize) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < pages; k++)
+    mem[k * pagesize] = 0;
+}
+
+static void _alloc_apply_policy(void *mem, const size_t size)
+{
+#ifdef __linux__
+  // madvise() and mbind() want page aligned ranges
+  const uintptr_t start = ((uintptr_t)mem + 4095) & ~(uintptr_t)4095;
+  const uintptr_t end = ((uintptr_t)mem + size) & ~(uintptr_t)4095;
+  if(end <= start) return;
+
+#ifdef MADV_HUGEPAGE
+  if(_alloc_policy.hugepages)
+    madvise((void *)start, end - start, MADV_HUGEPAGE);
+#endif
+#ifdef SYS_mbind
+  if(_alloc_policy.numa == DT_ALLOC_NUMA_INTERLEAVE)
+    syscall(SYS_mbind, (void *)start, (unsigned long)(end - start), DT_MPOL_INTERLEAVE,
+            &_alloc_policy.nodemask, 8 * sizeof(unsigned long), 0);
+#endif
+#endif
+  if(_alloc_policy.numa == DT_ALLOC_NUMA_FIRSTTOUCH)
+    _alloc_first_touch((char *)mem, size);
+}
+
 void *dt_alloc_align(const size_t alignment, const size_t size)
 {
   const size_t aligned_size = dt_round_size(size, alignment);
@@ -1818,7 +1913,11 @@ void *dt_alloc_align(const size_t alignment, const size_t size)
   return ((char*)ptr) + alignment ;
 #else
   void *ptr = NULL;
-  if(posix_memalign(&ptr, alignment, aligned_size)) return NULL;
+  const gboolean large = aligned_size >= DT_ALLOC_LARGE;
+  // huge pages can only back 2MB aligned ranges
+  const size_t align = large && _alloc_policy.hugepages ? MAX(alignment, DT_HUGEPAGE_SIZE) : alignment;
+  if(posix_memalign(&ptr, align, aligned_size)) return NULL;
+  if(large) _alloc_apply_policy(ptr, aligned_size);
   return ptr;
 #endif
 }
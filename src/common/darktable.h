@@ -434,6 +434,16 @@ void dt_dump_pipe_pfm(const char *mod,
                       const gboolean input,
                       const char *pipe);
 
+typedef enum dt_alloc_numa_t
+{
+  DT_ALLOC_NUMA_DEFAULT = 0,    // leave placement to the kernel
+  DT_ALLOC_NUMA_FIRSTTOUCH = 1, // touch pages from the threads that will process them
+  DT_ALLOC_NUMA_INTERLEAVE = 2, // spread pages over all memory nodes
+} dt_alloc_numa_t;
+
+// reads the placement policy for large buffers from darktablerc
+void dt_alloc_policy_init();
+
 void *dt_alloc_align(const size_t alignment, const size_t size);
 
 static inline void* dt_calloc_align(const size_t alignment, const size_t size)
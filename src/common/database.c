@@ -48,7 +48,7 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 44
+#define CURRENT_DATABASE_VERSION_LIBRARY 45
 #define CURRENT_DATABASE_VERSION_DATA    10
 
 // #define USE_NESTED_TRANSACTIONS
@@ -2551,6 +2551,16 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
 
     new_version = 44;
   }
+  else if(version == 44)
+  {
+    // line segments found by the perspective correction module, reused as long as the input didn't change
+    TRY_EXEC("CREATE TABLE main.ashift_lines"
+             " (imgid INTEGER PRIMARY KEY, hash INTEGER, enhance INTEGER,"
+             "  width INTEGER, height INTEGER, x_off INTEGER, y_off INTEGER, scale REAL, lines BLOB,"
+             "  FOREIGN KEY(imgid) REFERENCES images(id) ON UPDATE CASCADE ON DELETE CASCADE)",
+             "[init] can't create ashift_lines table\n");
+    new_version = 45;
+  }
   else
     new_version = version; // should be the fallback so that calling code sees that we are in an infinite loop
 
@@ -2992,6 +3002,12 @@ static void _create_library_schema(dt_database_t *db)
      "  mipmap_hash BLOB, fullthumb_hash BLOB, fullthumb_maxmip INTEGER,"
      "  FOREIGN KEY(imgid) REFERENCES images(id) ON UPDATE CASCADE ON DELETE CASCADE)",
      NULL, NULL, NULL);
+  sqlite3_exec
+    (db->handle, "CREATE TABLE main.ashift_lines"
+     " (imgid INTEGER PRIMARY KEY, hash INTEGER, enhance INTEGER,"
+     "  width INTEGER, height INTEGER, x_off INTEGER, y_off INTEGER, scale REAL, lines BLOB,"
+     "  FOREIGN KEY(imgid) REFERENCES images(id) ON UPDATE CASCADE ON DELETE CASCADE)",
+     NULL, NULL, NULL);
 
   // v34
   sqlite3_exec(db->handle, "CREATE INDEX main.images_datetime_taken_nc ON images (datetime_taken COLLATE NOCASE)",
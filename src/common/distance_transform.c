@@ -89,6 +89,18 @@ static void _image_distance_transform(const float *f, float *z, float *d, int *v
   }
 }
 
+// columns transformed together in the column pass
+#define DISTANCE_BLOCK 16
+
+// A line with the same value everywhere is its own distance transform. With small clipped areas in a large image
+// that's most lines: without any clipped pixel they are all zero, without any seed all DT_DISTANCE_TRANSFORM_MAX.
+static inline gboolean _constant_line(const float *const f, const size_t n)
+{
+  for(size_t i = 1; i < n; i++)
+    if(f[i] != f[0]) return FALSE;
+  return TRUE;
+}
+
 float dt_image_distance_transform(float *const src,
                                   float *const out,
                                   const size_t width,
@@ -123,22 +135,38 @@ float dt_image_distance_transform(float *const src,
   dt_omp_firstprivate(out, maxdim, width, height)
 #endif
   {
-    float *f = dt_alloc_align_float(maxdim);
+    float *f = dt_alloc_align_float(DISTANCE_BLOCK * height);
     float *z = dt_alloc_align_float(maxdim + 1);
     float *d = dt_alloc_align_float(maxdim);
     int *v = dt_alloc_align(64, maxdim * sizeof (int));
 
-    // transform along columns
+    // transform along columns, a block of DISTANCE_BLOCK columns at a time. The block is transposed into f
+    // so we read and write whole runs of the image rows instead of a single float per row.
 #ifdef _OPENMP
   #pragma omp for schedule (static)
 #endif
-    for(size_t x = 0; x < width; x++)
+    for(size_t x0 = 0; x0 < width; x0 += DISTANCE_BLOCK)
     {
+      const size_t bwidth = MIN(DISTANCE_BLOCK, width - x0);
       for(size_t y = 0; y < height; y++)
-        f[y] = out[y*width + x];
-      _image_distance_transform(f, z, d, v, height);
-      for(size_t y = 0; y < height; y++)
-        out[y*width + x] = d[y];
+        for(size_t c = 0; c < bwidth; c++)
+          f[c*height + y] = out[y*width + x0 + c];
+
+      gboolean changed = FALSE;
+      for(size_t c = 0; c < bwidth; c++)
+      {
+        float *const col = f + c*height;
+        if(_constant_line(col, height))
+          continue;
+        _image_distance_transform(col, z, d, v, height);
+        memcpy(col, d, sizeof(float) * height);
+        changed = TRUE;
+      }
+
+      if(changed)
+        for(size_t y = 0; y < height; y++)
+          for(size_t c = 0; c < bwidth; c++)
+            out[y*width + x0 + c] = f[c*height + y];
     }
     // implicit barrier :-)
     // transform along rows
@@ -147,11 +175,21 @@ float dt_image_distance_transform(float *const src,
 #endif
     for(size_t y = 0; y < height; y++)
     {
-      _image_distance_transform(&out[y*width], z, d, v, width);
+      float *const row = &out[y*width];
+      if(_constant_line(row, width))
+      {
+        const float val = sqrtf(row[0]);
+        if(val != 0.0f)
+          for(size_t x = 0; x < width; x++)
+            row[x] = val;
+        max_distance = fmaxf(max_distance, val);
+        continue;
+      }
+      _image_distance_transform(row, z, d, v, width);
       for(size_t x = 0; x < width; x++)
       {
         const float val = sqrtf(d[x]);
-        out[y*width + x] = val;
+        row[x] = val;
         max_distance = fmaxf(max_distance, val);
       }
     }
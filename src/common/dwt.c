@@ -17,6 +17,7 @@
 */
 
 #include "common/darktable.h"
+#include "common/atrous.h"
 #include "common/imagebuf.h"
 #include "control/control.h"
 #include "develop/imageop.h"
@@ -109,120 +110,17 @@ static void dwt_get_image_layer(float *const layer, dwt_params_t *const p)
     dt_iop_image_copy_by_size(p->image, layer, p->width, p->height, p->ch);
 }
 
-// first, "vertical" pass of wavelet decomposition
-static void dwt_decompose_vert(float *const restrict out, const float *const restrict in,
-                               const size_t height, const size_t width, const size_t lev)
-{
-  const size_t vscale = MIN(1 << lev, height-1);
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, vscale) \
-  dt_omp_sharedconst(in, out) \
-  schedule(static)
-#endif
-  for(int rowid = 0; rowid < height ; rowid++)
-  {
-    const size_t row = dwt_interleave_rows(rowid,height,vscale);
-    // perform a weighted sum of the current pixel row with the rows 'scale' pixels above and below
-    // if either of those is beyond the edge of the image, we use reflection to get a value for averaging,
-    // i.e. we move as many rows in from the edge as we would have been beyond the edge
-    // for the top edge, this means we can simply use the absolute value of row-vscale; for the bottom edge,
-    //   we need to reflect around height
-    const size_t rowstart = (size_t)4 * row * width;
-    const size_t above_row = (row > vscale) ? row - vscale : vscale - row;
-    const size_t below_row = (row + vscale < height) ? (row + vscale) : 2*(height-1) - (row + vscale);
-    const float* const restrict center = in + rowstart;
-    const float* const restrict above = in + 4 * above_row * width;
-    const float* const restrict below = in + 4 * below_row * width;
-    float* const restrict temprow = out + rowstart;
-    for(size_t col = 0; col < 4*width; col += 4)
-    {
-      for_each_channel(c,aligned(center, above, below, temprow : 16))
-      {
-        temprow[col + c] = 2.f * center[col+c] + above[col+c] + below[col+c];
-      }
-    }
-  }
-}
-
-// second, horizontal pass of wavelet decomposition; generates 'coarse' into the output buffer and overwrites
-//   the input buffer with 'details'
-static void dwt_decompose_horiz(
-    float *const restrict out,
-    float *const restrict in,
-    float *const temp,
-    size_t padded_size,
-    const size_t height,
-    const size_t width,
-    const size_t lev)
-{
-  const int hscale = MIN(1 << lev, width);  //(int because we need a signed difference below)
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, hscale, in, out, temp, padded_size)    \
-  schedule(static)
-#endif
-  for(int row = 0; row < height ; row++)
-  {
-    // perform a weighted sum of the current pixel with the ones 'scale' pixels to the left and right, using
-    // reflection to get a value if either of those positions is out of bounds, i.e. we move as many columns
-    // in from the edge as we would have been beyond the edge to avoid an additional pass, we also rescale the
-    // final sum and split the original input into 'coarse' and 'details' by subtracting the scaled sum from
-    // the original input.
-    const size_t rowindex = (size_t)4 * (row * width);
-    float* const restrict temprow = dt_get_perthread(temp,padded_size);
-    float* const restrict details = in + rowindex;
-    float* const restrict coarse = out + rowindex;
-
-    for(int col = 0; col < width - hscale; col++)
-    {
-      const size_t leftpos = (size_t)4*abs(col-hscale);	// the abs() handles reflection at the left edge
-      const size_t rightpos = (size_t)4*(col+hscale);
-      for_each_channel(c,aligned(temprow, details, coarse : 16))
-      {
-        const float left = coarse[leftpos+c];
-        const float right = coarse[rightpos+c];
-        // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-        const float hat = (2.f * coarse[4*col+c] + left + right) / 16.f;
-        // the normalized value is our 'coarse' result; 'details' is the difference between original input and 'coarse'
-        temprow[4*col+c] = hat;
-        details[4*col+c] -= hat;
-      }
-    }
-    // handle reflection at right edge
-    for(int col = width - hscale; col < width; col++)
-    {
-      const size_t leftpos = (size_t)4 * abs(col-hscale); // still need to handle reflection, if hscale>=width/2
-      const size_t rightpos = (size_t)4 * (2*width - 2 - (col+hscale));
-      for_each_channel(c,aligned(temprow, details, coarse : 16))
-      {
-        const float left = coarse[leftpos+c];
-        const float right = coarse[rightpos+c];
-        // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-        const float hat = (2.f * coarse[4*col+c] + left + right) / 16.f;
-        // the normalized value is our 'coarse' result; 'details' is the difference between original input and 'coarse'
-        temprow[4*col+c] = hat;
-        details[4*col+c] -= hat;
-      }
-    }
-    // now that we're done with the row of pixels, we can overwrite the intermediate result from the
-    // first pass with the final decomposition
-    memcpy(coarse, temprow, sizeof(float) * 4 * width);
-  }
-}
-
 // split input into 'coarse' and 'details'; put 'details' back into the input buffer
-static void dwt_decompose_layer(
-    float *const restrict out,
-    float *const restrict in,
-    float *const temp,
-    size_t padded_size,
-    const int lev,
-    const dwt_params_t *const p)
+static gboolean dwt_decompose_layer(float *const restrict out,
+                                    float *const restrict in,
+                                    const int lev,
+                                    const dwt_params_t *const p)
 {
-  dwt_decompose_vert(out, in, p->height, p->width, lev);
-  dwt_decompose_horiz(out, in, temp, padded_size, p->height, p->width, lev);
-  return;
+  const dt_atrous_t a = { .filter = DT_ATROUS_BSPLINE, .ch = 4, .width = p->width, .height = p->height,
+                          .scales = lev + 1 };
+  if(!dt_atrous_decompose(&a, lev, in, out, NULL)) return FALSE;
+  dt_iop_image_sub_image(in, out, p->width, p->height, p->ch);
+  return TRUE;
 }
 
 /* actual decomposing algorithm */
@@ -232,7 +130,6 @@ static void dwt_wavelet_decompose(float *img,
 {
   assert(p->ch == 4);
 
-  float *temp = NULL;		// scratch buffer for decomposition
   float *layers = NULL;		// buffer to reconstruct the image
   float *merged_layers = NULL;
   float *buffer[2] = { 0, 0 };
@@ -247,12 +144,10 @@ static void dwt_wavelet_decompose(float *img,
 
   /* allocate temporary storage */
   dt_iop_roi_t roi = { .x = 0, .y = 0, .height = p->height, .width = p->width };
-  size_t padded_size;
   const int do_merge = p->merge_from_scale > 0;
   if (!dt_iop_alloc_image_buffers(NULL, &roi, &roi,
                                   4 | DT_IMGSZ_INPUT, &buffer[1],
                                   4 | DT_IMGSZ_INPUT | DT_IMGSZ_CLEARBUF, &layers,
-                                  4 | DT_IMGSZ_WIDTH | DT_IMGSZ_PERTHREAD, &temp, &padded_size,
                                   (do_merge ? 4 | DT_IMGSZ_INPUT | DT_IMGSZ_CLEARBUF : 0), &merged_layers,
                                   0, NULL))
   {
@@ -268,7 +163,11 @@ static void dwt_wavelet_decompose(float *img,
   {
     unsigned int lpass = (1 - (lev & 1));
 
-    dwt_decompose_layer(buffer[lpass], buffer[hpass], temp, padded_size, lev, p);
+    if(!dwt_decompose_layer(buffer[lpass], buffer[hpass], lev, p))
+    {
+      bcontinue = 0;
+      break;
+    }
 
     // no merge scales or we didn't reach the merge scale from yet
     if(p->merge_from_scale == 0 || p->merge_from_scale > lev + 1)
@@ -346,7 +245,6 @@ static void dwt_wavelet_decompose(float *img,
     }
   }
 
-  dt_free_align(temp);
   dt_free_align(layers);
   dt_free_align(buffer[1]);
   if(merged_layers)
@@ -383,131 +281,26 @@ void dwt_decompose(dwt_params_t *p, _dwt_layer_func layer_func)
   dwt_wavelet_decompose(p->image, p, layer_func);
 }
 
-// first, "vertical" pass of wavelet decomposition
-static void dwt_denoise_vert_1ch(
-    float *const restrict out,
-    const float *const restrict in,
-    const size_t height,
-    const size_t width,
-    const size_t lev)
+// accumulates the portion of a detail scale that is above the noise threshold
+static void dwt_denoise_band(const float *const restrict details,
+                             float *const restrict accum,
+                             const int x,
+                             const int y,
+                             const int count,
+                             const int scale,
+                             void *data)
 {
-  const int vscale = MIN(1 << lev, height);
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, vscale) \
-  dt_omp_sharedconst(in, out) \
-  schedule(static)
-#endif
-  for(int rowid = 0; rowid < height ; rowid++)
-  {
-    const int row = dwt_interleave_rows(rowid,height,vscale);
-    // perform a weighted sum of the current pixel row with the rows 'scale' pixels above and below
-    // if either of those is beyond the edge of the image, we use reflection to get a value for averaging,
-    // i.e. we move as many rows in from the edge as we would have been beyond the edge
-    // for the top edge, this means we can simply use the absolute value of row-vscale; for the bottom edge,
-    //   we need to reflect around height
-    const size_t rowstart = (size_t)row * width;
-    const size_t below_row = (row + vscale < height) ? (row + vscale) : 2*(height-1) - (row + vscale);
-    const float *const restrict center = in + rowstart;
-    const float *const restrict above =  in + abs(row - vscale) * width;
-    const float *const restrict below = in + below_row * width;
-    float* const restrict outrow = out + rowstart;
+  const float thold = ((const float *)data)[scale];
 #ifdef _OPENMP
 #pragma omp simd
 #endif
-    for(int col= 0; col < width; col++)
-    {
-      outrow[col] = 2.f * center[col] + above[col] + below[col];
-    }
-  }
-}
-
-// second, horizontal pass of wavelet decomposition; generates 'coarse' into the output buffer and overwrites
-//   the input buffer with 'details'
-static void dwt_denoise_horiz_1ch(
-    float *const restrict out,
-    float *const restrict in,
-    float *const restrict accum,
-    const size_t height,
-    const size_t width,
-    const size_t lev,
-    const float thold,
-    const int last)
-{
-  const int hscale = MIN(1 << lev, width);
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, hscale, thold, last) \
-  dt_omp_sharedconst(in, out, accum) \
-  schedule(static)
-#endif
-  for(int row = 0; row < height ; row++)
+  for(int col = 0; col < count; col++)
   {
-    // perform a weighted sum of the current pixel with the ones 'scale' pixels to the left and right, using
-    // reflection to get a value if either of those positions is out of bounds, i.e. we move as many columns
-    // in from the edge as we would have been beyond the edge to avoid an additional pass, we also rescale the
-    // final sum and split the original input into 'coarse' and 'details' by subtracting the scaled sum from
-    // the original input.
-    const size_t rowindex = (size_t)row * width;
-    float *const restrict details = in + rowindex;
-    float *const restrict coarse = out + rowindex;
-    float *const restrict accum_row = accum + rowindex;
-    // handle reflection at left edge
-#ifdef _OPENMP
-#pragma omp simd
-#endif
-    for(int col = 0; col < hscale; col++)
-    {
-      // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[hscale-col] + coarse[col+hscale]) / 16.f;
-      // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
-      // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
-      // GCC8 won't vectorize if we use the following line, but it turns out that just adding the two conditional
-      // alternatives produces exactly the same result, and *that* does get vectorized
-      //const float excess = diff < 0.0 ? MIN(diff + thold, 0.0f) : MAX(diff - thold, 0.0f);
-      accum_row[col] += MAX(diff - thold,0.0f) + MIN(diff + thold, 0.0f);
-    }
-#ifdef _OPENMP
-#pragma omp simd
-#endif
-    for(int col = hscale; col < width - hscale; col++)
-    {
-      // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[col-hscale] + coarse[col+hscale]) / 16.f;
-      // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
-      // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
-      // GCC8 won't vectorize if we use the following line, but it turns out that just adding the two conditional
-      // alternatives produces exactly the same result, and *that* does get vectorized
-      //const float excess = diff < 0.0 ? MIN(diff + thold, 0.0f) : MAX(diff - thold, 0.0f);
-      accum_row[col] += MAX(diff - thold,0.0f) + MIN(diff + thold, 0.0f);
-    }
-    // handle reflection at right edge
-#ifdef _OPENMP
-#pragma omp simd
-#endif
-    for(int col = width - hscale; col < width; col++)
-    {
-      const float right = coarse[2*width - 2 - (col+hscale)];
-      // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[col-hscale] + right) / 16.f;
-      // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
-      // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
-      accum_row[col] += MAX(diff - thold,0.0f) + MIN(diff + thold, 0.0f);
-    }
-    if(last)
-    {
-      // add the details to the residue to create the final denoised result
-      for(int col = 0; col < width; col++)
-      {
-        details[col] += accum_row[col];
-      }
-    }
+    const float diff = details[col];
+    // GCC8 won't vectorize if we use the following line, but it turns out that just adding the two conditional
+    // alternatives produces exactly the same result, and *that* does get vectorized
+    //const float excess = diff < 0.0 ? MIN(diff + thold, 0.0f) : MAX(diff - thold, 0.0f);
+    accum[col] += MAX(diff - thold,0.0f) + MIN(diff + thold, 0.0f);
   }
 }
 
@@ -521,32 +314,21 @@ void dwt_denoise(float *const img,
                  const int bands,
                  const float *const noise)
 {
-  float *const details = dt_alloc_align_float((size_t)2 * width * height);
-  if(!details)
+  float *const denoised = dt_alloc_align_float((size_t)width * height);
+  if(!denoised)
   {
     dt_print(DT_DEBUG_ALWAYS,"[dwt_denoise] unable to alloc working memory, skipping denoise\n");
     return;
   }
-  float *const interm = details + width * height;	// temporary storage for use during each pass
-
-  // zero the accumulator
-  dt_iop_image_fill(details, 0.0f, width, height, 1);
 
-  for(int lev = 0; lev < bands; lev++)
-  {
-    const int last = (lev+1) == bands;
-
-    // "vertical" pass, averages pixels with those 'scale' rows above
-    // and below and puts result in 'interm'
-    dwt_denoise_vert_1ch(interm, img, height, width, lev);
-    // horizontal filtering pass, averages pixels in 'interm' with
-    // those 'scale' rows to the left and right
-    // accumulates the portion of the detail scale that is above the
-    // noise threshold into 'details'; this will be added to the
-    // residue left in 'img' on the last iteration
-    dwt_denoise_horiz_1ch(interm, img, details, height, width, lev, noise[lev], last);
-  }
-  dt_free_align(details);
+  // the engine adds up the thresholded detail scales and the residue, fusing the finest scales in tiles
+  const dt_atrous_t a = { .filter = DT_ATROUS_BSPLINE, .ch = 1, .width = width, .height = height,
+                          .scales = bands, .band = dwt_denoise_band, .data = (void *)noise };
+  if(dt_atrous_synthesize(&a, img, denoised))
+    dt_iop_image_copy_by_size(img, denoised, width, height, 1);
+  else
+    dt_print(DT_DEBUG_ALWAYS,"[dwt_denoise] unable to alloc working memory, skipping denoise\n");
+  dt_free_align(denoised);
 }
 
 #ifdef HAVE_OPENCL
@@ -22,22 +22,21 @@
 #include <stdlib.h>
 #include "common/darktable.h"
 
-typedef void((*eaw_decompose_t)(float *const restrict out, const float *const restrict in, float *const restrict detail,
-                                const int scale, const float sharpen, const int32_t width, const int32_t height));
-
 typedef void((*eaw_synthesize_t)(float *const out, const float *const in, const float *const restrict detail,
                                  const float *const restrict thrsf, const float *const restrict boostf,
                                  const int32_t width, const int32_t height));
 
-void eaw_decompose_and_synthesize(float *const restrict out,
-                                  const float *const restrict in,
-                                  float *const restrict accum,
-                                  const int scale,
-                                  const float sharpen,
-                                  const dt_aligned_pixel_t threshold,
-                                  const dt_aligned_pixel_t boost,
-                                  const ssize_t width,
-                                  const ssize_t height) ;
+/* decomposes 'in' into 'scales' edge-avoiding wavelet bands and writes to 'out' the residual plus the
+ * detail of each band, shrunk by threshold[scale] and multiplied by boost[scale]; the bands are fused in
+ * tiles by the engine in common/atrous.h. returns FALSE if out of memory. */
+gboolean eaw_decompose_and_synthesize(float *const restrict out,
+                                      const float *const restrict in,
+                                      const int scales,
+                                      const float *const sharpen,
+                                      const dt_aligned_pixel_t *const threshold,
+                                      const dt_aligned_pixel_t *const boost,
+                                      const int width,
+                                      const int height);
 void eaw_synthesize(float *const restrict out,
                     const float *const restrict in,
                     const float *const restrict detail,
@@ -34,9 +34,9 @@
  * but subtract them I2 = I0 - I1, where I0 is the sample image to be
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
- * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation.
- * It could benefit from a multi-grid evaluation of an initial solution
- * before the main iteration loop.
+ * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation,
+ * or alternatively a multigrid V-cycle (see _heal_multigrid below) which
+ * converges in a number of cycles independent of the size of the mask.
  *
  * I reduced the convergence criteria to 0.1% (0.001) as we are
  * dealing here with RGB integer components, more is overkill.
@@ -315,10 +315,12 @@ static void collect_runs(const int start, const float *const restrict mask, cons
 }
 
 // Solve the laplace equation for pixels and store the result in-place.
-static void _heal_laplace_loop(float *const restrict red_pixels, float *const restrict black_pixels,
-                               const size_t width, const size_t height,
-                               const float *const restrict mask, const int max_iter)
+// Returns the number of iterations done, and the final sum squared residual in *residual.
+static int _heal_laplace_loop(float *const restrict red_pixels, float *const restrict black_pixels,
+                              const size_t width, const size_t height,
+                              const float *const restrict mask, const int max_iter, float *residual)
 {
+  int iter = -1;
   // we start by converting the opacity mask into runs of nonzero positions, handling the 'red' and 'black'
   // checkerboarded pixels separately
   // the worst case is when consecutive red pixels alternate between being in the mask and out (same for black),
@@ -362,54 +364,410 @@ static void _heal_laplace_loop(float *const restrict red_pixels, float *const re
   const float err_exit = epsilon * epsilon * w * w;
 
   /* Gauss-Seidel with successive over-relaxation */
-  for(int iter = 0; iter < max_iter; iter++)
+  float err = 0.0f;
+  for(iter = 0; iter < max_iter; iter++)
   {
     // process red/black cells separately
-    float err = _heal_laplace_iteration(black_pixels, red_pixels, height, subwidth, black_runs, num_black, 1, w);
+    err = _heal_laplace_iteration(black_pixels, red_pixels, height, subwidth, black_runs, num_black, 1, w);
     err += _heal_laplace_iteration(red_pixels, black_pixels, height, subwidth, red_runs, num_red, 0, w);
 
-    if(err < err_exit) break;
+    if(err < err_exit)
+    {
+      iter++;
+      break;
+    }
   }
+  // the updates are the residuals scaled by the relaxation factor, report them divided by the
+  // diagonal of the laplacian (4 inside the stamp) like the multigrid solver
+  *residual = err / (16.0f * w * w);
 
 cleanup:
   if(red_runs) dt_free_align(red_runs);
   if(black_runs) dt_free_align(black_runs);
+  return iter;
+}
+
+/* Multigrid solver
+ *
+ * All levels work on interleaved 4-channel buffers. The fine level holds the
+ * difference image; the pixels outside of the mask are Dirichlet conditions
+ * and pixels beyond the borders of the stamp are simply not counted as
+ * neighbors, exactly like in the Gauss-Seidel solver above. A coarse cell is
+ * an unknown only if all of its 2x2 children are, the other coarse cells hold
+ * a zero correction: growing the domain instead would eventually swallow the
+ * Dirichlet conditions and leave a singular problem. The right hand side of a coarse level is the sum of the
+ * fine residuals of its children, which accounts for the 4x larger grid
+ * spacing of the (unscaled) 5-point laplacian. Corrections are interpolated
+ * bilinearly back to the fine level.
+ */
+
+#define HEAL_MG_MAX_LEVELS 32
+#define HEAL_MG_COARSEST 16    // pixels of the coarsest level, solved by plain relaxation
+#define HEAL_MG_SMOOTH 2       // pre- and post-smoothing sweeps per level
+
+typedef struct _heal_mg_level_t
+{
+  size_t width, height;
+  float *u;        // solution, or correction on coarse levels
+  float *f;        // right hand side, NULL on the fine level
+  float *r;        // residual
+  uint8_t *mask;   // unknowns
+} _heal_mg_level_t;
+
+// one red or black Gauss-Seidel sweep
+static void _heal_mg_smooth(const _heal_mg_level_t *const l, const int parity)
+{
+  float *const restrict u = l->u;
+  const float *const restrict f = l->f;
+  const uint8_t *const restrict mask = l->mask;
+  const size_t width = l->width;
+  const size_t height = l->height;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(u, f, mask, width, height, parity) \
+  schedule(static)
+#endif
+  for(size_t row = 0; row < height; row++)
+  {
+    for(size_t col = (row + parity) & 1; col < width; col += 2)
+    {
+      const size_t k = row * width + col;
+      if(!mask[k]) continue;
+      dt_aligned_pixel_t sum = { 0.0f };
+      float n = 0.0f;
+      if(row > 0)          { for_each_channel(c) sum[c] += u[4 * (k - width) + c]; n += 1.0f; }
+      if(row + 1 < height) { for_each_channel(c) sum[c] += u[4 * (k + width) + c]; n += 1.0f; }
+      if(col > 0)          { for_each_channel(c) sum[c] += u[4 * (k - 1) + c]; n += 1.0f; }
+      if(col + 1 < width)  { for_each_channel(c) sum[c] += u[4 * (k + 1) + c]; n += 1.0f; }
+      if(n == 0.0f) continue;
+      if(f)
+        for_each_channel(c) u[4 * k + c] = (sum[c] + f[4 * k + c]) / n;
+      else
+        for_each_channel(c) u[4 * k + c] = sum[c] / n;
+    }
+  }
+}
+
+// compute r = f - A u, and return the sum squared residual divided by the diagonal of A, the
+// correction a relaxation step would make, which is what the Gauss-Seidel solver stops on
+static float _heal_mg_residual(const _heal_mg_level_t *const l)
+{
+  const float *const restrict u = l->u;
+  const float *const restrict f = l->f;
+  float *const restrict r = l->r;
+  const uint8_t *const restrict mask = l->mask;
+  const size_t width = l->width;
+  const size_t height = l->height;
+  float err = 0.0f;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(u, f, r, mask, width, height) \
+  schedule(static) \
+  reduction(+ : err)
+#endif
+  for(size_t row = 0; row < height; row++)
+  {
+    for(size_t col = 0; col < width; col++)
+    {
+      const size_t k = row * width + col;
+      if(!mask[k])
+      {
+        for_four_channels(c) r[4 * k + c] = 0.0f;
+        continue;
+      }
+      dt_aligned_pixel_t sum = { 0.0f };
+      float n = 0.0f;
+      if(row > 0)          { for_each_channel(c) sum[c] += u[4 * (k - width) + c]; n += 1.0f; }
+      if(row + 1 < height) { for_each_channel(c) sum[c] += u[4 * (k + width) + c]; n += 1.0f; }
+      if(col > 0)          { for_each_channel(c) sum[c] += u[4 * (k - 1) + c]; n += 1.0f; }
+      if(col + 1 < width)  { for_each_channel(c) sum[c] += u[4 * (k + 1) + c]; n += 1.0f; }
+      for_each_channel(c)
+        r[4 * k + c] = (f ? f[4 * k + c] : 0.0f) - (n * u[4 * k + c] - sum[c]);
+      for(int c = 0; c < 3; c++) err += r[4 * k + c] * r[4 * k + c] / (n * n);
+    }
+  }
+  return err;
 }
 
+// sum the fine residuals into the right hand side of the coarse level, and clear its correction
+static void _heal_mg_restrict(const _heal_mg_level_t *const fine, const _heal_mg_level_t *const coarse)
+{
+  const float *const restrict r = fine->r;
+  float *const restrict f = coarse->f;
+  float *const restrict u = coarse->u;
+  const uint8_t *const restrict mask = coarse->mask;
+  const size_t fwidth = fine->width;
+  const size_t fheight = fine->height;
+  const size_t width = coarse->width;
+  const size_t height = coarse->height;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(r, f, u, mask, fwidth, fheight, width, height) \
+  schedule(static)
+#endif
+  for(size_t row = 0; row < height; row++)
+  {
+    for(size_t col = 0; col < width; col++)
+    {
+      const size_t k = row * width + col;
+      dt_aligned_pixel_t sum = { 0.0f };
+      if(mask[k])
+      {
+        for(size_t y = 2 * row; y < MIN(2 * row + 2, fheight); y++)
+          for(size_t x = 2 * col; x < MIN(2 * col + 2, fwidth); x++)
+            for_each_channel(c) sum[c] += r[4 * (y * fwidth + x) + c];
+      }
+      copy_pixel(f + 4 * k, sum);
+      for_four_channels(c) u[4 * k + c] = 0.0f;
+    }
+  }
+}
+
+// add the bilinearly interpolated coarse correction to the unknowns of the fine level
+static void _heal_mg_prolong(const _heal_mg_level_t *const coarse, const _heal_mg_level_t *const fine)
+{
+  const float *const restrict e = coarse->u;
+  float *const restrict u = fine->u;
+  const uint8_t *const restrict mask = fine->mask;
+  const size_t cwidth = coarse->width;
+  const size_t cheight = coarse->height;
+  const size_t width = fine->width;
+  const size_t height = fine->height;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(e, u, mask, cwidth, cheight, width, height) \
+  schedule(static)
+#endif
+  for(size_t row = 0; row < height; row++)
+  {
+    // the nearest coarse cell gets weight 3/4, the next one in the direction of the fine pixel 1/4
+    const size_t cy0 = row / 2;
+    const size_t cy1 = (row & 1) ? MIN(cy0 + 1, cheight - 1) : (cy0 > 0 ? cy0 - 1 : 0);
+    for(size_t col = 0; col < width; col++)
+    {
+      const size_t k = row * width + col;
+      if(!mask[k]) continue;
+      const size_t cx0 = col / 2;
+      const size_t cx1 = (col & 1) ? MIN(cx0 + 1, cwidth - 1) : (cx0 > 0 ? cx0 - 1 : 0);
+      const float *const e00 = e + 4 * (cy0 * cwidth + cx0);
+      const float *const e01 = e + 4 * (cy0 * cwidth + cx1);
+      const float *const e10 = e + 4 * (cy1 * cwidth + cx0);
+      const float *const e11 = e + 4 * (cy1 * cwidth + cx1);
+      for_each_channel(c)
+        u[4 * k + c] += (9.0f * e00[c] + 3.0f * (e01[c] + e10[c]) + e11[c]) * (1.0f / 16.0f);
+    }
+  }
+}
+
+static void _heal_mg_vcycle(const _heal_mg_level_t *const levels, const int level, const int num_levels)
+{
+  const _heal_mg_level_t *const l = levels + level;
+  if(level == num_levels - 1)
+  {
+    // the coarsest level only has a handful of cells
+    for(int i = 0; i < 2 * HEAL_MG_COARSEST; i++)
+    {
+      _heal_mg_smooth(l, 0);
+      _heal_mg_smooth(l, 1);
+    }
+    return;
+  }
+  for(int i = 0; i < HEAL_MG_SMOOTH; i++)
+  {
+    _heal_mg_smooth(l, 0);
+    _heal_mg_smooth(l, 1);
+  }
+  _heal_mg_residual(l);
+  _heal_mg_restrict(l, l + 1);
+  _heal_mg_vcycle(levels, level + 1, num_levels);
+  _heal_mg_prolong(l + 1, l);
+  for(int i = 0; i < HEAL_MG_SMOOTH; i++)
+  {
+    _heal_mg_smooth(l, 1);
+    _heal_mg_smooth(l, 0);
+  }
+}
+
+// Solve the laplace equation for the interleaved difference image in-place with multigrid V-cycles.
+// Returns the number of cycles done, and the final sum squared residual in *residual.
+static int _heal_multigrid(float *const restrict pixels, const size_t width, const size_t height,
+                           const float *const restrict mask, const int max_iter, float *residual)
+{
+  _heal_mg_level_t levels[HEAL_MG_MAX_LEVELS] = { { 0 } };
+  int num_levels = 0;
+  int iter = -1;
+
+  levels[0].width = width;
+  levels[0].height = height;
+  levels[0].u = pixels;
+  levels[0].r = dt_alloc_align_float(4 * width * height);
+  levels[0].mask = dt_alloc_align(64, width * height);
+  num_levels = 1;
+  if(!levels[0].r || !levels[0].mask) goto error;
+
+  for(size_t k = 0; k < width * height; k++)
+    levels[0].mask[k] = mask[k] != 0.0f;
+
+  while(num_levels < HEAL_MG_MAX_LEVELS)
+  {
+    const _heal_mg_level_t *const fine = levels + num_levels - 1;
+    if(fine->width * fine->height <= HEAL_MG_COARSEST) break;
+    _heal_mg_level_t *const l = levels + num_levels;
+    l->width = (fine->width + 1) / 2;
+    l->height = (fine->height + 1) / 2;
+    const size_t npix = l->width * l->height;
+    l->u = dt_alloc_align_float(4 * npix);
+    l->f = dt_alloc_align_float(4 * npix);
+    l->r = dt_alloc_align_float(4 * npix);
+    l->mask = dt_alloc_align(64, npix);
+    num_levels++;
+    if(!l->u || !l->f || !l->r || !l->mask) goto error;
+
+    for(size_t row = 0; row < l->height; row++)
+      for(size_t col = 0; col < l->width; col++)
+      {
+        uint8_t m = 1;
+        for(size_t y = 2 * row; y < MIN(2 * row + 2, fine->height); y++)
+          for(size_t x = 2 * col; x < MIN(2 * col + 2, fine->width); x++)
+            m &= fine->mask[y * fine->width + x];
+        l->mask[row * l->width + col] = m;
+      }
+  }
+
+  // same threshold as the Gauss-Seidel solver, on the scaled residual
+  const float epsilon = (0.1 / 255);
+  const float err_exit = epsilon * epsilon;
+
+  float err = _heal_mg_residual(levels);
+  for(iter = 0; iter < max_iter && err >= err_exit; iter++)
+  {
+    _heal_mg_vcycle(levels, 0, num_levels);
+    const float prev_err = err;
+    err = _heal_mg_residual(levels);
+    // stop once we are down to float precision
+    if(err >= prev_err)
+    {
+      iter++;
+      break;
+    }
+  }
+  *residual = err;
+
+  goto cleanup;
+
+error:
+  dt_print(DT_DEBUG_ALWAYS, "_heal_multigrid: error allocating memory for healing\n");
+  iter = -1;
+
+cleanup:
+  for(int i = 0; i < num_levels; i++)
+  {
+    if(i > 0 && levels[i].u) dt_free_align(levels[i].u);
+    if(levels[i].f) dt_free_align(levels[i].f);
+    if(levels[i].r) dt_free_align(levels[i].r);
+    if(levels[i].mask) dt_free_align(levels[i].mask);
+  }
+  return iter;
+}
+
+#undef HEAL_MG_MAX_LEVELS
+#undef HEAL_MG_COARSEST
+#undef HEAL_MG_SMOOTH
+
 
 /* Original Algorithm Design:
  *
  * T. Georgiev, "Photoshop Healing Brush: a Tool for Seamless Cloning
  * http://www.tgeorgiev.net/Photoshop_Healing.pdf
  */
-void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
-             const int height, const int ch, const int max_iter)
+int dt_heal_solve(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer,
+                  const int width, const int height, const int ch, const int max_iter,
+                  const dt_heal_solver_t solver, float *residual)
 {
   if(ch != 4)
   {
     dt_print(DT_DEBUG_ALWAYS,"dt_heal: full-color image required\n");
-    return;
+    return -1;
   }
-  const size_t subwidth = 4 * ((width+1)/2);  // round up to be able to handle odd widths
-  float *const restrict red_buffer = dt_alloc_align_float(subwidth * (height + 2));
-  float *const restrict black_buffer = dt_alloc_align_float(subwidth * (height + 2));
-  if(red_buffer == NULL || black_buffer == NULL)
+  dt_times_t start;
+  dt_get_perf_times(&start);
+
+  int iter = -1;
+  float err = 0.0f;
+
+  if(solver == DT_HEAL_SOLVER_MULTIGRID)
   {
-    dt_print(DT_DEBUG_ALWAYS, "dt_heal: error allocating memory for healing\n");
-    goto cleanup;
+    float *const restrict diff_buffer = dt_alloc_align_float((size_t)4 * width * height);
+    if(diff_buffer == NULL)
+    {
+      dt_print(DT_DEBUG_ALWAYS, "dt_heal: error allocating memory for healing\n");
+      return -1;
+    }
+    const size_t npixels = (size_t)width * height;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(src_buffer, dest_buffer, diff_buffer, npixels) \
+  schedule(static)
+#endif
+    for(size_t k = 0; k < 4 * npixels; k++)
+      diff_buffer[k] = dest_buffer[k] - src_buffer[k];
+
+    iter = _heal_multigrid(diff_buffer, width, height, mask_buffer, max_iter, &err);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(src_buffer, dest_buffer, diff_buffer, npixels) \
+  schedule(static)
+#endif
+    for(size_t k = 0; k < 4 * npixels; k++)
+      dest_buffer[k] = diff_buffer[k] + src_buffer[k];
+
+    dt_free_align(diff_buffer);
   }
+  else
+  {
+    const size_t subwidth = 4 * ((width+1)/2);  // round up to be able to handle odd widths
+    float *const restrict red_buffer = dt_alloc_align_float(subwidth * (height + 2));
+    float *const restrict black_buffer = dt_alloc_align_float(subwidth * (height + 2));
+    if(red_buffer == NULL || black_buffer == NULL)
+    {
+      dt_print(DT_DEBUG_ALWAYS, "dt_heal: error allocating memory for healing\n");
+      if(red_buffer) dt_free_align(red_buffer);
+      if(black_buffer) dt_free_align(black_buffer);
+      return -1;
+    }
 
-  /* subtract pattern from image and store the result split by 'red' and 'black' positions  */
-  _heal_sub(dest_buffer, src_buffer, red_buffer, black_buffer, width, height);
+    /* subtract pattern from image and store the result split by 'red' and 'black' positions  */
+    _heal_sub(dest_buffer, src_buffer, red_buffer, black_buffer, width, height);
 
-  _heal_laplace_loop(red_buffer, black_buffer, width, height, mask_buffer, max_iter);
+    iter = _heal_laplace_loop(red_buffer, black_buffer, width, height, mask_buffer, max_iter, &err);
 
-  /* add solution to original image and store in dest */
-  _heal_add(red_buffer, black_buffer, src_buffer, dest_buffer, width, height);
+    /* add solution to original image and store in dest */
+    _heal_add(red_buffer, black_buffer, src_buffer, dest_buffer, width, height);
 
-cleanup:
-  if(red_buffer) dt_free_align(red_buffer);
-  if(black_buffer) dt_free_align(black_buffer);
+    dt_free_align(red_buffer);
+    dt_free_align(black_buffer);
+  }
+
+  dt_show_times_f(&start, "[dt_heal]", "%s solver on %dx%d, %d iterations, residual %g",
+                  solver == DT_HEAL_SOLVER_MULTIGRID ? "multigrid" : "gauss-seidel",
+                  width, height, iter, err);
+  if(residual) *residual = err;
+  return iter;
+}
+
+void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
+             const int height, const int ch, const int max_iter)
+{
+  const dt_heal_solver_t solver = dt_conf_is_equal("plugins/darkroom/retouch/heal_solver", "multigrid")
+    ? DT_HEAL_SOLVER_MULTIGRID
+    : DT_HEAL_SOLVER_GAUSS_SEIDEL;
+  dt_heal_solve(src_buffer, dest_buffer, mask_buffer, width, height, ch, max_iter, solver, NULL);
 }
 
 #ifdef HAVE_OPENCL
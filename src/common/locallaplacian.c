@@ -224,7 +224,7 @@ static inline void gauss_reduce(
   ll_fill_boundary1(coarse, cw, ch);
 }
 
-// allocate output buffer with monochrome brightness channel from input, padded
+// fill the given buffer with monochrome brightness channel from input, padded
 // up by max_supp on all four sides, dimensions written to wd2 ht2
 static inline float *ll_pad_input(
     const float *const input,
@@ -233,12 +233,12 @@ static inline float *ll_pad_input(
     const int max_supp,
     int *wd2,
     int *ht2,
-    local_laplacian_boundary_t *b)
+    local_laplacian_boundary_t *b,
+    float *const out)
 {
   const int stride = 4;
   *wd2 = 2*max_supp + wd;
   *ht2 = 2*max_supp + ht;
-  float *const out = dt_alloc_align_float((size_t) *wd2 * *ht2);
 
   if(b && b->mode == 2)
   { // pad by preview buffer
@@ -381,13 +381,15 @@ static inline float curve_scalar(
   return val;
 }
 
-void apply_curve(
-    float *const out,
+// apply the curves for all gamma levels in a single pass over the padded input,
+// instead of reading it once per gamma level
+static void apply_curves_fused(
+    float *const out[num_gamma],
     const float *const in,
     const uint32_t w,
     const uint32_t h,
     const uint32_t padding,
-    const float g,
+    const float gamma[num_gamma],
     const float sigma,
     const float shadows,
     const float highlights,
@@ -395,20 +397,87 @@ void apply_curve(
 {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, sigma, shadows, w) \
+  dt_omp_firstprivate(clarity, gamma, h, highlights, in, out, padding, sigma, shadows, w) \
   schedule(static)
 #endif
   for(uint32_t j=padding;j<h-padding;j++)
   {
-    const float *in2  = in  + j*w + padding;
-    float *out2 = out + j*w + padding;
+    const float *in2 = in + j*w;
     for(uint32_t i=padding;i<w-padding;i++)
-      (*out2++) = curve_scalar(*(in2++), g, sigma, shadows, highlights, clarity);
-    out2 = out + j*w;
-    for(int i=0;i<padding;i++)   out2[i] = out2[padding];
-    for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
+    {
+      const float v = in2[i];
+      for(int k=0;k<num_gamma;k++)
+        out[k][j*w+i] = curve_scalar(v, gamma[k], sigma, shadows, highlights, clarity);
+    }
+    for(int k=0;k<num_gamma;k++)
+    {
+      float *out2 = out[k] + j*w;
+      for(int i=0;i<padding;i++)   out2[i] = out2[padding];
+      for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
+    }
+  }
+  for(int k=0;k<num_gamma;k++)
+    pad_by_replication(out[k], w, h, padding);
+}
+
+void local_laplacian_buffers_free(
+    local_laplacian_buffers_t *bufs)
+{
+  if(!bufs) return;
+  for(int l=0;l<max_levels;l++)
+  {
+    dt_free_align(bufs->padded[l]);
+    dt_free_align(bufs->output[l]);
+    for(int k=0;k<num_gamma;k++) dt_free_align(bufs->buf[k][l]);
+  }
+  memset(bufs, 0, sizeof(*bufs));
+}
+
+size_t local_laplacian_buffers_size(
+    const local_laplacian_buffers_t *bufs)
+{
+  if(!bufs || !bufs->valid) return 0;
+  size_t size = 0;
+  for(int l=0;l<=bufs->last_level;l++)
+    size += sizeof(float) * dl(bufs->w,l) * dl(bufs->h,l) * ((l < bufs->last_level ? 2 : 1) + num_gamma);
+  return size;
+}
+
+// make sure the pyramid buffers fit the padded size w x h and the number of levels,
+// keeps them if they already do. returns the number of bytes freshly allocated,
+// bufs->valid is FALSE if an allocation failed.
+static size_t ll_buffers_acquire(
+    local_laplacian_buffers_t *bufs,
+    const int w,
+    const int h,
+    const int last_level)
+{
+  if(bufs->valid && bufs->w == w && bufs->h == h && bufs->last_level == last_level)
+    return 0;
+
+  local_laplacian_buffers_free(bufs);
+  size_t allocated = 0;
+  gboolean success = TRUE;
+  for(int l=0;l<=last_level && success;l++)
+  {
+    const size_t size = (size_t)dl(w,l) * dl(h,l);
+    // the coarsest gauss level of the input is written directly to output
+    if(l < last_level) success = success && (bufs->padded[l] = dt_alloc_align_float(size));
+    success = success && (bufs->output[l] = dt_alloc_align_float(size));
+    for(int k=0;k<num_gamma && success;k++)
+      success = (bufs->buf[k][l] = dt_alloc_align_float(size)) != NULL;
+    allocated += sizeof(float) * size * ((l < last_level ? 2 : 1) + num_gamma);
+  }
+  if(!success)
+  {
+    local_laplacian_buffers_free(bufs);
+    return 0;
   }
-  pad_by_replication(out, w, h, padding);
+  bufs->w = w;
+  bufs->h = h;
+  bufs->last_level = last_level;
+  bufs->valid = TRUE;
+  return allocated;
 }
 
 void local_laplacian_internal(
@@ -420,7 +489,9 @@ void local_laplacian_internal(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    local_laplacian_boundary_t *b)
+    local_laplacian_boundary_t *b,
+    const int level_limit,
+    local_laplacian_buffers_t *buffers)
 {
   if(wd <= 1 || ht <= 1) return;
 
@@ -429,54 +500,30 @@ void local_laplacian_internal(
   int last_level = num_levels-1;
   if(b && b->mode == 2) // higher number here makes it less prone to aliasing and slower.
     last_level = num_levels > 4 ? 4 : num_levels-1;
+  else if(level_limit > 0) // reduced mode, trades large scale contrast for speed and memory
+    last_level = MIN(last_level, MAX(level_limit-1, 1));
   const int max_supp = 1<<last_level;
-  int w, h;
-  float *padded[max_levels] = {0};
-  if(b && b->mode == 2)
-    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, b);
-  else
-    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, 0);
-
-  // allocate pyramid pointers for padded input
-  gboolean success = padded[0] != NULL;
-  for(int l=1;l<=last_level;l++)
-  {
-    padded[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
-    if (!padded[l])
-    {
-      success = FALSE;
-      break;
-    }
-  }
-
-  // allocate pyramid pointers for output
-  float *output[max_levels] = {0};
-  for(int l=0;l<=last_level;l++)
+  int w = 2*max_supp + wd;
+  int h = 2*max_supp + ht;
+
+  // the preview collection mode hands padded[0] and output[] over to the caller,
+  // so it can't use persistent buffers.
+  local_laplacian_buffers_t scratch = { 0 };
+  local_laplacian_buffers_t *const bufs = (buffers && !(b && b->mode == 1)) ? buffers : &scratch;
+  const size_t allocated = ll_buffers_acquire(bufs, w, h, last_level);
+  if(!bufs->valid)
   {
-    output[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
-    if (!output[l])
-    {
-      success = FALSE;
-      break;
-    }
-  }
-
-  if(!success)
-  {
-    // we can't jump to cleanup from here because it would reference a
-    // variable which hasn't been initialized yet because it is
-    // declared below.  So just free whatever we've allocated and return.
-    for(int l = 0; l <= last_level; l++)
-    {
-      dt_free_align(padded[l]);
-      dt_free_align(output[l]);
-    }
     // copy the input buffer to the output so that we at least get a
     // valid result
     for(size_t k = 0; k < (size_t)4 * wd * ht; k++)
       out[k] = input[k];
     return;
   }
+  float **padded = bufs->padded;
+  float **output = bufs->output;
+  float *(*buf)[max_levels] = bufs->buf;
+
+  ll_pad_input(input, wd, ht, max_supp, &w, &h, (b && b->mode == 2) ? b : 0, padded[0]);
 
   // create gauss pyramid of padded input, write coarse directly to output
   for(int l=1;l<last_level;l++)
@@ -488,33 +535,17 @@ void local_laplacian_internal(
   for(int k=0;k<num_gamma;k++) gamma[k] = (k+.5f)/(float)num_gamma;
   // for(int k=0;k<num_gamma;k++) gamma[k] = k/(num_gamma-1.0f);
 
-  // allocate memory for intermediate laplacian pyramids
-  float *buf[num_gamma][max_levels] = {{0}};
-  for(int k=0;k<num_gamma;k++)
-    for(int l=0;l<=last_level;l++)
-    {
-      buf[k][l] = dt_alloc_align_float((size_t)dl(w,l)*dl(h,l));
-      if(!buf[k][l])
-      {
-        // copy the input buffer to the output so that we at least get a
-        // valid result
-        for(size_t p = 0; p < (size_t)4 * wd * ht; p++)
-          out[p] = input[p];
-        goto cleanup;
-      }
-    }
-
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
   // willing to pay the cost).
-  for(int k=0;k<num_gamma;k++)
-  { // process images
-    apply_curve(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
+  float *finest[num_gamma];
+  for(int k=0;k<num_gamma;k++) finest[k] = buf[k][0];
+  apply_curves_fused(finest, padded[0], w, h, max_supp, gamma, sigma, shadows, highlights, clarity);
 
-    // create gaussian pyramids
+  // create gaussian pyramids
+  for(int k=0;k<num_gamma;k++)
     for(int l=1;l<=last_level;l++)
       gauss_reduce(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
-  }
 
   // resample output[last_level] from preview
   // requires to transform from padded/downsampled to full image and then
@@ -622,6 +653,19 @@ void local_laplacian_internal(
     out[4*(j*wd+i)+1] = input[4*(j*wd+i)+1]; // copy original colour channels
     out[4*(j*wd+i)+2] = input[4*(j*wd+i)+2];
   }
+
+  if(darktable.unmuted & DT_DEBUG_PERF)
+  {
+    // traffic of the curve stage: read the padded input once instead of num_gamma times
+    const double plane = sizeof(float) * (double)w * h / (1024.0 * 1024.0);
+    dt_print(DT_DEBUG_PERF,
+             "[local laplacian] %dx%d, %d levels%s, allocated %.1fMB (%s buffers),"
+             " curve stage traffic %.1fMB fused vs %.1fMB separate\n",
+             wd, ht, last_level + 1, (level_limit > 0 && !(b && b->mode == 2)) ? " (reduced)" : "",
+             allocated / (1024.0 * 1024.0), bufs == buffers ? "persistent" : "temporary",
+             plane * (1 + num_gamma), plane * 2 * num_gamma);
+  }
+
   if(b && b->mode == 1)
   { // output the buffers for later re-use
     b->pad0 = padded[0];
@@ -629,17 +673,30 @@ void local_laplacian_internal(
     b->ht = ht;
     b->pwd = w;
     b->pht = h;
-    b->num_levels = num_levels;
-    for(int l=0;l<num_levels;l++) b->output[l] = output[l];
-  }
-  // free all buffers except the ones passed out for preview rendering
-cleanup:
-  for(int l=0;l<max_levels;l++)
-  {
-    if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
-    if(!b || b->mode != 1)        dt_free_align(output[l]);
-    for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
+    b->num_levels = last_level + 1;
+    for(int l=0;l<=last_level;l++) b->output[l] = output[l];
+    // the caller owns these now
+    scratch.padded[0] = NULL;
+    for(int l=0;l<=last_level;l++) scratch.output[l] = NULL;
   }
+  // free all temporary buffers except the ones passed out for preview rendering
+  if(bufs == &scratch)
+    local_laplacian_buffers_free(&scratch);
+}
+
+void local_laplacian_buffered(
+    const float *const input,
+    float *const out,
+    const int wd,
+    const int ht,
+    const float sigma,
+    const float shadows,
+    const float highlights,
+    const float clarity,
+    const int level_limit,
+    local_laplacian_buffers_t *buffers)
+{
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 0, level_limit, buffers);
 }
 
 
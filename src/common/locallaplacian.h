@@ -37,6 +37,26 @@ typedef struct local_laplacian_boundary_t
 }
 local_laplacian_boundary_t;
 
+// persistent pyramid buffers, to be kept e.g. per pixelpipe piece so that
+// repeated runs of the same size don't have to allocate (and page fault) again
+typedef struct local_laplacian_buffers_t
+{
+  int w, h;                // padded size the buffers have been allocated for
+  int last_level;          // coarsest pyramid level allocated
+  gboolean valid;
+  float *padded[30];       // gauss pyramid of the padded input
+  float *output[30];       // output pyramid
+  float *buf[6][30];       // laplacian pyramids per gamma level
+}
+local_laplacian_buffers_t;
+
+void local_laplacian_buffers_free(
+    local_laplacian_buffers_t *bufs);
+
+// bytes currently held by the persistent buffers
+size_t local_laplacian_buffers_size(
+    const local_laplacian_buffers_t *bufs);
+
 void local_laplacian_boundary_free(
     local_laplacian_boundary_t *b)
 {
@@ -55,7 +75,9 @@ void local_laplacian_internal(
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
     // the following is just needed for clipped roi with boundary conditions from coarse buffer (can be 0)
-    local_laplacian_boundary_t *b);
+    local_laplacian_boundary_t *b,
+    const int level_limit,      // if > 0, use at most this many pyramid levels (reduced mode)
+    local_laplacian_buffers_t *buffers); // persistent buffers to (re-)use (can be 0)
 
 void local_laplacian(
     const float *const input,   // input buffer in some Labx or yuvx format
@@ -68,9 +90,23 @@ void local_laplacian(
     const float clarity,        // user param: increase clarity/local contrast
     local_laplacian_boundary_t *b) // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, b, 0, 0);
 }
 
+// same as above, without boundary conditions but with persistent buffers and optionally
+// a reduced number of pyramid levels, e.g. for preview pipes
+void local_laplacian_buffered(
+    const float *const input,   // input buffer in some Labx or yuvx format
+    float *const out,           // output buffer with colour
+    const int wd,               // width and
+    const int ht,               // height of the input buffer
+    const float sigma,          // user param: separate shadows/mid-tones/highlights
+    const float shadows,        // user param: lift shadows
+    const float highlights,     // user param: compress highlights
+    const float clarity,        // user param: increase clarity/local contrast
+    const int level_limit,      // if > 0, use at most this many pyramid levels
+    local_laplacian_buffers_t *buffers); // kept between calls, free with local_laplacian_buffers_free()
+
 size_t local_laplacian_memory_use(const int width,      // width of input image
                                   const int height);    // height of input image
 
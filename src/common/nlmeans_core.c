@@ -66,6 +66,19 @@ struct patch_t
 };
 typedef struct patch_t patch_t;
 
+// cell size (in search-window offsets) used by the adaptive search, must be odd
+#define ADAPTIVE_CELL 3
+
+// layout of the patch array used by the adaptive (coarse-to-fine) search
+typedef struct adaptive_search_t
+{
+  int num_coarse;	// patches searched for every pixel: central cell plus one per outer cell
+  int num_cells;	// number of outer cells
+  int refine;		// number of most promising cells refined per chunk
+  int *cell_rep;	// index of the coarse patch representing each cell
+  int *cell_start;	// fine patches of cell k are cell_start[k] .. cell_start[k+1]-1
+} adaptive_search_t;
+
 static inline float gh(const float f)
 {
   return dt_fast_mexp2f(f) ;
@@ -92,17 +105,33 @@ static int scatter(
   return scale * ((abs_i1 * abs_i1 * abs_i1 + 7.0 * abs_i1 * sqrt(abs_i2)) * sign(index1) * scattering / 6.0 + index1);
 }
 
+// set up a patch for the given search-window indices, applying the scattering and tracking the largest shift
+static inline void set_patch(
+        struct patch_t *const patch,
+        const dt_nlmeans_param_t *const params,
+        const int stride,
+        const int row_index,
+        const int col_index,
+        int *shift)
+{
+  const int r = scatter(params->scale,params->scattering,row_index,col_index);
+  const int c = scatter(params->scale,params->scattering,col_index,row_index);
+  patch->rows = r;
+  patch->cols = c;
+  *shift = MAX(*shift, MAX(abs(r), abs(c)));
+  patch->offset = (r * stride + c * 4);
+}
+
 // allocate and fill an array of patch definitions
 static struct patch_t* define_patches(
         const dt_nlmeans_param_t *const params,
         const int stride,
+        const int decimation,
         int *num_patches,
         int *max_shift)
 {
   const int search_radius = params->search_radius;
-  const float scale = params->scale;
-  const float scattering = params->scattering;
-  int decimate = params->decimate ? 1 : 0;  // must start at 1 when nonzero, to choose correct patches to skip below
+  int decimate = (decimation == DT_NLMEANS_HALF) ? 1 : 0;  // must start at 1 when nonzero, to choose correct patches to skip below
   // determine how many patches we have
   int n_patches = (2 * search_radius + 1) * (2 * search_radius + 1);
   if(decimate)
@@ -118,15 +147,7 @@ static struct patch_t* define_patches(
     for(int col_index = -search_radius; col_index <= search_radius; col_index++)
     {
       if(decimate && (++decimate & 1)) continue; // skip every other patch
-      int r = scatter(scale,scattering,row_index,col_index);
-      int c = scatter(scale,scattering,col_index,row_index);
-      patches[patch_num].rows = r;
-      patches[patch_num].cols = c;
-      if(r > shift) shift = r;
-      else if(-r > shift) shift = -r;
-      if(c > shift) shift = c;
-      else if(-c > shift) shift = -c;
-      patches[patch_num].offset = (r * stride + c * 4);
+      set_patch(&patches[patch_num], params, stride, row_index, col_index, &shift);
       patch_num++;
     }
   }
@@ -134,6 +155,70 @@ static struct patch_t* define_patches(
   return patches;
 }
 
+// allocate and fill the patch definitions for the adaptive (coarse-to-fine) search.
+//   The search window is split into cells of ADAPTIVE_CELL x ADAPTIVE_CELL offsets.  The central
+//   cell is always searched densely, every other cell is first represented by its center offset
+//   only.  The remaining offsets of a cell are stored after all coarse patches, grouped by cell,
+//   so that only the cells which turned out to be the most promising have to be refined.
+static struct patch_t* define_adaptive_patches(
+        const dt_nlmeans_param_t *const params,
+        const int stride,
+        int *num_patches,
+        int *max_shift,
+        adaptive_search_t *search)
+{
+  const int K = params->search_radius;
+  const int half = ADAPTIVE_CELL / 2;
+  // cell centers are multiples of ADAPTIVE_CELL, the outermost ones may be clipped by the window
+  const int cmax = ADAPTIVE_CELL * ((K + half) / ADAPTIVE_CELL);
+  const int cells_per_row = 2 * (cmax / ADAPTIVE_CELL) + 1;
+  const int num_cells = cells_per_row * cells_per_row - 1;
+  const int center_size = 2 * MIN(half, K) + 1;
+  const int num_coarse = center_size * center_size + num_cells;
+  const int n_patches = (2 * K + 1) * (2 * K + 1);
+
+  struct patch_t* patches = dt_alloc_align(64, sizeof(struct patch_t) * n_patches);
+  search->cell_rep = malloc(sizeof(int) * MAX(num_cells, 1));
+  search->cell_start = malloc(sizeof(int) * (num_cells + 1));
+  search->num_coarse = num_coarse;
+  search->num_cells = num_cells;
+  search->refine = MAX(1, num_cells / 4);
+
+  int shift = 0;
+  int coarse = 0;
+  int fine = num_coarse;
+  int cell = 0;
+  // the densely searched central cell
+  for(int row_index = -MIN(half, K); row_index <= MIN(half, K); row_index++)
+    for(int col_index = -MIN(half, K); col_index <= MIN(half, K); col_index++)
+      set_patch(&patches[coarse++], params, stride, row_index, col_index, &shift);
+
+  for(int cr = -cmax; cr <= cmax; cr += ADAPTIVE_CELL)
+  {
+    for(int cc = -cmax; cc <= cmax; cc += ADAPTIVE_CELL)
+    {
+      if(cr == 0 && cc == 0) continue;
+      // representative offset is the cell center, moved into the window for clipped cells
+      const int rep_r = CLAMP(cr, -K, K);
+      const int rep_c = CLAMP(cc, -K, K);
+      search->cell_rep[cell] = coarse;
+      search->cell_start[cell] = fine;
+      set_patch(&patches[coarse++], params, stride, rep_r, rep_c, &shift);
+      for(int row_index = MAX(cr - half, -K); row_index <= MIN(cr + half, K); row_index++)
+        for(int col_index = MAX(cc - half, -K); col_index <= MIN(cc + half, K); col_index++)
+        {
+          if(row_index == rep_r && col_index == rep_c) continue;
+          set_patch(&patches[fine++], params, stride, row_index, col_index, &shift);
+        }
+      cell++;
+    }
+  }
+  search->cell_start[num_cells] = fine;
+  *num_patches = fine;
+  *max_shift = shift;
+  return patches;
+}
+
 static float compute_center_pixel_norm(const float center_weight, const int radius)
 {
   // scale the central pixel's contribution by the size of the patch so that the center-weight
@@ -323,8 +408,176 @@ static int compute_slice_width(const int width)
   return sl_width;
 }
 
+// accumulate the weighted contributions of a single patch offset over one chunk of the image,
+//   returns the sum of the weights which have been applied.  Not cloned itself so that it gets
+//   inlined into each of the SIMD clones of the caller.
+static inline float accumulate_patch(
+        const patch_t *const patch,
+        const float *const inbuf,
+        float *const outbuf,
+        float *const col_sums,
+        const int chunk_top,
+        const int chunk_bot,
+        const int chunk_left,
+        const int chunk_right,
+        const dt_iop_roi_t *const roi_out,
+        const size_t stride,
+        const int radius,
+        const dt_aligned_pixel_t center_norm,
+        const dt_nlmeans_param_t *const params)
+{
+  float wsum = 0.0f;
+  // skip any rows where the patch center would be above top of RoI or below bottom of RoI
+  const int height = roi_out->height;
+  const int row_min = MAX(chunk_top,MAX(0,-patch->rows));
+  const int row_max = MIN(chunk_bot,height - MAX(0,patch->rows));
+  // figure out which rows at top and bottom result in patches extending outside the RoI, even though the
+  // center pixel is inside
+  const int row_top = MAX(row_min,MAX(radius,radius-patch->rows));
+  const int row_bot = MIN(row_max,height-1-MAX(radius,radius+patch->rows));
+  // skip any columns where the patch center would be to the left or the right of the RoI
+  const int width = roi_out->width;
+  const int scol = patch->cols;
+  const int col_min = MAX(chunk_left,-scol);
+  const int col_max = MIN(chunk_right,roi_out->width - scol);
+
+  init_column_sums(col_sums,patch,inbuf,row_min,chunk_left,chunk_right,height,width,
+                   stride,radius,params->norm);
+  for(int row = row_min; row < row_max; row++)
+  {
+    // add up the initial columns of the sliding window of total patch distortion
+    float distortion = 0.0f;
+    for(int i = col_min - radius; i < MIN(col_min+radius, col_max); i++)
+    {
+      distortion += col_sums[i];
+    }
+    // now proceed down the current row of the image
+    const float *in = inbuf + stride * row;
+    float *const out = outbuf + (size_t)4 * width * row;
+    const int offset = patch->offset;
+    const float sharpness = params->sharpness;
+    if(params->center_weight < 0.0f)
+    {
+      // computation as used by denoise(non-local) iop
+      for(int col = col_min; col < col_max; col++)
+      {
+        distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
+        const float wt = gh(distortion * sharpness);
+        wsum += wt;
+#if defined(__SSE__) && defined(__GNUC__) && __GNUC__ < 12
+        // GCC10 has really poor code generation here, so manually force vectorized evaluation
+        __m128 pixel = _mm_loadu_ps(in+4*col+offset);
+        pixel[3] = 1.0f;
+        ((__m128*)out)[col] += (pixel * _mm_set1_ps(wt));
+#else
+        const float *const inpx = in+4*col;
+        const dt_aligned_pixel_t pixel = { inpx[offset], inpx[offset+1], inpx[offset+2], 1.0f };
+        for_four_channels(c,aligned(pixel,out:16))
+        {
+          out[4*col+c] += pixel[c] * wt;
+        }
+#endif  /* __SSE__ && __GNUC__ */
+        _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
+      }
+    }
+    else
+    {
+      // computation as used by denoiseprofiled iop with non-local means
+      for(int col = col_min; col < col_max; col++)
+      {
+        distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
+        const float dissimilarity = (distortion + pixel_difference(in+4*col,in+4*col+offset,center_norm))
+                                     / (1.0f + params->center_weight);
+        const float wt = gh(fmaxf(0.0f, dissimilarity * sharpness - 2.0f));
+        wsum += wt;
+#if defined(__SSE__) && defined(__GNUC__) && __GNUC__ < 12
+        // GCC10 has really poor code generation here, so manually force vectorized evaluation
+        __m128 pixel = _mm_loadu_ps(in+4*col+offset);
+        pixel[3] = 1.0f;
+        ((__m128*)out)[col] += (pixel * _mm_set1_ps(wt));
+#else
+        const float *const inpx = in + 4*col;
+        const dt_aligned_pixel_t pixel = { inpx[offset], inpx[offset+1], inpx[offset+2], 1.0f };
+        for_four_channels(c,aligned(pixel,out:16))
+        {
+          out[4*col+c] += pixel[c] * wt;
+        }
+#endif
+        _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
+      }
+    }
+    const int pcol_min = chunk_left - MIN(radius,MIN(chunk_left,chunk_left+scol));
+    const int pcol_max = chunk_right + MIN(radius,MIN(width-chunk_right,width-(chunk_right+scol)));
+    if(row < MIN(row_top, row_bot))
+    {
+      // top edge of patch was above top of RoI, so it had a value of zero; just add in the new row
+      const float *bot_row = inbuf + (row+1+radius)*stride;
+      for(int col = pcol_min; col < pcol_max; col++)
+      {
+        const float *const bot_px = bot_row + 4*col;
+        const float diff = pixel_difference(bot_px,bot_px+offset,params->norm);
+        _mm_prefetch(bot_px+stride, _MM_HINT_T0);
+#ifdef CACHE_PIXDIFFS
+        set_pixdiff(col_sums,radius,row+radius+1,col,diff);
+#endif
+        col_sums[col] += diff;
+        _mm_prefetch(bot_px+offset+stride, _MM_HINT_T0);
+      }
+    }
+    else if(row < row_bot)
+    {
+#ifndef CACHE_PIXDIFFS
+      const float *const top_row = inbuf + (row-radius)*stride   /* +(2*radius+1)*stride*/ ;
+#endif /* !CACHE_PIXDIFFS */
+      const float *const bot_row = inbuf + (row+1+radius)*stride ;
+      // both prior and new positions are entirely within the RoI, so subtract the old row and add the new one
+      for(int col = pcol_min; col < pcol_max; col++)
+      {
+#ifdef CACHE_PIXDIFFS
+        const float *const bot_px = bot_row + 4*col;
+        const float diff = pixel_difference(bot_px,bot_px+offset,params->norm);
+        col_sums[col] += diff - get_pixdiff(col_sums,radius,row-radius,col);
+        _mm_prefetch(bot_px+stride, _MM_HINT_T0);
+        set_pixdiff(col_sums,radius,row+1+radius,col,diff);
+#else
+        const float *const top_px = top_row + 4*col;
+        const float *const bot_px = bot_row + 4*col;
+        const float diff = diff_of_pixels_diff(bot_px,bot_px+offset,top_px,top_px+offset,params->norm);
+        _mm_prefetch(bot_px+stride, _MM_HINT_T0);
+        col_sums[col] += diff;
+#endif /* CACHE_PIXDIFFS */
+        _mm_prefetch(bot_px+offset+stride, _MM_HINT_T0);
+      }
+    }
+    else if(row >= row_top && row + 1 < row_max) // don't bother updating if last iteration
+    {
+      // new row of the patch is below the bottom of RoI, so its value is zero; just subtract the old row
+#ifndef CACHE_PIXDIFFS
+      const float *top_row = inbuf + (row-radius)*stride;
+#endif /* !CACHE_PIXDIFFS */
+      for(int col = pcol_min; col < pcol_max; col++)
+      {
+#ifdef CACHE_PIXDIFFS
+        col_sums[col] -= get_pixdiff(col_sums,radius,row-radius,col);
+#else
+        const float *const top_px = top_row + 4*col;
+        col_sums[col] -= pixel_difference(top_px,top_px+offset,params->norm);
+#endif /* CACHE_PIXDIFFS */
+      }
+    }
+  }
+  return wsum;
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+  const float fa = *(const float *)a;
+  const float fb = *(const float *)b;
+  return (fa > fb) - (fa < fb);
+}
+
 __DT_CLONE_TARGETS__
-void nlmeans_denoise(
+static void _nlmeans_denoise(
         const float *const inbuf,
         float *const outbuf,
         const dt_iop_roi_t *const roi_in,
@@ -345,7 +598,18 @@ void nlmeans_denoise(
   const size_t stride = 4 * roi_in->width;
   int num_patches;
   int max_shift;
-  struct patch_t* patches = define_patches(params,stride,&num_patches,&max_shift);
+  adaptive_search_t search = { 0 };
+  const gboolean adaptive = params->decimate == DT_NLMEANS_ADAPTIVE;
+  struct patch_t* patches = adaptive
+    ? define_adaptive_patches(params,stride,&num_patches,&max_shift,&search)
+    : define_patches(params,stride,params->decimate,&num_patches,&max_shift);
+  // with adaptive search, first all coarse patches are evaluated, then only the fine patches of the
+  //   most promising cells
+  const int num_coarse = adaptive ? search.num_coarse : num_patches;
+  const int num_cells = search.num_cells;
+  const int refine = search.refine;
+  const int *const cell_rep = search.cell_rep;
+  const int *const cell_start = search.cell_start;
   // allocate scratch space, including an overrun area on each end so we don't need a boundary check on every access
   const int radius = params->patch_radius;
 #if defined(CACHE_PIXDIFFS)
@@ -355,12 +619,19 @@ void nlmeans_denoise(
 #endif /* CACHE_PIXDIFFS */
   size_t padded_scratch_size;
   float *const restrict scratch_buf = dt_alloc_perthread_float(scratch_size, &padded_scratch_size);
+  // per-thread weights of the coarse patches and the cells they represent
+  size_t padded_weights_size = 0;
+  float *const restrict weights_buf = adaptive
+    ? dt_alloc_perthread_float(num_coarse + 2 * num_cells, &padded_weights_size)
+    : NULL;
   const int chk_height = compute_slice_height(roi_out->height);
   const int chk_width = compute_slice_width(roi_out->width);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
       dt_omp_firstprivate(patches, num_patches, scratch_buf, padded_scratch_size, chk_height, chk_width, radius, \
-                          params, roi_out, outbuf, inbuf, stride, center_norm, skip_blend, weight, invert) \
+                          params, roi_out, outbuf, inbuf, stride, center_norm, skip_blend, weight, invert, \
+                          adaptive, num_coarse, num_cells, refine, cell_rep, cell_start, weights_buf, \
+                          padded_weights_size) \
       schedule(static) \
       collapse(2)
 #endif
@@ -381,147 +652,32 @@ void nlmeans_denoise(
       {
         memset(outbuf + 4*(i*roi_out->width+chunk_left), '\0', sizeof(float) * 4 * (chunk_right-chunk_left));
       }
-      // cycle through all of the patches over our slice of the image
-      for(int p = 0; p < num_patches; p++)
+      // cycle through all of the (coarse) patches over our slice of the image
+      float *const coarse_wt = adaptive ? dt_get_perthread(weights_buf, padded_weights_size) : NULL;
+      for(int p = 0; p < num_coarse; p++)
       {
-        // retrieve info about the current patch
-        const patch_t *patch = &patches[p];
-        // skip any rows where the patch center would be above top of RoI or below bottom of RoI
-        const int height = roi_out->height;
-        const int row_min = MAX(chunk_top,MAX(0,-patch->rows));
-        const int row_max = MIN(chunk_bot,height - MAX(0,patch->rows));
-        // figure out which rows at top and bottom result in patches extending outside the RoI, even though the
-        // center pixel is inside
-        const int row_top = MAX(row_min,MAX(radius,radius-patch->rows));
-        const int row_bot = MIN(row_max,height-1-MAX(radius,radius+patch->rows));
-        // skip any columns where the patch center would be to the left or the right of the RoI
-        const int width = roi_out->width;
-        const int scol = patch->cols;
-        const int col_min = MAX(chunk_left,-scol);
-        const int col_max = MIN(chunk_right,roi_out->width - scol);
-
-        init_column_sums(col_sums,patch,inbuf,row_min,chunk_left,chunk_right,height,width,
-                         stride,radius,params->norm);
-        for(int row = row_min; row < row_max; row++)
+        const float wsum = accumulate_patch(&patches[p], inbuf, outbuf, col_sums, chunk_top, chunk_bot,
+                                            chunk_left, chunk_right, roi_out, stride, radius,
+                                            center_norm, params);
+        if(adaptive) coarse_wt[p] = wsum;
+      }
+      if(adaptive && num_cells > 0)
+      {
+        // refine the cells whose representative got the largest total weight in this chunk
+        float *const cell_wt = coarse_wt + num_coarse;
+        float *const sorted_wt = cell_wt + num_cells;
+        for(int k = 0; k < num_cells; k++)
+          cell_wt[k] = sorted_wt[k] = coarse_wt[cell_rep[k]];
+        qsort(sorted_wt, num_cells, sizeof(float), compare_floats);
+        const float threshold = sorted_wt[num_cells - refine];
+        int refined = 0;
+        for(int k = 0; k < num_cells && refined < refine; k++)
         {
-          // add up the initial columns of the sliding window of total patch distortion
-          float distortion = 0.0f;
-          for(int i = col_min - radius; i < MIN(col_min+radius, col_max); i++)
-          {
-            distortion += col_sums[i];
-          }
-          // now proceed down the current row of the image
-          const float *in = inbuf + stride * row;
-          float *const out = outbuf + (size_t)4 * width * row;
-          const int offset = patch->offset;
-          const float sharpness = params->sharpness;
-          if(params->center_weight < 0.0f)
-          {
-            // computation as used by denoise(non-local) iop
-            for(int col = col_min; col < col_max; col++)
-            {
-              distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
-              const float wt = gh(distortion * sharpness);
-#if defined(__SSE__) && defined(__GNUC__) && __GNUC__ < 12
-              // GCC10 has really poor code generation here, so manually force vectorized evaluation
-              __m128 pixel = _mm_loadu_ps(in+4*col+offset);
-              pixel[3] = 1.0f;
-              ((__m128*)out)[col] += (pixel * _mm_set1_ps(wt));
-#else
-              const float *const inpx = in+4*col;
-              const dt_aligned_pixel_t pixel = { inpx[offset], inpx[offset+1], inpx[offset+2], 1.0f };
-              for_four_channels(c,aligned(pixel,out:16))
-              {
-                out[4*col+c] += pixel[c] * wt;
-              }
-#endif  /* __SSE__ && __GNUC__ */
-              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
-            }
-          }
-          else
-          {
-            // computation as used by denoiseprofiled iop with non-local means
-            for(int col = col_min; col < col_max; col++)
-            {
-              distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
-              const float dissimilarity = (distortion + pixel_difference(in+4*col,in+4*col+offset,center_norm))
-                                           / (1.0f + params->center_weight);
-              const float wt = gh(fmaxf(0.0f, dissimilarity * sharpness - 2.0f));
-#if defined(__SSE__) && defined(__GNUC__) && __GNUC__ < 12
-              // GCC10 has really poor code generation here, so manually force vectorized evaluation
-              __m128 pixel = _mm_loadu_ps(in+4*col+offset);
-              pixel[3] = 1.0f;
-              ((__m128*)out)[col] += (pixel * _mm_set1_ps(wt));
-#else
-              const float *const inpx = in + 4*col;
-              const dt_aligned_pixel_t pixel = { inpx[offset], inpx[offset+1], inpx[offset+2], 1.0f };
-              for_four_channels(c,aligned(pixel,out:16))
-              {
-                out[4*col+c] += pixel[c] * wt;
-              }
-#endif
-              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
-            }
-          }
-          const int pcol_min = chunk_left - MIN(radius,MIN(chunk_left,chunk_left+scol));
-          const int pcol_max = chunk_right + MIN(radius,MIN(width-chunk_right,width-(chunk_right+scol)));
-          if(row < MIN(row_top, row_bot))
-          {
-            // top edge of patch was above top of RoI, so it had a value of zero; just add in the new row
-            const float *bot_row = inbuf + (row+1+radius)*stride;
-            for(int col = pcol_min; col < pcol_max; col++)
-            {
-              const float *const bot_px = bot_row + 4*col;
-              const float diff = pixel_difference(bot_px,bot_px+offset,params->norm);
-              _mm_prefetch(bot_px+stride, _MM_HINT_T0);
-#ifdef CACHE_PIXDIFFS
-              set_pixdiff(col_sums,radius,row+radius+1,col,diff);
-#endif
-              col_sums[col] += diff;
-              _mm_prefetch(bot_px+offset+stride, _MM_HINT_T0);
-            }
-          }
-          else if(row < row_bot)
-          {
-#ifndef CACHE_PIXDIFFS
-            const float *const top_row = inbuf + (row-radius)*stride   /* +(2*radius+1)*stride*/ ;
-#endif /* !CACHE_PIXDIFFS */
-            const float *const bot_row = inbuf + (row+1+radius)*stride ;
-            // both prior and new positions are entirely within the RoI, so subtract the old row and add the new one
-            for(int col = pcol_min; col < pcol_max; col++)
-            {
-#ifdef CACHE_PIXDIFFS
-              const float *const bot_px = bot_row + 4*col;
-              const float diff = pixel_difference(bot_px,bot_px+offset,params->norm);
-              col_sums[col] += diff - get_pixdiff(col_sums,radius,row-radius,col);
-              _mm_prefetch(bot_px+stride, _MM_HINT_T0);
-              set_pixdiff(col_sums,radius,row+1+radius,col,diff);
-#else
-              const float *const top_px = top_row + 4*col;
-              const float *const bot_px = bot_row + 4*col;
-              const float diff = diff_of_pixels_diff(bot_px,bot_px+offset,top_px,top_px+offset,params->norm);
-              _mm_prefetch(bot_px+stride, _MM_HINT_T0);
-              col_sums[col] += diff;
-#endif /* CACHE_PIXDIFFS */
-              _mm_prefetch(bot_px+offset+stride, _MM_HINT_T0);
-            }
-          }
-          else if(row >= row_top && row + 1 < row_max) // don't bother updating if last iteration
-          {
-            // new row of the patch is below the bottom of RoI, so its value is zero; just subtract the old row
-#ifndef CACHE_PIXDIFFS
-            const float *top_row = inbuf + (row-radius)*stride;
-#endif /* !CACHE_PIXDIFFS */
-            for(int col = pcol_min; col < pcol_max; col++)
-            {
-#ifdef CACHE_PIXDIFFS
-              col_sums[col] -= get_pixdiff(col_sums,radius,row-radius,col);
-#else
-              const float *const top_px = top_row + 4*col;
-              col_sums[col] -= pixel_difference(top_px,top_px+offset,params->norm);
-#endif /* CACHE_PIXDIFFS */
-            }
-          }
+          if(cell_wt[k] < threshold) continue;
+          refined++;
+          for(int p = cell_start[k]; p < cell_start[k+1]; p++)
+            accumulate_patch(&patches[p], inbuf, outbuf, col_sums, chunk_top, chunk_bot,
+                             chunk_left, chunk_right, roi_out, stride, radius, center_norm, params);
         }
       }
       if(skip_blend)
@@ -561,9 +717,73 @@ void nlmeans_denoise(
   // clean up: free the work space
   dt_free_align(patches);
   dt_free_align(scratch_buf);
+  dt_free_align(weights_buf);
+  free(search.cell_rep);
+  free(search.cell_start);
   return;
 }
 
+void nlmeans_denoise(
+        const float *const inbuf,
+        float *const outbuf,
+        const dt_iop_roi_t *const roi_in,
+        const dt_iop_roi_t *const roi_out,
+        const dt_nlmeans_param_t *const params)
+{
+  // the comparison against the exact search is only done on request as it doubles the processing time
+  const gboolean compare = params->decimate != DT_NLMEANS_EXACT
+    && (darktable.unmuted & DT_DEBUG_PERF) && (darktable.unmuted & DT_DEBUG_VERBOSE);
+  if(!compare)
+  {
+    _nlmeans_denoise(inbuf, outbuf, roi_in, roi_out, params);
+    return;
+  }
+
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+  float *const exact = dt_alloc_align_float(4 * npixels);
+  if(!exact)
+  {
+    _nlmeans_denoise(inbuf, outbuf, roi_in, roi_out, params);
+    return;
+  }
+
+  dt_nlmeans_param_t exact_params = *params;
+  exact_params.decimate = DT_NLMEANS_EXACT;
+
+  const double start = dt_get_wtime();
+  _nlmeans_denoise(inbuf, outbuf, roi_in, roi_out, params);
+  const double mid = dt_get_wtime();
+  _nlmeans_denoise(inbuf, exact, roi_in, roi_out, &exact_params);
+  const double end = dt_get_wtime();
+
+  // PSNR of the approximation relative to the peak of the exact result
+  double sqerr = 0.0;
+  float peak = 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(outbuf, exact, npixels) \
+  reduction(+ : sqerr) reduction(max : peak) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      const float diff = outbuf[4*k+c] - exact[4*k+c];
+      sqerr += diff * diff;
+      peak = fmaxf(peak, fabsf(exact[4*k+c]));
+    }
+  }
+  const double mse = sqerr / (3.0 * MAX(npixels, 1));
+  const double psnr = (mse > 0.0 && peak > 0.0f) ? 10.0 * log10((double)peak * peak / mse) : INFINITY;
+  dt_print(DT_DEBUG_PERF,
+           "[nlmeans_denoise] %s search, radius %d, %dx%d: %.4fs vs exact %.4fs (%.2fx), PSNR %.2f dB\n",
+           params->decimate == DT_NLMEANS_ADAPTIVE ? "adaptive" : "decimated",
+           params->search_radius, roi_out->width, roi_out->height,
+           mid - start, end - mid, (end - mid) / fmax(mid - start, 1e-9), psnr);
+  dt_free_align(exact);
+}
+
 /**************************************************************/
 /**************************************************************/
 /*      Everything from here to end of file is OpenCL         */
@@ -671,7 +891,9 @@ int nlmeans_denoise_cl(
   const size_t stride = 4 * roi_in->width;
   int num_patches;
   int max_shift;
-  struct patch_t* patches = define_patches(params,stride,&num_patches,&max_shift);
+  // the OpenCL code path has no adaptive search, use the full search window instead
+  const int decimation = (params->decimate == DT_NLMEANS_HALF) ? DT_NLMEANS_HALF : DT_NLMEANS_EXACT;
+  struct patch_t* patches = define_patches(params,stride,decimation,&num_patches,&max_shift);
 
   cl_int err = DT_OPENCL_DEFAULT_ERROR;
   cl_mem buckets[NUM_BUCKETS] = { NULL };
@@ -757,7 +979,9 @@ int nlmeans_denoiseprofile_cl(
   const size_t stride = 4 * roi_in->width;
   int num_patches;
   int max_shift;
-  struct patch_t* patches = define_patches(params,stride,&num_patches,&max_shift);
+  // the OpenCL code path has no adaptive search, use the full search window instead
+  const int decimation = (params->decimate == DT_NLMEANS_HALF) ? DT_NLMEANS_HALF : DT_NLMEANS_EXACT;
+  struct patch_t* patches = define_patches(params,stride,decimation,&num_patches,&max_shift);
 
   cl_int err = DT_OPENCL_DEFAULT_ERROR;
   cl_mem buckets[NUM_BUCKETS] = { NULL };
@@ -19,6 +19,13 @@
 
 #include "iop/iop_api.h"
 
+typedef enum dt_nlmeans_decimate_t
+{
+  DT_NLMEANS_EXACT = 0,     // compare all patches in the search window
+  DT_NLMEANS_HALF = 1,      // compare only every other patch
+  DT_NLMEANS_ADAPTIVE = 2   // coarse-to-fine: dense center, refine only the most promising cells (CPU only)
+} dt_nlmeans_decimate_t;
+
 struct dt_nlmeans_param_t
 {
   float scattering;	// scattering factor for patches (default 0 = densest possible)
@@ -29,7 +36,7 @@ struct dt_nlmeans_param_t
   float sharpness;	// relative weight of central pixel (preserves detail), ignored if center_weight >= 0
   int patch_radius;	// radius of patches which are compared, 1..4
   int search_radius;	// radius around a pixel in which to compare patches (default = 7)
-  int decimate;         // set to 1 to search only half the patches in the neighborhood (default = 0)
+  int decimate;         // dt_nlmeans_decimate_t, search strategy for the neighborhood (default = exact)
   const float* const norm; // array of four per-channel weight factors
   dt_dev_pixelpipe_type_t pipetype;
   int kernel_init;	// CL: initialization (runs once)
@@ -294,6 +294,9 @@ void dt_control_shutdown(dt_control_t *s)
   dt_pthread_mutex_unlock(&s->run_mutex);
   dt_pthread_mutex_unlock(&s->cond_mutex);
   pthread_cond_broadcast(&s->cond);
+  dt_pthread_mutex_lock(&s->queue_mutex);
+  pthread_cond_broadcast(&s->queue_cond);
+  dt_pthread_mutex_unlock(&s->queue_mutex);
 
   /* first wait for gphoto device updater */
 #ifdef HAVE_GPHOTO2
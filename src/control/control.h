@@ -191,8 +191,13 @@ typedef struct dt_control_t
   pthread_t *thread, kick_on_workers_thread, update_gphoto_thread;
   dt_job_t **job;
 
-  GList *queues[DT_JOB_QUEUE_MAX];
+  // intrusive job lists, protected by queue_mutex
+  dt_job_t *queues[DT_JOB_QUEUE_MAX];
+  dt_job_t *queue_tails[DT_JOB_QUEUE_MAX];
   size_t queue_length[DT_JOB_QUEUE_MAX];
+  GHashTable *queued_jobs;  // jobs of DT_JOB_QUEUE_SYSTEM_FG, for deduping
+  pthread_cond_t queue_cond; // idle workers wait on this one
+  int32_t idle_workers;
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
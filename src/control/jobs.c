@@ -51,6 +51,10 @@ typedef struct _dt_job_t
 
   dt_progress_t *progress;
 
+  // links in the job queue, protected by queue_mutex
+  struct _dt_job_t *prev, *next;
+  double queued_time;
+
   char description[DT_CONTROL_DESCRIPTION_LEN];
 } _dt_job_t;
 
@@ -58,16 +62,96 @@ typedef struct _dt_job_t
    match
     we don't want to compare result, priority or state since these will change during the course of
    processing.
+    jobs with params are compared by their params, the others by their description.
     NOTE: maybe allow to pass a comparator for params.
  */
 static inline int dt_control_job_equal(_dt_job_t *j1, _dt_job_t *j2)
 {
   if(!j1 || !j2) return 0;
-  if(j1->params_size != 0 && j1->params_size == j2->params_size)
-    return (j1->execute == j2->execute && j1->state_changed_cb == j2->state_changed_cb
-            && j1->queue == j2->queue && (memcmp(j1->params, j2->params, j1->params_size) == 0));
-  return (j1->execute == j2->execute && j1->state_changed_cb == j2->state_changed_cb && j1->queue == j2->queue
-          && (g_strcmp0(j1->description, j2->description) == 0));
+  if(j1->execute != j2->execute || j1->state_changed_cb != j2->state_changed_cb || j1->queue != j2->queue
+     || j1->params_size != j2->params_size)
+    return 0;
+  if(j1->params_size != 0)
+    return memcmp(j1->params, j2->params, j1->params_size) == 0;
+  return g_strcmp0(j1->description, j2->description) == 0;
+}
+
+/** hash matching dt_control_job_equal(), for looking up queued duplicates */
+static guint _control_job_hash(gconstpointer key)
+{
+  const _dt_job_t *job = (const _dt_job_t *)key;
+  guint hash = g_direct_hash(job->execute) ^ (g_direct_hash(job->state_changed_cb) << 1) ^ job->queue
+               ^ (guint)job->params_size << 8;
+  if(job->params_size != 0)
+  {
+    const unsigned char *p = (const unsigned char *)job->params;
+    for(size_t k = 0; k < job->params_size; k++) hash = hash * 33 + p[k];
+  }
+  else
+    hash ^= g_str_hash(job->description);
+  return hash;
+}
+
+static gboolean _control_job_hash_equal(gconstpointer a, gconstpointer b)
+{
+  return dt_control_job_equal((_dt_job_t *)a, (_dt_job_t *)b);
+}
+
+/* the queues are intrusive doubly linked lists, so that adding, removing and dropping jobs is O(1).
+   the caller has to hold queue_mutex. */
+static void _queue_append(dt_control_t *control, _dt_job_t *job)
+{
+  const dt_job_queue_t q = job->queue;
+  job->next = NULL;
+  job->prev = control->queue_tails[q];
+  if(job->prev)
+    job->prev->next = job;
+  else
+    control->queues[q] = job;
+  control->queue_tails[q] = job;
+  control->queue_length[q]++;
+  if(q == DT_JOB_QUEUE_SYSTEM_FG) g_hash_table_add(control->queued_jobs, job);
+}
+
+static void _queue_prepend(dt_control_t *control, _dt_job_t *job)
+{
+  const dt_job_queue_t q = job->queue;
+  job->prev = NULL;
+  job->next = control->queues[q];
+  if(job->next)
+    job->next->prev = job;
+  else
+    control->queue_tails[q] = job;
+  control->queues[q] = job;
+  control->queue_length[q]++;
+  if(q == DT_JOB_QUEUE_SYSTEM_FG) g_hash_table_add(control->queued_jobs, job);
+}
+
+static void _queue_unlink(dt_control_t *control, _dt_job_t *job)
+{
+  const dt_job_queue_t q = job->queue;
+  if(job->prev)
+    job->prev->next = job->next;
+  else
+    control->queues[q] = job->next;
+  if(job->next)
+    job->next->prev = job->prev;
+  else
+    control->queue_tails[q] = job->prev;
+  job->prev = job->next = NULL;
+  control->queue_length[q]--;
+  if(q == DT_JOB_QUEUE_SYSTEM_FG) g_hash_table_remove(control->queued_jobs, job);
+}
+
+/** is there any job a worker could pick right now? the caller has to hold queue_mutex. */
+static gboolean _queue_has_job(const dt_control_t *control)
+{
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
+    if(control->queues[i]) return TRUE;
+  }
+  return FALSE;
 }
 
 static void dt_control_job_set_state(_dt_job_t *job, dt_job_state_t state)
@@ -235,8 +319,12 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
    *   * user background
    *   * system background
    * - the jobs that didn't get picked this round get their priority incremented
+   * - jobs that got cancelled while waiting are dropped from the queue heads without
+   *   bothering a worker with them
    */
 
+  GList *cancelled = NULL;
+
   dt_pthread_mutex_lock(&control->queue_mutex);
 
   // find the job
@@ -245,10 +333,15 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   int max_priority = -1;
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(control->queues[i] == NULL) continue;
     if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
-    if(_job->priority > max_priority)
+    _dt_job_t *_job = control->queues[i];
+    while(_job && dt_control_job_get_state(_job) == DT_JOB_STATE_CANCELLED)
+    {
+      _queue_unlink(control, _job);
+      cancelled = g_list_prepend(cancelled, _job);
+      _job = control->queues[i];
+    }
+    if(_job && _job->priority > max_priority)
     {
       max_priority = _job->priority;
       job = _job;
@@ -256,41 +349,47 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
     }
   }
 
-  if(!job)
+  if(job)
   {
-    dt_pthread_mutex_unlock(&control->queue_mutex);
-    return NULL;
-  }
+    // the order of the queues in control->queues matches our priority, and we only update job when the
+    // priority is strictly bigger
+    // invariant -> job is the one we are looking for
 
-  // the order of the queues in control->queues matches our priority, and we only update job when the priority
-  // is strictly bigger
-  // invariant -> job is the one we are looking for
+    // remove the to be scheduled job from its queue
+    _queue_unlink(control, job);
+    if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
 
-  // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
-  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
+    // and place it in scheduled job array (for job deduping)
+    control->job[dt_control_get_threadid()] = job;
 
-  // and place it in scheduled job array (for job deduping)
-  control->job[dt_control_get_threadid()] = job;
-
-  // increment the priorities of the others
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
-  {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
+    // increment the priorities of the others
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    {
+      if(i == winner_queue || control->queues[i] == NULL) continue;
+      control->queues[i]->priority++;
+    }
   }
 
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
+  for(GList *iter = cancelled; iter; iter = g_list_next(iter))
+  {
+    dt_print(DT_DEBUG_CONTROL, "[schedule_job] dropping cancelled job: ");
+    dt_control_job_print((_dt_job_t *)iter->data);
+    dt_print(DT_DEBUG_CONTROL, "\n");
+    dt_control_job_dispose((_dt_job_t *)iter->data);
+  }
+  g_list_free(cancelled);
+
   return job;
 }
 
 static void dt_control_job_execute(_dt_job_t *job)
 {
-  dt_print(DT_DEBUG_CONTROL, "[run_job+] %02d %f ", DT_CTL_WORKER_RESERVED + dt_control_get_threadid(),
-           dt_get_wtime());
+  const double now = dt_get_wtime();
+  dt_print(DT_DEBUG_CONTROL, "[run_job+] %02d %f (queued %.3fs) ",
+           DT_CTL_WORKER_RESERVED + dt_control_get_threadid(), now,
+           job->queued_time > 0.0 ? now - job->queued_time : 0.0);
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -387,15 +486,13 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   }
 
   job->queue = queue_id;
+  job->queued_time = dt_get_wtime();
 
   _dt_job_t *job_for_disposal = NULL;
 
   dt_pthread_mutex_lock(&control->queue_mutex);
 
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
-
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", control->queue_length[queue_id]);
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -424,40 +521,29 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     }
 
     // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    _dt_job_t *other_job = (_dt_job_t *)g_hash_table_lookup(control->queued_jobs, job);
+    if(other_job)
     {
-      _dt_job_t *other_job = (_dt_job_t *)iter->data;
-      if(dt_control_job_equal(job, other_job))
-      {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
-
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
+      dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
+      dt_control_job_print(other_job);
+      dt_print(DT_DEBUG_CONTROL, "\n");
 
-        job_for_disposal = job;
-
-        job = other_job;
-        break; // there can't be any further copy in the list
-      }
+      _queue_unlink(control, other_job);
+      job_for_disposal = job;
+      job = other_job;
     }
 
     // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
+    _queue_prepend(control, job);
 
     // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
+    if(control->queue_length[queue_id] > DT_CONTROL_MAX_JOBS)
     {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
+      _dt_job_t *last = control->queue_tails[queue_id];
+      _queue_unlink(control, last);
+      dt_control_job_set_state(last, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(last);
     }
-
-    control->queue_length[queue_id] = length;
   }
   else
   {
@@ -468,16 +554,13 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
       job->priority = 0;
     else
       job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    _queue_append(control, job);
   }
   dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
-  dt_pthread_mutex_unlock(&control->queue_mutex);
 
-  // notify workers
-  dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
-  dt_pthread_mutex_unlock(&control->cond_mutex);
+  // wake up one idle worker, the busy ones look at the queues anyways before going to sleep
+  if(control->idle_workers > 0) pthread_cond_signal(&control->queue_cond);
+  dt_pthread_mutex_unlock(&control->queue_mutex);
 
   // dispose of dropped job, if any
   dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
@@ -541,6 +624,9 @@ static void *dt_control_worker_kicker(void *ptr)
     dt_pthread_mutex_lock(&control->cond_mutex);
     pthread_cond_broadcast(&control->cond);
     dt_pthread_mutex_unlock(&control->cond_mutex);
+    dt_pthread_mutex_lock(&control->queue_mutex);
+    pthread_cond_broadcast(&control->queue_cond);
+    dt_pthread_mutex_unlock(&control->queue_mutex);
   }
   return NULL;
 }
@@ -563,10 +649,15 @@ static void *dt_control_work(void *ptr)
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d\n", threadid);
     if(dt_control_run_job(control) < 0)
     {
-      // wait for a new job.
-      dt_pthread_mutex_lock(&control->cond_mutex);
-      dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
-      dt_pthread_mutex_unlock(&control->cond_mutex);
+      // wait for a new job. checking the queues under the lock makes sure we don't miss the wakeup.
+      dt_pthread_mutex_lock(&control->queue_mutex);
+      if(!_queue_has_job(control) && dt_control_running())
+      {
+        control->idle_workers++;
+        dt_pthread_cond_wait(&control->queue_cond, &control->queue_mutex);
+        control->idle_workers--;
+      }
+      dt_pthread_mutex_unlock(&control->queue_mutex);
     }
   }
   return NULL;
@@ -608,6 +699,9 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = dt_worker_threads();
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->queued_jobs = g_hash_table_new(_control_job_hash, _control_job_hash_equal);
+  control->idle_workers = 0;
+  pthread_cond_init(&control->queue_cond, NULL);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -643,6 +737,8 @@ void dt_control_jobs_cleanup(dt_control_t *control)
 {
   free(control->job);
   free(control->thread);
+  g_hash_table_destroy(control->queued_jobs);
+  pthread_cond_destroy(&control->queue_cond);
 }
 
 // clang-format off
@@ -1350,6 +1350,74 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 }
 
 
+// decode stage of the export: loads the full image of the next export into the mipmap
+// cache while the current one goes through the pixelpipe, the encoder and the storage.
+typedef struct dt_control_export_prefetch_t
+{
+  GAsyncQueue *queue; // ids of the images to decode, -1 to stop
+  pthread_t thread;
+  dt_pthread_mutex_t lock;
+  double busy;        // seconds spent decoding
+} dt_control_export_prefetch_t;
+
+static void *_export_prefetch_thread(void *data)
+{
+  dt_control_export_prefetch_t *prefetch = (dt_control_export_prefetch_t *)data;
+  while(TRUE)
+  {
+    dt_imgid_t imgid = GPOINTER_TO_INT(g_async_queue_pop(prefetch->queue));
+    // if decoding fell behind, the export will load the skipped images itself
+    gpointer next;
+    while((next = g_async_queue_try_pop(prefetch->queue)))
+      imgid = GPOINTER_TO_INT(next);
+    if(!dt_is_valid_imgid(imgid)) break;
+
+    const double start = dt_get_wtime();
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+
+    dt_pthread_mutex_lock(&prefetch->lock);
+    prefetch->busy += dt_get_wtime() - start;
+    dt_pthread_mutex_unlock(&prefetch->lock);
+  }
+  return NULL;
+}
+
+static double _export_prefetch_busy(dt_control_export_prefetch_t *prefetch)
+{
+  dt_pthread_mutex_lock(&prefetch->lock);
+  const double busy = prefetch->busy;
+  dt_pthread_mutex_unlock(&prefetch->lock);
+  return busy;
+}
+
+static dt_control_export_prefetch_t *_export_prefetch_start()
+{
+  dt_control_export_prefetch_t *prefetch = calloc(1, sizeof(dt_control_export_prefetch_t));
+  if(!prefetch) return NULL;
+  prefetch->queue = g_async_queue_new();
+  dt_pthread_mutex_init(&prefetch->lock, NULL);
+  if(dt_pthread_create(&prefetch->thread, _export_prefetch_thread, prefetch))
+  {
+    g_async_queue_unref(prefetch->queue);
+    dt_pthread_mutex_destroy(&prefetch->lock);
+    free(prefetch);
+    return NULL;
+  }
+  return prefetch;
+}
+
+static void _export_prefetch_stop(dt_control_export_prefetch_t *prefetch)
+{
+  if(!prefetch) return;
+  g_async_queue_push(prefetch->queue, GINT_TO_POINTER(-1));
+  pthread_join(prefetch->thread, NULL);
+  g_async_queue_unref(prefetch->queue);
+  dt_pthread_mutex_destroy(&prefetch->lock);
+  free(prefetch);
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1427,15 +1495,39 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
+  // decode the next image while the current one is developed, encoded and stored. this
+  // keeps one more full image in the mipmap cache, and is pointless for plain copies.
+  dt_control_export_prefetch_t *prefetch =
+    total > 1
+    && strcmp(mformat->mime(fdata), "x-copy")
+    && dt_conf_get_bool("plugins/lighttable/export/prefetch")
+    ? _export_prefetch_start()
+    : NULL;
+  const double export_start = dt_get_wtime();
+  double store_busy = 0.0;
+
   while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
   {
     const dt_imgid_t imgid = GPOINTER_TO_INT(t->data);
     t = g_list_next(t);
     const guint num = total - g_list_length(t);
 
+    if(prefetch && t)
+      g_async_queue_push(prefetch->queue, t->data);
+
     // progress message
     char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
+    if(prefetch && num > 1)
+    {
+      // show how busy the decode and develop/write stages have been so far
+      const double elapsed = MAX(dt_get_wtime() - export_start, 1e-3);
+      snprintf(message, sizeof(message), _("exporting %d / %d to %s (decode %d%%, develop and write %d%%)"),
+               num, total, mstorage->name(mstorage),
+               (int)(100.0 * MIN(_export_prefetch_busy(prefetch) / elapsed, 1.0)),
+               (int)(100.0 * MIN(store_busy / elapsed, 1.0)));
+    }
+    else
+      snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
     // update the message. initialize_store() might have changed the number of images
     dt_control_job_set_progress_message(job, message);
 
@@ -1456,9 +1548,13 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
       else
       {
         dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type, settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
+        const double store_start = dt_get_wtime();
+        const int store_failed =
+          mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality,
+                          settings->upscale, settings->export_masks, settings->icc_type,
+                          settings->icc_filename, settings->icc_intent, &metadata);
+        store_busy += dt_get_wtime() - store_start;
+        if(store_failed)
           dt_control_job_cancel(job);
         else
         {
@@ -1480,6 +1576,17 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   }
   g_list_free_full(metadata.list, g_free);
 
+  if(prefetch)
+  {
+    const double elapsed = MAX(dt_get_wtime() - export_start, 1e-3);
+    dt_print(DT_DEBUG_PERF,
+             "[export] %d images in %.3f secs, decode stage busy %.3f secs (%.0f%%),"
+             " develop and write stage busy %.3f secs (%.0f%%)\n",
+             total, elapsed, _export_prefetch_busy(prefetch),
+             100.0 * _export_prefetch_busy(prefetch) / elapsed, store_busy, 100.0 * store_busy / elapsed);
+    _export_prefetch_stop(prefetch);
+  }
+
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
 
 end:
@@ -161,9 +161,10 @@ dt_develop_blend_colorspace(const dt_dev_pixelpipe_iop_t *const piece,
   }
 }
 
-void dt_develop_blendif_process_parameters(float *const restrict parameters,
-                                           const dt_develop_blend_params_t *const params)
+unsigned int dt_develop_blendif_process_parameters(float *const restrict parameters,
+                                                   const dt_develop_blend_params_t *const params)
 {
+  unsigned int open_span = 0;
   const int32_t blend_csp = params->blend_cst;
   const uint32_t blendif = params->blendif;
   const float *blendif_parameters = params->blendif_parameters;
@@ -215,7 +216,10 @@ void dt_develop_blendif_process_parameters(float *const restrict parameters,
       parameters[j + 4] = 0.0f;
       parameters[j + 5] = 0.0f;
     }
+    if(parameters[j + 1] == -FLT_MAX && parameters[j + 2] == FLT_MAX)
+      open_span |= 1 << i;
   }
+  return open_span;
 }
 
 // See function definition in blend.h for important information
@@ -525,9 +529,10 @@ void dt_develop_blend_process(struct dt_iop_module_t *self,
 
   float *const restrict mask = _mask;
 
-  if(mask_mode == DEVELOP_MASK_ENABLED || suppress_mask)
+  if(mask_mode == DEVELOP_MASK_ENABLED || suppress_mask || opacity == 0.0f)
   {
-    // blend uniformly (no drawn or parametric mask)
+    // blend uniformly (no drawn or parametric mask, or a zero opacity which
+    // makes the mask zero whatever the drawn and parametric parts select)
     dt_iop_image_fill(mask, opacity, owidth, oheight, 1); // mask[k] = value;
   }
   else if(mask_mode & DEVELOP_MASK_RASTER)
@@ -1060,9 +1065,10 @@ gboolean dt_develop_blend_process_cl(struct dt_iop_module_t *self,
              "[opencl_blendop] profile_info_cl: %s\n", cl_errstr(err));
     goto error;
   }
-  if(mask_mode == DEVELOP_MASK_ENABLED || suppress_mask)
+  if(mask_mode == DEVELOP_MASK_ENABLED || suppress_mask || opacity == 0.0f)
   {
-    // blend uniformly (no drawn or parametric mask)
+    // blend uniformly (no drawn or parametric mask, or a zero opacity which
+    // makes the mask zero whatever the drawn and parametric parts select)
 
     // set dev_mask with global opacity value
     dt_opencl_set_kernel_args(devid, kernel_set_mask, 0,
@@ -415,8 +415,9 @@ gboolean dt_develop_blend_legacy_params_from_so(dt_iop_module_so_t *module_so,
 #define DEVELOP_BLENDIF_PARAMETER_ITEMS 6
 
 /** initializes the parameter array (of size
- * DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_SIZE) */
-void dt_develop_blendif_process_parameters(float *const parameters,
+ * DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_SIZE) and returns the
+ * channels whose span is open at both ends, i.e. which select every pixel */
+unsigned int dt_develop_blendif_process_parameters(float *const parameters,
                                            const dt_develop_blend_params_t *const params);
 
 /**
@@ -93,103 +93,84 @@ static inline float _blendif_compute_factor(const float value, const unsigned in
   return invert_mask ? 1.0f - factor : factor; // inverted channel?
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride)
-#endif
-static inline void _blendif_lab_l(const float *const restrict pixels, float *const restrict mask,
-                                  const size_t stride, const float *const restrict parameters,
-                                  const unsigned int invert_mask)
+// number of pixels converted at once into the per channel rows of the parametric mask
+#define DT_BLENDIF_LAB_BATCH 256
+
+// the conditional channels of the input (or, shifted by 4, of the output) and their row in the batch
+#define DT_BLENDIF_LAB_CHANNELS 5
+static const unsigned int _blendif_channels[DT_BLENDIF_LAB_CHANNELS]
+    = { DEVELOP_BLENDIF_L_in, DEVELOP_BLENDIF_A_in, DEVELOP_BLENDIF_B_in, DEVELOP_BLENDIF_C_in,
+        DEVELOP_BLENDIF_h_in };
+
+static void _blendif_convert(const float *const restrict pixels,
+                             float (*const restrict channels)[DT_BLENDIF_LAB_BATCH], const size_t stride,
+                             const unsigned int blendif)
 {
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_LAB_CH)
+  if(blendif & ((1 << DEVELOP_BLENDIF_L_in) | (1 << DEVELOP_BLENDIF_A_in) | (1 << DEVELOP_BLENDIF_B_in)))
   {
-    mask[x] *= _blendif_compute_factor(pixels[j + 0] / 100.0f, invert_mask, parameters);
-  }
-}
-
+    float *const restrict L = channels[0];
+    float *const restrict A = channels[1];
+    float *const restrict B = channels[2];
 #ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride)
+#pragma omp simd aligned(L, A, B: 64)
 #endif
-static inline void _blendif_lab_a(const float *const restrict pixels, float *const restrict mask,
-                                  const size_t stride, const float *const restrict parameters,
-                                  const unsigned int invert_mask)
-{
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_LAB_CH)
-  {
-    mask[x] *= _blendif_compute_factor(pixels[j + 1] / 256.0f, invert_mask, parameters);
-  }
-}
-
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride)
-#endif
-static inline void _blendif_lab_b(const float *const restrict pixels, float *const restrict mask,
-                                  const size_t stride, const float *const restrict parameters,
-                                  const unsigned int invert_mask)
-{
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_LAB_CH)
-  {
-    mask[x] *= _blendif_compute_factor(pixels[j + 2] / 256.0f, invert_mask, parameters);
+    for(size_t x = 0; x < stride; x++)
+    {
+      const float *const restrict p = pixels + x * DT_BLENDIF_LAB_CH;
+      L[x] = p[0] / 100.0f;
+      A[x] = p[1] / 256.0f;
+      B[x] = p[2] / 256.0f;
+    }
   }
-}
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels, invert_mask: 16) uniform(parameters, invert_mask, stride)
-#endif
-static inline void _blendif_lch(const float *const restrict pixels, float *const restrict mask,
-                                const size_t stride, const float *const restrict parameters,
-                                const unsigned int *const restrict invert_mask)
-{
-  const float c_scale = 1.0f / (128.0f * sqrtf(2.0f));
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_LAB_CH)
+  if(blendif & ((1 << DEVELOP_BLENDIF_C_in) | (1 << DEVELOP_BLENDIF_h_in)))
   {
-    dt_aligned_pixel_t LCH;
-    dt_Lab_2_LCH(pixels + j, LCH);
-    float factor = 1.0f;
-    factor *= _blendif_compute_factor(LCH[1] * c_scale, invert_mask[0], parameters);
-    factor *= _blendif_compute_factor(LCH[2], invert_mask[1], parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS);
-    mask[x] *= factor;
+    const float c_scale = 1.0f / (128.0f * sqrtf(2.0f));
+    float *const restrict C = channels[3];
+    float *const restrict h = channels[4];
+    for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_LAB_CH)
+    {
+      dt_aligned_pixel_t LCH;
+      dt_Lab_2_LCH(pixels + j, LCH);
+      C[x] = LCH[1] * c_scale;
+      h[x] = LCH[2];
+    }
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(stride, blendif, parameters)
-#endif
-static void _blendif_combine_channels(const float *const restrict pixels, float *const restrict mask,
+static void _blendif_combine_channels(const float *const restrict pixels, float *const restrict factor,
+                                      float (*const restrict channels)[DT_BLENDIF_LAB_BATCH],
                                       const size_t stride, const unsigned int blendif,
                                       const float *const restrict parameters)
 {
-  if(blendif & (1 << DEVELOP_BLENDIF_L_in))
-  {
-    const unsigned int invert_mask = (blendif >> 16) & (1 << DEVELOP_BLENDIF_L_in);
-    _blendif_lab_l(pixels, mask, stride, parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_L_in,
-                   invert_mask);
-  }
+  if(!(blendif & DEVELOP_BLENDIF_Lab_MASK & ~DEVELOP_BLENDIF_OUTPUT_MASK)) return;
 
-  if(blendif & (1 << DEVELOP_BLENDIF_A_in))
-  {
-    const unsigned int invert_mask = (blendif >> 16) & (1 << DEVELOP_BLENDIF_A_in);
-    _blendif_lab_a(pixels, mask, stride, parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_A_in,
-                   invert_mask);
-  }
+  // convert the pixels once into all the channels needed, then evaluate every channel on its own row
+  _blendif_convert(pixels, channels, stride, blendif);
 
-  if(blendif & (1 << DEVELOP_BLENDIF_B_in))
+  for(size_t c = 0; c < DT_BLENDIF_LAB_CHANNELS; c++)
   {
-    const unsigned int invert_mask = (blendif >> 16) & (1 << DEVELOP_BLENDIF_B_in);
-    _blendif_lab_b(pixels, mask, stride, parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_B_in,
-                   invert_mask);
-  }
+    const unsigned int channel = _blendif_channels[c];
+    if(!(blendif & (1 << channel))) continue;
 
-  if(blendif & ((1 << DEVELOP_BLENDIF_C_in) | (1 << DEVELOP_BLENDIF_h_in)))
-  {
-    const unsigned int invert_mask[2] DT_ALIGNED_PIXEL = {
-        (blendif >> 16) & (1 << DEVELOP_BLENDIF_C_in),
-        (blendif >> 16) & (1 << DEVELOP_BLENDIF_h_in),
-    };
-    _blendif_lch(pixels, mask, stride, parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_C_in,
-                 invert_mask);
+    const unsigned int invert_mask = (blendif >> 16) & (1 << channel);
+    const float *const restrict channel_parameters = parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * channel;
+    const float *const restrict value = channels[c];
+#ifdef _OPENMP
+#pragma omp simd aligned(value, factor: 64)
+#endif
+    for(size_t x = 0; x < stride; x++)
+      factor[x] *= _blendif_compute_factor(value[x], invert_mask, channel_parameters);
   }
 }
 
+static inline gboolean _mask_is_uniform(const float *const restrict mask, const size_t stride, const float value)
+{
+  size_t differing = 0;
+  for(size_t x = 0; x < stride; x++) differing += (mask[x] != value);
+  return differing == 0;
+}
+
 void dt_develop_blendif_lab_make_mask(struct dt_dev_pixelpipe_iop_t *piece, const float *const restrict a,
                                       const float *const restrict b, const struct dt_iop_roi_t *const roi_in,
                                       const struct dt_iop_roi_t *const roi_out, float *const restrict mask)
@@ -204,15 +185,20 @@ void dt_develop_blendif_lab_make_mask(struct dt_dev_pixelpipe_iop_t *piece, cons
   const int owidth = roi_out->width;
   const int oheight = roi_out->height;
 
-  const unsigned int any_channel_active = d->blendif & DEVELOP_BLENDIF_Lab_MASK;
+  // parameters, for every channel the 4 limits + pre-computed increasing slope and decreasing slope
+  float parameters[DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_SIZE] DT_ALIGNED_ARRAY;
+  const unsigned int open_span = dt_develop_blendif_process_parameters(parameters, d);
+
   const unsigned int mask_inclusive = d->mask_combine & DEVELOP_COMBINE_INCL;
   const unsigned int mask_inversed = d->mask_combine & DEVELOP_COMBINE_INV;
 
-  // invert the individual channels if the combine mode is inclusive
-  const unsigned int blendif = d->blendif ^ (mask_inclusive ? DEVELOP_BLENDIF_Lab_MASK << 16 : 0);
+  // invert the individual channels if the combine mode is inclusive,
+  // and drop the channels selecting the whole span as they leave the mask unchanged
+  const unsigned int blendif = (d->blendif ^ (mask_inclusive ? DEVELOP_BLENDIF_Lab_MASK << 16 : 0)) & ~open_span;
+  const unsigned int any_channel_active = blendif & DEVELOP_BLENDIF_Lab_MASK;
 
   // a channel cancels the mask if the whole span is selected and the channel is inverted
-  const unsigned int canceling_channel = (blendif >> 16) & ~blendif & DEVELOP_BLENDIF_Lab_MASK;
+  const unsigned int canceling_channel = (blendif >> 16) & open_span & DEVELOP_BLENDIF_Lab_MASK;
 
   const size_t buffsize = (size_t)owidth * oheight;
 
@@ -234,9 +220,9 @@ void dt_develop_blendif_lab_make_mask(struct dt_dev_pixelpipe_iop_t *piece, cons
       dt_iop_image_mul_const(mask,global_opacity,owidth,oheight,1); //mask[k] *= global_opacity;
     }
   }
-  else if(canceling_channel || !any_channel_active)
+  else if(canceling_channel || global_opacity == 0.0f)
   {
-    // one of the conditional channel selects nothing
+    // one of the conditional channel selects nothing or the opacity is zero
     // this means that the conditional opacity of all pixels is the same
     // and depends on whether the mask combination is inclusive and whether the mask is inverted
     if((mask_inversed == 0) ^ (mask_inclusive == 0))
@@ -252,91 +238,74 @@ void dt_develop_blendif_lab_make_mask(struct dt_dev_pixelpipe_iop_t *piece, cons
   {
     // we need to process all conditional channels
 
-    // parameters, for every channel the 4 limits + pre-computed increasing slope and decreasing slope
-    float parameters[DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_SIZE] DT_ALIGNED_ARRAY;
-    dt_develop_blendif_process_parameters(parameters, d);
-
-    // allocate space for a temporary mask buffer to split the computation of every channel
-    float *const restrict temp_mask = dt_alloc_align_float(buffsize);
-    if(!temp_mask)
-    {
-      return;
-    }
+    // where the drawn mask is 1 (inclusive) or 0 (exclusive) the conditional channels
+    // cannot change the result, so the pixels need no conversion there
+    const float decisive_mask = mask_inclusive ? 1.0f : 0.0f;
 
 #ifdef _OPENMP
 #pragma omp parallel default(none) \
-  dt_omp_firstprivate(temp_mask, mask, a, b, oheight, owidth, iwidth, yoffs, xoffs, buffsize, \
+  dt_omp_firstprivate(mask, a, b, oheight, owidth, iwidth, yoffs, xoffs, decisive_mask, \
                       blendif, parameters, mask_inclusive, mask_inversed, global_opacity)
 #endif
     {
       // flush denormals to zero to avoid performance penalty if there are a lot of zero values in the mask
       const int oldMode = dt_mm_enable_flush_zero();
 
-      // initialize the parametric mask
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(temp_mask:64)
-#endif
-      for(size_t x = 0; x < buffsize; x++) temp_mask[x] = 1.0f;
+      float channels[DT_BLENDIF_LAB_CHANNELS][DT_BLENDIF_LAB_BATCH] DT_ALIGNED_ARRAY;
+      float factor[DT_BLENDIF_LAB_BATCH] DT_ALIGNED_ARRAY;
 
-      // combine channels
 #ifdef _OPENMP
-#pragma omp for schedule(static)
+#pragma omp for schedule(dynamic, 4)
 #endif
       for(size_t y = 0; y < oheight; y++)
       {
-        const size_t start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_LAB_CH;
-        _blendif_combine_channels(a + start, temp_mask + (y * owidth), owidth, blendif, parameters);
-      }
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-      for(size_t y = 0; y < oheight; y++)
-      {
-        const size_t start = (y * owidth) * DT_BLENDIF_LAB_CH;
-        _blendif_combine_channels(b + start, temp_mask + (y * owidth), owidth, blendif >> DEVELOP_BLENDIF_L_out,
-                                  parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_L_out);
-      }
+        const float *const restrict in = a + ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_LAB_CH;
+        const float *const restrict out = b + y * owidth * DT_BLENDIF_LAB_CH;
+        float *const restrict row = mask + y * owidth;
 
-      // apply global opacity
-      if(mask_inclusive)
-      {
-        if(mask_inversed)
+        for(size_t x = 0; x < owidth; x += DT_BLENDIF_LAB_BATCH)
         {
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
-#endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - mask[x]) * temp_mask[x];
-        }
-        else
-        {
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
-#endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - (1.0f - mask[x]) * temp_mask[x]);
-        }
-      }
-      else
-      {
-        if(mask_inversed)
-        {
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
-#endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - mask[x] * temp_mask[x]);
-        }
-        else
-        {
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
-#endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * mask[x] * temp_mask[x];
+          const size_t n = MIN(DT_BLENDIF_LAB_BATCH, owidth - x);
+          float *const restrict m = row + x;
+
+          // combine channels of the input and the output into the parametric mask
+          for(size_t k = 0; k < n; k++) factor[k] = 1.0f;
+          if(!_mask_is_uniform(m, n, decisive_mask))
+          {
+            _blendif_combine_channels(in + x * DT_BLENDIF_LAB_CH, factor, channels, n, blendif, parameters);
+            _blendif_combine_channels(out + x * DT_BLENDIF_LAB_CH, factor, channels, n,
+                                      blendif >> DEVELOP_BLENDIF_L_out,
+                                      parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_L_out);
+          }
+
+          // apply global opacity
+          if(mask_inclusive)
+          {
+            if(mask_inversed)
+            {
+              for(size_t k = 0; k < n; k++) m[k] = global_opacity * (1.0f - m[k]) * factor[k];
+            }
+            else
+            {
+              for(size_t k = 0; k < n; k++) m[k] = global_opacity * (1.0f - (1.0f - m[k]) * factor[k]);
+            }
+          }
+          else
+          {
+            if(mask_inversed)
+            {
+              for(size_t k = 0; k < n; k++) m[k] = global_opacity * (1.0f - m[k] * factor[k]);
+            }
+            else
+            {
+              for(size_t k = 0; k < n; k++) m[k] = global_opacity * m[k] * factor[k];
+            }
+          }
         }
       }
 
       dt_mm_restore_flush_zero(oldMode);
     }
-
-    dt_free_align(temp_mask);
   }
 }
 
@@ -85,148 +85,108 @@ static inline float _blendif_compute_factor(const float value, const unsigned in
   return invert_mask ? 1.0f - factor : factor; // inverted channel?
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride, profile)
-#endif
-static inline void _blendif_gray(const float *const restrict pixels, float *const restrict mask,
-                                 const size_t stride, const float *const restrict parameters,
-                                 const unsigned int invert_mask,
-                                 const dt_iop_order_iccprofile_info_t *const restrict profile)
+// number of pixels converted at once into the per channel rows of the parametric mask
+#define DT_BLENDIF_RGB_BATCH 256
+
+// the conditional channels of the input (or, shifted by 4, of the output) and their row in the batch
+#define DT_BLENDIF_RGB_CHANNELS 7
+static const unsigned int _blendif_channels[DT_BLENDIF_RGB_CHANNELS]
+    = { DEVELOP_BLENDIF_GRAY_in, DEVELOP_BLENDIF_RED_in, DEVELOP_BLENDIF_GREEN_in, DEVELOP_BLENDIF_BLUE_in,
+        DEVELOP_BLENDIF_H_in,    DEVELOP_BLENDIF_S_in,   DEVELOP_BLENDIF_l_in };
+
+static void _blendif_convert(const float *const restrict pixels,
+                             float (*const restrict channels)[DT_BLENDIF_RGB_BATCH], const size_t stride,
+                             const unsigned int blendif,
+                             const dt_iop_order_iccprofile_info_t *const restrict profile)
 {
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_RGB_CH)
+  if(blendif & (1 << DEVELOP_BLENDIF_GRAY_in))
   {
-    const float value = dt_ioppr_get_rgb_matrix_luminance(pixels + j, profile->matrix_in, profile->lut_in,
-                                                          profile->unbounded_coeffs_in, profile->lutsize,
-                                                          profile->nonlinearlut);
-    mask[x] *= _blendif_compute_factor(value, invert_mask, parameters);
-  }
-}
-
+    float *const restrict gray = channels[0];
+    if(profile)
+    {
+      for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_RGB_CH)
+        gray[x] = dt_ioppr_get_rgb_matrix_luminance(pixels + j, profile->matrix_in, profile->lut_in,
+                                                    profile->unbounded_coeffs_in, profile->lutsize,
+                                                    profile->nonlinearlut);
+    }
+    else
+    {
 #ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride)
+#pragma omp simd aligned(gray: 64)
 #endif
-static inline void _blendif_gray_fb(const float *const restrict pixels, float *const restrict mask,
-                                    const size_t stride, const float *const restrict parameters,
-                                    const unsigned int invert_mask)
-{
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_RGB_CH)
-  {
-    const float value = 0.3f * pixels[j + 0] + 0.59f * pixels[j + 1] + 0.11f * pixels[j + 2];
-    mask[x] *= _blendif_compute_factor(value, invert_mask, parameters);
+      for(size_t x = 0; x < stride; x++)
+      {
+        const float *const restrict p = pixels + x * DT_BLENDIF_RGB_CH;
+        gray[x] = 0.3f * p[0] + 0.59f * p[1] + 0.11f * p[2];
+      }
+    }
   }
-}
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride)
-#endif
-static inline void _blendif_rgb_red(const float *const restrict pixels, float *const restrict mask,
-                                    const size_t stride, const float *const restrict parameters,
-                                    const unsigned int invert_mask)
-{
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_RGB_CH)
+  if(blendif & ((1 << DEVELOP_BLENDIF_RED_in) | (1 << DEVELOP_BLENDIF_GREEN_in) | (1 << DEVELOP_BLENDIF_BLUE_in)))
   {
-    mask[x] *= _blendif_compute_factor(pixels[j + 0], invert_mask, parameters);
-  }
-}
-
+    float *const restrict red = channels[1];
+    float *const restrict green = channels[2];
+    float *const restrict blue = channels[3];
 #ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride)
+#pragma omp simd aligned(red, green, blue: 64)
 #endif
-static inline void _blendif_rgb_green(const float *const restrict pixels, float *const restrict mask,
-                                      const size_t stride, const float *const restrict parameters,
-                                      const unsigned int invert_mask)
-{
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_RGB_CH)
-  {
-    mask[x] *= _blendif_compute_factor(pixels[j + 1], invert_mask, parameters);
-  }
-}
-
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride)
-#endif
-static inline void _blendif_rgb_blue(const float *const restrict pixels, float *const restrict mask,
-                                     const size_t stride, const float *const restrict parameters,
-                                     const unsigned int invert_mask)
-{
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_RGB_CH)
-  {
-    mask[x] *= _blendif_compute_factor(pixels[j + 2], invert_mask, parameters);
+    for(size_t x = 0; x < stride; x++)
+    {
+      const float *const restrict p = pixels + x * DT_BLENDIF_RGB_CH;
+      red[x] = p[0];
+      green[x] = p[1];
+      blue[x] = p[2];
+    }
   }
-}
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels, invert_mask: 16) uniform(parameters, invert_mask, stride)
-#endif
-static inline void _blendif_hsl(const float *const restrict pixels, float *const restrict mask,
-                                const size_t stride, const float *const restrict parameters,
-                                const unsigned int *const restrict invert_mask)
-{
-  for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_RGB_CH)
+  if(blendif & ((1 << DEVELOP_BLENDIF_H_in) | (1 << DEVELOP_BLENDIF_S_in) | (1 << DEVELOP_BLENDIF_l_in)))
   {
-    dt_aligned_pixel_t HSL;
-    dt_RGB_2_HSL(pixels + j, HSL);
-    float factor = 1.0f;
-    for(size_t i = 0; i < 3; i++)
-      factor *= _blendif_compute_factor(HSL[i], invert_mask[i], parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * i);
-    mask[x] *= factor;
+    float *const restrict H = channels[4];
+    float *const restrict S = channels[5];
+    float *const restrict l = channels[6];
+    for(size_t x = 0, j = 0; x < stride; x++, j += DT_BLENDIF_RGB_CH)
+    {
+      dt_aligned_pixel_t HSL;
+      dt_RGB_2_HSL(pixels + j, HSL);
+      H[x] = HSL[0];
+      S[x] = HSL[1];
+      l[x] = HSL[2];
+    }
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(pixels: 16) uniform(stride, blendif, parameters, profile)
-#endif
-static void _blendif_combine_channels(const float *const restrict pixels, float *const restrict mask,
+static void _blendif_combine_channels(const float *const restrict pixels, float *const restrict factor,
+                                      float (*const restrict channels)[DT_BLENDIF_RGB_BATCH],
                                       const size_t stride, const unsigned int blendif,
                                       const float *const restrict parameters,
                                       const dt_iop_order_iccprofile_info_t *const restrict profile)
 {
-  if(blendif & (1 << DEVELOP_BLENDIF_GRAY_in))
-  {
-    const unsigned int invert_mask = (blendif >> 16) & (1 << DEVELOP_BLENDIF_GRAY_in);
-    if(profile)
-    {
-      _blendif_gray(pixels, mask, stride, parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_GRAY_in,
-                    invert_mask, profile);
-    }
-    else
-    {
-      _blendif_gray_fb(pixels, mask, stride,
-                       parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_GRAY_in, invert_mask);
-    }
-  }
+  if(!(blendif & DEVELOP_BLENDIF_RGB_MASK & ~DEVELOP_BLENDIF_OUTPUT_MASK)) return;
 
-  if(blendif & (1 << DEVELOP_BLENDIF_RED_in))
-  {
-    const unsigned int invert_mask = (blendif >> 16) & (1 << DEVELOP_BLENDIF_RED_in);
-    _blendif_rgb_red(pixels, mask, stride, parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_RED_in,
-                     invert_mask);
-  }
+  // convert the pixels once into all the channels needed, then evaluate every channel on its own row
+  _blendif_convert(pixels, channels, stride, blendif, profile);
 
-  if(blendif & (1 << DEVELOP_BLENDIF_GREEN_in))
+  for(size_t c = 0; c < DT_BLENDIF_RGB_CHANNELS; c++)
   {
-    const unsigned int invert_mask = (blendif >> 16) & (1 << DEVELOP_BLENDIF_GREEN_in);
-    _blendif_rgb_green(pixels, mask, stride,
-                       parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_GREEN_in, invert_mask);
-  }
+    const unsigned int channel = _blendif_channels[c];
+    if(!(blendif & (1 << channel))) continue;
 
-  if(blendif & (1 << DEVELOP_BLENDIF_BLUE_in))
-  {
-    const unsigned int invert_mask = (blendif >> 16) & (1 << DEVELOP_BLENDIF_BLUE_in);
-    _blendif_rgb_blue(pixels, mask, stride, parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_BLUE_in,
-                      invert_mask);
+    const unsigned int invert_mask = (blendif >> 16) & (1 << channel);
+    const float *const restrict channel_parameters = parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * channel;
+    const float *const restrict value = channels[c];
+#ifdef _OPENMP
+#pragma omp simd aligned(value, factor: 64)
+#endif
+    for(size_t x = 0; x < stride; x++)
+      factor[x] *= _blendif_compute_factor(value[x], invert_mask, channel_parameters);
   }
+}
 
-  if(blendif & ((1 << DEVELOP_BLENDIF_H_in) | (1 << DEVELOP_BLENDIF_S_in) | (1 << DEVELOP_BLENDIF_l_in)))
-  {
-    const unsigned int invert_mask[3] DT_ALIGNED_PIXEL = {
-        (blendif >> 16) & (1 << DEVELOP_BLENDIF_H_in),
-        (blendif >> 16) & (1 << DEVELOP_BLENDIF_S_in),
-        (blendif >> 16) & (1 << DEVELOP_BLENDIF_l_in),
-    };
-    _blendif_hsl(pixels, mask, stride, parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_H_in,
-                 invert_mask);
-  }
+static inline gboolean _mask_is_uniform(const float *const restrict mask, const size_t stride, const float value)
+{
+  size_t differing = 0;
+  for(size_t x = 0; x < stride; x++) differing += (mask[x] != value);
+  return differing == 0;
 }
 
 void dt_develop_blendif_rgb_hsl_make_mask(struct dt_dev_pixelpipe_iop_t *piece, const float *const restrict a,
@@ -243,15 +203,20 @@ void dt_develop_blendif_rgb_hsl_make_mask(struct dt_dev_pixelpipe_iop_t *piece,
   const int owidth = roi_out->width;
   const int oheight = roi_out->height;
 
-  const unsigned int any_channel_active = d->blendif & DEVELOP_BLENDIF_RGB_MASK;
+  // parameters, for every channel the 4 limits + pre-computed increasing slope and decreasing slope
+  float parameters[DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_SIZE] DT_ALIGNED_ARRAY;
+  const unsigned int open_span = dt_develop_blendif_process_parameters(parameters, d);
+
   const unsigned int mask_inclusive = d->mask_combine & DEVELOP_COMBINE_INCL;
   const unsigned int mask_inversed = d->mask_combine & DEVELOP_COMBINE_INV;
 
-  // invert the individual channels if the combine mode is inclusive
-  const unsigned int blendif = d->blendif ^ (mask_inclusive ? DEVELOP_BLENDIF_RGB_MASK << 16 : 0);
+  // invert the individual channels if the combine mode is inclusive,
+  // and drop the channels selecting the whole span as they leave the mask unchanged
+  const unsigned int blendif = (d->blendif ^ (mask_inclusive ? DEVELOP_BLENDIF_RGB_MASK << 16 : 0)) & ~open_span;
+  const unsigned int any_channel_active = blendif & DEVELOP_BLENDIF_RGB_MASK;
 
   // a channel cancels the mask if the whole span is selected and the channel is inverted
-  const unsigned int canceling_channel = (blendif >> 16) & ~blendif & DEVELOP_BLENDIF_RGB_MASK;
+  const unsigned int canceling_channel = (blendif >> 16) & open_span & DEVELOP_BLENDIF_RGB_MASK;
 
   const size_t buffsize = (size_t)owidth * oheight;
 
@@ -273,9 +238,9 @@ void dt_develop_blendif_rgb_hsl_make_mask(struct dt_dev_pixelpipe_iop_t *piece,
       dt_iop_image_mul_const(mask,global_opacity,owidth,oheight,1); // mask[k] *= global_opacity;
     }
   }
-  else if(canceling_channel || !any_channel_active)
+  else if(canceling_channel || global_opacity == 0.0f)
   {
-    // one of the conditional channel selects nothing
+    // one of the conditional channel selects nothing or the opacity is zero
     // this means that the conditional opacity of all pixels is the same
     // and depends on whether the mask combination is inclusive and whether the mask is inverted
     const float opac = ((mask_inversed == 0) ^ (mask_inclusive == 0)) ? global_opacity : 0.0f;
@@ -284,98 +249,81 @@ void dt_develop_blendif_rgb_hsl_make_mask(struct dt_dev_pixelpipe_iop_t *piece,
   else
   {
     // we need to process all conditional channels
-
-    // parameters, for every channel the 4 limits + pre-computed increasing slope and decreasing slope
-    float parameters[DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_SIZE] DT_ALIGNED_ARRAY;
-    dt_develop_blendif_process_parameters(parameters, d);
-
     dt_iop_order_iccprofile_info_t blend_profile;
     const gboolean use_profile = dt_develop_blendif_init_masking_profile(piece, &blend_profile,
                                                                     DEVELOP_BLEND_CS_RGB_DISPLAY);
     const dt_iop_order_iccprofile_info_t *profile = use_profile ? &blend_profile : NULL;
 
-    // allocate space for a temporary mask buffer to split the computation of every channel
-    float *const restrict temp_mask = dt_alloc_align_float(buffsize);
-    if(!temp_mask)
-    {
-      return;
-    }
+    // where the drawn mask is 1 (inclusive) or 0 (exclusive) the conditional channels
+    // cannot change the result, so the pixels need no conversion there
+    const float decisive_mask = mask_inclusive ? 1.0f : 0.0f;
 
 #ifdef _OPENMP
 #pragma omp parallel default(none) \
-  dt_omp_firstprivate(temp_mask, mask, a, b, oheight, owidth, iwidth, yoffs, xoffs, buffsize, \
+  dt_omp_firstprivate(mask, a, b, oheight, owidth, iwidth, yoffs, xoffs, decisive_mask, \
                       blendif, profile, parameters, mask_inclusive, mask_inversed, global_opacity)
 #endif
     {
       // flush denormals to zero to avoid performance penalty if there are a lot of zero values in the mask
       const int oldMode = dt_mm_enable_flush_zero();
 
-      // initialize the parametric mask
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(temp_mask:64)
-#endif
-      for(size_t x = 0; x < buffsize; x++) temp_mask[x] = 1.0f;
+      float channels[DT_BLENDIF_RGB_CHANNELS][DT_BLENDIF_RGB_BATCH] DT_ALIGNED_ARRAY;
+      float factor[DT_BLENDIF_RGB_BATCH] DT_ALIGNED_ARRAY;
 
-      // combine channels
 #ifdef _OPENMP
-#pragma omp for schedule(static)
+#pragma omp for schedule(dynamic, 4)
 #endif
       for(size_t y = 0; y < oheight; y++)
       {
-        const size_t start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_RGB_CH;
-        _blendif_combine_channels(a + start, temp_mask + (y * owidth), owidth, blendif, parameters, profile);
-      }
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-      for(size_t y = 0; y < oheight; y++)
-      {
-        const size_t start = (y * owidth) * DT_BLENDIF_RGB_CH;
-        _blendif_combine_channels(b + start, temp_mask + (y * owidth), owidth, blendif >> DEVELOP_BLENDIF_GRAY_out,
-                                  parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_GRAY_out,
-                                  profile);
-      }
+        const float *const restrict in = a + ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_RGB_CH;
+        const float *const restrict out = b + y * owidth * DT_BLENDIF_RGB_CH;
+        float *const restrict row = mask + y * owidth;
 
-      // apply global opacity
-      if(mask_inclusive)
-      {
-        if(mask_inversed)
+        for(size_t x = 0; x < owidth; x += DT_BLENDIF_RGB_BATCH)
         {
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
-#endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - mask[x]) * temp_mask[x];
-        }
-        else
-        {
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
-#endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - (1.0f - mask[x]) * temp_mask[x]);
-        }
-      }
-      else
-      {
-        if(mask_inversed)
-        {
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
-#endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - mask[x] * temp_mask[x]);
-        }
-        else
-        {
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
-#endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * mask[x] * temp_mask[x];
+          const size_t n = MIN(DT_BLENDIF_RGB_BATCH, owidth - x);
+          float *const restrict m = row + x;
+
+          // combine channels of the input and the output into the parametric mask
+          for(size_t k = 0; k < n; k++) factor[k] = 1.0f;
+          if(!_mask_is_uniform(m, n, decisive_mask))
+          {
+            _blendif_combine_channels(in + x * DT_BLENDIF_RGB_CH, factor, channels, n, blendif, parameters,
+                                      profile);
+            _blendif_combine_channels(out + x * DT_BLENDIF_RGB_CH, factor, channels, n,
+                                      blendif >> DEVELOP_BLENDIF_GRAY_out,
+                                      parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_GRAY_out,
+                                      profile);
+          }
+
+          // apply global opacity
+          if(mask_inclusive)
+          {
+            if(mask_inversed)
+            {
+              for(size_t k = 0; k < n; k++) m[k] = global_opacity * (1.0f - m[k]) * factor[k];
+            }
+            else
+            {
+              for(size_t k = 0; k < n; k++) m[k] = global_opacity * (1.0f - (1.0f - m[k]) * factor[k]);
+            }
+          }
+          else
+          {
+            if(mask_inversed)
+            {
+              for(size_t k = 0; k < n; k++) m[k] = global_opacity * (1.0f - m[k] * factor[k]);
+            }
+            else
+            {
+              for(size_t k = 0; k < n; k++) m[k] = global_opacity * m[k] * factor[k];
+            }
+          }
         }
       }
 
       dt_mm_restore_flush_zero(oldMode);
     }
-
-    dt_free_align(temp_mask);
   }
 }
 
@@ -2047,6 +2047,9 @@ void dt_iop_commit_params(dt_iop_module_t *module,
   if(module->flags() & IOP_FLAGS_ALLOW_TILING)
     piece->process_tiling_ready = TRUE;
 
+  // same for the output depending on the pipe type
+  piece->pipe_dependent = (module->flags() & IOP_FLAGS_PIPE_DEPENDENT) != 0;
+
   if(darktable.unmuted & DT_DEBUG_PARAMS && module->so->get_introspection())
     _iop_validate_params(module->so->get_introspection()->field, params,
                          TRUE, module->so->op);
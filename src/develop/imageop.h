@@ -40,6 +40,13 @@ typedef struct dt_iop_roi_t
   float scale;
 } dt_iop_roi_t;
 
+/** an independent local change a module makes to its input, see local_edits() in iop_api.h */
+typedef struct dt_iop_local_edit_t
+{
+  uint64_t hash;           // of everything the pixels in the area depend on
+  int x, y, width, height; // the area of the output it changes, in the same coordinates as roi_out->x, y
+} dt_iop_local_edit_t;
+
 #ifdef __cplusplus
 } // extern "C"
 #endif /* __cplusplus */
@@ -133,7 +140,8 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_UNSAFE_COPY = 1 << 13,       // Unsafe to copy as part of history
   IOP_FLAGS_GUIDES_SPECIAL_DRAW = 1 << 14, // handle the grid drawing directly
   IOP_FLAGS_GUIDES_WIDGET = 1 << 15,      // require the guides widget
-  IOP_FLAGS_CROP_EXPOSER = 1 << 16        // offers crop exposing
+  IOP_FLAGS_CROP_EXPOSER = 1 << 16,       // offers crop exposing
+  IOP_FLAGS_PIPE_DEPENDENT = 1 << 17      // Output may differ between pipe types for the same parameters, see piece->pipe_dependent
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -477,6 +477,8 @@ int dt_masks_group_render_roi(dt_iop_module_t *module,
                               dt_masks_form_t *form,
                               const dt_iop_roi_t *roi,
                               float *buffer);
+/** free the rasterized masks the pipe keeps across runs and modules */
+void dt_masks_cache_cleanup(dt_dev_pixelpipe_t *pipe);
 
 // returns current masks version
 int dt_masks_version(void);
@@ -592,6 +594,12 @@ void dt_masks_iop_use_same_as(struct dt_iop_module_t *module,
 int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form);
 char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form,
                                      char *str);
+/** same, with the sub-forms of groups taken from the given list, e.g. the forms of a pipe */
+int dt_masks_group_get_hash_buffer_length_ext(GList *forms,
+                                              dt_masks_form_t *form);
+char *dt_masks_group_get_hash_buffer_ext(GList *forms,
+                                         dt_masks_form_t *form,
+                                         char *str);
 
 void dt_masks_form_remove(struct dt_iop_module_t *module,
                           dt_masks_form_t *grp,
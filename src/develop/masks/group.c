@@ -17,6 +17,7 @@
 */
 
 #include "common/debug.h"
+#include "common/imagebuf.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -709,6 +710,147 @@ static void _combine_masks_exclusion(float *const restrict dest,
   }
 }
 
+// rasterized masks are kept per pipe across runs and modules, keyed by
+// everything the rendering depends on: the form and all its sub-forms, the
+// roi, the image and the distortions applied before the module
+typedef struct _masks_cache_entry_t
+{
+  uint64_t hash;
+  size_t size;
+  float *mask;
+} _masks_cache_entry_t;
+
+static uint64_t _cache_hash_bytes(uint64_t hash, const void *const data, const size_t size)
+{
+  const char *str = (const char *)data;
+  for(size_t k = 0; k < size; k++) hash = ((hash << 5) + hash) ^ str[k];
+  return hash;
+}
+
+// returns 0 if the mask can't be cached, also with --disable-pipecache
+static uint64_t _cache_hash(const dt_iop_module_t *const module,
+                            const dt_dev_pixelpipe_iop_t *const piece,
+                            dt_masks_form_t *const form,
+                            const dt_iop_roi_t *const roi)
+{
+  if(!darktable.pipe_cache) return 0;
+
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  uint64_t hash = dt_dev_hash_distort_plus(module->dev, pipe, module->iop_order,
+                                           DT_DEV_TRANSFORM_DIR_BACK_INCL);
+  if(hash == 0) return 0;
+
+  // the form and its sub-forms as rendered, from the forms of the pipe
+  const int length = dt_masks_group_get_hash_buffer_length_ext(pipe->forms, form);
+  char *str = malloc(length);
+  if(!str) return 0;
+  dt_masks_group_get_hash_buffer_ext(pipe->forms, form, str);
+
+  hash = _cache_hash_bytes(hash, &pipe->image.id, sizeof(pipe->image.id));
+  hash = _cache_hash_bytes(hash, &pipe->iwidth, sizeof(pipe->iwidth));
+  hash = _cache_hash_bytes(hash, &pipe->iheight, sizeof(pipe->iheight));
+  hash = _cache_hash_bytes(hash, &pipe->iscale, sizeof(pipe->iscale));
+  hash = _cache_hash_bytes(hash, &module->dev->preview_downsampling, sizeof(float));
+  hash = _cache_hash_bytes(hash, &roi->x, sizeof(roi->x));
+  hash = _cache_hash_bytes(hash, &roi->y, sizeof(roi->y));
+  hash = _cache_hash_bytes(hash, &roi->width, sizeof(roi->width));
+  hash = _cache_hash_bytes(hash, &roi->height, sizeof(roi->height));
+  hash = _cache_hash_bytes(hash, &roi->scale, sizeof(roi->scale));
+  hash = _cache_hash_bytes(hash, str, length);
+  free(str);
+  return hash ? hash : 1;
+}
+
+static gboolean _cache_get(dt_dev_pixelpipe_t *pipe,
+                           const uint64_t hash,
+                           const size_t size,
+                           float *const buffer)
+{
+  if(hash == 0) return FALSE;
+
+  for(GList *l = pipe->mask_cache; l; l = g_list_next(l))
+  {
+    _masks_cache_entry_t *entry = (_masks_cache_entry_t *)l->data;
+    if(entry->hash == hash && entry->size == size)
+    {
+      dt_iop_image_copy(buffer, entry->mask, size);
+      // keep the list ordered from the most to the least recently used
+      pipe->mask_cache = g_list_remove_link(pipe->mask_cache, l);
+      pipe->mask_cache = g_list_concat(l, pipe->mask_cache);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static void _cache_free_entry(_masks_cache_entry_t *entry)
+{
+  dt_free_align(entry->mask);
+  free(entry);
+}
+
+static void _cache_put(dt_dev_pixelpipe_t *pipe,
+                       const uint64_t hash,
+                       const size_t size,
+                       const float *const buffer)
+{
+  const size_t limit = dt_get_singlebuffer_mem();
+  if(hash == 0 || sizeof(float) * size > limit) return;
+
+  // drop the least recently used masks to stay within the limit
+  while(pipe->mask_cache && pipe->mask_cache_size + sizeof(float) * size > limit)
+  {
+    GList *last = g_list_last(pipe->mask_cache);
+    _masks_cache_entry_t *entry = (_masks_cache_entry_t *)last->data;
+    pipe->mask_cache_size -= sizeof(float) * entry->size;
+    _cache_free_entry(entry);
+    pipe->mask_cache = g_list_delete_link(pipe->mask_cache, last);
+  }
+
+  _masks_cache_entry_t *entry = malloc(sizeof(_masks_cache_entry_t));
+  float *mask = dt_alloc_align_float(size);
+  if(!entry || !mask)
+  {
+    free(entry);
+    dt_free_align(mask);
+    return;
+  }
+  dt_iop_image_copy(mask, buffer, size);
+  entry->hash = hash;
+  entry->size = size;
+  entry->mask = mask;
+  pipe->mask_cache = g_list_prepend(pipe->mask_cache, entry);
+  pipe->mask_cache_size += sizeof(float) * size;
+}
+
+void dt_masks_cache_cleanup(dt_dev_pixelpipe_t *pipe)
+{
+  g_list_free_full(pipe->mask_cache, (GDestroyNotify)_cache_free_entry);
+  pipe->mask_cache = NULL;
+  pipe->mask_cache_size = 0;
+}
+
+// renders the mask of a form, or takes it from the cache of the pipe
+static int _cached_get_mask_roi(const dt_iop_module_t *const module,
+                                const dt_dev_pixelpipe_iop_t *const piece,
+                                dt_masks_form_t *const form,
+                                const dt_iop_roi_t *const roi,
+                                float *const buffer)
+{
+  const size_t npixels = (size_t)roi->width * roi->height;
+  const uint64_t hash = _cache_hash(module, piece, form, roi);
+  if(_cache_get(piece->pipe, hash, npixels, buffer))
+  {
+    dt_print(DT_DEBUG_MASKS, "[masks %s] taken from the cache of the %s pipe\n",
+             form->name, dt_dev_pixelpipe_type_to_str(piece->pipe->type));
+    return 1;
+  }
+
+  const int ok = dt_masks_get_mask_roi(module, piece, form, roi, buffer);
+  if(ok) _cache_put(piece->pipe, hash, npixels, buffer);
+  return ok;
+}
+
 static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
                                const dt_dev_pixelpipe_iop_t *const restrict piece,
                                dt_masks_form_t *const form,
@@ -732,14 +874,15 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
   for(GList *fpts = form->points; fpts; fpts = g_list_next(fpts))
   {
     dt_masks_point_group_t *fpt = (dt_masks_point_group_t *)fpts->data;
-    dt_masks_form_t *sel = dt_masks_get_from_id(module->dev, fpt->formid);
+    // the forms of the pipe, the cache keys are made of them
+    dt_masks_form_t *sel = dt_masks_get_from_id_ext(piece->pipe->forms, fpt->formid);
 
     if(sel)
     {
       // ensure that we start with a zeroed buffer regardless of what
       // was previously written into 'bufs'
       memset(bufs, 0, npixels*sizeof(float));
-      const int ok = dt_masks_get_mask_roi(module, piece, sel, roi, bufs);
+      const int ok = _cached_get_mask_roi(module, piece, sel, roi, bufs);
       const float op = fpt->opacity;
       const int state = fpt->state;
 
@@ -835,7 +978,7 @@ int dt_masks_group_render_roi(dt_iop_module_t *module,
   const double start = dt_get_wtime();
   if(!form) return 0;
 
-  const int ok = dt_masks_get_mask_roi(module, piece, form, roi, buffer);
+  const int ok = _cached_get_mask_roi(module, piece, form, roi, buffer);
 
   if(darktable.unmuted & DT_DEBUG_PERF)
     dt_print(DT_DEBUG_MASKS,
@@ -2025,7 +2025,7 @@ void dt_masks_group_ungroup(dt_masks_form_t *dest_grp,
   }
 }
 
-int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form)
+int dt_masks_group_get_hash_buffer_length_ext(GList *forms_list, dt_masks_form_t *form)
 {
   if(!form) return 0;
   int pos = 0;
@@ -2042,14 +2042,14 @@ int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form)
     if(form->type & DT_MASKS_GROUP)
     {
       dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
-      dt_masks_form_t *f = dt_masks_get_from_id(darktable.develop, grpt->formid);
+      dt_masks_form_t *f = dt_masks_get_from_id_ext(forms_list, grpt->formid);
       if(f)
       {
         // state & opacity
         pos += sizeof(int);
         pos += sizeof(float);
         // the form itself
-        pos += dt_masks_group_get_hash_buffer_length(f);
+        pos += dt_masks_group_get_hash_buffer_length_ext(forms_list, f);
       }
     }
     else if(form->functions)
@@ -2060,7 +2060,7 @@ int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form)
   return pos;
 }
 
-char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
+char *dt_masks_group_get_hash_buffer_ext(GList *forms_list, dt_masks_form_t *form, char *str)
 {
   if(!form) return str;
   int pos = 0;
@@ -2079,7 +2079,7 @@ char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
     if(form->type & DT_MASKS_GROUP)
     {
       dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
-      dt_masks_form_t *f = dt_masks_get_from_id(darktable.develop, grpt->formid);
+      dt_masks_form_t *f = dt_masks_get_from_id_ext(forms_list, grpt->formid);
       if(f)
       {
         // state & opacity
@@ -2088,7 +2088,7 @@ char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
         memcpy(str + pos, &grpt->opacity, sizeof(float));
         pos += sizeof(float);
         // the form itself
-        str = dt_masks_group_get_hash_buffer(f, str + pos) - pos;
+        str = dt_masks_group_get_hash_buffer_ext(forms_list, f, str + pos) - pos;
       }
     }
     else if(form->functions)
@@ -2100,6 +2100,16 @@ char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
   return str + pos;
 }
 
+int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form)
+{
+  return dt_masks_group_get_hash_buffer_length_ext(darktable.develop->forms, form);
+}
+
+char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
+{
+  return dt_masks_group_get_hash_buffer_ext(darktable.develop->forms, form, str);
+}
+
 void dt_masks_update_image(dt_develop_t *dev)
 {
   /* invalidate image data*/
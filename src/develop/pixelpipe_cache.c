@@ -42,6 +42,9 @@ gboolean dt_dev_pixelpipe_cache_init(
   cache->allmem = cache->hits = cache->calls = cache->tests = 0;
   cache->memlimit = limit;
 
+  memset(&cache->arena, 0, sizeof(dt_dev_pixelpipe_arena_t));
+  dt_pthread_mutex_init(&cache->arena.lock, NULL);
+
   const size_t csize = sizeof(void *) + sizeof(size_t) + sizeof(dt_iop_buffer_dsc_t) + 2*sizeof(int32_t) + sizeof(uint64_t);
   cache->data = (void **) calloc(entries, csize);
   cache->size = (size_t *)((void *)cache->data + entries * sizeof(void *));
@@ -101,12 +104,23 @@ void dt_dev_pixelpipe_cache_cleanup(struct dt_dev_pixelpipe_t *pipe)
   }
   free(cache->data);
   cache->data = NULL;
+
+  dt_dev_pixelpipe_arena_t *arena = &cache->arena;
+  for(int k = 0; k < DT_PIPEARENA_SLOTS; k++)
+  {
+    if(arena->busy[k])
+      dt_print(DT_DEBUG_ALWAYS, "[pixelpipe_cache_cleanup] scratch buffer %p still in use\n", arena->data[k]);
+    dt_free_align(arena->data[k]);
+    arena->data[k] = NULL;
+  }
+  dt_pthread_mutex_destroy(&arena->lock);
 }
 
 static uint64_t _dev_pixelpipe_cache_basichash(
            const dt_imgid_t imgid,
            struct dt_dev_pixelpipe_t *pipe,
-           const int position)
+           const int position,
+           const int type)
 {
   // bernstein hash (djb2)
   uint64_t hash = 5381;
@@ -121,7 +135,7 @@ static uint64_t _dev_pixelpipe_cache_basichash(
           of the mask writing module (rawprepare or demosaic)
   */
   const uint32_t hashing_pipemode[3] = {(uint32_t)imgid,
-                                        (uint32_t)pipe->type,
+                                        (uint32_t)type,
                                         (uint32_t)pipe->want_detail_mask };
 
   char *pstr = (char *)hashing_pipemode;
@@ -165,7 +179,17 @@ uint64_t dt_dev_pixelpipe_cache_hash(
            struct dt_dev_pixelpipe_t *pipe,
            const int position)
 {
-  uint64_t hash = _dev_pixelpipe_cache_basichash(imgid, pipe, position);
+  return dt_dev_pixelpipe_cache_hash_as(imgid, roi, pipe, position, pipe->type);
+}
+
+uint64_t dt_dev_pixelpipe_cache_hash_as(
+           const dt_imgid_t imgid,
+           const dt_iop_roi_t *roi,
+           struct dt_dev_pixelpipe_t *pipe,
+           const int position,
+           const int type)
+{
+  uint64_t hash = _dev_pixelpipe_cache_basichash(imgid, pipe, position, type);
   // also include roi data
   char *str = (char *)roi;
   for(size_t i = 0; i < sizeof(dt_iop_roi_t); i++)
@@ -202,6 +226,26 @@ gboolean dt_dev_pixelpipe_cache_available(
   return FALSE;
 }
 
+void *dt_dev_pixelpipe_cache_peek(
+           struct dt_dev_pixelpipe_t *pipe,
+           const uint64_t hash,
+           const size_t size,
+           dt_iop_buffer_dsc_t **dsc)
+{
+  dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
+  if(hash == INVALID_CACHEHASH || !cache->data) return NULL;
+
+  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+  {
+    if(cache->hash[k] == hash && cache->size[k] == size && cache->data[k])
+    {
+      *dsc = &cache->dsc[k];
+      return cache->data[k];
+    }
+  }
+  return NULL;
+}
+
 // While looking for the oldest cacheline we always ignore the first two lines as they are used
 // for swapping buffers while in entries==DT_PIPECACHE_MIN or masking mode
 static int _get_oldest_cacheline(dt_dev_pixelpipe_cache_t *cache,
@@ -476,6 +520,136 @@ void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe)
     _to_mb(freed), _to_mb(cache->allmem), _to_mb(cache->memlimit));
 }
 
+static void _arena_release(dt_dev_pixelpipe_arena_t *arena, const int k)
+{
+  dt_free_align(arena->data[k]);
+  arena->allmem -= arena->size[k];
+  arena->data[k] = NULL;
+  arena->size[k] = 0;
+  arena->busy[k] = FALSE;
+}
+
+// release idle buffers, largest first, until at most keep bytes are held
+static void _arena_shrink(dt_dev_pixelpipe_arena_t *arena, const size_t keep)
+{
+  while(arena->allmem > keep)
+  {
+    int largest = -1;
+    for(int k = 0; k < DT_PIPEARENA_SLOTS; k++)
+      if(arena->data[k] && !arena->busy[k]
+         && (largest < 0 || arena->size[k] > arena->size[largest]))
+        largest = k;
+    if(largest < 0) return;
+    _arena_release(arena, largest);
+  }
+}
+
+void *dt_dev_pixelpipe_arena_alloc(struct dt_dev_pixelpipe_t *pipe, const size_t size)
+{
+  // not worth the bookkeeping
+  if(size < DT_PIPEARENA_MINSIZE) return dt_alloc_align(64, size);
+
+  dt_dev_pixelpipe_arena_t *arena = &pipe->cache.arena;
+  dt_pthread_mutex_lock(&arena->lock);
+  arena->requests++;
+
+  // smallest idle buffer that fits without wasting more than half of it
+  int best = -1;
+  int empty = -1;
+  for(int k = 0; k < DT_PIPEARENA_SLOTS; k++)
+  {
+    if(!arena->data[k])
+    {
+      if(empty < 0) empty = k;
+    }
+    else if(!arena->busy[k]
+            && arena->size[k] >= size
+            && arena->size[k] / 2 <= size
+            && (best < 0 || arena->size[k] < arena->size[best]))
+      best = k;
+  }
+
+  void *mem = NULL;
+  if(best >= 0)
+  {
+    arena->busy[best] = TRUE;
+    arena->reused++;
+    arena->reused_mem += size;
+    mem = arena->data[best];
+  }
+  else
+  {
+    // don't grow beyond what this run is expected to need
+    const size_t keep = MAX(arena->limit, arena->expected);
+    _arena_shrink(arena, keep > size ? keep - size : 0);
+    if(empty < 0)
+    {
+      for(int k = 0; k < DT_PIPEARENA_SLOTS && empty < 0; k++)
+        if(!arena->data[k]) empty = k;
+    }
+
+    mem = dt_alloc_align(64, size);
+    if(mem && empty >= 0)
+    {
+      arena->data[empty] = mem;
+      arena->size[empty] = size;
+      arena->busy[empty] = TRUE;
+      arena->allmem += size;
+    }
+  }
+  dt_pthread_mutex_unlock(&arena->lock);
+  return mem;
+}
+
+float *dt_dev_pixelpipe_arena_alloc_perthread_float(struct dt_dev_pixelpipe_t *pipe, const size_t n,
+                                                     size_t *padded_size)
+{
+  const size_t cache_lines = (n * sizeof(float) + 63) / 64;
+  *padded_size = 64 * cache_lines / sizeof(float);
+  return (float *)dt_dev_pixelpipe_arena_alloc(pipe, 64 * cache_lines * dt_get_num_threads());
+}
+
+void dt_dev_pixelpipe_arena_free(struct dt_dev_pixelpipe_t *pipe, void *mem)
+{
+  if(!mem) return;
+
+  dt_dev_pixelpipe_arena_t *arena = &pipe->cache.arena;
+  gboolean found = FALSE;
+  dt_pthread_mutex_lock(&arena->lock);
+  for(int k = 0; k < DT_PIPEARENA_SLOTS; k++)
+  {
+    if(arena->data[k] == mem)
+    {
+      arena->busy[k] = FALSE;
+      found = TRUE;
+      break;
+    }
+  }
+  if(found) _arena_shrink(arena, MAX(arena->limit, arena->expected));
+  dt_pthread_mutex_unlock(&arena->lock);
+
+  if(!found) dt_free_align(mem);
+}
+
+void dt_dev_pixelpipe_arena_expect(struct dt_dev_pixelpipe_t *pipe, const size_t size)
+{
+  dt_dev_pixelpipe_arena_t *arena = &pipe->cache.arena;
+  dt_pthread_mutex_lock(&arena->lock);
+  arena->expected = MAX(arena->expected, size);
+  dt_pthread_mutex_unlock(&arena->lock);
+}
+
+void dt_dev_pixelpipe_arena_trim(struct dt_dev_pixelpipe_t *pipe)
+{
+  dt_dev_pixelpipe_arena_t *arena = &pipe->cache.arena;
+  dt_pthread_mutex_lock(&arena->lock);
+  // keep what the last run needed for the next one, but never hog memory
+  arena->limit = MIN(arena->expected, dt_get_available_mem() / 4);
+  arena->expected = 0;
+  _arena_shrink(arena, arena->limit);
+  dt_pthread_mutex_unlock(&arena->lock);
+}
+
 void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
@@ -487,6 +661,13 @@ void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe)
     _to_mb(cache->allmem), _to_mb(cache->memlimit),
     (double)(cache->hits) / fmax(1.0, pipe->runs),
     (double)(cache->hits) / fmax(1.0, cache->tests));
+
+  const dt_dev_pixelpipe_arena_t *arena = &cache->arena;
+  if(arena->requests)
+    dt_print_pipe(DT_DEBUG_PIPE, "scratch arena", pipe, NULL, NULL, NULL,
+      "%" PRIu64 " of %" PRIu64 " allocations avoided (%iMB). Holding %iMB, keeping %iMB\n",
+      arena->reused, arena->requests, _to_mb(arena->reused_mem),
+      _to_mb(arena->allmem), _to_mb(arena->limit));
 }
 
 #undef INVALID_CACHEHASH
@@ -18,12 +18,38 @@
 
 #pragma once
 
+#include "common/dtpthread.h"
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
 struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
 
+#define DT_PIPEARENA_SLOTS 16
+#define DT_PIPEARENA_MINSIZE (256 * 1024)
+
+/**
+ * pool of scratch buffers used by modules while processing. buffers handed back are kept
+ * for the next request of a similar size instead of being freed, so long exports and
+ * repeated darkroom runs don't go through the allocator and fresh page faults for every
+ * module. the pool keeps what the most demanding module of the last run asked for
+ * according to its tiling requirements and releases the rest.
+ */
+typedef struct dt_dev_pixelpipe_arena_t
+{
+  dt_pthread_mutex_t lock;
+  void *data[DT_PIPEARENA_SLOTS];
+  size_t size[DT_PIPEARENA_SLOTS];
+  gboolean busy[DT_PIPEARENA_SLOTS];
+  size_t allmem;
+  size_t expected;
+  size_t limit;
+  // stats
+  uint64_t requests;
+  uint64_t reused;
+  size_t reused_mem;
+} dt_dev_pixelpipe_arena_t;
+
 /**
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
@@ -49,6 +75,7 @@ typedef struct dt_dev_pixelpipe_cache_t
   uint32_t lused;
   uint32_t linvalid;
   uint32_t limportant;
+  dt_dev_pixelpipe_arena_t arena;
 } dt_dev_pixelpipe_cache_t;
 
 typedef enum dt_dev_pixelpipe_cache_test_t
@@ -69,6 +96,12 @@ void dt_dev_pixelpipe_cache_cleanup(struct dt_dev_pixelpipe_t *pipe);
 uint64_t dt_dev_pixelpipe_cache_hash(const dt_imgid_t imgid, const struct dt_iop_roi_t *roi,
                                      struct dt_dev_pixelpipe_t *pipe, const int position);
 
+/** same hash as if the module stack of pipe was processed by a pipe of the given type,
+    to look up buffers in the cache of another pipe. */
+uint64_t dt_dev_pixelpipe_cache_hash_as(const dt_imgid_t imgid, const struct dt_iop_roi_t *roi,
+                                        struct dt_dev_pixelpipe_t *pipe, const int position,
+                                        const int type);
+
 /** returns a float data buffer in 'data' for the given hash from the cache, dsc is updated too.
   If the hash does not match any cache line, use an old buffer or allocate a fresh one.
   The size of the buffer in 'data' will be at least of size bytes.
@@ -77,6 +110,11 @@ uint64_t dt_dev_pixelpipe_cache_hash(const dt_imgid_t imgid, const struct dt_iop
 gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const uint64_t hash,
                                const size_t size, void **data, struct dt_iop_buffer_dsc_t **dsc, struct dt_iop_module_t *module, const gboolean important);
 
+/** returns the data of the cache line for hash or NULL, without touching the cache state.
+    the caller has to hold the pipe's busy_mutex. */
+void *dt_dev_pixelpipe_cache_peek(struct dt_dev_pixelpipe_t *pipe, const uint64_t hash,
+                                  const size_t size, struct dt_iop_buffer_dsc_t **dsc);
+
 /** test availability of a cache line without destroying another, if it is not found. */
 gboolean dt_dev_pixelpipe_cache_available(struct dt_dev_pixelpipe_t *pipe, const uint64_t hash, const size_t size);
 
@@ -92,6 +130,28 @@ void dt_dev_pixelpipe_important_cacheline(const struct dt_dev_pixelpipe_t *pipe,
 /** mark the given cache line as invalid or to be ignored */
 void dt_dev_pixelpipe_invalidate_cacheline(const struct dt_dev_pixelpipe_t *pipe, const void *data);
 
+/** returns a 64 byte aligned scratch buffer of size bytes from the pipe's arena, NULL if out of memory.
+    must be released by dt_dev_pixelpipe_arena_free() with the same pipe. */
+void *dt_dev_pixelpipe_arena_alloc(struct dt_dev_pixelpipe_t *pipe, const size_t size);
+
+/** same as dt_alloc_perthread_float() but taken from the pipe's arena */
+float *dt_dev_pixelpipe_arena_alloc_perthread_float(struct dt_dev_pixelpipe_t *pipe, const size_t n,
+                                                     size_t *padded_size);
+
+static inline float *dt_dev_pixelpipe_arena_alloc_float(struct dt_dev_pixelpipe_t *pipe, const size_t pixels)
+{
+  return (float *)dt_dev_pixelpipe_arena_alloc(pipe, pixels * sizeof(float));
+}
+
+/** hands a buffer back to the arena. buffers not owned by the arena are freed. */
+void dt_dev_pixelpipe_arena_free(struct dt_dev_pixelpipe_t *pipe, void *mem);
+
+/** announces the scratch memory a module is expected to use in this run */
+void dt_dev_pixelpipe_arena_expect(struct dt_dev_pixelpipe_t *pipe, const size_t size);
+
+/** end of a run, releases unused buffers beyond what the run was expected to need */
+void dt_dev_pixelpipe_arena_trim(struct dt_dev_pixelpipe_t *pipe);
+
 /** print out cache lines/hashes and do a cache cleanup */
 void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe);
 void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe);
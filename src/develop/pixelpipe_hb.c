@@ -22,6 +22,7 @@
 #include "common/opencl.h"
 #include "common/iop_order.h"
 #include "common/imagebuf.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
@@ -263,6 +264,8 @@ gboolean dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe,
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
   pipe->store_all_raster_masks = FALSE;
+  pipe->mask_cache = NULL;
+  pipe->mask_cache_size = 0;
   pipe->work_profile_info = NULL;
   pipe->input_profile_info = NULL;
   pipe->output_profile_info = NULL;
@@ -367,12 +370,14 @@ void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
     piece->histogram = NULL;
     g_hash_table_destroy(piece->raster_masks);
     piece->raster_masks = NULL;
+    if(piece->last_edits) g_array_free(piece->last_edits, TRUE);
     free(piece);
   }
   g_list_free(pipe->nodes);
   pipe->nodes = NULL;
 
   dt_dev_clear_scharr_mask(pipe);
+  dt_masks_cache_cleanup(pipe);
 
   // also cleanup iop here
   if(pipe->iop)
@@ -1141,6 +1146,84 @@ static void _collect_histogram_on_CPU(dt_dev_pixelpipe_t *pipe,
   }
 }
 
+/* the output of the last run of the module is already in *output and only the area (x0, y0, x1, y1 in
+   roi_out) needs to be recomputed. like a tile, the area is processed with the overlap the module asked
+   for and the part of the input modify_roi_in() wants for it, so the pixels inside are the same as when
+   processing the whole roi. returns FALSE if that's not possible and the whole roi must be processed. */
+static gboolean _pixelpipe_process_dirty(dt_dev_pixelpipe_t *pipe,
+                                         dt_iop_module_t *module,
+                                         dt_dev_pixelpipe_iop_t *piece,
+                                         const void *input,
+                                         const dt_iop_roi_t *roi_in,
+                                         const size_t in_bpp,
+                                         void *output,
+                                         const dt_iop_roi_t *roi_out,
+                                         const size_t bpp,
+                                         const dt_develop_tiling_t *tiling,
+                                         const int *const area)
+{
+  if(area[2] <= area[0] || area[3] <= area[1]) return TRUE;
+
+  // keep the alignment of the sensor pattern for the modules asking for it
+  const int xalign = MAX(1, tiling->xalign);
+  const int yalign = MAX(1, tiling->yalign);
+  const int x0 = MAX(0, area[0] - tiling->overlap) / xalign * xalign;
+  const int y0 = MAX(0, area[1] - tiling->overlap) / yalign * yalign;
+  const int x1 = MIN(roi_out->width, area[2] + tiling->overlap);
+  const int y1 = MIN(roi_out->height, area[3] + tiling->overlap);
+
+  const dt_iop_roi_t sub_out = { roi_out->x + x0, roi_out->y + y0, x1 - x0, y1 - y0, roi_out->scale };
+  dt_iop_roi_t sub_in = sub_out;
+  module->modify_roi_in(module, piece, &sub_out, &sub_in);
+  if(sub_in.scale != roi_in->scale
+     || sub_in.x < roi_in->x || sub_in.y < roi_in->y
+     || sub_in.x + sub_in.width > roi_in->x + roi_in->width
+     || sub_in.y + sub_in.height > roi_in->y + roi_in->height)
+    return FALSE;
+
+  // a few more pixels than asked for, interpolations at the border see what they would see in the whole roi
+  if(xalign == 1 && yalign == 1)
+  {
+    const int left = MAX(roi_in->x, sub_in.x - 4);
+    const int top = MAX(roi_in->y, sub_in.y - 4);
+    sub_in.width = MIN(roi_in->x + roi_in->width, sub_in.x + sub_in.width + 4) - left;
+    sub_in.height = MIN(roi_in->y + roi_in->height, sub_in.y + sub_in.height + 4) - top;
+    sub_in.x = left;
+    sub_in.y = top;
+  }
+
+  const size_t in_width = sub_in.width;
+  const size_t out_width = sub_out.width;
+  char *in = dt_dev_pixelpipe_arena_alloc(pipe, in_bpp * in_width * sub_in.height);
+  char *out = dt_dev_pixelpipe_arena_alloc(pipe, bpp * out_width * sub_out.height);
+  if(!in || !out)
+  {
+    dt_dev_pixelpipe_arena_free(pipe, in);
+    dt_dev_pixelpipe_arena_free(pipe, out);
+    return FALSE;
+  }
+
+  const size_t ix = sub_in.x - roi_in->x;
+  const size_t iy = sub_in.y - roi_in->y;
+  for(size_t j = 0; j < sub_in.height; j++)
+    memcpy(in + in_bpp * j * in_width,
+           (const char *)input + in_bpp * ((iy + j) * roi_in->width + ix), in_bpp * in_width);
+
+  module->process(module, piece, in, out, &sub_in, &sub_out);
+
+  // only the area itself, the overlap around it may be off
+  const size_t ox = area[0] - x0;
+  const size_t oy = area[1] - y0;
+  const size_t width = area[2] - area[0];
+  for(size_t j = 0; j < area[3] - area[1]; j++)
+    memcpy((char *)output + bpp * ((area[1] + j) * roi_out->width + area[0]),
+           out + bpp * ((oy + j) * out_width + ox), bpp * width);
+
+  dt_dev_pixelpipe_arena_free(pipe, in);
+  dt_dev_pixelpipe_arena_free(pipe, out);
+  return TRUE;
+}
+
 static gboolean _pixelpipe_process_on_CPU(
                  dt_dev_pixelpipe_t *pipe,
                  dt_develop_t *dev,
@@ -1153,7 +1236,8 @@ static gboolean _pixelpipe_process_on_CPU(
                  dt_iop_module_t *module,
                  dt_dev_pixelpipe_iop_t *piece,
                  dt_develop_tiling_t *tiling,
-                 dt_pixelpipe_flow_t *pixelpipe_flow)
+                 dt_pixelpipe_flow_t *pixelpipe_flow,
+                 const int *const dirty)
 {
   if(dt_atomic_get_int(&pipe->shutdown))
     return TRUE;
@@ -1215,7 +1299,19 @@ static gboolean _pixelpipe_process_on_CPU(
                      roi_in->width, roi_in->height, in_bpp,
                      TRUE, dt_dev_pixelpipe_type_to_str(piece->pipe->type));
 
-  if(!fitting && piece->process_tiling_ready)
+  if(dirty
+     && _pixelpipe_process_dirty(pipe, module, piece, input, roi_in, in_bpp, *output, roi_out, bpp,
+                                 tiling, dirty))
+  {
+    dt_print_pipe(DT_DEBUG_PIPE,
+                  "process DIRTY", piece->pipe, module, roi_in, roi_out, "%d/%d - %d/%d\n",
+                  dirty[0], dirty[1], dirty[2], dirty[3]);
+
+    *pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU);
+    *pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU
+                         | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
+  }
+  else if(!fitting && piece->process_tiling_ready)
   {
     dt_print_pipe(DT_DEBUG_PIPE,
                   "process TILE", piece->pipe, module, roi_in, roi_out, "\n");
@@ -1348,6 +1444,420 @@ static inline gboolean _opencl_pipe_isok(dt_dev_pixelpipe_t *pipe)
 #endif
 
 // recursive helper for process, returns TRUE in case of unfinished work or error
+static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
+                                           dt_develop_t *dev,
+                                           void **output,
+                                           void **cl_mem_output,
+                                           dt_iop_buffer_dsc_t **out_format,
+                                           const dt_iop_roi_t *roi_out,
+                                           GList *modules,
+                                           GList *pieces,
+                                           const int pos);
+
+/* a run of point-to-point modules planned by dt_tiling_plan_segment(): get the input of the
+   first one and pass each tile through all of them. the intermediate results don't go
+   through the cache. */
+static gboolean _dev_pixelpipe_process_segment(dt_dev_pixelpipe_t *pipe,
+                                               dt_develop_t *dev,
+                                               void **output,
+                                               dt_iop_buffer_dsc_t **out_format,
+                                               const dt_iop_roi_t *roi_out,
+                                               GList *modules,
+                                               GList *pieces,
+                                               const int pos,
+                                               const uint64_t hash,
+                                               const size_t bufsize,
+                                               const dt_develop_tiling_segment_t *segment)
+{
+  dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+  GList *first_module = modules;
+  GList *first_piece = pieces;
+  for(int k = 1; k < segment->steps; k++)
+  {
+    first_module = g_list_previous(first_module);
+    first_piece = g_list_previous(first_piece);
+  }
+
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+
+  if(_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out,
+                                g_list_previous(first_module),
+                                g_list_previous(first_piece), pos - segment->steps))
+    return TRUE;
+
+  // the planner refuses pipes using opencl
+  if(cl_mem_input != NULL)
+  {
+    dt_print_pipe(DT_DEBUG_ALWAYS,
+                  "fused tiling", pipe, module, roi_out, roi_out, "unexpected input on GPU\n");
+    return TRUE;
+  }
+
+  **out_format = pipe->dsc = *input_format;
+  dt_dev_pixelpipe_cache_get(pipe, hash, bufsize, output, out_format, module, FALSE);
+
+  if(dt_atomic_get_int(&pipe->shutdown))
+    return TRUE;
+
+  dt_times_t start;
+  dt_get_perf_times(&start);
+
+  dt_print_pipe(DT_DEBUG_PIPE,
+                "process TILE fused", pipe, module, roi_out, roi_out, "%d modules\n", segment->count);
+  if(dt_tiling_process_segment(pipe, pieces, segment, input, *output, roi_out, input_format))
+    return TRUE;
+
+  **out_format = pipe->dsc = *input_format;
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "[%s] processed %d modules up to `%s%s' on CPU with fused tiling",
+                  dt_dev_pixelpipe_type_to_str(pipe->type), segment->count,
+                  module->op, dt_iop_get_instance_id(module));
+
+  _dev_pixelpipe_dirty_reset(pipe, hash);
+  return dt_atomic_get_int(&pipe->shutdown);
+}
+
+/* exporting the image that is open in darkroom: the full pipe may already hold the output of
+   this module for the same history prefix, input and roi. cachelines can't be shared between
+   pipes, so the buffer is copied into the export pipe's cache. modules rendering differently
+   in darkroom (markers, interactive approximations) end the shareable prefix, a mask display
+   anywhere in the darkroom pipe prevents sharing.
+   returns TRUE if *output holds the module's output. */
+static gboolean _dev_pixelpipe_from_darkroom(dt_dev_pixelpipe_t *pipe,
+                                             dt_iop_module_t *module,
+                                             const dt_iop_roi_t *roi_out,
+                                             const int pos,
+                                             const uint64_t hash,
+                                             const size_t bufsize,
+                                             void **output,
+                                             dt_iop_buffer_dsc_t **out_format)
+{
+  dt_develop_t *ddev = darktable.develop;
+  if(!module
+     || !(pipe->type & DT_DEV_PIXELPIPE_EXPORT)
+     || pipe->want_detail_mask
+     || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE
+     || !ddev
+     || !ddev->gui_attached
+     || !ddev->pipe
+     || ddev->pipe == pipe
+     || ddev->pipe->image.id != pipe->image.id
+     || !dt_conf_get_bool("plugins/lighttable/export/reuse_darkroom_cache"))
+    return FALSE;
+
+  // don't wait for the darkroom, it's either busy or we're fine
+  dt_dev_pixelpipe_t *full = ddev->pipe;
+  if(dt_pthread_mutex_trylock(&full->busy_mutex)) return FALSE;
+
+  // what the modules did in the last darkroom run, e.g. marking fixed hot pixels
+  gboolean dependent = FALSE;
+  int k = 0;
+  for(GList *nodes = full->nodes; nodes && k < pos && !dependent; nodes = g_list_next(nodes), k++)
+  {
+    const dt_dev_pixelpipe_iop_t *p = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dependent = p->enabled && p->pipe_dependent;
+  }
+
+  gboolean found = FALSE;
+  if(!dependent
+     && !full->processing
+     && full->changed == DT_DEV_PIPE_UNCHANGED
+     && !full->cache_obsolete
+     && !full->want_detail_mask
+     && full->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE
+     && ddev->image_status == DT_DEV_PIXELPIPE_VALID
+     && full->iwidth == pipe->iwidth
+     && full->iheight == pipe->iheight)
+  {
+    const uint64_t full_hash =
+      dt_dev_pixelpipe_cache_hash_as(pipe->image.id, roi_out, pipe, pos, DT_DEV_PIXELPIPE_FULL);
+    dt_iop_buffer_dsc_t *full_dsc = NULL;
+    const void *data = dt_dev_pixelpipe_cache_peek(full, full_hash, bufsize, &full_dsc);
+    if(data)
+    {
+      dt_times_t start;
+      dt_get_perf_times(&start);
+      dt_dev_pixelpipe_cache_get(pipe, hash, bufsize, output, out_format, module, FALSE);
+      memcpy(*output, data, bufsize);
+      **out_format = *full_dsc;
+      found = TRUE;
+      dt_show_times_f(&start, "[dev_pixelpipe]", "[export] `%s%s' output taken from darkroom cache",
+                      module->op, dt_iop_get_instance_id(module));
+    }
+  }
+  dt_pthread_mutex_unlock(&full->busy_mutex);
+  return found;
+}
+
+/* partial recomputation after local edits.
+
+   each piece remembers the cache hash of the last output it computed, the input it was computed from and
+   the module's local edits at that time. when the module is processed again for the same rois, the new
+   output can only differ from the last one where the input changed (grown by the overlap the module
+   declares for tiling, tiling already relies on modules being local) or where the local edits differ.
+   that area is passed down the pipe in pipe->dirty. modules able to process a sub roi on their own, the
+   ones with local edits and the tileable ones, copy the last output and recompute only the area. the
+   others run as usual but still pass the area on.
+
+   masks, mask display, color pickers and histograms need the whole roi, so does blending for the partial
+   recomputation. */
+
+static inline void _dev_pixelpipe_dirty_reset(dt_dev_pixelpipe_t *pipe, const uint64_t hash)
+{
+  pipe->dirty = (dt_dev_pixelpipe_dirty_t){ .hash = hash, .base = hash };
+}
+
+// everything but the params and the input the output of a piece depends on
+static uint64_t _dev_pixelpipe_dirty_key(const dt_dev_pixelpipe_t *pipe,
+                                         const dt_iop_roi_t *roi_in,
+                                         const dt_iop_roi_t *roi_out)
+{
+  const int settings[3] = { pipe->type, pipe->want_detail_mask, pipe->mask_display };
+  const uint64_t scharr = pipe->scharr.hash;
+  uint64_t hash = 5381;
+  const char *parts[4] = { (const char *)settings, (const char *)&scharr,
+                           (const char *)roi_in, (const char *)roi_out };
+  const size_t sizes[4] = { sizeof(settings), sizeof(scharr), sizeof(dt_iop_roi_t), sizeof(dt_iop_roi_t) };
+  for(int p = 0; p < 4; p++)
+    for(size_t i = 0; i < sizes[p]; i++) hash = ((hash << 5) + hash) ^ parts[p][i];
+  return hash;
+}
+
+// the blend params are part of the piece hash but not of the local edits
+static uint64_t _dev_pixelpipe_blend_hash(const dt_dev_pixelpipe_iop_t *piece)
+{
+  uint64_t hash = 5381;
+  const char *str = (const char *)piece->blendop_data;
+  if(str)
+    for(size_t i = 0; i < sizeof(dt_develop_blend_params_t); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+static gint _local_edit_cmp(gconstpointer a, gconstpointer b)
+{
+  const uint64_t ha = ((const dt_iop_local_edit_t *)a)->hash;
+  const uint64_t hb = ((const dt_iop_local_edit_t *)b)->hash;
+  return (ha > hb) - (ha < hb);
+}
+
+static inline void _dirty_add(int *area, const int x0, const int y0, const int x1, const int y1)
+{
+  if(x1 <= x0 || y1 <= y0) return;
+  if(area[2] <= area[0] || area[3] <= area[1])
+  {
+    area[0] = x0; area[1] = y0; area[2] = x1; area[3] = y1;
+    return;
+  }
+  area[0] = MIN(area[0], x0);
+  area[1] = MIN(area[1], y0);
+  area[2] = MAX(area[2], x1);
+  area[3] = MAX(area[3], y1);
+}
+
+/* the area of roi_out depending on the area (x0, y0, x1, y1) of roi_in, FALSE if unknown. modules
+   describing their output as local edits copy pixels from anywhere, modules not able to work on tiles
+   may depend on the whole input. */
+static gboolean _dev_pixelpipe_dirty_map(dt_iop_module_t *module,
+                                         dt_dev_pixelpipe_iop_t *piece,
+                                         const dt_iop_roi_t *roi_in,
+                                         const dt_iop_roi_t *roi_out,
+                                         const int overlap,
+                                         const int *const in_area,
+                                         int *area)
+{
+  if(module->local_edits || !piece->process_tiling_ready)
+    return FALSE;
+
+  if(!memcmp(roi_in, roi_out, sizeof(dt_iop_roi_t))
+     && !(module->operation_tags() & IOP_TAG_DISTORT))
+  {
+    _dirty_add(area, in_area[0] - overlap, in_area[1] - overlap, in_area[2] + overlap, in_area[3] + overlap);
+    return TRUE;
+  }
+
+  // sample the border of the area (grown by the support of the interpolation) and transform it
+  // to the output, the transformed border encloses the transformed area.
+  const float grow = overlap + 4.0f * fmaxf(1.0f, roi_in->scale / roi_out->scale);
+  const float x0 = in_area[0] - grow, y0 = in_area[1] - grow;
+  const float x1 = in_area[2] + grow, y1 = in_area[3] + grow;
+  const int steps = 16;
+  float points[2 * 4 * 16];
+  for(int k = 0; k < steps; k++)
+  {
+    const float t = (float)k / steps;
+    const float edges[4][2] = { { x0 + t * (x1 - x0), y0 }, { x1, y0 + t * (y1 - y0) },
+                                { x1 - t * (x1 - x0), y1 }, { x0, y1 - t * (y1 - y0) } };
+    for(int e = 0; e < 4; e++)
+    {
+      points[2 * (e * steps + k)] = (edges[e][0] + roi_in->x) / roi_in->scale;
+      points[2 * (e * steps + k) + 1] = (edges[e][1] + roi_in->y) / roi_in->scale;
+    }
+  }
+  if(!module->distort_transform(module, piece, points, 4 * steps)) return FALSE;
+
+  float min[2] = { FLT_MAX, FLT_MAX };
+  float max[2] = { -FLT_MAX, -FLT_MAX };
+  for(int k = 0; k < 4 * steps; k++)
+    for(int c = 0; c < 2; c++)
+    {
+      const float v = points[2 * k + c];
+      if(!dt_isfinite(v)) return FALSE;
+      min[c] = fminf(min[c], v);
+      max[c] = fmaxf(max[c], v);
+    }
+
+  _dirty_add(area,
+             floorf(min[0] * roi_out->scale - roi_out->x) - 2, floorf(min[1] * roi_out->scale - roi_out->y) - 2,
+             ceilf(max[0] * roi_out->scale - roi_out->x) + 2, ceilf(max[1] * roi_out->scale - roi_out->y) + 2);
+  return TRUE;
+}
+
+/* the area (x0, y0, x1, y1 in roi_out) where the output can differ from the last one computed by the
+   piece, given what changed in its input and the local edits of the module. returns FALSE if unknown. */
+static gboolean _dev_pixelpipe_dirty_area(dt_iop_module_t *module,
+                                          dt_dev_pixelpipe_iop_t *piece,
+                                          const dt_dev_pixelpipe_dirty_t *in,
+                                          GArray *edits,
+                                          const uint64_t key,
+                                          const dt_iop_roi_t *roi_in,
+                                          const dt_iop_roi_t *roi_out,
+                                          const int overlap,
+                                          int *area)
+{
+  area[0] = area[1] = area[2] = area[3] = 0;
+
+  if(!piece->last_hash || piece->last_key != key || piece->last_input != in->base)
+    return FALSE;
+
+  // a uniform blend keeps the pixels where they are, masks might not
+  const dt_develop_blend_params_t *const bp = piece->blendop_data;
+  if(bp && (bp->mask_mode & ~DEVELOP_MASK_ENABLED))
+    return FALSE;
+
+  if(piece->hash != piece->last_params)
+  {
+    // the edits only explain a change of the params if the blending is the same as well
+    if(!edits || !piece->last_edits || _dev_pixelpipe_blend_hash(piece) != piece->last_blend)
+      return FALSE;
+
+    // all edits in only one of the lists, both are sorted by hash
+    const dt_iop_local_edit_t *a = (dt_iop_local_edit_t *)edits->data;
+    const dt_iop_local_edit_t *b = (dt_iop_local_edit_t *)piece->last_edits->data;
+    guint i = 0, j = 0;
+    while(i < edits->len || j < piece->last_edits->len)
+    {
+      const dt_iop_local_edit_t *e = NULL;
+      if(j == piece->last_edits->len || (i < edits->len && a[i].hash < b[j].hash))
+        e = &a[i++];
+      else if(i == edits->len || b[j].hash < a[i].hash)
+        e = &b[j++];
+      else
+      {
+        i++;
+        j++;
+        continue;
+      }
+      _dirty_add(area, e->x - roi_out->x - 1, e->y - roi_out->y - 1,
+                 e->x - roi_out->x + e->width + 1, e->y - roi_out->y + e->height + 1);
+    }
+
+    // an unchanged edit partly in the area would be computed on a clipped domain, so take all of it
+    // and of the ones it touches in turn
+    gboolean grown = area[2] > area[0] && area[3] > area[1];
+    while(grown)
+    {
+      grown = FALSE;
+      for(i = 0; i < edits->len; i++)
+      {
+        const int x0 = a[i].x - roi_out->x - 1, y0 = a[i].y - roi_out->y - 1;
+        const int x1 = x0 + a[i].width + 2, y1 = y0 + a[i].height + 2;
+        if(x0 < area[2] && area[0] < x1 && y0 < area[3] && area[1] < y1
+           && (x0 < area[0] || y0 < area[1] || x1 > area[2] || y1 > area[3]))
+        {
+          _dirty_add(area, x0, y0, x1, y1);
+          grown = TRUE;
+        }
+      }
+    }
+  }
+
+  if(in->width > 0 && in->height > 0)
+  {
+    const int in_area[4] = { in->x, in->y, in->x + in->width, in->y + in->height };
+    if(!_dev_pixelpipe_dirty_map(module, piece, roi_in, roi_out, overlap, in_area, area))
+      return FALSE;
+  }
+
+  area[0] = CLAMP(area[0], 0, roi_out->width);
+  area[1] = CLAMP(area[1], 0, roi_out->height);
+  area[2] = CLAMP(area[2], area[0], roi_out->width);
+  area[3] = CLAMP(area[3], area[1], roi_out->height);
+
+  // not worth following the area any further
+  return (size_t)(area[2] - area[0]) * (area[3] - area[1]) <= (size_t)roi_out->width * roi_out->height / 2;
+}
+
+/* can the output be made from the last one, recomputing only the area? the module must work on a
+   sub roi on its own, like a tile, and nothing may need its whole output or input. */
+static gboolean _dev_pixelpipe_dirty_partial(dt_dev_pixelpipe_t *pipe,
+                                             dt_develop_t *dev,
+                                             dt_iop_module_t *module,
+                                             dt_dev_pixelpipe_iop_t *piece,
+                                             const dt_iop_roi_t *roi_in,
+                                             const dt_iop_roi_t *roi_out,
+                                             const dt_iop_buffer_dsc_t *previous,
+                                             const dt_iop_buffer_dsc_t *format,
+                                             const int overlap,
+                                             const int *const area)
+{
+  if(previous->channels != format->channels
+     || previous->datatype != format->datatype
+     || previous->cst != module->output_colorspace(module, pipe, piece)
+     || pipe->want_detail_mask
+     || (piece->request_histogram & DT_REQUEST_ON)
+     || _request_color_pick(pipe, dev, module)
+     || _transform_for_blend(module, piece))
+    return FALSE;
+
+  if(area[2] <= area[0] || area[3] <= area[1]) return TRUE;
+
+  const size_t width = MIN(roi_out->width, area[2] - area[0] + 2 * overlap);
+  const size_t height = MIN(roi_out->height, area[3] - area[1] + 2 * overlap);
+  return (module->local_edits
+          || (piece->process_tiling_ready && !(module->operation_tags() & IOP_TAG_DISTORT)))
+         && roi_in->scale == roi_out->scale
+         && width * height < (size_t)roi_out->width * roi_out->height / 2;
+}
+
+// tell the next module what changed and remember the output of the piece for the next run if it's in the cache
+static void _dev_pixelpipe_dirty_record(dt_dev_pixelpipe_t *pipe,
+                                        dt_dev_pixelpipe_iop_t *piece,
+                                        const uint64_t hash,
+                                        const uint64_t last_hash,
+                                        const dt_dev_pixelpipe_dirty_t *in,
+                                        const uint64_t key,
+                                        const int *const area,
+                                        const gboolean cached)
+{
+  if(area)
+    pipe->dirty = (dt_dev_pixelpipe_dirty_t){ .hash = hash, .base = last_hash,
+                                              .x = area[0], .y = area[1],
+                                              .width = area[2] - area[0], .height = area[3] - area[1] };
+  else
+    _dev_pixelpipe_dirty_reset(pipe, hash);
+
+  if(!cached) return;
+
+  piece->last_hash = hash;
+  piece->last_input = in->hash;
+  piece->last_params = piece->hash;
+  piece->last_blend = _dev_pixelpipe_blend_hash(piece);
+  piece->last_key = key;
+}
+
 static gboolean _dev_pixelpipe_process_rec(
                  dt_dev_pixelpipe_t *pipe,
                  dt_develop_t *dev,
@@ -1429,12 +1939,25 @@ static gboolean _dev_pixelpipe_process_rec(
 
     dt_print_pipe(DT_DEBUG_PIPE,
                   "pixelpipe data: from cache", pipe, module, &roi_in, roi_out, "\n");
+    _dev_pixelpipe_dirty_reset(pipe, hash);
     // we're done! as colorpicker/scopes only work on gamma iop
     // input -- which is unavailable via cache -- there's no need to
     // run these
     return FALSE;
   }
 
+  if(!pipe->nocache
+     && _dev_pixelpipe_from_darkroom(pipe, module, roi_out, pos, hash, bufsize, output, out_format))
+  {
+    if(dt_atomic_get_int(&pipe->shutdown))
+      return TRUE;
+
+    dt_print_pipe(DT_DEBUG_PIPE,
+                  "pixelpipe data: from darkroom", pipe, module, &roi_in, roi_out, "\n");
+    _dev_pixelpipe_dirty_reset(pipe, hash);
+    return FALSE;
+  }
+
   // 2) if history changed or exit event, abort processing?
   // preview pipe: abort on all but zoom events (same buffer anyways)
   if(dt_iop_breakpoint(dev, pipe)) return TRUE;
@@ -1509,6 +2032,8 @@ static gboolean _dev_pixelpipe_process_rec(
     dt_show_times_f(&start, "[dev_pixelpipe]",
                     "initing base buffer [%s]", dt_dev_pixelpipe_type_to_str(pipe->type));
 
+    _dev_pixelpipe_dirty_reset(pipe, hash);
+
     if(dt_atomic_get_int(&pipe->shutdown))
       return TRUE;
 
@@ -1532,6 +2057,12 @@ static gboolean _dev_pixelpipe_process_rec(
 
   piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
 
+  // consecutive point-to-point modules needing tiling might be cheaper as one tiled segment
+  dt_develop_tiling_segment_t segment;
+  if(dt_tiling_plan_segment(pipe, pieces, roi_out, &segment))
+    return _dev_pixelpipe_process_segment(pipe, dev, output, out_format, roi_out,
+                                          modules, pieces, pos, hash, bufsize, &segment);
+
   piece->processed_roi_in = roi_in;
   piece->processed_roi_out = *roi_out;
 
@@ -1540,6 +2071,10 @@ static gboolean _dev_pixelpipe_process_rec(
                                 g_list_previous(pieces), pos - 1))
     return TRUE;
 
+  // what changed in the input since the last run
+  const dt_dev_pixelpipe_dirty_t in_dirty = pipe->dirty;
+  _dev_pixelpipe_dirty_reset(pipe, hash);
+
   const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
 
   piece->dsc_out = piece->dsc_in = *input_format;
@@ -1554,6 +2089,17 @@ static gboolean _dev_pixelpipe_process_rec(
   if(dt_atomic_get_int(&pipe->shutdown))
     return TRUE;
 
+  // the last output of the piece, before its cacheline might be taken for the new one
+  const gboolean track_dirty = pipe->cache.entries > DT_PIPECACHE_MIN
+                               && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE
+                               && !pipe->nocache;
+  dt_iop_buffer_dsc_t previous_dsc = { 0 };
+  dt_iop_buffer_dsc_t *previous_pdsc = NULL;
+  const void *previous = track_dirty && piece->last_hash
+    ? dt_dev_pixelpipe_cache_peek(pipe, piece->last_hash, bufsize, &previous_pdsc)
+    : NULL;
+  if(previous) previous_dsc = *previous_pdsc;
+
   const gboolean important_out = module
       && (pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE)
       && (((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) && dt_iop_module_is(module->so, "colorout"))
@@ -1640,9 +2186,45 @@ static gboolean _dev_pixelpipe_process_rec(
   assert(tiling.factor > 0.0f);
   assert(tiling.factor_cl > 0.0f);
 
+  // the factor includes input and output buffers, the rest is scratch memory
+  // the module might take from the pipe's arena
+  dt_dev_pixelpipe_arena_expect
+    (pipe, fmaxf(tiling.factor - 2.0f, 0.0f)
+           * MAX((size_t)roi_in.width * roi_in.height * in_bpp, bufsize) + tiling.overhead);
+
   if(dt_atomic_get_int(&pipe->shutdown))
     return TRUE;
 
+  // recompute only what changed since the last run if possible
+  const uint64_t dirty_key = _dev_pixelpipe_dirty_key(pipe, &roi_in, roi_out);
+  GArray *edits = track_dirty && module->local_edits
+    ? module->local_edits(module, piece, roi_out)
+    : NULL;
+  if(edits) g_array_sort(edits, _local_edit_cmp);
+
+  int dirty_area[4] = { 0 };
+  const gboolean dirty_known =
+    track_dirty
+    && _dev_pixelpipe_dirty_area(module, piece, &in_dirty, edits, dirty_key,
+                                 &roi_in, roi_out, tiling.overlap, dirty_area);
+  const int *partial = NULL;
+  if(dirty_known && previous
+     && _dev_pixelpipe_dirty_partial(pipe, dev, module, piece, &roi_in, roi_out, &previous_dsc,
+                                     *out_format, tiling.overlap, dirty_area))
+  {
+    if(*output != previous) memcpy(*output, previous, bufsize);
+    partial = dirty_area;
+    dt_print_pipe(DT_DEBUG_PIPE,
+                  "pixelpipe dirty", pipe, module, &roi_in, roi_out, "area %d/%d - %d/%d\n",
+                  dirty_area[0], dirty_area[1], dirty_area[2], dirty_area[3]);
+  }
+
+  // nothing is known about the last output of the piece until the new one is done
+  const uint64_t last_hash = piece->last_hash;
+  piece->last_hash = 0;
+  if(piece->last_edits) g_array_free(piece->last_edits, TRUE);
+  piece->last_edits = edits;
+
 #ifdef HAVE_OPENCL
 
   // Fetch RGB working profile
@@ -1680,7 +2262,7 @@ static gboolean _dev_pixelpipe_process_rec(
     /* test for a possible opencl path after checking some module
        specific pre-requisites */
     gboolean possible_cl =
-      (module->process_cl && piece->process_cl_ready
+      (module->process_cl && piece->process_cl_ready && !partial
        && !((pipe->type & (DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2))
             && (module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL)));
 
@@ -2246,7 +2828,7 @@ static gboolean _dev_pixelpipe_process_rec(
         }
         if(_pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in, output,
                                      out_format,
-                                     roi_out, module, piece, &tiling, &pixelpipe_flow))
+                                     roi_out, module, piece, &tiling, &pixelpipe_flow, partial))
           return TRUE;
       }
 
@@ -2284,7 +2866,7 @@ static gboolean _dev_pixelpipe_process_rec(
 
       if(_pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in,
                                    output, out_format,
-                                   roi_out, module, piece, &tiling, &pixelpipe_flow))
+                                   roi_out, module, piece, &tiling, &pixelpipe_flow, partial))
         return TRUE;
     }
 
@@ -2299,13 +2881,13 @@ static gboolean _dev_pixelpipe_process_rec(
 
     if(_pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in,
                                  output, out_format, roi_out,
-                                 module, piece, &tiling, &pixelpipe_flow))
+                                 module, piece, &tiling, &pixelpipe_flow, partial))
       return TRUE;
   }
 #else // HAVE_OPENCL
   if(_pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in,
                                output, out_format, roi_out,
-                               module, piece, &tiling, &pixelpipe_flow))
+                               module, piece, &tiling, &pixelpipe_flow, partial))
     return TRUE;
 #endif // HAVE_OPENCL
 
@@ -2372,6 +2954,10 @@ static gboolean _dev_pixelpipe_process_rec(
     }
   }
 
+  _dev_pixelpipe_dirty_record(pipe, piece, hash, last_hash, &in_dirty, dirty_key,
+                              dirty_known ? dirty_area : NULL,
+                              track_dirty && !pipe->nocache && *cl_mem_output == NULL);
+
   // warn on NaN or infinity
 #ifndef _DEBUG
   if((darktable.unmuted & DT_DEBUG_NAN)
@@ -2775,6 +3361,7 @@ restart:
   }
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
+  dt_dev_pixelpipe_arena_trim(pipe);
   dt_dev_pixelpipe_cache_report(pipe);
 
   dt_print_pipe(DT_DEBUG_PIPE, "pixelpipe finished", pipe, NULL, &roi, &roi, "\n\n");
@@ -65,11 +65,20 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_roi_t processed_roi_in, processed_roi_out; // the actual roi that was used for processing the piece
   gboolean process_cl_ready;       // set this to FALSE in commit_params to temporarily disable the use of process_cl
   gboolean process_tiling_ready;   // set this to FALSE in commit_params to temporarily disable tiling
+  gboolean pipe_dependent;         // output differs from other pipe types, commit_params can change it
 
   // the following are used internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
 
   GHashTable *raster_masks;
+
+  // the last output computed for this piece, used to recompute only what changed
+  uint64_t last_hash;   // cache hash of the output
+  uint64_t last_input;  // cache hash of the input it was computed from
+  uint64_t last_params; // piece hash at that time
+  uint64_t last_blend;  // hash of the blend params at that time
+  uint64_t last_key;    // rois and pipe settings it was computed with
+  GArray *last_edits;   // the module's local edits at that time, sorted by hash, or NULL
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -89,6 +98,18 @@ typedef struct dt_dev_detail_mask_t
   float *data;
 } dt_dev_detail_mask_t;
 
+/**
+ * relates the buffer just returned by a stage of the pipe to an earlier output of the same stage: they
+ * only differ inside the given area. if nothing is known about the earlier outputs base is the hash of
+ * the buffer itself and the area is empty.
+ */
+typedef struct dt_dev_pixelpipe_dirty_t
+{
+  uint64_t hash;           // cache hash of the buffer
+  uint64_t base;           // cache hash of the earlier output
+  int x, y, width, height; // the area that differs, in pixels of the buffer
+} dt_dev_pixelpipe_dirty_t;
+
 /**
  * this encapsulates the pixelpipe.
  * a develop module will need several of these:
@@ -183,6 +204,11 @@ typedef struct dt_dev_pixelpipe_t
   GList *forms;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
+  // rasterized drawn masks kept across runs and modules, see dt_masks_group_render_roi()
+  GList *mask_cache;
+  size_t mask_cache_size;
+  // what changed in the buffer last returned while processing
+  dt_dev_pixelpipe_dirty_t dirty;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
@@ -22,6 +22,7 @@
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/pixelpipe.h"
+#include "develop/pixelpipe_cache.h"
 
 #include <assert.h>
 #include <math.h>
@@ -569,60 +570,23 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
 }
 
 
-/* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
-static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
-                                        const void *const ivoid, void *const ovoid,
-                                        const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
-                                        const int in_bpp)
+/* tile dimensions and aligned overlap of the point-to-point algorithm for a full image of
+   full_width x full_height, given the module's requirements and the memory available on top
+   of the full input and output buffers. */
+static void _ptp_tile_dimensions(const dt_develop_tiling_t *tiling, const int full_width,
+                                 const int full_height, const int max_bpp, const float available,
+                                 int *tile_width, int *tile_height, int *tile_overlap)
 {
-  void *input = NULL;
-  void *output = NULL;
-  dt_print(DT_DEBUG_TILING,
-           "[default_process_tiling_ptp] [%s] **** tiling module '%s%s' for image with size %dx%d --> %dx%d\n",
-           dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self),
-           roi_in->width, roi_in->height, roi_out->width, roi_out->height);
-  dt_iop_buffer_dsc_t dsc;
-  self->output_format(self, piece->pipe, piece, &dsc);
-  const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
-
-  const int ipitch = roi_in->width * in_bpp;
-  const int opitch = roi_out->width * out_bpp;
-  const int max_bpp = _max(in_bpp, out_bpp);
-
-  /* get tiling requirements of module */
-  dt_develop_tiling_t tiling = { 0 };
-  self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
-
-  /* tiling really does not make sense in these cases. standard process() is not better or worse than we are
-   */
-  if((tiling.factor < 2.2f)
-     && (tiling.overhead < 0.2f * roi_in->width * roi_in->height * max_bpp))
-  {
-    dt_print(DT_DEBUG_TILING,
-             "[default_process_tiling_ptp] [%s]  no need to use tiling for module '%s%s' "
-             "as no real memory saving to be expected\n",
-             dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self));
-    goto fallback;
-  }
-
-  /* calculate optimal size of tiles */
-  float available = dt_get_available_mem();
-  assert(available >= 500.0f * 1024.0f * 1024.0f);
-  /* correct for size of ivoid and ovoid which are needed on top of tiling */
-  available = fmaxf(available - ((float)roi_out->width * roi_out->height * out_bpp)
-                   - ((float)roi_in->width * roi_in->height * in_bpp) - tiling.overhead,
-                   0);
-
-  /* we ignore the above value if singlebuffer_limit (is defined and) is higher than available/tiling.factor.
+  /* we ignore available if singlebuffer_limit (is defined and) is higher than available/tiling.factor.
      this will mainly allow tiling for modules with high and "unpredictable" memory demand which is
      reflected in high values of tiling.factor (take bilateral noise reduction as an example). */
   float singlebuffer = dt_get_singlebuffer_mem();
-  const float factor = fmaxf(tiling.factor, 1.0f);
-  const float maxbuf = fmaxf(tiling.maxbuf, 1.0f);
+  const float factor = fmaxf(tiling->factor, 1.0f);
+  const float maxbuf = fmaxf(tiling->maxbuf, 1.0f);
   singlebuffer = fmaxf(available / factor, singlebuffer);
 
-  int width = roi_in->width;
-  int height = roi_in->height;
+  int width = full_width;
+  int height = full_height;
 
   /* shrink tile size in case it would exceed singlebuffer size */
   if((float)width * height * max_bpp * maxbuf > singlebuffer)
@@ -643,19 +607,11 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
       width = floorf(width * sqrtf(scale));
       height = floorf(height * sqrtf(scale));
     }
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_ptp] buffer exceeds singlebuffer, corrected to %dx%d\n",
-             width, height);
   }
 
   /* make sure we have a reasonably effective tile dimension. if not try square tiles */
-  if(3 * tiling.overlap > width || 3 * tiling.overlap > height)
-  {
+  if(3 * tiling->overlap > width || 3 * tiling->overlap > height)
     width = height = floorf(sqrtf((float)width * height));
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_roi] use squares because of overlap, corrected to %dx%d\n",
-             width, height);
-  }
 
   /* Alignment rules: we need to make sure that alignment requirements of module are fulfilled.
      Modules will report alignment requirements via xalign and yalign within tiling_callback().
@@ -664,17 +620,70 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
      We guarantee alignment by selecting image width/height and overlap accordingly. For a tile width/height
      that is identical to image width/height no special alignment is needed. */
 
-  const unsigned int xyalign = _lcm(tiling.xalign, tiling.yalign);
+  const unsigned int xyalign = _lcm(tiling->xalign, tiling->yalign);
 
   assert(xyalign != 0);
 
   /* properly align tile width and height by making them smaller if needed */
-  if(width < roi_in->width) width = (width / xyalign) * xyalign;
-  if(height < roi_in->height) height = (height / xyalign) * xyalign;
+  if(width < full_width) width = (width / xyalign) * xyalign;
+  if(height < full_height) height = (height / xyalign) * xyalign;
 
   /* also make sure that overlap follows alignment rules by making it wider when needed */
-  const int overlap = tiling.overlap % xyalign != 0 ? (tiling.overlap / xyalign + 1) * xyalign
-                                                    : tiling.overlap;
+  *tile_overlap = tiling->overlap % xyalign != 0 ? (tiling->overlap / xyalign + 1) * xyalign
+                                                 : tiling->overlap;
+  *tile_width = width;
+  *tile_height = height;
+}
+
+/* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
+static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                        const void *const ivoid, void *const ovoid,
+                                        const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                                        const int in_bpp)
+{
+  void *input = NULL;
+  void *output = NULL;
+  dt_print(DT_DEBUG_TILING,
+           "[default_process_tiling_ptp] [%s] **** tiling module '%s%s' for image with size %dx%d --> %dx%d\n",
+           dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self),
+           roi_in->width, roi_in->height, roi_out->width, roi_out->height);
+  dt_iop_buffer_dsc_t dsc;
+  self->output_format(self, piece->pipe, piece, &dsc);
+  const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
+
+  const int ipitch = roi_in->width * in_bpp;
+  const int opitch = roi_out->width * out_bpp;
+  const int max_bpp = _max(in_bpp, out_bpp);
+
+  /* get tiling requirements of module */
+  dt_develop_tiling_t tiling = { 0 };
+  self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
+
+  /* tiling really does not make sense in these cases. standard process() is not better or worse than we are
+   */
+  if((tiling.factor < 2.2f)
+     && (tiling.overhead < 0.2f * roi_in->width * roi_in->height * max_bpp))
+  {
+    dt_print(DT_DEBUG_TILING,
+             "[default_process_tiling_ptp] [%s]  no need to use tiling for module '%s%s' "
+             "as no real memory saving to be expected\n",
+             dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self));
+    goto fallback;
+  }
+
+  /* calculate optimal size of tiles */
+  float available = dt_get_available_mem();
+  assert(available >= 500.0f * 1024.0f * 1024.0f);
+  /* correct for size of ivoid and ovoid which are needed on top of tiling */
+  available = fmaxf(available - ((float)roi_out->width * roi_out->height * out_bpp)
+                   - ((float)roi_in->width * roi_in->height * in_bpp) - tiling.overhead,
+                   0);
+
+  int width = 0;
+  int height = 0;
+  int overlap = 0;
+  _ptp_tile_dimensions(&tiling, roi_in->width, roi_in->height, max_bpp, available,
+                       &width, &height, &overlap);
 
   /* calculate effective tile size */
   const int tile_wd = width - 2 * overlap > 0 ? width - 2 * overlap : 1;
@@ -1202,6 +1211,434 @@ void default_process_tiling(struct dt_iop_module_t *self, struct dt_dev_pixelpip
   return;
 }
 
+/* relative cost of moving a pixel between a full buffer and a tile buffer, compared to
+   processing it in a module that needs tiling */
+#define SEGMENT_COPY_COST 0.25f
+
+/* pixels processed along one axis by _default_process_tiling_ptp(), matching its tile loop */
+static size_t _ptp_axis_pixels(const int full, const int size, const int overlap)
+{
+  if(size >= full) return full;
+
+  const int step = _max(size - 2 * overlap, 1);
+  const int tiles = ceilf(full / (float)step);
+  size_t sum = 0;
+  for(int t = 0; t < tiles; t++)
+  {
+    const int len = t * step + size > full ? full - t * step : size;
+    if(len <= 2 * overlap && t > 0) continue;
+    sum += len;
+  }
+  return sum;
+}
+
+/* pixels processed along one axis by a segment module whose input is reduced by shrink on the
+   inner sides of each tile, matching the tile loop of dt_tiling_process_segment() */
+static size_t _segment_axis_pixels(const int full, const int size, const int overlap, const int shrink,
+                                   int *tiles)
+{
+  size_t sum = 0;
+  *tiles = 0;
+  for(int x = 0;; x += size - 2 * overlap)
+  {
+    const int len = _min(size, full - x);
+    sum += len - (x > 0 ? shrink : 0) - (x + len < full ? shrink : 0);
+    (*tiles)++;
+    if(x + len >= full) break;
+  }
+  return sum;
+}
+
+static inline int _align_overlap(const int overlap, const int align)
+{
+  return overlap % align != 0 ? (overlap / align + 1) * align : overlap;
+}
+
+/* can the module be part of a fused segment? it has to work point-to-point on 4 channel float
+   data and must not need anything but its own input tile. */
+static gboolean _segment_member(struct dt_dev_pixelpipe_t *pipe, struct dt_dev_pixelpipe_iop_t *piece,
+                                const dt_iop_roi_t *const roi)
+{
+  struct dt_iop_module_t *module = piece->module;
+  if(!piece->process_tiling_ready
+     || module->process_tiling != default_process_tiling
+     || !(module->flags() & IOP_FLAGS_ALLOW_TILING)
+     || (module->flags() & IOP_FLAGS_TILING_FULL_ROI)
+     || (module->operation_tags() & IOP_TAG_DISTORT)
+     || (piece->request_histogram & DT_REQUEST_ON))
+    return FALSE;
+
+  // blending works on the full input and output buffers
+  if(piece->blendop_data
+     && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+
+  if(module->input_colorspace(module, pipe, piece) == IOP_CS_RAW
+     || module->output_colorspace(module, pipe, piece) == IOP_CS_RAW)
+    return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  if(memcmp(&roi_in, roi, sizeof(dt_iop_roi_t))) return FALSE;
+
+  dt_iop_buffer_dsc_t dsc = pipe->dsc;
+  module->output_format(module, pipe, piece, &dsc);
+  return dt_iop_buffer_dsc_to_bpp(&dsc) == 4 * sizeof(float);
+}
+
+gboolean dt_tiling_plan_segment(struct dt_dev_pixelpipe_t *pipe, GList *pieces, const dt_iop_roi_t *const roi,
+                                dt_develop_tiling_segment_t *segment)
+{
+  // other pipes rather keep the intermediate results in their cache. fused tiles are
+  // processed on CPU only.
+  if(!pieces
+     || !(pipe->type & DT_DEV_PIXELPIPE_EXPORT)
+     || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE
+     || (pipe->opencl_enabled && pipe->devid >= 0))
+    return FALSE;
+
+  struct dt_dev_pixelpipe_iop_t *last = (struct dt_dev_pixelpipe_iop_t *)pieces->data;
+  if(!last->enabled || !_segment_member(pipe, last, roi)) return FALSE;
+
+  const int bpp = 4 * sizeof(float);
+  const float area = (float)roi->width * roi->height;
+  /* correct for size of the full input and output buffers which are needed on top of tiling */
+  const float available = fmaxf((float)dt_get_available_mem() - 2.0f * area * bpp, 0.0f);
+
+  /* collect candidates backwards from the last module together with the cost of tiling
+     each of them on its own */
+  struct dt_dev_pixelpipe_iop_t *member[DT_TILING_SEGMENT_MAX];
+  dt_develop_tiling_t tiling[DT_TILING_SEGMENT_MAX];
+  float processed[DT_TILING_SEGMENT_MAX];
+  float cost[DT_TILING_SEGMENT_MAX];
+  int steps[DT_TILING_SEGMENT_MAX];
+  int tiled[DT_TILING_SEGMENT_MAX];
+
+  int n = 0;
+  int step = 0;
+  for(GList *l = pieces; l && n < DT_TILING_SEGMENT_MAX; l = g_list_previous(l))
+  {
+    struct dt_dev_pixelpipe_iop_t *piece = (struct dt_dev_pixelpipe_iop_t *)l->data;
+    step++;
+    if(!piece->enabled) continue;
+    if(!_segment_member(pipe, piece, roi)) break;
+
+    dt_develop_tiling_t *t = &tiling[n];
+    *t = (dt_develop_tiling_t){ 0 };
+    piece->module->tiling_callback(piece->module, piece, roi, roi, t);
+
+    const gboolean no_saving = t->factor < 2.2f && t->overhead < 0.2f * area * bpp;
+    tiled[n] = !no_saving
+               && !dt_tiling_piece_fits_host_memory(roi->width, roi->height, bpp, t->factor, t->overhead);
+    if(tiled[n])
+    {
+      int width = 0, height = 0, overlap = 0;
+      _ptp_tile_dimensions(t, roi->width, roi->height, bpp, fmaxf(available - t->overhead, 0.0f),
+                           &width, &height, &overlap);
+      processed[n] = (float)_ptp_axis_pixels(roi->width, width, overlap)
+                     * _ptp_axis_pixels(roi->height, height, overlap);
+      cost[n] = processed[n] + SEGMENT_COPY_COST * (processed[n] + area);
+    }
+    else
+      processed[n] = cost[n] = area;
+
+    member[n] = piece;
+    steps[n] = step;
+    n++;
+  }
+
+  /* try all segments ending at the last module and keep the one saving most work */
+  float best_gain = 0.0f;
+  float best_fused = 0.0f;
+  float best_independent = 0.0f;
+  int best_count = 0;
+  int best_tiles = 0;
+  int any_tiled = tiled[0];
+  dt_develop_tiling_segment_t candidate = { 0 };
+
+  for(int c = 2; c <= n; c++)
+  {
+    any_tiled |= tiled[c - 1];
+    if(!any_tiled) continue;
+
+    dt_develop_tiling_t sum = { 0 };
+    sum.xalign = sum.yalign = 1;
+    for(int i = 0; i < c; i++)
+    {
+      sum.factor = fmaxf(sum.factor, tiling[i].factor);
+      sum.maxbuf = fmaxf(sum.maxbuf, tiling[i].maxbuf);
+      sum.overhead = MAX(sum.overhead, tiling[i].overhead);
+      sum.xalign = _lcm(sum.xalign, tiling[i].xalign);
+      sum.yalign = _lcm(sum.yalign, tiling[i].yalign);
+    }
+    const unsigned int xyalign = _lcm(sum.xalign, sum.yalign);
+
+    // processing order is the reverse of the collection order
+    candidate.count = c;
+    candidate.steps = steps[c - 1];
+    candidate.overlap = 0;
+    for(int p = 0; p < c; p++)
+    {
+      candidate.overlaps[p] = _align_overlap(tiling[c - 1 - p].overlap, xyalign);
+      candidate.overlap += candidate.overlaps[p];
+    }
+    sum.overlap = candidate.overlap;
+
+    int overlap = 0;
+    _ptp_tile_dimensions(&sum, roi->width, roi->height, bpp, fmaxf(available - sum.overhead, 0.0f),
+                         &candidate.width, &candidate.height, &overlap);
+    if((candidate.width < roi->width && candidate.width <= 2 * candidate.overlap)
+       || (candidate.height < roi->height && candidate.height <= 2 * candidate.overlap))
+      continue;
+
+    float fused_processed = 0.0f;
+    float moved = 2.0f * area;
+    int tiles_x = 0, tiles_y = 0;
+    int shrink = 0;
+    for(int p = 0; p < c; p++)
+    {
+      const float pixels
+          = (float)_segment_axis_pixels(roi->width, candidate.width, candidate.overlap, shrink, &tiles_x)
+            * _segment_axis_pixels(roi->height, candidate.height, candidate.overlap, shrink, &tiles_y);
+      fused_processed += pixels;
+      if(shrink) moved += pixels;
+      shrink += candidate.overlaps[p];
+    }
+    if(tiles_x * tiles_y > _maximum_number_tiles()) continue;
+
+    float independent = 0.0f;
+    for(int i = 0; i < c; i++) independent += cost[i];
+    const float fused = fused_processed + SEGMENT_COPY_COST * moved;
+
+    if(independent - fused > best_gain)
+    {
+      best_gain = independent - fused;
+      best_fused = fused_processed;
+      best_independent = 0.0f;
+      for(int i = 0; i < c; i++) best_independent += processed[i];
+      best_count = c;
+      best_tiles = tiles_x * tiles_y;
+      *segment = candidate;
+    }
+  }
+
+  if(best_count)
+  {
+    struct dt_iop_module_t *first = member[best_count - 1]->module;
+    dt_print(DT_DEBUG_TILING,
+             "[tiling_plan_segment] [%s] fuse %d modules '%s%s' .. '%s%s': %d tiles of %dx%d with accumulated"
+             " overlap %d. overlap overhead %.1f%% fused, %.1f%% tiled one by one\n",
+             dt_dev_pixelpipe_type_to_str(pipe->type), best_count, first->op, dt_iop_get_instance_id(first),
+             last->module->op, dt_iop_get_instance_id(last->module), best_tiles, segment->width,
+             segment->height, segment->overlap, 100.0f * (best_fused / (best_count * area) - 1.0f),
+             100.0f * (best_independent / (best_count * area) - 1.0f));
+    return TRUE;
+  }
+
+  if(tiled[0])
+    dt_print(DT_DEBUG_TILING,
+             "[tiling_plan_segment] [%s] tile '%s%s' on its own, overlap overhead %.1f%%\n",
+             dt_dev_pixelpipe_type_to_str(pipe->type), last->module->op,
+             dt_iop_get_instance_id(last->module), 100.0f * (processed[0] / area - 1.0f));
+  return FALSE;
+}
+
+/* copies height rows of width 4 channel pixels, strides are given in pixels */
+static void _segment_copy_rect(float *const out, const int out_stride, const float *const in,
+                               const int in_stride, const int width, const int height)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(out, out_stride, in, in_stride, width, height) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+    memcpy(out + (size_t)4 * j * out_stride, in + (size_t)4 * j * in_stride, sizeof(float) * 4 * width);
+}
+
+/* crops the tile buffer holding the region at cx, cy with size cw x ch in place to the
+   contained region at x, y with size w x h */
+static void _segment_crop(float *const buf, int *cx, int *cy, int *cw, int *ch,
+                          const int x, const int y, const int w, const int h)
+{
+  if(x == *cx && y == *cy && w == *cw && h == *ch) return;
+
+  // rows only move towards the start of the buffer, so forward order is safe
+  for(int j = 0; j < h; j++)
+    memmove(buf + (size_t)4 * j * w, buf + (size_t)4 * ((size_t)(y - *cy + j) * *cw + (x - *cx)),
+            sizeof(float) * 4 * w);
+  *cx = x;
+  *cy = y;
+  *cw = w;
+  *ch = h;
+}
+
+/* run the segment's modules one after the other on the full buffers, using ivoid as scratch.
+   this only happens if the tile buffers can't be allocated. */
+static gboolean _process_segment_untiled(struct dt_dev_pixelpipe_t *pipe,
+                                         struct dt_dev_pixelpipe_iop_t **member, const int n,
+                                         void *const ivoid, void *const ovoid,
+                                         const dt_iop_roi_t *const roi, dt_iop_buffer_dsc_t *dsc)
+{
+  const int bpp = 4 * sizeof(float);
+  const dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_work_profile_info(pipe);
+  dt_iop_buffer_dsc_t format = *dsc;
+
+  for(int k = 0; k < n; k++)
+  {
+    if(dt_atomic_get_int(&pipe->shutdown)) return TRUE;
+
+    struct dt_dev_pixelpipe_iop_t *piece = member[k];
+    struct dt_iop_module_t *module = piece->module;
+    float *const in = (k & 1) ? ovoid : ivoid;
+    float *const out = (k & 1) ? ivoid : ovoid;
+
+    piece->dsc_in = piece->dsc_out = format;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    pipe->dsc = piece->dsc_out;
+    dt_ioppr_transform_image_colorspace(module, in, in, roi->width, roi->height, format.cst,
+                                        module->input_colorspace(module, pipe, piece), &format.cst,
+                                        work_profile);
+
+    dt_develop_tiling_t tiling = { 0 };
+    module->tiling_callback(module, piece, roi, roi, &tiling);
+    if(dt_tiling_piece_fits_host_memory(roi->width, roi->height, bpp, tiling.factor, tiling.overhead))
+      module->process(module, piece, in, out, roi, roi);
+    else
+      module->process_tiling(module, piece, in, out, roi, roi, bpp);
+
+    pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+    format = piece->dsc_out = pipe->dsc;
+  }
+
+  if(!(n & 1)) memcpy(ovoid, ivoid, (size_t)roi->width * roi->height * bpp);
+  dt_dev_pixelpipe_invalidate_cacheline(pipe, ivoid);
+  *dsc = format;
+  return FALSE;
+}
+
+gboolean dt_tiling_process_segment(struct dt_dev_pixelpipe_t *pipe, GList *pieces,
+                                   const dt_develop_tiling_segment_t *segment, void *const ivoid,
+                                   void *const ovoid, const dt_iop_roi_t *const roi, dt_iop_buffer_dsc_t *dsc)
+{
+  const int bpp = 4 * sizeof(float);
+  if(dt_iop_buffer_dsc_to_bpp(dsc) != bpp)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[tiling_process_segment] [%s] unexpected input format with %zu bytes per pixel\n",
+             dt_dev_pixelpipe_type_to_str(pipe->type), dt_iop_buffer_dsc_to_bpp(dsc));
+    return TRUE;
+  }
+
+  // modules of the segment in processing order
+  struct dt_dev_pixelpipe_iop_t *member[DT_TILING_SEGMENT_MAX];
+  const int n = segment->count;
+  int k = n;
+  GList *l = pieces;
+  for(int s = 0; s < segment->steps && l; s++, l = g_list_previous(l))
+  {
+    struct dt_dev_pixelpipe_iop_t *piece = (struct dt_dev_pixelpipe_iop_t *)l->data;
+    if(piece->enabled && k > 0) member[--k] = piece;
+    piece->processed_roi_in = piece->processed_roi_out = *roi;
+  }
+  if(k != 0) return TRUE;
+
+  const int width = roi->width;
+  const int height = roi->height;
+  const int tile_width = _min(segment->width, width);
+  const int tile_height = _min(segment->height, height);
+  const int overlap = segment->overlap;
+
+  float *buf[2] = { dt_alloc_align_float((size_t)4 * tile_width * tile_height),
+                    dt_alloc_align_float((size_t)4 * tile_width * tile_height) };
+  if(!buf[0] || !buf[1])
+  {
+    if(buf[0]) dt_free_align(buf[0]);
+    if(buf[1]) dt_free_align(buf[1]);
+    dt_print(DT_DEBUG_TILING,
+             "[tiling_process_segment] [%s] could not alloc tile buffers, processing modules one by one\n",
+             dt_dev_pixelpipe_type_to_str(pipe->type));
+    return _process_segment_untiled(pipe, member, n, ivoid, ovoid, roi, dsc);
+  }
+
+  const dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_work_profile_info(pipe);
+  const dt_iop_buffer_dsc_t start = *dsc;
+  dt_iop_buffer_dsc_t format = start;
+  gboolean shutdown = FALSE;
+
+  pipe->tiling = TRUE;
+  for(int y = 0; !shutdown; y += tile_height - 2 * overlap)
+  {
+    const int ht = _min(tile_height, height - y);
+    for(int x = 0; !shutdown; x += tile_width - 2 * overlap)
+    {
+      const int wd = _min(tile_width, width - x);
+      dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
+               "[tiling_process_segment] [%s] tile with %dx%d at origin [%d,%d]\n",
+               dt_dev_pixelpipe_type_to_str(pipe->type), wd, ht, x, y);
+
+      _segment_copy_rect(buf[0], wd, (const float *)ivoid + (size_t)4 * ((size_t)y * width + x), width,
+                         wd, ht);
+
+      /* every module starts from the format of the segment input, as in the ptp tiling */
+      format = start;
+      int cur = 0;
+      int cx = x, cy = y, cw = wd, ch = ht;
+      int shrink = 0;
+      for(int m = 0; m < n; m++)
+      {
+        if(dt_atomic_get_int(&pipe->shutdown))
+        {
+          shutdown = TRUE;
+          break;
+        }
+
+        /* drop the border the previous modules could not compute correctly */
+        const int left = x > 0 ? shrink : 0;
+        const int right = x + wd < width ? shrink : 0;
+        const int top = y > 0 ? shrink : 0;
+        const int bottom = y + ht < height ? shrink : 0;
+        _segment_crop(buf[cur], &cx, &cy, &cw, &ch, x + left, y + top, wd - left - right, ht - top - bottom);
+
+        struct dt_dev_pixelpipe_iop_t *piece = member[m];
+        struct dt_iop_module_t *module = piece->module;
+        piece->dsc_in = piece->dsc_out = format;
+        module->output_format(module, pipe, piece, &piece->dsc_out);
+        pipe->dsc = piece->dsc_out;
+        dt_ioppr_transform_image_colorspace(module, buf[cur], buf[cur], cw, ch, format.cst,
+                                            module->input_colorspace(module, pipe, piece), &format.cst,
+                                            work_profile);
+
+        const dt_iop_roi_t troi = { roi->x + cx, roi->y + cy, cw, ch, roi->scale };
+        module->process(module, piece, buf[cur], buf[!cur], &troi, &troi);
+
+        pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+        format = piece->dsc_out = pipe->dsc;
+        cur = !cur;
+        shrink += segment->overlaps[m];
+      }
+      if(shutdown) break;
+
+      /* copy the good part of the tile to the output */
+      const int left = x > 0 ? overlap : 0;
+      const int right = x + wd < width ? overlap : 0;
+      const int top = y > 0 ? overlap : 0;
+      const int bottom = y + ht < height ? overlap : 0;
+      _segment_copy_rect((float *)ovoid + (size_t)4 * ((size_t)(y + top) * width + x + left), width,
+                         buf[cur] + (size_t)4 * ((size_t)(y + top - cy) * cw + (x + left - cx)), cw,
+                         wd - left - right, ht - top - bottom);
+
+      if(x + wd >= width) break;
+    }
+    if(y + ht >= height) break;
+  }
+  pipe->tiling = FALSE;
+
+  dt_free_align(buf[0]);
+  dt_free_align(buf[1]);
+  *dsc = format;
+  return shutdown;
+}
+
 float dt_tiling_estimate_cpumem(struct dt_develop_tiling_t *tiling, struct dt_dev_pixelpipe_iop_t *piece,
                                         const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                                         const int max_bpp)
@@ -43,6 +43,27 @@ typedef struct dt_develop_tiling_t
   unsigned yalign;
 } dt_develop_tiling_t;
 
+/** maximum number of modules fused into one tiled segment */
+#define DT_TILING_SEGMENT_MAX 16
+
+/** a run of consecutive point-to-point modules tiled as a whole: each tile passes through
+    all modules of the segment before the next tile is read. the overlaps of the modules
+    accumulate, the intermediate results never hit the pixelpipe cache. */
+typedef struct dt_develop_tiling_segment_t
+{
+  /** number of enabled modules in the segment */
+  int count;
+  /** number of pipe nodes spanned, including disabled modules */
+  int steps;
+  /** tile dimensions including the accumulated overlap */
+  int width;
+  int height;
+  /** accumulated overlap of all modules */
+  int overlap;
+  /** aligned overlap of each module in processing order */
+  int overlaps[DT_TILING_SEGMENT_MAX];
+} dt_develop_tiling_segment_t;
+
 int default_process_tiling_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                               const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
                               const dt_iop_roi_t *const roi_out, const int bpp);
@@ -71,6 +92,17 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
                      const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
                      struct dt_develop_tiling_t *tiling);
 
+/** plans a fused segment ending at the pipe node in pieces, working on roi. returns TRUE if
+    tiling the segment as a whole needs less work than tiling its modules one by one. */
+gboolean dt_tiling_plan_segment(struct dt_dev_pixelpipe_t *pipe, GList *pieces, const dt_iop_roi_t *const roi,
+                                dt_develop_tiling_segment_t *segment);
+
+/** processes a planned segment ending at the pipe node in pieces. dsc describes ivoid on input
+    and ovoid on output. ivoid may be used as scratch buffer. returns TRUE on error or shutdown. */
+gboolean dt_tiling_process_segment(struct dt_dev_pixelpipe_t *pipe, GList *pieces,
+                                   const dt_develop_tiling_segment_t *segment, void *const ivoid,
+                                   void *const ovoid, const dt_iop_roi_t *const roi, dt_iop_buffer_dsc_t *dsc);
+
 gboolean dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, const unsigned bpp,
                                      const float factor, const size_t overhead);
 
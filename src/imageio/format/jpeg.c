@@ -28,9 +28,11 @@
 #include "imageio/imageio_module.h"
 #include "imageio/format/imageio_format_api.h"
 #include <inttypes.h>
+#include <limits.h>
 #include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 // this fixes a rather annoying, long time bug in libjpeg :(
 #undef HAVE_STDLIB_H
 #undef HAVE_STDDEF_H
@@ -157,6 +159,448 @@ static void write_icc_profile(j_compress_ptr cinfo, const JOCTET *icc_data_ptr,
 #undef MAX_SEQ_NO
 
 
+// encoder settings shared by the serial and the banded writer
+static void _set_compress_params(j_compress_ptr cinfo, const int quality)
+{
+  jpeg_set_defaults(cinfo);
+  jpeg_set_quality(cinfo, quality, TRUE);
+  if(quality > 90) cinfo->comp_info[0].v_samp_factor = 1;
+  if(quality > 92) cinfo->comp_info[0].h_samp_factor = 1;
+  if(quality > 95) cinfo->dct_method = JDCT_FLOAT;
+  if(quality < 50) cinfo->dct_method = JDCT_IFAST;
+  if(quality < 80) cinfo->smoothing_factor = 20;
+  if(quality < 60) cinfo->smoothing_factor = 40;
+  if(quality < 40) cinfo->smoothing_factor = 60;
+  cinfo->optimize_coding = 1;
+
+  const int resolution = dt_conf_get_int("metadata/resolution");
+  cinfo->density_unit = 1;
+  cinfo->X_density = resolution;
+  cinfo->Y_density = resolution;
+}
+
+#ifdef MEM_SRCDST_SUPPORTED
+
+/*
+ * Banded encoder for large images: the image is cut into horizontal bands of whole MCU rows,
+ * each band being exactly one restart interval. The bands are encoded on separate threads,
+ * their quantized coefficients are read back to gather the symbol statistics, and one set of
+ * optimal Huffman tables is built from the merged statistics. Each band is then entropy coded
+ * again with these tables, and the entropy coded segments are joined with RST markers into
+ * one baseline JPEG.
+ */
+
+// natural order of the coefficients in zigzag sequence
+static const int _jpeg_zigzag[DCTSIZE2] =
+{
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+typedef struct _jpeg_band_t
+{
+  int row;                // first image row
+  int height;
+  unsigned char *coded;   // encoded band, standalone jpeg
+  unsigned long coded_size;
+  long dc_freq[NUM_HUFF_TBLS][257];
+  long ac_freq[NUM_HUFF_TBLS][257];
+  gboolean failed;
+} _jpeg_band_t;
+
+static inline int _jpeg_nbits(int v)
+{
+  v = abs(v);
+  int nbits = 0;
+  while(v)
+  {
+    nbits++;
+    v >>= 1;
+  }
+  return nbits;
+}
+
+// gather the huffman symbol statistics of a band from its quantized coefficients, in the
+// order the entropy coder visits the blocks of an interleaved scan
+static void _jpeg_count_symbols(j_decompress_ptr dinfo, jvirt_barray_ptr *coefs, _jpeg_band_t *band)
+{
+  const int hmax = dinfo->max_h_samp_factor;
+  const int vmax = dinfo->max_v_samp_factor;
+  const int mcus_per_row = (dinfo->image_width + 8 * hmax - 1) / (8 * hmax);
+  const int mcu_rows = (dinfo->image_height + 8 * vmax - 1) / (8 * vmax);
+  int last_dc[MAX_COMPONENTS] = { 0 };
+
+  for(int mrow = 0; mrow < mcu_rows; mrow++)
+  {
+    JBLOCKARRAY rows[MAX_COMPONENTS];
+    for(int ci = 0; ci < dinfo->num_components; ci++)
+    {
+      const jpeg_component_info *comp = dinfo->comp_info + ci;
+      rows[ci] = (*dinfo->mem->access_virt_barray)((j_common_ptr)dinfo, coefs[ci],
+                                                    mrow * comp->v_samp_factor,
+                                                    comp->v_samp_factor, FALSE);
+    }
+    for(int mcol = 0; mcol < mcus_per_row; mcol++)
+      for(int ci = 0; ci < dinfo->num_components; ci++)
+      {
+        const jpeg_component_info *comp = dinfo->comp_info + ci;
+        long *dc_freq = band->dc_freq[comp->dc_tbl_no];
+        long *ac_freq = band->ac_freq[comp->ac_tbl_no];
+        for(int by = 0; by < comp->v_samp_factor; by++)
+          for(int bx = 0; bx < comp->h_samp_factor; bx++)
+          {
+            const JCOEF *block = rows[ci][by][mcol * comp->h_samp_factor + bx];
+            dc_freq[_jpeg_nbits(block[0] - last_dc[ci])]++;
+            last_dc[ci] = block[0];
+
+            int run = 0;
+            for(int k = 1; k < DCTSIZE2; k++)
+            {
+              const int v = block[_jpeg_zigzag[k]];
+              if(v == 0)
+              {
+                run++;
+                continue;
+              }
+              for(; run > 15; run -= 16) ac_freq[0xf0]++; // ZRL
+              ac_freq[(run << 4) + _jpeg_nbits(v)]++;
+              run = 0;
+            }
+            if(run > 0) ac_freq[0]++; // EOB
+          }
+      }
+  }
+}
+
+// optimal huffman table limited to 16 bit codes, see section K.2 of the JPEG standard.
+// this follows jpeg_gen_optimal_table(), which libjpeg doesn't export.
+static void _jpeg_optimal_table(JHUFF_TBL *htbl, long freq[257])
+{
+  UINT8 bits[33] = { 0 };
+  int codesize[257] = { 0 };
+  int others[257];
+  for(int i = 0; i < 257; i++) others[i] = -1;
+
+  // reserve one code point so that no code consists of all ones
+  freq[256] = 1;
+  for(;;)
+  {
+    int c1 = -1, c2 = -1;
+    long v = LONG_MAX;
+    for(int i = 0; i <= 256; i++)
+      if(freq[i] && freq[i] <= v)
+      {
+        v = freq[i];
+        c1 = i;
+      }
+    v = LONG_MAX;
+    for(int i = 0; i <= 256; i++)
+      if(freq[i] && freq[i] <= v && i != c1)
+      {
+        v = freq[i];
+        c2 = i;
+      }
+    if(c2 < 0) break;
+
+    freq[c1] += freq[c2];
+    freq[c2] = 0;
+    codesize[c1]++;
+    while(others[c1] >= 0)
+    {
+      c1 = others[c1];
+      codesize[c1]++;
+    }
+    others[c1] = c2;
+    codesize[c2]++;
+    while(others[c2] >= 0)
+    {
+      c2 = others[c2];
+      codesize[c2]++;
+    }
+  }
+
+  for(int i = 0; i <= 256; i++)
+    if(codesize[i]) bits[MIN(codesize[i], 32)]++;
+
+  int i = 32;
+  for(; i > 16; i--)
+    while(bits[i] > 0)
+    {
+      int j = i - 2;
+      while(bits[j] == 0) j--;
+      bits[i] -= 2;
+      bits[i - 1]++;
+      bits[j + 1] += 2;
+      bits[j]--;
+    }
+  while(bits[i] == 0) i--;
+  bits[i]--; // drop the reserved code point
+
+  memcpy(htbl->bits, bits, sizeof(htbl->bits));
+  int p = 0;
+  for(int len = 1; len <= 32; len++)
+    for(int j = 0; j <= 255; j++)
+      if(codesize[j] == len) htbl->huffval[p++] = (UINT8)j;
+  htbl->sent_table = FALSE;
+}
+
+static void _jpeg_pack_rows(const uint8_t *in, const int width, const int row, const int height, uint8_t *out)
+{
+  for(int j = 0; j < height; j++)
+  {
+    const uint8_t *buf = in + (size_t)(row + j) * width * 4;
+    uint8_t *o = out + (size_t)j * width * 3;
+    for(int i = 0; i < width; i++)
+      for(int k = 0; k < 3; k++) o[3 * i + k] = buf[4 * i + k];
+  }
+}
+
+// first pass: encode the band as a standalone image and gather its symbol statistics
+static void _jpeg_band_encode(const uint8_t *in, const int width, const int quality, _jpeg_band_t *band)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_decompress_struct dinfo;
+  struct dt_imageio_jpeg_error_mgr jerr;
+  uint8_t *rows = NULL;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  dinfo.err = cinfo.err;
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  jpeg_create_compress(&cinfo);
+  jpeg_create_decompress(&dinfo);
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    band->failed = TRUE;
+    goto cleanup;
+  }
+
+  rows = dt_alloc_align(64, sizeof(uint8_t) * 3 * width * band->height);
+  if(!rows)
+  {
+    band->failed = TRUE;
+    goto cleanup;
+  }
+  _jpeg_pack_rows(in, width, band->row, band->height, rows);
+
+  jpeg_mem_dest(&cinfo, &band->coded, &band->coded_size);
+  cinfo.image_width = width;
+  cinfo.image_height = band->height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  _set_compress_params(&cinfo, quality);
+  // the tables are replaced in the second pass anyways
+  cinfo.optimize_coding = 0;
+  jpeg_start_compress(&cinfo, TRUE);
+  while(cinfo.next_scanline < cinfo.image_height)
+  {
+    JSAMPROW row[1] = { rows + (size_t)cinfo.next_scanline * width * 3 };
+    jpeg_write_scanlines(&cinfo, row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+
+  jpeg_mem_src(&dinfo, band->coded, band->coded_size);
+  jpeg_read_header(&dinfo, TRUE);
+  jvirt_barray_ptr *coefs = jpeg_read_coefficients(&dinfo);
+  _jpeg_count_symbols(&dinfo, coefs, band);
+  jpeg_finish_decompress(&dinfo);
+
+cleanup:
+  jpeg_destroy_decompress(&dinfo);
+  jpeg_destroy_compress(&cinfo);
+  dt_free_align(rows);
+}
+
+// second pass: entropy code the band again with the merged tables, one restart interval
+static void _jpeg_band_recode(_jpeg_band_t *band,
+                              const JHUFF_TBL *const dc_tbl,
+                              const JHUFF_TBL *const ac_tbl,
+                              const gboolean *const tbl_used,
+                              const int restart_interval,
+                              const JOCTET *icc,
+                              const unsigned int icc_len)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_decompress_struct dinfo;
+  struct dt_imageio_jpeg_error_mgr jerr;
+  unsigned char *coded = NULL;
+  unsigned long coded_size = 0;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  dinfo.err = cinfo.err;
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  jpeg_create_compress(&cinfo);
+  jpeg_create_decompress(&dinfo);
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    band->failed = TRUE;
+    free(coded);
+    coded = NULL;
+    goto cleanup;
+  }
+
+  jpeg_mem_src(&dinfo, band->coded, band->coded_size);
+  jpeg_read_header(&dinfo, TRUE);
+  jvirt_barray_ptr *coefs = jpeg_read_coefficients(&dinfo);
+
+  jpeg_mem_dest(&cinfo, &coded, &coded_size);
+  jpeg_copy_critical_parameters(&dinfo, &cinfo);
+  cinfo.optimize_coding = FALSE;
+  cinfo.restart_interval = restart_interval;
+  for(int t = 0; t < NUM_HUFF_TBLS; t++)
+  {
+    if(!tbl_used[t]) continue;
+    if(!cinfo.dc_huff_tbl_ptrs[t]) cinfo.dc_huff_tbl_ptrs[t] = jpeg_alloc_huff_table((j_common_ptr)&cinfo);
+    if(!cinfo.ac_huff_tbl_ptrs[t]) cinfo.ac_huff_tbl_ptrs[t] = jpeg_alloc_huff_table((j_common_ptr)&cinfo);
+    *cinfo.dc_huff_tbl_ptrs[t] = dc_tbl[t];
+    *cinfo.ac_huff_tbl_ptrs[t] = ac_tbl[t];
+  }
+  jpeg_write_coefficients(&cinfo, coefs);
+  if(icc) write_icc_profile(&cinfo, icc, icc_len);
+  jpeg_finish_compress(&cinfo);
+  jpeg_finish_decompress(&dinfo);
+
+cleanup:
+  jpeg_destroy_decompress(&dinfo);
+  jpeg_destroy_compress(&cinfo);
+  free(band->coded);
+  band->coded = coded;
+  band->coded_size = coded_size;
+}
+
+// offset of the entropy coded data behind the SOS header, 0 if there is none
+static size_t _jpeg_scan_start(const unsigned char *buf, const size_t size, size_t *sof)
+{
+  size_t pos = 2; // SOI
+  while(pos + 4 <= size && buf[pos] == 0xff)
+  {
+    const int marker = buf[pos + 1];
+    const size_t len = (buf[pos + 2] << 8) | buf[pos + 3];
+    if(sof && marker >= 0xc0 && marker <= 0xc2) *sof = pos;
+    if(marker == 0xda) return pos + 2 + len;
+    pos += 2 + len;
+  }
+  return 0;
+}
+
+// returns -1 if the image is not suitable and nothing was written, 1 on errors
+static int _write_image_banded(const dt_imageio_jpeg_t *jpg,
+                               const char *filename,
+                               const uint8_t *in,
+                               const JOCTET *icc,
+                               const unsigned int icc_len)
+{
+  const int width = jpg->global.width;
+  const int height = jpg->global.height;
+  const int quality = jpg->quality;
+  // MCU size of the sampling chosen by _set_compress_params()
+  const int mcu_w = quality > 92 ? 8 : 16;
+  const int mcu_h = quality > 90 ? 8 : 16;
+  const int mcus_per_row = (width + mcu_w - 1) / mcu_w;
+  const int mcu_rows = (height + mcu_h - 1) / mcu_h;
+  const int nthreads = dt_get_num_threads();
+  // a band is one restart interval, which can't have more than 65535 MCUs
+  const int band_mcu_rows = MIN((mcu_rows + 2 * nthreads - 1) / (2 * nthreads), 65535 / mcus_per_row);
+  if(band_mcu_rows < 1) return -1;
+  const int band_rows = band_mcu_rows * mcu_h;
+  const int nbands = (height + band_rows - 1) / band_rows;
+  if(nbands < 2) return -1;
+
+  _jpeg_band_t *bands = calloc(nbands, sizeof(_jpeg_band_t));
+  if(!bands) return -1;
+  for(int b = 0; b < nbands; b++)
+  {
+    bands[b].row = b * band_rows;
+    bands[b].height = MIN(band_rows, height - bands[b].row);
+  }
+
+  dt_times_t start;
+  dt_get_perf_times(&start);
+
+  int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(bands, nbands, in, width, quality) \
+  reduction(|:failed) \
+  schedule(dynamic)
+#endif
+  for(int b = 0; b < nbands; b++)
+  {
+    _jpeg_band_encode(in, width, quality, bands + b);
+    failed |= bands[b].failed;
+  }
+
+  // merge the statistics of all bands into one set of tables
+  JHUFF_TBL dc_tbl[NUM_HUFF_TBLS] = { { { 0 } } };
+  JHUFF_TBL ac_tbl[NUM_HUFF_TBLS] = { { { 0 } } };
+  gboolean tbl_used[NUM_HUFF_TBLS] = { FALSE };
+  for(int t = 0; !failed && t < NUM_HUFF_TBLS; t++)
+  {
+    long dc_freq[257] = { 0 }, ac_freq[257] = { 0 };
+    for(int b = 0; b < nbands; b++)
+      for(int k = 0; k < 256; k++)
+      {
+        dc_freq[k] += bands[b].dc_freq[t][k];
+        ac_freq[k] += bands[b].ac_freq[t][k];
+        tbl_used[t] |= bands[b].dc_freq[t][k] != 0 || bands[b].ac_freq[t][k] != 0;
+      }
+    if(!tbl_used[t]) continue;
+    _jpeg_optimal_table(dc_tbl + t, dc_freq);
+    _jpeg_optimal_table(ac_tbl + t, ac_freq);
+  }
+
+  const int restart_interval = band_mcu_rows * mcus_per_row;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(bands, nbands, dc_tbl, ac_tbl, tbl_used, restart_interval, icc, icc_len) \
+  shared(failed) \
+  schedule(dynamic)
+#endif
+  for(int b = 0; b < nbands; b++)
+  {
+    if(failed) continue;
+    _jpeg_band_recode(bands + b, dc_tbl, ac_tbl, tbl_used, restart_interval, b == 0 ? icc : NULL, icc_len);
+  }
+
+  size_t sof = 0;
+  size_t total_size = 0;
+  for(int b = 0; b < nbands; b++) failed |= bands[b].failed;
+  const size_t header = failed ? 0 : _jpeg_scan_start(bands[0].coded, bands[0].coded_size, &sof);
+  int rc = failed || !header || !sof ? -1 : 1;
+
+  FILE *f = rc == 1 ? g_fopen(filename, "wb") : NULL;
+  if(f)
+  {
+    // the header of the first band, with the height of the whole image
+    bands[0].coded[sof + 5] = height >> 8;
+    bands[0].coded[sof + 6] = height & 0xff;
+    gboolean ok = fwrite(bands[0].coded, 1, header, f) == header;
+    total_size += header;
+    for(int b = 0; ok && b < nbands; b++)
+    {
+      const size_t scan = b ? _jpeg_scan_start(bands[b].coded, bands[b].coded_size, NULL) : header;
+      // entropy coded segment up to the EOI marker
+      const size_t len = bands[b].coded_size - 2 - scan;
+      ok = scan && fwrite(bands[b].coded + scan, 1, len, f) == len;
+      const unsigned char marker[2] = { 0xff, b == nbands - 1 ? JPEG_EOI : JPEG_RST0 + (b & 7) };
+      ok = ok && fwrite(marker, 1, 2, f) == 2;
+      total_size += len + 2;
+    }
+    rc = fclose(f) || !ok;
+  }
+
+  if(rc == 0)
+    dt_show_times_f(&start, "[jpeg] banded encoding", "%dx%d in %d bands of %d rows, %zu bytes",
+                    width, height, nbands, band_rows, total_size);
+
+  for(int b = 0; b < nbands; b++) free(bands[b].coded);
+  free(bands);
+  return rc;
+}
+
+#endif // MEM_SRCDST_SUPPORTED
+
 int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
@@ -166,6 +610,30 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   const uint8_t *in = (const uint8_t *)in_tmp;
   struct dt_imageio_jpeg_error_mgr jerr;
 
+#ifdef MEM_SRCDST_SUPPORTED
+  // large images are encoded in bands on all cores. input smoothing looks across band
+  // borders, so it is left to the serial encoder.
+  if(jpg->quality >= 80
+     && dt_get_num_threads() > 1
+     && (size_t)jpg->global.width * jpg->global.height > (size_t)2 * 1024 * 1024
+     && dt_conf_get_bool("plugins/imageio/format/jpeg/parallel"))
+  {
+    cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
+    uint32_t len = 0;
+    cmsSaveProfileToMem(out_profile, NULL, &len);
+    unsigned char *icc = len > 0 ? malloc(sizeof(unsigned char) * len) : NULL;
+    if(icc) cmsSaveProfileToMem(out_profile, icc, &len);
+
+    const int rc = _write_image_banded(jpg, filename, in, icc, icc ? len : 0);
+    free(icc);
+    if(rc >= 0)
+    {
+      if(rc == 0 && exif) dt_exif_write_blob(exif, exif_len, filename, 1);
+      return rc;
+    }
+  }
+#endif
+
   jpg->cinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
   if(setjmp(jerr.setjmp_buffer))
@@ -182,21 +650,7 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   jpg->cinfo.image_height = jpg->global.height;
   jpg->cinfo.input_components = 3;
   jpg->cinfo.in_color_space = JCS_RGB;
-  jpeg_set_defaults(&(jpg->cinfo));
-  jpeg_set_quality(&(jpg->cinfo), jpg->quality, TRUE);
-  if(jpg->quality > 90) jpg->cinfo.comp_info[0].v_samp_factor = 1;
-  if(jpg->quality > 92) jpg->cinfo.comp_info[0].h_samp_factor = 1;
-  if(jpg->quality > 95) jpg->cinfo.dct_method = JDCT_FLOAT;
-  if(jpg->quality < 50) jpg->cinfo.dct_method = JDCT_IFAST;
-  if(jpg->quality < 80) jpg->cinfo.smoothing_factor = 20;
-  if(jpg->quality < 60) jpg->cinfo.smoothing_factor = 40;
-  if(jpg->quality < 40) jpg->cinfo.smoothing_factor = 60;
-  jpg->cinfo.optimize_coding = 1;
-
-  const int resolution = dt_conf_get_int("metadata/resolution");
-  jpg->cinfo.density_unit = 1;
-  jpg->cinfo.X_density = resolution;
-  jpg->cinfo.Y_density = resolution;
+  _set_compress_params(&(jpg->cinfo), jpg->quality);
 
   jpeg_start_compress(&(jpg->cinfo), TRUE);
 
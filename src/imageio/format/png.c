@@ -121,6 +121,249 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
 }
 #endif
 
+// rows of filtered data per deflate chunk are chosen to give chunks of about this size
+#define PNG_PARALLEL_CHUNK (256 * 1024)
+// deflate window, the tail of the previous chunk primes the dictionary of the next one
+#define PNG_WINDOW (32 * 1024)
+
+static inline int _paeth(const int a, const int b, const int c)
+{
+  const int p = a + b - c;
+  const int pa = abs(p - a);
+  const int pb = abs(p - b);
+  const int pc = abs(p - c);
+  if(pa <= pb && pa <= pc) return a;
+  if(pb <= pc) return b;
+  return c;
+}
+
+// pack row y of the pipe output as big endian RGB samples
+static void _pack_row(const void *ivoid,
+                      const int width,
+                      const int bpp,
+                      const int y,
+                      uint8_t *out)
+{
+  if(bpp > 8)
+  {
+    const uint16_t *in = (const uint16_t *)ivoid + (size_t)4 * y * width;
+    for(int x = 0; x < width; x++, in += 4, out += 6)
+      for(int c = 0; c < 3; c++)
+      {
+        out[2 * c] = in[c] >> 8;
+        out[2 * c + 1] = in[c] & 0xff;
+      }
+  }
+  else
+  {
+    const uint8_t *in = (const uint8_t *)ivoid + (size_t)4 * y * width;
+    for(int x = 0; x < width; x++, in += 4, out += 3)
+      memcpy(out, in, 3);
+  }
+}
+
+// filter one packed row into out (filter type byte followed by the filtered row), choosing
+// the filter with the smallest sum of absolute signed differences, like libpng does
+static void _filter_row(const uint8_t *row,
+                        const uint8_t *prev,
+                        const size_t len,
+                        const int pixel,
+                        uint8_t *out,
+                        uint8_t *candidate)
+{
+  size_t best_sum = SIZE_MAX;
+  for(int type = PNG_FILTER_VALUE_NONE; type <= PNG_FILTER_VALUE_PAETH; type++)
+  {
+    // without a previous row, up, average and paeth degrade to none and sub
+    if(!prev && (type == PNG_FILTER_VALUE_UP || type == PNG_FILTER_VALUE_PAETH)) continue;
+    size_t sum = 0;
+    for(size_t k = 0; k < len; k++)
+    {
+      const int a = k >= pixel ? row[k - pixel] : 0;
+      const int b = prev ? prev[k] : 0;
+      const int c = prev && k >= pixel ? prev[k - pixel] : 0;
+      int pred = 0;
+      switch(type)
+      {
+        case PNG_FILTER_VALUE_SUB: pred = a; break;
+        case PNG_FILTER_VALUE_UP: pred = b; break;
+        case PNG_FILTER_VALUE_AVG: pred = (a + b) >> 1; break;
+        case PNG_FILTER_VALUE_PAETH: pred = _paeth(a, b, c); break;
+        default: break;
+      }
+      const uint8_t v = row[k] - pred;
+      candidate[k] = v;
+      sum += v < 128 ? v : 256 - v;
+    }
+    if(sum < best_sum)
+    {
+      best_sum = sum;
+      out[0] = type;
+      memcpy(out + 1, candidate, len);
+    }
+  }
+}
+
+static void _write_idat(png_structp png_ptr, const uint8_t *data, const size_t len)
+{
+  const png_byte idat[5] = "IDAT";
+  if(len) png_write_chunk(png_ptr, idat, data, len);
+}
+
+// filter and deflate the image on all cores. rows are filtered in parallel, the filtered
+// data is cut into chunks that are deflated concurrently, each primed with the last 32k of
+// the previous chunk and ended with a sync flush, so the concatenation is one valid zlib
+// stream. returns -1 if nothing was written and the caller can fall back to libpng,
+// 1 if writing failed midway.
+static int _write_image_parallel(png_structp png_ptr,
+                                 const dt_imageio_png_t *p,
+                                 const void *ivoid)
+{
+  const int width = p->global.width;
+  const int height = p->global.height;
+  const int level = p->compression;
+  const int pixel = 3 * p->bpp / 8;
+  const size_t len = (size_t)width * pixel;
+  const size_t rowbytes = len + 1;
+  const int chunk_rows = MAX(1, PNG_PARALLEL_CHUNK / rowbytes);
+  const int nchunks = (height + chunk_rows - 1) / chunk_rows;
+  const int nthreads = dt_get_num_threads();
+  // chunks deflated per round, written in order before the next round starts
+  const int batch = MIN(2 * nthreads, nchunks);
+  const size_t chunk_bytes = rowbytes * chunk_rows;
+
+  dt_times_t start;
+  dt_get_perf_times(&start);
+
+  z_stream probe = { 0 };
+  if(deflateInit2(&probe, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+  // room for the sync flush marker and the empty block the flush may add
+  const size_t out_size = deflateBound(&probe, chunk_bytes) + 64;
+  deflateEnd(&probe);
+
+  // filtered data of the current round, preceded by the window of the previous round
+  uint8_t *const filtered = dt_alloc_align(64, PNG_WINDOW + batch * chunk_bytes);
+  uint8_t *const packed = dt_alloc_align(64, batch * out_size);
+  size_t *const packed_len = calloc(batch, sizeof(size_t));
+  uLong *const chunk_adler = calloc(batch, sizeof(uLong));
+  size_t rows_size;
+  uint8_t *const rows = dt_alloc_perthread(3 * len, sizeof(uint8_t), &rows_size);
+  if(!filtered || !packed || !packed_len || !chunk_adler || !rows)
+  {
+    dt_free_align(filtered);
+    dt_free_align(packed);
+    free(packed_len);
+    free(chunk_adler);
+    dt_free_align(rows);
+    return -1;
+  }
+
+  // zlib header: deflate with a 32k window, no preset dictionary
+  uint8_t header[2] = { 0x78, (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6 };
+  header[1] += 31 - ((header[0] << 8) + header[1]) % 31;
+  _write_idat(png_ptr, header, 2);
+
+  uLong adler = adler32(0L, Z_NULL, 0);
+  size_t window = 0; // bytes of valid dictionary in front of the round's data
+  size_t total_out = 2 + 4;
+  int rc = 0;
+
+  for(int first = 0; !rc && first < nchunks; first += batch)
+  {
+    const int last = MIN(first + batch, nchunks);
+    const int y0 = first * chunk_rows;
+    const int y1 = MIN(last * chunk_rows, height);
+    uint8_t *const data = filtered + PNG_WINDOW;
+    int failed = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(ivoid, width, height, pixel, len, rowbytes, chunk_rows, p, y0, y1, data, \
+                      rows, rows_size, first, last, level, out_size, packed, packed_len, \
+                      chunk_adler, chunk_bytes, window, nchunks) \
+  reduction(|:failed)
+#endif
+    {
+      // filter the rows of this round
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for(int y = y0; y < y1; y++)
+      {
+        uint8_t *const row = dt_get_perthread(rows, rows_size);
+        uint8_t *const prev = row + len;
+        uint8_t *const candidate = row + 2 * len;
+        _pack_row(ivoid, width, p->bpp, y, row);
+        if(y > 0) _pack_row(ivoid, width, p->bpp, y - 1, prev);
+        _filter_row(row, y > 0 ? prev : NULL, len, pixel, data + (size_t)(y - y0) * rowbytes, candidate);
+      }
+
+      // and deflate its chunks
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for(int chunk = first; chunk < last; chunk++)
+      {
+        const int slot = chunk - first;
+        const size_t offset = (size_t)slot * chunk_bytes;
+        const size_t in_len = (size_t)(MIN((chunk + 1) * chunk_rows, height) - chunk * chunk_rows) * rowbytes;
+        const size_t dict = MIN(offset + window, PNG_WINDOW);
+        uint8_t *const in = data + offset;
+        chunk_adler[slot] = adler32(adler32(0L, Z_NULL, 0), in, in_len);
+
+        z_stream zs = { 0 };
+        if(deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+          failed |= 1;
+          continue;
+        }
+        if(dict && deflateSetDictionary(&zs, in - dict, dict) != Z_OK) failed |= 1;
+        zs.next_in = in;
+        zs.avail_in = in_len;
+        zs.next_out = packed + (size_t)slot * out_size;
+        zs.avail_out = out_size;
+        const int ret = deflate(&zs, chunk == nchunks - 1 ? Z_FINISH : Z_SYNC_FLUSH);
+        if(zs.avail_in || (chunk == nchunks - 1 ? ret != Z_STREAM_END : (ret != Z_OK || zs.avail_out == 0)))
+          failed |= 1;
+        packed_len[slot] = zs.total_out;
+        deflateEnd(&zs);
+      }
+    }
+
+    rc = failed;
+    for(int chunk = first; !rc && chunk < last; chunk++)
+    {
+      const int slot = chunk - first;
+      const size_t in_len = (size_t)(MIN((chunk + 1) * chunk_rows, height) - chunk * chunk_rows) * rowbytes;
+      adler = adler32_combine(adler, chunk_adler[slot], in_len);
+      _write_idat(png_ptr, packed + (size_t)slot * out_size, packed_len[slot]);
+      total_out += packed_len[slot];
+    }
+
+    // keep the tail of this round as dictionary for the next one
+    const size_t round_len = (size_t)(y1 - y0) * rowbytes;
+    window = MIN(round_len + window, PNG_WINDOW);
+    memmove(filtered + PNG_WINDOW - window, data + round_len - window, window);
+  }
+
+  if(!rc)
+  {
+    const uint8_t trailer[4] = { adler >> 24, (adler >> 16) & 0xff, (adler >> 8) & 0xff, adler & 0xff };
+    _write_idat(png_ptr, trailer, 4);
+
+    const size_t total_in = (size_t)height * rowbytes;
+    dt_show_times_f(&start, "[png] parallel deflate", "%dx%d %d bit, %zu -> %zu bytes (%.1f%%)",
+                    width, height, p->bpp, total_in, total_out, 100.0 * total_out / total_in);
+  }
+
+  dt_free_align(filtered);
+  dt_free_align(packed);
+  free(packed_len);
+  free(chunk_adler);
+  dt_free_align(rows);
+  return rc;
+}
+
 int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
@@ -284,6 +527,27 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   }
 #endif
 
+  // large images are filtered and deflated on all cores, the IDAT chunks are written
+  // directly and so is IEND, as libpng's png_write_end() insists on its own IDAT.
+  if(p->compression > 0
+     && dt_get_num_threads() > 1
+     && (size_t)height * width * 3 * p->bpp / 8 > (size_t)4 * PNG_PARALLEL_CHUNK
+     && dt_conf_get_bool("plugins/imageio/format/png/parallel"))
+  {
+    const int rc = _write_image_parallel(png_ptr, p, ivoid);
+    if(rc >= 0)
+    {
+      if(rc == 0)
+      {
+        const png_byte iend[5] = "IEND";
+        png_write_chunk(png_ptr, iend, NULL, 0);
+      }
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+      fclose(f);
+      return rc;
+    }
+  }
+
   /*
    * Get rid of filler (OR ALPHA) bytes, pack XRGB/RGBX/ARGB/RGBA into
    * RGB (4 channels -> 3 channels). The second parameter is not used.
@@ -673,6 +937,9 @@ int flags(dt_imageio_module_data_t *data)
   return FORMAT_FLAGS_SUPPORT_XMP;
 }
 
+#undef PNG_PARALLEL_CHUNK
+#undef PNG_WINDOW
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <tiffio.h>
+#include <zlib.h>
 #ifdef HAVE_IMATH
 #include "Imath/half.h"
 #endif
@@ -64,6 +65,191 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
+// pack row y of the pipe output into rowdata, keeping the first layers channels
+// and converting to the sample format of the file
+static void _pack_row(const dt_imageio_tiff_t *d,
+                      const void *in_void,
+                      const int y,
+                      const int layers,
+                      void *rowdata)
+{
+  if(d->bpp == 32)
+  {
+    const float *in = (const float *)in_void + (size_t)4 * y * d->global.width;
+    float *out = (float *)rowdata;
+
+    for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+    {
+      memcpy(out, in, sizeof(float) * layers);
+    }
+  }
+#ifdef HAVE_IMATH
+  else if(d->bpp == 16 && d->pixelformat)
+  {
+    const float *in = (const float *)in_void + (size_t)4 * y * d->global.width;
+    uint16_t *out = (uint16_t *)rowdata;
+
+    for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+    {
+      for(int l = 0; l < layers; ++l) out[l] = imath_float_to_half(in[l]);
+    }
+  }
+#endif
+  else if(d->bpp == 16 && !d->pixelformat)
+  {
+    const uint16_t *in = (const uint16_t *)in_void + (size_t)4 * y * d->global.width;
+    uint16_t *out = (uint16_t *)rowdata;
+
+    for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+    {
+      memcpy(out, in, sizeof(uint16_t) * layers);
+    }
+  }
+  else // 8bpp
+  {
+    const uint8_t *in = (const uint8_t *)in_void + (size_t)4 * y * d->global.width;
+    uint8_t *out = (uint8_t *)rowdata;
+
+    for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+    {
+      memcpy(out, in, sizeof(uint8_t) * layers);
+    }
+  }
+}
+
+// apply the TIFF predictor to one packed row the same way libtiff's encoder does,
+// tmp needs rowsize bytes for the floating point predictor
+static void _predict_row(uint8_t *row,
+                         const size_t rowsize,
+                         const int layers,
+                         const int bytes,
+                         const uint16_t predictor,
+                         uint8_t *tmp)
+{
+  if(predictor == PREDICTOR_HORIZONTAL)
+  {
+    if(bytes == 2)
+    {
+      uint16_t *p = (uint16_t *)row;
+      for(size_t k = rowsize / 2 - 1; k >= (size_t)layers; k--) p[k] -= p[k - layers];
+    }
+    else if(bytes == 1)
+    {
+      for(size_t k = rowsize - 1; k >= (size_t)layers; k--) row[k] -= row[k - layers];
+    }
+  }
+  else if(predictor == PREDICTOR_FLOATINGPOINT)
+  {
+    // split the samples into byte planes, most significant first, then difference the bytes
+    const size_t wc = rowsize / bytes;
+    memcpy(tmp, row, rowsize);
+    for(size_t count = 0; count < wc; count++)
+      for(int byte = 0; byte < bytes; byte++)
+        row[(bytes - byte - 1) * wc + count] = tmp[bytes * count + byte];
+    for(size_t k = rowsize - 1; k >= (size_t)layers; k--) row[k] -= row[k - layers];
+  }
+}
+
+// deflate the strips on all cores and write them in order. the strips are complete
+// zlib streams with the predictor applied, just like libtiff's own encoder produces.
+// only valid if the file has the byte order of the host.
+static int _write_strips_parallel(TIFF *tif,
+                                  const dt_imageio_tiff_t *d,
+                                  const void *in_void,
+                                  const int layers)
+{
+  uint32_t rows_per_strip = 0;
+  uint16_t predictor = PREDICTOR_NONE;
+  TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_PREDICTOR, &predictor);
+  rows_per_strip = CLAMP(rows_per_strip, 1, d->global.height);
+
+  const int height = d->global.height;
+  const int bytes = d->bpp / 8;
+  const int level = d->compresslevel;
+  const size_t rowsize = (size_t)d->global.width * layers * bytes;
+  const size_t stripsize = rowsize * rows_per_strip;
+  const size_t bound = compressBound(stripsize);
+  const int nstrips = TIFFNumberOfStrips(tif);
+  const int nthreads = dt_get_num_threads();
+  // strips compressed per round, written in order before the next round starts
+  const int batch = 4 * nthreads;
+
+  uint8_t *const raw = dt_alloc_align(64, (size_t)batch * stripsize);
+  uint8_t *const packed = dt_alloc_align(64, (size_t)batch * bound);
+  size_t *const packed_size = calloc(batch, sizeof(size_t));
+  size_t tmp_size;
+  uint8_t *const tmp = dt_alloc_perthread(rowsize, sizeof(uint8_t), &tmp_size);
+  z_stream *const streams = calloc(nthreads, sizeof(z_stream));
+  gboolean *const stream_ok = calloc(nthreads, sizeof(gboolean));
+
+  int rc = !(raw && packed && packed_size && tmp && streams && stream_ok);
+
+  for(int first = 0; !rc && first < nstrips; first += batch)
+  {
+    const int last = MIN(first + batch, nstrips);
+    int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(d, in_void, layers, first, last, height, bytes, level, rowsize, \
+                      stripsize, bound, rows_per_strip, predictor, raw, packed, packed_size, \
+                      tmp, tmp_size, streams, stream_ok) \
+  reduction(|:failed) \
+  schedule(dynamic)
+#endif
+    for(int strip = first; strip < last; strip++)
+    {
+      const int slot = strip - first;
+      const int y0 = strip * rows_per_strip;
+      const int y1 = MIN(y0 + (int)rows_per_strip, height);
+      uint8_t *const in = raw + (size_t)slot * stripsize;
+      uint8_t *const rowtmp = dt_get_perthread(tmp, tmp_size);
+      for(int y = y0; y < y1; y++)
+      {
+        uint8_t *const row = in + (size_t)(y - y0) * rowsize;
+        _pack_row(d, in_void, y, layers, row);
+        _predict_row(row, rowsize, layers, bytes, predictor, rowtmp);
+      }
+
+      const int thread = dt_get_thread_num();
+      z_stream *const zs = streams + thread;
+      if(!stream_ok[thread])
+        stream_ok[thread] = deflateInit(zs, level) == Z_OK;
+      if(!stream_ok[thread] || deflateReset(zs) != Z_OK)
+      {
+        failed |= 1;
+        continue;
+      }
+      zs->next_in = in;
+      zs->avail_in = (uInt)((y1 - y0) * rowsize);
+      zs->next_out = packed + (size_t)slot * bound;
+      zs->avail_out = (uInt)bound;
+      if(deflate(zs, Z_FINISH) != Z_STREAM_END)
+        failed |= 1;
+      packed_size[slot] = zs->total_out;
+    }
+
+    rc = failed;
+    for(int strip = first; !rc && strip < last; strip++)
+    {
+      const int slot = strip - first;
+      if(TIFFWriteRawStrip(tif, strip, packed + (size_t)slot * bound, (tmsize_t)packed_size[slot]) == -1)
+        rc = 1;
+    }
+  }
+
+  if(streams && stream_ok)
+    for(int k = 0; k < nthreads; k++)
+      if(stream_ok[k]) deflateEnd(streams + k);
+  free(stream_ok);
+  free(streams);
+  dt_free_align(tmp);
+  free(packed_size);
+  dt_free_align(packed);
+  dt_free_align(raw);
+  return rc;
+}
+
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, dt_imgid_t imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
@@ -77,6 +263,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   TIFF *tif = NULL;
 
   void *rowdata = NULL;
+  size_t rowdata_width = 0; // in pixels
 
   gboolean free_mask = FALSE;
   float *raster_mask = NULL;
@@ -247,83 +434,28 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
   TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
 
-  const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
+  if(d->compress && G_BYTE_ORDER == G_LITTLE_ENDIAN)
   {
-    rc = 1;
-    goto exit;
-  }
-
-  if(d->bpp == 32)
-  {
-    for(int y = 0; y < d->global.height; y++)
+    // deflate is the bottleneck of the export otherwise
+    if(_write_strips_parallel(tif, d, in_void, layers))
     {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(float) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      rc = 1;
+      goto exit;
     }
   }
-#ifdef HAVE_IMATH
-  else if(d->bpp == 16 && d->pixelformat)
+  else
   {
-    for(int y = 0; y < d->global.height; y++)
+    const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
+    if((rowdata = malloc(rowsize)) == NULL)
     {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        for(int l = 0; l < layers; ++l) out[l] = imath_float_to_half(in[l]);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      rc = 1;
+      goto exit;
     }
-  }
-#endif
-  else if(d->bpp == 16 && !d->pixelformat)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
+    rowdata_width = d->global.width;
 
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint16_t) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else // 8bpp
-  {
     for(int y = 0; y < d->global.height; y++)
     {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint8_t) * layers);
-      }
+      _pack_row(d, in_void, y, layers, rowdata);
 
       if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
       {
@@ -444,11 +576,18 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
           TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
         TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
 
-        if(w != d->global.width)
+        // the parallel strip writer of the image doesn't use rowdata
+        if(!rowdata || w != rowdata_width)
         {
           free(rowdata);
           const size_t _rowsize = (w * layers) * d->bpp / 8;
           rowdata = malloc(_rowsize);
+          rowdata_width = rowdata ? w : 0;
+          if(!rowdata)
+          {
+            rc = 1;
+            goto exit;
+          }
         }
 
         if(d->bpp == 32)
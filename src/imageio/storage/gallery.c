@@ -21,6 +21,7 @@
 #include "common/file_location.h"
 #include "common/image.h"
 #include "common/image_cache.h"
+#include "common/interpolation.h"
 #include "common/metadata.h"
 #include "common/utility.h"
 #include "common/variables.h"
@@ -37,6 +38,7 @@
 #ifdef GDK_WINDOWING_QUARTZ
 #include "osx/osx.h"
 #endif
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -59,16 +61,21 @@ typedef struct dt_imageio_gallery_t
                                                // stored in param
                                                // struct.
   dt_variables_params_t *vp;
-  GList *l;
+  FILE *index;  // index.html, written while the images are stored
+  size_t count; // images in the index so far
 } dt_imageio_gallery_t;
 
-// sorted list of all images
-typedef struct pair_t
+// the thumbnail of each image is scaled down from the buffer of the full size export.
+// the format's write_image() is wrapped for this, it is handed a copy of the format
+// params which is placed right behind the thumbnail context.
+typedef struct _gallery_thumb_t
 {
-  char line[4096];
-  char item[4096];
-  int pos;
-} pair_t;
+  dt_imageio_module_format_t *format;
+  const char *filename;
+  dt_imageio_module_data_t fdata DT_ALIGNED_ARRAY; // format params, must be last
+} _gallery_thumb_t;
+
+#define GALLERY_THUMB_SIZE 200
 
 
 const char *name(const struct dt_imageio_module_storage_t *self)
@@ -248,9 +255,238 @@ void gui_reset(dt_imageio_module_storage_t *self)
                      gtk_entry_get_text(d->title_entry));
 }
 
-static gint sort_pos(pair_t *a, pair_t *b)
+static int _write_thumbnail(dt_imageio_module_format_t *format,
+                            dt_imageio_module_data_t *data,
+                            const char *filename,
+                            const void *in,
+                            const dt_colorspaces_color_profile_type_t over_type,
+                            const char *over_filename,
+                            const dt_imgid_t imgid,
+                            const int num,
+                            const int total,
+                            struct dt_dev_pixelpipe_t *pipe)
 {
-  return a->pos - b->pos;
+  const int width = data->width;
+  const int height = data->height;
+  const float scale = fminf((float)GALLERY_THUMB_SIZE / width, (float)GALLERY_THUMB_SIZE / height);
+  const int thumb_width = MAX(1, (int)roundf(scale * width));
+  const int thumb_height = MAX(1, (int)roundf(scale * height));
+  const int bpp = format->bpp(data);
+  const size_t npixels = (size_t)width * height;
+  const size_t thumb_npixels = (size_t)thumb_width * thumb_height;
+
+  float *full = bpp == 32 ? (float *)in : dt_alloc_align_float(4 * npixels);
+  float *thumb = dt_alloc_align_float(4 * thumb_npixels);
+  void *out = bpp == 32 ? (void *)thumb : dt_alloc_align(64, thumb_npixels * 4 * bpp / 8);
+  if(!full || !thumb || !out)
+  {
+    if(full != in) dt_free_align(full);
+    if(out != thumb) dt_free_align(out);
+    dt_free_align(thumb);
+    return 1;
+  }
+
+  if(bpp == 8)
+  {
+    const uint8_t *const in8 = (const uint8_t *)in;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(npixels, in8, full) \
+    schedule(static)
+#endif
+    for(size_t k = 0; k < 4 * npixels; k++) full[k] = in8[k] * (1.0f / 255.0f);
+  }
+  else if(bpp == 16)
+  {
+    const uint16_t *const in16 = (const uint16_t *)in;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(npixels, in16, full) \
+    schedule(static)
+#endif
+    for(size_t k = 0; k < 4 * npixels; k++) full[k] = in16[k] * (1.0f / 65535.0f);
+  }
+
+  const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+  const dt_iop_roi_t roi_out = { 0, 0, thumb_width, thumb_height, scale };
+  const struct dt_interpolation *itor = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
+  dt_interpolation_resample(itor, thumb, &roi_out, thumb_width * 4 * sizeof(float),
+                            full, &roi_in, width * 4 * sizeof(float));
+
+  if(bpp == 8)
+  {
+    uint8_t *const out8 = (uint8_t *)out;
+    for(size_t k = 0; k < 4 * thumb_npixels; k++)
+      out8[k] = (uint8_t)roundf(CLAMP(thumb[k] * 255.0f, 0.0f, 255.0f));
+  }
+  else if(bpp == 16)
+  {
+    uint16_t *const out16 = (uint16_t *)out;
+    for(size_t k = 0; k < 4 * thumb_npixels; k++)
+      out16[k] = (uint16_t)roundf(CLAMP(thumb[k] * 65535.0f, 0.0f, 65535.0f));
+  }
+
+  data->width = thumb_width;
+  data->height = thumb_height;
+  const int res = format->write_image(data, filename, out, over_type, over_filename,
+                                      NULL, 0, imgid, num, total, pipe, FALSE);
+  data->width = width;
+  data->height = height;
+
+  if(full != in) dt_free_align(full);
+  if(out != thumb) dt_free_align(out);
+  dt_free_align(thumb);
+  return res;
+}
+
+// writes the thumbnail first, then the image itself
+static int _gallery_write_image(dt_imageio_module_data_t *data,
+                                const char *filename,
+                                const void *in,
+                                const dt_colorspaces_color_profile_type_t over_type,
+                                const char *over_filename,
+                                void *exif,
+                                const int exif_len,
+                                const dt_imgid_t imgid,
+                                const int num,
+                                const int total,
+                                struct dt_dev_pixelpipe_t *pipe,
+                                const gboolean export_masks)
+{
+  _gallery_thumb_t *t = (_gallery_thumb_t *)((char *)data - offsetof(_gallery_thumb_t, fdata));
+  if(in && data->width > 0 && data->height > 0
+     && _write_thumbnail(t->format, data, t->filename, in, over_type, over_filename,
+                         imgid, num, total, pipe))
+  {
+    dt_print(DT_DEBUG_ALWAYS,
+             "[imageio_storage_gallery] could not export to file: `%s'!\n", t->filename);
+    return 1;
+  }
+  return t->format->write_image(data, filename, in, over_type, over_filename,
+                                exif, exif_len, imgid, num, total, pipe, export_masks);
+}
+
+static void _copy_resources(const char *dirname)
+{
+  char filename[PATH_MAX] = { 0 };
+  g_strlcpy(filename, dirname, sizeof(filename));
+  char *c = filename + strlen(filename);
+
+  // also create style/ subdir:
+  sprintf(c, "/style");
+  g_mkdir_with_parents(filename, 0755);
+  sprintf(c, "/style/style.css");
+  dt_copy_resource_file("/style/style.css", filename);
+  sprintf(c, "/style/favicon.ico");
+  dt_copy_resource_file("/style/favicon.ico", filename);
+
+  // create subdir pswp for photoswipe scripts
+  sprintf(c, "/pswp/default-skin/");
+  g_mkdir_with_parents(filename, 0755);
+  sprintf(c, "/pswp/photoswipe.js");
+  dt_copy_resource_file("/pswp/photoswipe.js", filename);
+  sprintf(c, "/pswp/photoswipe.min.js");
+  dt_copy_resource_file("/pswp/photoswipe.min.js", filename);
+  sprintf(c, "/pswp/photoswipe-ui-default.js");
+  dt_copy_resource_file("/pswp/photoswipe-ui-default.js", filename);
+  sprintf(c, "/pswp/photoswipe.css");
+  dt_copy_resource_file("/pswp/photoswipe.css", filename);
+  sprintf(c, "/pswp/photoswipe-ui-default.min.js");
+  dt_copy_resource_file("/pswp/photoswipe-ui-default.min.js", filename);
+  sprintf(c, "/pswp/default-skin/default-skin.css");
+  dt_copy_resource_file("/pswp/default-skin/default-skin.css", filename);
+  sprintf(c, "/pswp/default-skin/default-skin.png");
+  dt_copy_resource_file("/pswp/default-skin/default-skin.png", filename);
+  sprintf(c, "/pswp/default-skin/default-skin.svg");
+  dt_copy_resource_file("/pswp/default-skin/default-skin.svg", filename);
+  sprintf(c, "/pswp/default-skin/preloader.gif");
+  dt_copy_resource_file("/pswp/default-skin/preloader.gif", filename);
+}
+
+/* the index is written while the images are stored, so that an interrupted export still leaves
+   a working gallery behind. everything the thumbnails need (photoswipe dialog, items and
+   openSwipe()) comes before them, finalize_store() only closes the page. */
+static FILE *_open_index(dt_imageio_gallery_t *d)
+{
+  _copy_resources(d->cached_dirname);
+
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s/index.html", d->cached_dirname);
+
+  const char *title = d->title;
+
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return NULL;
+  fprintf(f,
+          "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\" "
+          "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n"
+          "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
+          "  <head>\n"
+          "    <meta http-equiv=\"Content-type\" content=\"text/html;charset=UTF-8\" />\n"
+          "    <link rel=\"shortcut icon\" href=\"style/favicon.ico\" />\n"
+          "    <link rel=\"stylesheet\" href=\"style/style.css\" type=\"text/css\" />\n"
+          "    <link rel=\"stylesheet\" href=\"pswp/photoswipe.css\">\n"
+          "    <link rel=\"stylesheet\" href=\"pswp/default-skin/default-skin.css\">\n"
+          "    <script src=\"pswp/photoswipe.min.js\"></script>\n"
+          "    <script src=\"pswp/photoswipe-ui-default.min.js\"></script>\n"
+          "    <title>%s</title>\n"
+          "  </head>\n"
+          "  <body>\n"
+          "    <div class=\"pswp\" tabindex=\"-1\" role=\"dialog\" aria-hidden=\"true\">\n"
+          "        <div class=\"pswp__bg\"></div>\n"
+          "        <div class=\"pswp__scroll-wrap\">\n"
+          "            <div class=\"pswp__container\">\n"
+          "                <div class=\"pswp__item\"></div>\n"
+          "                <div class=\"pswp__item\"></div>\n"
+          "                <div class=\"pswp__item\"></div>\n"
+          "            </div>\n"
+          "            <div class=\"pswp__ui pswp__ui--hidden\">\n"
+          "                <div class=\"pswp__top-bar\">\n"
+          "                    <div class=\"pswp__counter\"></div>\n"
+          "                    <button class=\"pswp__button pswp__button--close\" title=\"Close (Esc)\"></button>\n"
+          "                    <button class=\"pswp__button pswp__button--share\" title=\"Share\"></button>\n"
+          "                    <button class=\"pswp__button pswp__button--fs\" title=\"Toggle fullscreen\"></button>\n"
+          "                    <button class=\"pswp__button pswp__button--zoom\" title=\"Zoom in/out\"></button>\n"
+          "                    <div class=\"pswp__preloader\">\n"
+          "                        <div class=\"pswp__preloader__icn\">\n"
+          "                          <div class=\"pswp__preloader__cut\">\n"
+          "                            <div class=\"pswp__preloader__donut\"></div>\n"
+          "                          </div>\n"
+          "                        </div>\n"
+          "                   </div>\n"
+          "                </div>\n"
+          "                <div class=\"pswp__share-modal pswp__share-modal--hidden pswp__single-tap\">\n"
+          "                    <div class=\"pswp__share-tooltip\"></div>\n"
+          "                </div>\n"
+          "                <button class=\"pswp__button pswp__button--arrow--left\" title=\"Previous (arrow left)\">\n"
+          "                </button>\n"
+          "                <button class=\"pswp__button pswp__button--arrow--right\" title=\"Next (arrow right)\">\n"
+          "                </button>\n"
+          "                <div class=\"pswp__caption\">\n"
+          "                    <div class=\"pswp__caption__center\"></div>\n"
+          "                </div>\n"
+          "            </div>\n"
+          "        </div>\n"
+          "    </div>\n"
+          "<script>\n"
+          "var items = [];\n"
+          "function openSwipe(img)\n"
+          "{\n"
+          "    var pswpElement = document.querySelectorAll('.pswp')[0];\n"
+          "    // define options (if needed)\n"
+          "    var options = {\n"
+          "          // optionName: 'option value'\n"
+          "          index: img // start at first slide\n"
+          "    };\n"
+          "    var gallery = new PhotoSwipe( pswpElement, PhotoSwipeUI_Default, items, options);\n"
+          "    gallery.init();\n"
+          "}\n"
+          "</script>\n"
+          "    <div class=\"title\">%s</div>\n"
+          "    <div class=\"page\">\n",
+          title, title);
+  fflush(f);
+  return f;
 }
 
 int store(dt_imageio_module_storage_t *self,
@@ -337,9 +573,6 @@ int store(dt_imageio_module_storage_t *self,
 
   sprintf(c, ".%s", ext);
 
-  // save image to list, in order:
-  pair_t *pair = malloc(sizeof(pair_t));
-
   char *title = NULL, *description = NULL;
   GList *res_title = NULL, *res_desc = NULL;
 
@@ -372,11 +605,14 @@ int store(dt_imageio_module_storage_t *self,
   if(c <= relthumbfilename) c = relthumbfilename + strlen(relthumbfilename);
   sprintf(c, "-thumb.%s", ext);
 
-  char subfilename[PATH_MAX] = { 0 }, relsubfilename[PATH_MAX] = { 0 };
-  g_strlcpy(subfilename, d->cached_dirname, sizeof(subfilename));
-  char *sc = subfilename + strlen(subfilename);
-  sprintf(sc, "/img_%d.html", num);
-  snprintf(relsubfilename, sizeof(relsubfilename), "img_%d.html", num);
+  // the thumbnail goes next to the image, with -thumb appended
+  char thumbfilename[PATH_MAX] = { 0 };
+  g_strlcpy(thumbfilename, filename, sizeof(thumbfilename));
+  c = thumbfilename + strlen(thumbfilename);
+  for(; c > thumbfilename && *c != '.' && *c != '/'; c--)
+    ;
+  if(c <= thumbfilename || *c == '/') c = thumbfilename + strlen(thumbfilename);
+  sprintf(c, "-thumb.%s", ext);
 
   // escape special character and especially " which is used in <img>
   // and below in src and msrc
@@ -384,76 +620,63 @@ int store(dt_imageio_module_storage_t *self,
   gchar *esc_relfilename = g_strescape(relfilename, NULL);
   gchar *esc_relthumbfilename = g_strescape(relthumbfilename, NULL);
 
-  snprintf(pair->line, sizeof(pair->line),
-           "\n"
-           "      <div><div class=\"dia\">\n"
-           "      <img src=\"%s\" alt=\"img%d\" class=\"img\" onclick=\"openSwipe(%d)\"/></div>\n"
-           "      <h1>%s</h1>\n"
-           "      %s</div>\n",
-           esc_relthumbfilename,
-           num, num-1, title ? title : "&nbsp;", description ? description : "&nbsp;");
-
-  if(res_title)
-    g_list_free_full(res_title, &g_free);
-  if(res_desc)
-    g_list_free_full(res_desc, &g_free);
-
-  // export image to file. need this to be able to access meaningful
-  // fdata->width and height below.
-  if(dt_imageio_export(imgid, filename, format, fdata, high_quality,
-                       upscale, TRUE, export_masks, icc_type,
-                       icc_filename, icc_intent, self, sdata, num, total, metadata) != 0)
+  // export image and thumbnail in one go. need this to be able to
+  // access meaningful fdata->width and height below.
+  dt_imageio_module_format_t gallery_format = *format;
+  gallery_format.write_image = _gallery_write_image;
+  const size_t fdata_size = format->params_size(format);
+  _gallery_thumb_t *thumb = dt_alloc_align(64, offsetof(_gallery_thumb_t, fdata) + fdata_size);
+  int res = 1;
+  if(thumb)
+  {
+    thumb->format = format;
+    thumb->filename = thumbfilename;
+    memcpy(&thumb->fdata, fdata, fdata_size);
+    res = dt_imageio_export(imgid, filename, &gallery_format, &thumb->fdata, high_quality,
+                            upscale, TRUE, export_masks, icc_type,
+                            icc_filename, icc_intent, self, sdata, num, total, metadata);
+    fdata->width = thumb->fdata.width;
+    fdata->height = thumb->fdata.height;
+    dt_free_align(thumb);
+  }
+  if(res != 0)
   {
     dt_print(DT_DEBUG_ALWAYS,
              "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
-    free(pair);
+    if(res_title)
+      g_list_free_full(res_title, &g_free);
+    if(res_desc)
+      g_list_free_full(res_desc, &g_free);
     g_free(esc_relfilename);
     g_free(esc_relthumbfilename);
     return 1;
   }
 
-  snprintf(pair->item, sizeof(pair->item),
-           "{\n"
-           "src: \"%s\",\n"
-           "w: %d,\n"
-           "h: %d,\n"
-           "msrc: \"%s\",\n"
-           "},\n",
-           esc_relfilename, fdata->width, fdata->height, esc_relthumbfilename);
+  if(!d->index) d->index = _open_index(d);
+  if(d->index)
+  {
+    fprintf(d->index,
+            "\n"
+            "      <div><div class=\"dia\">\n"
+            "      <img src=\"%s\" alt=\"img%d\" class=\"img\" onclick=\"openSwipe(%zu)\"/></div>\n"
+            "      <h1>%s</h1>\n"
+            "      %s</div>\n"
+            "      <script>items.push({ src: \"%s\", w: %d, h: %d, msrc: \"%s\" });</script>\n",
+            esc_relthumbfilename, num, d->count,
+            title ? title : "&nbsp;", description ? description : "&nbsp;",
+            esc_relfilename, fdata->width, fdata->height, esc_relthumbfilename);
+    fflush(d->index);
+    d->count++;
+  }
 
+  if(res_title)
+    g_list_free_full(res_title, &g_free);
+  if(res_desc)
+    g_list_free_full(res_desc, &g_free);
   g_free(esc_relfilename);
   g_free(esc_relthumbfilename);
 
-  pair->pos = num;
-  d->l = g_list_insert_sorted(d->l, pair, (GCompareFunc)sort_pos);
-
-  /* also export thumbnail: */
-  // write with reduced resolution:
-  const int save_max_width = fdata->max_width;
-  const int save_max_height = fdata->max_height;
-  fdata->max_width = 200;
-  fdata->max_height = 200;
-  // alter filename with -thumb:
-  c = filename + strlen(filename);
-  for(; c > filename && *c != '.' && *c != '/'; c--)
-    ;
-  if(c <= filename || *c == '/') c = filename + strlen(filename);
-  ext = format->extension(fdata);
-  sprintf(c, "-thumb.%s", ext);
-  if(dt_imageio_export(imgid, filename, format, fdata, FALSE, TRUE, FALSE,
-                       export_masks, icc_type, icc_filename,
-                       icc_intent, self, sdata, num, total, NULL) != 0)
-  {
-    dt_print(DT_DEBUG_ALWAYS,
-             "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
-    dt_control_log(_("could not export to file `%s'!"), filename);
-    return 1;
-  }
-  // restore for next image:
-  fdata->max_width = save_max_width;
-  fdata->max_height = save_max_height;
-
   dt_print(DT_DEBUG_ALWAYS, "[export_job] exported to `%s'\n", filename);
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
                  num, total, filename);
@@ -463,72 +686,8 @@ int store(dt_imageio_module_storage_t *self,
 void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *dd)
 {
   dt_imageio_gallery_t *d = (dt_imageio_gallery_t *)dd;
-  char filename[PATH_MAX] = { 0 };
-  g_strlcpy(filename, d->cached_dirname, sizeof(filename));
-  char *c = filename + strlen(filename);
-
-  // also create style/ subdir:
-  sprintf(c, "/style");
-  g_mkdir_with_parents(filename, 0755);
-  sprintf(c, "/style/style.css");
-  dt_copy_resource_file("/style/style.css", filename);
-  sprintf(c, "/style/favicon.ico");
-  dt_copy_resource_file("/style/favicon.ico", filename);
-
-  // create subdir pswp for photoswipe scripts
-  sprintf(c, "/pswp/default-skin/");
-  g_mkdir_with_parents(filename, 0755);
-  sprintf(c, "/pswp/photoswipe.js");
-  dt_copy_resource_file("/pswp/photoswipe.js", filename);
-  sprintf(c, "/pswp/photoswipe.min.js");
-  dt_copy_resource_file("/pswp/photoswipe.min.js", filename);
-  sprintf(c, "/pswp/photoswipe-ui-default.js");
-  dt_copy_resource_file("/pswp/photoswipe-ui-default.js", filename);
-  sprintf(c, "/pswp/photoswipe.css");
-  dt_copy_resource_file("/pswp/photoswipe.css", filename);
-  sprintf(c, "/pswp/photoswipe-ui-default.min.js");
-  dt_copy_resource_file("/pswp/photoswipe-ui-default.min.js", filename);
-  sprintf(c, "/pswp/default-skin/default-skin.css");
-  dt_copy_resource_file("/pswp/default-skin/default-skin.css", filename);
-  sprintf(c, "/pswp/default-skin/default-skin.png");
-  dt_copy_resource_file("/pswp/default-skin/default-skin.png", filename);
-  sprintf(c, "/pswp/default-skin/default-skin.svg");
-  dt_copy_resource_file("/pswp/default-skin/default-skin.svg", filename);
-  sprintf(c, "/pswp/default-skin/preloader.gif");
-  dt_copy_resource_file("/pswp/default-skin/preloader.gif", filename);
-
-  sprintf(c, "/index.html");
-
-  const char *title = d->title;
-
-  FILE *f = g_fopen(filename, "wb");
+  FILE *f = d->index;
   if(!f) return;
-  fprintf(f,
-          "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\" "
-          "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n"
-          "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
-          "  <head>\n"
-          "    <meta http-equiv=\"Content-type\" content=\"text/html;charset=UTF-8\" />\n"
-          "    <link rel=\"shortcut icon\" href=\"style/favicon.ico\" />\n"
-          "    <link rel=\"stylesheet\" href=\"style/style.css\" type=\"text/css\" />\n"
-          "    <link rel=\"stylesheet\" href=\"pswp/photoswipe.css\">\n"
-          "    <link rel=\"stylesheet\" href=\"pswp/default-skin/default-skin.css\">\n"
-          "    <script src=\"pswp/photoswipe.min.js\"></script>\n"
-          "    <script src=\"pswp/photoswipe-ui-default.min.js\"></script>\n"
-          "    <title>%s</title>\n"
-          "  </head>\n"
-          "  <body>\n"
-          "    <div class=\"title\">%s</div>\n"
-          "    <div class=\"page\">\n",
-          title, title);
-
-  size_t count = 0;
-  for(GList *tmp = d->l; tmp; tmp = g_list_next(tmp))
-  {
-    pair_t *p = (pair_t *)tmp->data;
-    fprintf(f, "%s", p->line);
-    count++;
-  }
 
   fprintf(f, "        <p style=\"clear:both;\"></p>\n"
              "    </div>\n"
@@ -538,74 +697,18 @@ void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t
              "      </script><br />\n"
              "      created with %s\n"
              "    </div>\n"
-             "    <div class=\"pswp\" tabindex=\"-1\" role=\"dialog\" aria-hidden=\"true\">\n"
-             "        <div class=\"pswp__bg\"></div>\n"
-             "        <div class=\"pswp__scroll-wrap\">\n"
-             "            <div class=\"pswp__container\">\n"
-             "                <div class=\"pswp__item\"></div>\n"
-             "                <div class=\"pswp__item\"></div>\n"
-             "                <div class=\"pswp__item\"></div>\n"
-             "            </div>\n"
-             "            <div class=\"pswp__ui pswp__ui--hidden\">\n"
-             "                <div class=\"pswp__top-bar\">\n"
-             "                    <div class=\"pswp__counter\"></div>\n"
-             "                    <button class=\"pswp__button pswp__button--close\" title=\"Close (Esc)\"></button>\n"
-             "                    <button class=\"pswp__button pswp__button--share\" title=\"Share\"></button>\n"
-             "                    <button class=\"pswp__button pswp__button--fs\" title=\"Toggle fullscreen\"></button>\n"
-             "                    <button class=\"pswp__button pswp__button--zoom\" title=\"Zoom in/out\"></button>\n"
-             "                    <div class=\"pswp__preloader\">\n"
-             "                        <div class=\"pswp__preloader__icn\">\n"
-             "                          <div class=\"pswp__preloader__cut\">\n"
-             "                            <div class=\"pswp__preloader__donut\"></div>\n"
-             "                          </div>\n"
-             "                        </div>\n"
-             "                   </div>\n"
-             "                </div>\n"
-             "                <div class=\"pswp__share-modal pswp__share-modal--hidden pswp__single-tap\">\n"
-             "                    <div class=\"pswp__share-tooltip\"></div>\n"
-             "                </div>\n"
-             "                <button class=\"pswp__button pswp__button--arrow--left\" title=\"Previous (arrow left)\">\n"
-             "                </button>\n"
-             "                <button class=\"pswp__button pswp__button--arrow--right\" title=\"Next (arrow right)\">\n"
-             "                </button>\n"
-             "                <div class=\"pswp__caption\">\n"
-             "                    <div class=\"pswp__caption__center\"></div>\n"
-             "                </div>\n"
-             "            </div>\n"
-             "        </div>\n"
-             "    </div>\n"
              "  </body>\n"
-             "<script>\n"
-             "var pswpElement = document.querySelectorAll('.pswp')[0];\n"
-             "var items = [\n",
-          count,
+             "</html>\n",
+          d->count,
           darktable_package_string);
-  while(d->l)
-  {
-    pair_t *p = (pair_t *)d->l->data;
-    fprintf(f, "%s", p->item);
-    free(p);
-    d->l = g_list_delete_link(d->l, d->l);
-  }
-  fprintf(f, "];\n"
-             "function openSwipe(img)\n"
-             "{\n"
-             "    // define options (if needed)\n"
-             "    var options = {\n"
-             "          // optionName: 'option value'\n"
-             "          index: img // start at first slide\n"
-             "    };\n"
-             "    var gallery = new PhotoSwipe( pswpElement, PhotoSwipeUI_Default, items, options);\n"
-             "    gallery.init();\n"
-             "}\n"
-             "</script>\n"
-             "</html>\n");
   fclose(f);
+  d->index = NULL;
+  d->count = 0;
 }
 
 size_t params_size(dt_imageio_module_storage_t *self)
 {
-  return sizeof(dt_imageio_gallery_t) - 2 * sizeof(void *) - DT_MAX_PATH_FOR_PARAMS;
+  return offsetof(dt_imageio_gallery_t, cached_dirname);
 }
 
 void init(dt_imageio_module_storage_t *self)
@@ -624,7 +727,8 @@ void *get_params(dt_imageio_module_storage_t *self)
   dt_imageio_gallery_t *d =
     (dt_imageio_gallery_t *)calloc(1, sizeof(dt_imageio_gallery_t));
   d->vp = NULL;
-  d->l = NULL;
+  d->index = NULL;
+  d->count = 0;
   dt_variables_params_init(&d->vp);
 
   const char *text =
@@ -642,6 +746,7 @@ void free_params(dt_imageio_module_storage_t *self,
 {
   if(!params) return;
   dt_imageio_gallery_t *d = (dt_imageio_gallery_t *)params;
+  if(d->index) fclose(d->index);
   dt_variables_params_destroy(d->vp);
   free(params);
 }
@@ -673,6 +778,8 @@ gboolean supported(dt_imageio_module_storage_t *storage,
   return FALSE;
 }
 
+#undef GALLERY_THUMB_SIZE
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -22,6 +22,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/bilateral.h"
 #include "common/colorspaces_inline_conversions.h"
+#include "common/database.h"
 #include "common/debug.h"
 #include "common/imagebuf.h"
 #include "common/interpolation.h"
@@ -1729,6 +1730,92 @@ error:
   return FALSE;
 }
 
+// the line segments found in the preview buffer are kept in the library, so that reopening an image or
+// toggling the module doesn't run the line detection again. they are valid as long as the modules before
+// this one and the preview buffer geometry did not change.
+static int _lines_cache_load(const dt_imgid_t imgid,
+                             const uint64_t hash,
+                             const dt_iop_ashift_enhance_t enhance,
+                             const int width,
+                             const int height,
+                             const int x_off,
+                             const int y_off,
+                             const float scale,
+                             dt_iop_ashift_line_t **alines,
+                             int *lcount)
+{
+  int found = FALSE;
+  sqlite3_stmt *stmt;
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT lines"
+                              " FROM main.ashift_lines"
+                              " WHERE imgid = ?1 AND hash = ?2 AND enhance = ?3"
+                              "   AND width = ?4 AND height = ?5 AND x_off = ?6 AND y_off = ?7"
+                              "   AND scale = ?8",
+                              -1, &stmt, NULL);
+  // clang-format on
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 2, (sqlite3_int64)hash);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, enhance);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 4, width);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 5, height);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 6, x_off);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 7, y_off);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, scale);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const void *blob = sqlite3_column_blob(stmt, 0);
+    const int size = sqlite3_column_bytes(stmt, 0);
+    const size_t count = size / sizeof(dt_iop_ashift_line_t);
+    // a blob written by a build with a different line layout is ignored
+    if(blob && count > 0 && (size_t)size == count * sizeof(dt_iop_ashift_line_t))
+    {
+      *alines = malloc(size);
+      if(*alines)
+      {
+        memcpy(*alines, blob, size);
+        *lcount = count;
+        found = TRUE;
+      }
+    }
+  }
+  sqlite3_finalize(stmt);
+  return found;
+}
+
+static void _lines_cache_store(const dt_imgid_t imgid,
+                               const uint64_t hash,
+                               const dt_iop_ashift_enhance_t enhance,
+                               const int width,
+                               const int height,
+                               const int x_off,
+                               const int y_off,
+                               const float scale,
+                               const dt_iop_ashift_line_t *lines,
+                               const int lcount)
+{
+  sqlite3_stmt *stmt;
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO main.ashift_lines"
+                              " (imgid, hash, enhance, width, height, x_off, y_off, scale, lines)"
+                              " VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)",
+                              -1, &stmt, NULL);
+  // clang-format on
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 2, (sqlite3_int64)hash);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, enhance);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 4, width);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 5, height);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 6, x_off);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 7, y_off);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, scale);
+  DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 9, lines, sizeof(dt_iop_ashift_line_t) * lcount, SQLITE_STATIC);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
 // get image from buffer, analyze for structure and save results
 static int _get_structure(dt_iop_module_t *module,
                           const dt_iop_ashift_enhance_t enhance)
@@ -1741,6 +1828,7 @@ static int _get_structure(dt_iop_module_t *module,
   int x_off = 0;
   int y_off = 0;
   float scale = 0.0f;
+  uint64_t hash = 0;
 
   dt_iop_gui_enter_critical_section(module);
   // read buffer data if they are available
@@ -1751,6 +1839,7 @@ static int _get_structure(dt_iop_module_t *module,
     x_off = g->buf_x_off;
     y_off = g->buf_y_off;
     scale = g->buf_scale;
+    hash = g->buf_hash;
 
     // create a temporary buffer to hold image data
     buffer = malloc(sizeof(float) * 4 * (size_t)width * height);
@@ -1775,11 +1864,38 @@ static int _get_structure(dt_iop_module_t *module,
   float vertical_weight;
   float horizontal_weight;
 
-  // get new structural data
-  if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
-                  &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
-                  enhance, dt_image_is_raw(&module->dev->image_storage)))
-    goto error;
+  const dt_imgid_t imgid = module->dev->image_storage.id;
+
+  // get new structural data, from the library if the preview input is the one they were found in
+  if(hash != 0
+     && _lines_cache_load(imgid, hash, enhance, width, height, x_off, y_off, scale, &lines, &lines_count))
+  {
+    vertical_count = horizontal_count = 0;
+    vertical_weight = horizontal_weight = 0.0f;
+    for(int n = 0; n < lines_count; n++)
+    {
+      if(lines[n].type == ASHIFT_LINE_VERTICAL_SELECTED)
+      {
+        vertical_count++;
+        vertical_weight += lines[n].weight;
+      }
+      else if(lines[n].type == ASHIFT_LINE_HORIZONTAL_SELECTED)
+      {
+        horizontal_count++;
+        horizontal_weight += lines[n].weight;
+      }
+    }
+  }
+  else
+  {
+    if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
+                    &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
+                    enhance, dt_image_is_raw(&module->dev->image_storage)))
+      goto error;
+
+    if(hash != 0)
+      _lines_cache_store(imgid, hash, enhance, width, height, x_off, y_off, scale, lines, lines_count);
+  }
 
   // save new structural data
   g->lines_in_width = width;
@@ -3604,44 +3720,61 @@ void process(struct dt_iop_module_t *self,
   const float cx = roi_out->scale * fullwidth * data->cl;
   const float cy = roi_out->scale * fullheight * data->ct;
 
+  // the output row j maps to the homogeneous input coordinates base_j + i * step, so each row's source
+  // positions are computed in one vectorizable pass into a per-thread scanline before interpolating
+  const float step[3] = { ihomograph[0][0] / roi_out->scale,
+                          ihomograph[1][0] / roi_out->scale,
+                          ihomograph[2][0] / roi_out->scale };
+  const int owidth = roi_out->width;
+  size_t padded_size;
+  float *const restrict coords = dt_alloc_perthread_float(2 * owidth, &padded_size);
+  if(!coords)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[ashift] out of memory, skipping process\n");
+    dt_iop_copy_image_roi(ovoid, ivoid, ch, roi_in, roi_out);
+    return;
+  }
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, ch_width, cx, cy, ivoid, ovoid, roi_in, roi_out) \
-  shared(ihomograph, interpolation) \
+  dt_omp_firstprivate(ch, ch_width, cx, cy, ivoid, ovoid, roi_in, roi_out, owidth, coords, padded_size) \
+  shared(ihomograph, interpolation, step) \
   schedule(static)
 #endif
   // go over all pixels of output image
   for(int j = 0; j < roi_out->height; j++)
   {
     float *const restrict out = ((float *)ovoid) + (size_t)ch * j * roi_out->width;
-    for(int i = 0; i < roi_out->width; i++)
-    {
-      float pin[3], pout[3];
+    float *const restrict xs = dt_get_perthread(coords, padded_size);
+    float *const restrict ys = xs + owidth;
 
-      // convert output pixel coordinates to original image coordinates
-      pout[0] = roi_out->x + i + cx;
-      pout[1] = roi_out->y + j + cy;
-      pout[0] /= roi_out->scale;
-      pout[1] /= roi_out->scale;
-      pout[2] = 1.0f;
-
-      // apply homograph
-      mat3mulv(pin, (float *)ihomograph, pout);
+    // convert the first output pixel of the row to original image coordinates and apply the homograph
+    const float pout[3] = { (roi_out->x + cx) / roi_out->scale, (roi_out->y + j + cy) / roi_out->scale, 1.0f };
+    float base[3];
+    mat3mulv(base, (float *)ihomograph, pout);
 
+    const float in_scale = roi_in->scale;
+    const float in_x = roi_in->x;
+    const float in_y = roi_in->y;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int i = 0; i < owidth; i++)
+    {
       // convert to input pixel coordinates
-      pin[0] /= pin[2];
-      pin[1] /= pin[2];
-      pin[0] *= roi_in->scale;
-      pin[1] *= roi_in->scale;
-      pin[0] -= roi_in->x;
-      pin[1] -= roi_in->y;
+      const float z = base[2] + i * step[2];
+      xs[i] = (base[0] + i * step[0]) / z * in_scale - in_x;
+      ys[i] = (base[1] + i * step[1]) / z * in_scale - in_y;
+    }
 
-      // get output values by interpolation from input image
+    // get output values by interpolation from input image
+    for(int i = 0; i < owidth; i++)
       dt_interpolation_compute_pixel4c(interpolation, (float *)ivoid, out + ch*i,
-                                       pin[0], pin[1], roi_in->width,
+                                       xs[i], ys[i], roi_in->width,
                                        roi_in->height, ch_width);
-    }
   }
+
+  dt_free_align(coords);
 }
 
 #ifdef HAVE_OPENCL
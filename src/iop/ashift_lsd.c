@@ -152,6 +152,9 @@
 #define TRUE 1
 #endif /* !TRUE */
 
+/** Minimal number of rows of the bands searched in parallel. */
+#define LSD_BAND_ROWS 256
+
 /** Label for pixels with undefined gradient. */
 #define NOTDEF -1024.0
 
@@ -645,10 +648,9 @@ static image_double gaussian_sampler( image_double in, double scale,
                                       double sigma_scale )
 {
   image_double aux,out;
-  ntuple_list kernel;
-  unsigned int N,M,h,n,x,y,i;
-  int xc,yc,j,double_x_size,double_y_size;
-  double sigma,xx,yy,sum,prec;
+  unsigned int N,M,h,n;
+  int double_x_size,double_y_size;
+  double sigma,prec;
 
   /* check parameters */
   if( in == NULL || in->data == NULL || in->xsize == 0 || in->ysize == 0 )
@@ -679,82 +681,104 @@ static image_double gaussian_sampler( image_double in, double scale,
   prec = 3.0;
   h = (unsigned int) ceil( sigma * sqrt( 2.0 * prec * log(10.0) ) );
   n = 1+2*h; /* kernel size */
-  kernel = new_ntuple_list(n);
 
   /* auxiliary double image size variables */
   double_x_size = (int) (2 * in->xsize);
   double_y_size = (int) (2 * in->ysize);
 
-  /* First subsampling: x axis */
-  for(x=0;x<aux->xsize;x++)
-    {
-      /*
-         x   is the coordinate in the new image.
-         xx  is the corresponding x-value in the original size image.
-         xc  is the integer value, the pixel coordinate of xx.
-       */
-      xx = (double) x / scale;
-      /* coordinate (0.0,0.0) is in the center of pixel (0,0),
-         so the pixel with xc=0 get the values of xx from -0.5 to 0.5 */
-      xc = (int) floor( xx + 0.5 );
-      gaussian_kernel( kernel, sigma, (double) h + xx - (double) xc );
-      /* the kernel must be computed for each x because the fine
-         offset xx-xc is different in each case */
-
-      for(y=0;y<aux->ysize;y++)
-        {
-          sum = 0.0;
-          for(i=0;i<kernel->dim;i++)
-            {
-              j = xc - h + i;
-
-              /* symmetry boundary condition */
-              while( j < 0 ) j += double_x_size;
-              while( j >= double_x_size ) j -= double_x_size;
-              if( j >= (int) in->xsize ) j = double_x_size-1-j;
-
-              sum += in->data[ j + y * in->xsize ] * kernel->values[i];
-            }
-          aux->data[ x + y * aux->xsize ] = sum;
-        }
-    }
+  /* First subsampling: x axis.
+     The columns, and the rows of the second subsampling, are independent
+     of each other; each thread computes its own kernel. */
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(in, aux, scale, sigma, h, n, double_x_size)
+#endif
+  {
+    ntuple_list kernel = new_ntuple_list(n);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(unsigned int x=0;x<aux->xsize;x++)
+      {
+        /*
+           x   is the coordinate in the new image.
+           xx  is the corresponding x-value in the original size image.
+           xc  is the integer value, the pixel coordinate of xx.
+         */
+        const double xx = (double) x / scale;
+        /* coordinate (0.0,0.0) is in the center of pixel (0,0),
+           so the pixel with xc=0 get the values of xx from -0.5 to 0.5 */
+        const int xc = (int) floor( xx + 0.5 );
+        gaussian_kernel( kernel, sigma, (double) h + xx - (double) xc );
+        /* the kernel must be computed for each x because the fine
+           offset xx-xc is different in each case */
+
+        for(unsigned int y=0;y<aux->ysize;y++)
+          {
+            double sum = 0.0;
+            for(unsigned int i=0;i<kernel->dim;i++)
+              {
+                int j = xc - h + i;
+
+                /* symmetry boundary condition */
+                while( j < 0 ) j += double_x_size;
+                while( j >= double_x_size ) j -= double_x_size;
+                if( j >= (int) in->xsize ) j = double_x_size-1-j;
+
+                sum += in->data[ j + y * in->xsize ] * kernel->values[i];
+              }
+            aux->data[ x + y * aux->xsize ] = sum;
+          }
+      }
+    free_ntuple_list(kernel);
+  }
 
   /* Second subsampling: y axis */
-  for(y=0;y<out->ysize;y++)
-    {
-      /*
-         y   is the coordinate in the new image.
-         yy  is the corresponding x-value in the original size image.
-         yc  is the integer value, the pixel coordinate of xx.
-       */
-      yy = (double) y / scale;
-      /* coordinate (0.0,0.0) is in the center of pixel (0,0),
-         so the pixel with yc=0 get the values of yy from -0.5 to 0.5 */
-      yc = (int) floor( yy + 0.5 );
-      gaussian_kernel( kernel, sigma, (double) h + yy - (double) yc );
-      /* the kernel must be computed for each y because the fine
-         offset yy-yc is different in each case */
-
-      for(x=0;x<out->xsize;x++)
-        {
-          sum = 0.0;
-          for(i=0;i<kernel->dim;i++)
-            {
-              j = yc - h + i;
-
-              /* symmetry boundary condition */
-              while( j < 0 ) j += double_y_size;
-              while( j >= double_y_size ) j -= double_y_size;
-              if( j >= (int) in->ysize ) j = double_y_size-1-j;
-
-              sum += aux->data[ x + j * aux->xsize ] * kernel->values[i];
-            }
-          out->data[ x + y * out->xsize ] = sum;
-        }
-    }
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(in, aux, out, scale, sigma, h, n, double_y_size)
+#endif
+  {
+    ntuple_list kernel = new_ntuple_list(n);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(unsigned int y=0;y<out->ysize;y++)
+      {
+        /*
+           y   is the coordinate in the new image.
+           yy  is the corresponding x-value in the original size image.
+           yc  is the integer value, the pixel coordinate of xx.
+         */
+        const double yy = (double) y / scale;
+        /* coordinate (0.0,0.0) is in the center of pixel (0,0),
+           so the pixel with yc=0 get the values of yy from -0.5 to 0.5 */
+        const int yc = (int) floor( yy + 0.5 );
+        gaussian_kernel( kernel, sigma, (double) h + yy - (double) yc );
+        /* the kernel must be computed for each y because the fine
+           offset yy-yc is different in each case */
+
+        for(unsigned int x=0;x<out->xsize;x++)
+          {
+            double sum = 0.0;
+            for(unsigned int i=0;i<kernel->dim;i++)
+              {
+                int j = yc - h + i;
+
+                /* symmetry boundary condition */
+                while( j < 0 ) j += double_y_size;
+                while( j >= double_y_size ) j -= double_y_size;
+                if( j >= (int) in->ysize ) j = double_y_size-1-j;
+
+                sum += aux->data[ x + j * aux->xsize ] * kernel->values[i];
+              }
+            out->data[ x + y * out->xsize ] = sum;
+          }
+      }
+    free_ntuple_list(kernel);
+  }
 
   /* free memory */
-  free_ntuple_list(kernel);
   free_image_double(aux);
 
   return out;
@@ -765,6 +789,15 @@ static image_double gaussian_sampler( image_double in, double scale,
 /*--------------------------------- Gradient ---------------------------------*/
 /*----------------------------------------------------------------------------*/
 
+/*----------------------------------------------------------------------------*/
+/** First row of band 'b' when 'ysize' rows are split into 'n_bands' bands.
+ */
+static unsigned int band_start(unsigned int b, unsigned int n_bands,
+                               unsigned int ysize)
+{
+  return (unsigned int) ( (size_t) b * ysize / n_bands );
+}
+
 /*----------------------------------------------------------------------------*/
 /** Computes the direction of the level line of 'in' at each point.
 
@@ -781,14 +814,19 @@ static image_double gaussian_sampler( image_double in, double scale,
       the bins.)
     - a pointer 'mem_p' to the memory used by 'list_p' to be able to
       free the memory when it is not used anymore.
+
+    The pixels are split into 'n_bands' bands of rows, see band_start(),
+    with one list per band in 'list_p' and coordinates relative to the
+    first row of their band.
  */
 static image_double ll_angle( image_double in, double threshold,
                               struct coorlist ** list_p, void ** mem_p,
-                              image_double * modgrad, unsigned int n_bins )
+                              image_double * modgrad, unsigned int n_bins,
+                              unsigned int n_bands )
 {
   image_double g;
-  unsigned int n,p,x,y,adr,i;
-  double com1,com2,gx,gy,norm,norm2;
+  unsigned int n,p,x,y,i;
+  double norm;
   /* the rest of the variables are used for pseudo-ordering
      the gradient magnitude values */
   int list_count = 0;
@@ -798,6 +836,7 @@ static image_double ll_angle( image_double in, double threshold,
   struct coorlist * start;
   struct coorlist * end;
   double max_grad = 0.0;
+  unsigned int b,y_start,y_end;
 
   /* check parameters */
   if( in == NULL || in->data == NULL || in->xsize == 0 || in->ysize == 0 )
@@ -821,23 +860,30 @@ static image_double ll_angle( image_double in, double threshold,
   /* get memory for "ordered" list of pixels */
   list = (struct coorlist *) calloc( (size_t) (n*p), sizeof(struct coorlist) );
   *mem_p = (void *) list;
-  range_l_s = (struct coorlist **) calloc( (size_t) n_bins,
+  range_l_s = (struct coorlist **) calloc( (size_t) n_bins * n_bands,
                                            sizeof(struct coorlist *) );
-  range_l_e = (struct coorlist **) calloc( (size_t) n_bins,
+  range_l_e = (struct coorlist **) calloc( (size_t) n_bins * n_bands,
                                            sizeof(struct coorlist *) );
   if( list == NULL || range_l_s == NULL || range_l_e == NULL )
     error("not enough memory.");
-  for(i=0;i<n_bins;i++) range_l_s[i] = range_l_e[i] = NULL;
+  for(i=0;i<n_bins*n_bands;i++) range_l_s[i] = range_l_e[i] = NULL;
 
   /* 'undefined' on the down and right boundaries */
   for(x=0;x<p;x++) g->data[(n-1)*p+x] = NOTDEF;
   for(y=0;y<n;y++) g->data[p*y+p-1]   = NOTDEF;
 
-  /* compute gradient on the remaining pixels */
-  for(x=0;x<p-1;x++)
-    for(y=0;y<n-1;y++)
+  /* compute gradient on the remaining pixels, row by row in parallel */
+  image_double mg = *modgrad;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, g, mg, n, p, threshold) \
+  reduction(max : max_grad) schedule(static)
+#endif
+  for(unsigned int y=0;y<n-1;y++)
+    for(unsigned int x=0;x<p-1;x++)
       {
-        adr = y*p+x;
+        const unsigned int adr = y*p+x;
+        double com1,com2,gx,gy,norm,norm2;
 
         /*
            Norm 2 computation using 2x2 pixel window:
@@ -858,7 +904,7 @@ static image_double ll_angle( image_double in, double threshold,
         norm2 = gx*gx+gy*gy;
         norm = sqrt( norm2 / 4.0 ); /* gradient norm */
 
-        (*modgrad)->data[adr] = norm; /* store gradient norm */
+        mg->data[adr] = norm; /* store gradient norm */
 
         if( norm <= threshold ) /* norm too small, gradient no defined */
           g->data[adr] = NOTDEF; /* gradient angle not defined */
@@ -872,15 +918,24 @@ static image_double ll_angle( image_double in, double threshold,
           }
       }
 
-  /* compute histogram of gradient values */
+  /* compute histogram of gradient values, one per band of rows with
+     band relative coordinates */
   for(x=0;x<p-1;x++)
-    for(y=0;y<n-1;y++)
+    for(y=0,b=0,y_start=0,y_end=band_start(1,n_bands,n);y<n-1;y++)
       {
+        while( y >= y_end )
+          {
+            ++b;
+            y_start = y_end;
+            y_end = band_start(b+1,n_bands,n);
+          }
+
         norm = (*modgrad)->data[y*p+x];
 
         /* store the point in the right bin according to its norm */
         i = (unsigned int) (norm * (double) n_bins / max_grad);
         if( i >= n_bins ) i = n_bins-1;
+        i += b * n_bins;
         if( range_l_e[i] == NULL )
           range_l_s[i] = range_l_e[i] = list+list_count++;
         else
@@ -889,7 +944,7 @@ static image_double ll_angle( image_double in, double threshold,
             range_l_e[i] = list+list_count++;
           }
         range_l_e[i]->x = (int) x;
-        range_l_e[i]->y = (int) y;
+        range_l_e[i]->y = (int) (y - y_start);
         range_l_e[i]->next = NULL;
       }
 
@@ -898,20 +953,25 @@ static image_double ll_angle( image_double in, double threshold,
      pixels with the highest gradient value. Pixels would be ordered
      by norm value, up to a precision given by max_grad/n_bins.
    */
-  for(i=n_bins-1; i>0 && range_l_s[i]==NULL; i--);
-  start = range_l_s[i];
-  end = range_l_e[i];
-  if( start != NULL )
-    while(i>0)
-      {
-        --i;
-        if( range_l_s[i] != NULL )
+  for(b=0;b<n_bands;b++)
+    {
+      struct coorlist ** band_s = range_l_s + b * n_bins;
+      struct coorlist ** band_e = range_l_e + b * n_bins;
+      for(i=n_bins-1; i>0 && band_s[i]==NULL; i--);
+      start = band_s[i];
+      end = band_e[i];
+      if( start != NULL )
+        while(i>0)
           {
-            end->next = range_l_s[i];
-            end = range_l_e[i];
+            --i;
+            if( band_s[i] != NULL )
+              {
+                end->next = band_s[i];
+                end = band_e[i];
+              }
           }
-      }
-  *list_p = start;
+      list_p[b] = start;
+    }
 
   /* free memory */
   free( (void *) range_l_s );
@@ -1064,12 +1124,17 @@ static double log_gamma_windschitl(double x)
 
 // clang-format on
 
-static double *inv = NULL; /* table to keep computed inverse values */
+static double *inv = NULL; /* table of inverse values */
 
+// the table is filled once here rather than on demand in nfa(), so that
+// the line segment search can run on several threads at once
 __attribute__((constructor)) static void invConstructor()
 {
   if(inv) return;
   inv = malloc(sizeof(double) * TABSIZE);
+  if(!inv) return;
+  inv[0] = 0.0;
+  for(int i = 1; i < TABSIZE; i++) inv[i] = 1.0 / (double)i;
 }
 
 __attribute__((destructor)) static void invDestructor()
@@ -1174,12 +1239,11 @@ static double nfa(int n, int k, double p, double logNT)
            term_i / term_i-1 = (n-i+1)/i * p/(1-p)
          and
            term_i = term_i-1 * (n-i+1)/i * p/(1-p).
-         1/i is stored in a table as they are computed,
+         1/i is read from a precomputed table,
          because divisions are expensive.
          p/(1-p) is computed only once and stored in 'p_term'.
        */
-      bin_term = (double) (n-i+1) * ( i<TABSIZE ?
-                   ( inv[i]!=0.0 ? inv[i] : ( inv[i] = 1.0 / (double) i ) ) :
+      bin_term = (double) (n-i+1) * ( i<TABSIZE && inv ? inv[i] :
                    1.0 / (double) i );
 
       mult_term = bin_term * p_term;
@@ -2073,6 +2137,229 @@ static int refine( struct point * reg, int * reg_size, image_double modgrad,
 /*-------------------------- Line Segment Detector ---------------------------*/
 /*----------------------------------------------------------------------------*/
 
+/*----------------------------------------------------------------------------*/
+/** Search the pixels of 'list_p' for line segments and add them to 'out',
+    in the coordinates of the 'angles' grid shifted down by 'y_off'.
+ */
+static void search_segments( struct coorlist * list_p, image_double angles,
+                             image_double modgrad, image_char used,
+                             struct point * reg, image_int region,
+                             int * ls_count, double prec, double p,
+                             double logNT, double log_eps, double density_th,
+                             int min_reg_size, double y_off, ntuple_list out )
+{
+  struct rect rec;
+  int reg_size,i;
+  double reg_angle,log_nfa;
+
+  for(; list_p != NULL; list_p = list_p->next )
+    if( used->data[ list_p->x + list_p->y * used->xsize ] == NOTUSED &&
+        angles->data[ list_p->x + list_p->y * angles->xsize ] != NOTDEF )
+       /* there is no risk of double comparison problems here
+          because we are only interested in the exact NOTDEF value */
+      {
+        /* find the region of connected point and ~equal angle */
+        region_grow( list_p->x, list_p->y, angles, reg, &reg_size,
+                     &reg_angle, used, prec );
+
+        /* reject small regions */
+        if( reg_size < min_reg_size ) continue;
+
+        /* construct rectangular approximation for the region */
+        region2rect(reg,reg_size,modgrad,reg_angle,prec,p,&rec);
+
+        /* Check if the rectangle exceeds the minimal density of
+           region points. If not, try to improve the region.
+           The rectangle will be rejected if the final one does
+           not fulfill the minimal density condition.
+           This is an addition to the original LSD algorithm published in
+           "LSD: A Fast Line Segment Detector with a False Detection Control"
+           by R. Grompone von Gioi, J. Jakubowicz, J.M. Morel, and G. Randall.
+           The original algorithm is obtained with density_th = 0.0.
+         */
+        if( !refine( reg, &reg_size, modgrad, reg_angle,
+                     prec, p, &rec, used, angles, density_th ) ) continue;
+
+        /* compute NFA value */
+        log_nfa = rect_improve(&rec,angles,logNT,log_eps);
+        if( log_nfa <= log_eps ) continue;
+
+        /* A New Line Segment was found! */
+        ++(*ls_count);  /* increase line segment counter */
+
+        /* add line segment found to output */
+        add_7tuple( out, rec.x1, rec.y1 + y_off, rec.x2, rec.y2 + y_off,
+                         rec.width, rec.p, log_nfa );
+
+        /* add region number to 'region' image if needed */
+        if( region != NULL )
+          for(i=0; i<reg_size; i++)
+            region->data[ reg[i].x + reg[i].y * region->xsize ] = *ls_count;
+      }
+}
+
+/*----------------------------------------------------------------------------*/
+/** Try to join segment 'a', found above the band boundary at row 'yb',
+    with segment 'b' found below it. They are joined if they have the same
+    direction up to their precision, lie on the same line up to their width,
+    leave no gap at the boundary, and the joined rectangle is meaningful.
+    On success the joined segment is written to 'b'.
+ */
+static int join_segments( const double * a, double * b, double yb,
+                          image_double angles, double logNT, double log_eps )
+{
+  const double tol = 2.0;
+  struct rect r;
+  double pts[4][2] = { { a[0], a[1] }, { a[2], a[3] },
+                       { b[0], b[1] }, { b[2], b[3] } };
+  double len,dx,dy,ta,tb1,tb2,d,w,pr,tmin,tmax,log_nfa;
+  int i,imin,imax;
+
+  /* both must reach the boundary */
+  if( fmax(a[1],a[3]) < yb - 1.0 - tol || fmin(b[1],b[3]) > yb + tol )
+    return FALSE;
+
+  w = fmax(a[4],b[4]);
+  pr = M_PI * fmax(a[5],b[5]);
+  len = dist(a[0],a[1],a[2],a[3]);
+  if( len <= 0.0 || dist(b[0],b[1],b[2],b[3]) <= 0.0 ) return FALSE;
+  if( angle_diff( atan2(a[3]-a[1],a[2]-a[0]), atan2(b[3]-b[1],b[2]-b[0]) ) > pr )
+    return FALSE;
+
+  /* the end points nearest to the boundary must lie on the other line */
+  dx = (a[2]-a[0]) / len;
+  dy = (a[3]-a[1]) / len;
+  i = b[1] < b[3] ? 2 : 3;
+  d = fabs( (pts[i][0]-a[0]) * dy - (pts[i][1]-a[1]) * dx );
+  if( d > w ) return FALSE;
+  i = a[1] > a[3] ? 0 : 1;
+  d = fabs( (pts[i][0]-b[0]) * (b[3]-b[1]) - (pts[i][1]-b[1]) * (b[2]-b[0]) )
+      / dist(b[0],b[1],b[2],b[3]);
+  if( d > w ) return FALSE;
+
+  /* and they must overlap or nearly touch along the line */
+  tb1 = (b[0]-a[0]) * dx + (b[1]-a[1]) * dy;
+  tb2 = (b[2]-a[0]) * dx + (b[3]-a[1]) * dy;
+  if( fmin(tb1,tb2) > len + w + tol || fmax(tb1,tb2) < -w - tol ) return FALSE;
+
+  /* the joined segment spans the extreme end points along the line */
+  imin = imax = 0;
+  tmin = tmax = 0.0;
+  for(i=1; i<4; i++)
+    {
+      ta = (pts[i][0]-a[0]) * dx + (pts[i][1]-a[1]) * dy;
+      if( ta < tmin ) { tmin = ta; imin = i; }
+      if( ta > tmax ) { tmax = ta; imax = i; }
+    }
+
+  r.x1 = pts[imin][0]; r.y1 = pts[imin][1];
+  r.x2 = pts[imax][0]; r.y2 = pts[imax][1];
+  r.width = w;
+  r.x = (r.x1 + r.x2) / 2.0;
+  r.y = (r.y1 + r.y2) / 2.0;
+  r.theta = atan2(r.y2-r.y1,r.x2-r.x1);
+  r.dx = cos(r.theta);
+  r.dy = sin(r.theta);
+  r.p = fmax(a[5],b[5]);
+  r.prec = M_PI * r.p;
+
+  log_nfa = rect_nfa(&r,angles,logNT);
+  if( log_nfa <= log_eps ) return FALSE;
+
+  b[0] = r.x1; b[1] = r.y1; b[2] = r.x2; b[3] = r.y2;
+  b[4] = r.width; b[5] = r.p; b[6] = log_nfa;
+  return TRUE;
+}
+
+/*----------------------------------------------------------------------------*/
+/** Search for line segments in the 'n_bands' bands of ll_angle() in
+    parallel, each band on its own as if it were a separate image, but with
+    the number of tests of the whole image. Segments crossing a band boundary
+    are found as two pieces, which are joined afterwards.
+ */
+static void search_bands( struct coorlist ** list_p, image_double angles,
+                          image_double modgrad, image_char used,
+                          unsigned int n_bands, double prec, double p,
+                          double logNT, double log_eps, double density_th,
+                          int min_reg_size, ntuple_list out )
+{
+  const unsigned int xsize = angles->xsize;
+  const unsigned int ysize = angles->ysize;
+  unsigned int * y0 = (unsigned int *) malloc( (n_bands+1) * sizeof(unsigned int) );
+  ntuple_list * found = (ntuple_list *) calloc( n_bands, sizeof(ntuple_list) );
+  unsigned int b,k,l;
+
+  if( y0 == NULL || found == NULL ) error("not enough memory!");
+
+  for(b=0; b<=n_bands; b++) y0[b] = band_start(b,n_bands,ysize);
+  for(b=0; b<n_bands; b++) found[b] = new_ntuple_list(7);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(angles, modgrad, used, n_bands, prec, p, logNT, log_eps, \
+                      density_th, min_reg_size, xsize, y0, list_p, found) \
+  schedule(dynamic)
+#endif
+  for(unsigned int band=0; band<n_bands; band++)
+    {
+      const unsigned int rows = y0[band+1] - y0[band];
+      const size_t offset = (size_t) y0[band] * xsize;
+      struct image_double_s band_angles = { angles->data + offset, xsize, rows };
+      struct image_double_s band_modgrad = { modgrad->data + offset, xsize, rows };
+      struct image_char_s band_used = { used->data + offset, xsize, rows };
+      struct point * reg = (struct point *) calloc( (size_t) xsize * rows, sizeof(struct point) );
+      int count = 0;
+      if( reg == NULL ) error("not enough memory!");
+
+      search_segments( list_p[band], &band_angles, &band_modgrad, &band_used,
+                       reg, NULL, &count, prec, p, logNT, log_eps, density_th,
+                       min_reg_size, (double) y0[band], found[band] );
+      free( (void *) reg );
+    }
+
+  /* join the pieces across each boundary, top to bottom, so that a segment
+     crossing several bands grows one band at a time. a joined segment
+     replaces its lower piece, the upper one is marked by a negative width. */
+  for(b=0; b+1<n_bands; b++)
+    {
+      ntuple_list upper = found[b];
+      ntuple_list lower = found[b+1];
+      unsigned char * joined = (unsigned char *) calloc( lower->size + 1, 1 );
+      if( joined == NULL ) error("not enough memory!");
+      for(k=0; k<upper->size; k++)
+        {
+          double * a = upper->values + k * 7;
+          if( a[4] < 0.0 ) continue;
+          for(l=0; l<lower->size; l++)
+            {
+              double * c = lower->values + l * 7;
+              if( joined[l] || c[4] < 0.0 ) continue;
+              if( join_segments( a, c, (double) y0[b+1], angles, logNT, log_eps ) )
+                {
+                  joined[l] = 1;
+                  a[4] = -1.0;
+                  break;
+                }
+            }
+        }
+      free( (void *) joined );
+    }
+
+  for(b=0; b<n_bands; b++)
+    {
+      for(k=0; k<found[b]->size; k++)
+        {
+          const double * v = found[b]->values + k * 7;
+          if( v[4] >= 0.0 )
+            add_7tuple( out, v[0], v[1], v[2], v[3], v[4], v[5], v[6] );
+        }
+      free_ntuple_list(found[b]);
+    }
+
+  free( (void *) y0 );
+  free( (void *) found );
+}
+
 /*----------------------------------------------------------------------------*/
 /** LSD full interface.
  */
@@ -2090,13 +2377,12 @@ double * LineSegmentDetection( int * n_out,
   image_double scaled_image,angles,modgrad;
   image_char used;
   image_int region = NULL;
-  struct coorlist * list_p;
+  struct coorlist ** list_p;
   void * mem_p;
-  struct rect rec;
-  struct point * reg;
-  int reg_size,min_reg_size,i;
-  unsigned int xsize,ysize;
-  double rho,reg_angle,prec,p,log_nfa,logNT;
+  struct point * reg = NULL;
+  int min_reg_size;
+  unsigned int xsize,ysize,n_bands,n;
+  double rho,prec,p,logNT;
   int ls_count = 0;                   /* line segments are numbered 1,2,3,... */
 
 
@@ -2118,18 +2404,26 @@ double * LineSegmentDetection( int * n_out,
   rho = quant / sin(prec); /* gradient magnitude threshold */
 
 
-  /* load and scale image (if necessary) and compute angle at each pixel */
+  /* load and scale image (if necessary) */
   image = new_image_double_ptr( (unsigned int) X, (unsigned int) Y, img );
-  if( scale != 1.0 )
-    {
-      scaled_image = gaussian_sampler( image, scale, sigma_scale );
-      angles = ll_angle( scaled_image, rho, &list_p, &mem_p,
-                         &modgrad, (unsigned int) n_bins );
-      free_image_double(scaled_image);
-    }
+  scaled_image = scale != 1.0 ? gaussian_sampler( image, scale, sigma_scale )
+                              : image;
+
+  /* Large images are searched for line segments in bands of at least
+     LSD_BAND_ROWS rows in parallel. The number of bands depends on the
+     image size only, so that the result does not depend on the number of
+     threads. The region image needs the serial search. */
+  if( reg_img != NULL && reg_x != NULL && reg_y != NULL )
+    n_bands = 1;
   else
-    angles = ll_angle( image, rho, &list_p, &mem_p, &modgrad,
-                       (unsigned int) n_bins );
+    n_bands = MAX( 1, scaled_image->ysize / LSD_BAND_ROWS );
+  list_p = (struct coorlist **) calloc( n_bands, sizeof(struct coorlist *) );
+  if( list_p == NULL ) error("not enough memory!");
+
+  /* compute angle at each pixel */
+  angles = ll_angle( scaled_image, rho, list_p, &mem_p, &modgrad,
+                     (unsigned int) n_bins, n_bands );
+  if( scale != 1.0 ) free_image_double(scaled_image);
   xsize = angles->xsize;
   ysize = angles->ysize;
 
@@ -2156,71 +2450,42 @@ double * LineSegmentDetection( int * n_out,
   if( reg_img != NULL && reg_x != NULL && reg_y != NULL ) /* save region data */
     region = new_image_int_ini(angles->xsize,angles->ysize,0);
   used = new_image_char_ini(xsize,ysize,NOTUSED);
-  reg = (struct point *) calloc( (size_t) (xsize*ysize), sizeof(struct point) );
-  if( reg == NULL ) error("not enough memory!");
+  if( n_bands == 1 )
+    {
+      reg = (struct point *) calloc( (size_t) (xsize*ysize), sizeof(struct point) );
+      if( reg == NULL ) error("not enough memory!");
+    }
 
 
   /* search for line segments */
-  for(; list_p != NULL; list_p = list_p->next )
-    if( used->data[ list_p->x + list_p->y * used->xsize ] == NOTUSED &&
-        angles->data[ list_p->x + list_p->y * angles->xsize ] != NOTDEF )
-       /* there is no risk of double comparison problems here
-          because we are only interested in the exact NOTDEF value */
-      {
-        /* find the region of connected point and ~equal angle */
-        region_grow( list_p->x, list_p->y, angles, reg, &reg_size,
-                     &reg_angle, used, prec );
-
-        /* reject small regions */
-        if( reg_size < min_reg_size ) continue;
-
-        /* construct rectangular approximation for the region */
-        region2rect(reg,reg_size,modgrad,reg_angle,prec,p,&rec);
-
-        /* Check if the rectangle exceeds the minimal density of
-           region points. If not, try to improve the region.
-           The rectangle will be rejected if the final one does
-           not fulfill the minimal density condition.
-           This is an addition to the original LSD algorithm published in
-           "LSD: A Fast Line Segment Detector with a False Detection Control"
-           by R. Grompone von Gioi, J. Jakubowicz, J.M. Morel, and G. Randall.
-           The original algorithm is obtained with density_th = 0.0.
-         */
-        if( !refine( reg, &reg_size, modgrad, reg_angle,
-                     prec, p, &rec, used, angles, density_th ) ) continue;
-
-        /* compute NFA value */
-        log_nfa = rect_improve(&rec,angles,logNT,log_eps);
-        if( log_nfa <= log_eps ) continue;
-
-        /* A New Line Segment was found! */
-        ++ls_count;  /* increase line segment counter */
-
-        /*
-           The gradient was computed with a 2x2 mask, its value corresponds to
-           points with an offset of (0.5,0.5), that should be added to output.
-           The coordinates origin is at the center of pixel (0,0).
-         */
-        rec.x1 += 0.5; rec.y1 += 0.5;
-        rec.x2 += 0.5; rec.y2 += 0.5;
+  if( n_bands > 1 )
+    search_bands( list_p, angles, modgrad, used, n_bands, prec, p, logNT,
+                  log_eps, density_th, min_reg_size, out );
+  else
+    search_segments( list_p[0], angles, modgrad, used, reg, region, &ls_count,
+                     prec, p, logNT, log_eps, density_th, min_reg_size, 0.0,
+                     out );
 
-        /* scale the result values if a subsampling was performed */
-        if( scale != 1.0 )
-          {
-            rec.x1 /= scale; rec.y1 /= scale;
-            rec.x2 /= scale; rec.y2 /= scale;
-            rec.width /= scale;
-          }
+  for(n=0; n<out->size; n++)
+    {
+      double * v = out->values + n * out->dim;
 
-        /* add line segment found to output */
-        add_7tuple( out, rec.x1, rec.y1, rec.x2, rec.y2,
-                         rec.width, rec.p, log_nfa );
+      /*
+         The gradient was computed with a 2x2 mask, its value corresponds to
+         points with an offset of (0.5,0.5), that should be added to output.
+         The coordinates origin is at the center of pixel (0,0).
+       */
+      v[0] += 0.5; v[1] += 0.5;
+      v[2] += 0.5; v[3] += 0.5;
 
-        /* add region number to 'region' image if needed */
-        if( region != NULL )
-          for(i=0; i<reg_size; i++)
-            region->data[ reg[i].x + reg[i].y * region->xsize ] = ls_count;
-      }
+      /* scale the result values if a subsampling was performed */
+      if( scale != 1.0 )
+        {
+          v[0] /= scale; v[1] /= scale;
+          v[2] /= scale; v[3] /= scale;
+          v[4] /= scale;
+        }
+    }
 
 
   /* free memory */
@@ -2232,6 +2497,7 @@ double * LineSegmentDetection( int * n_out,
   free_image_char(used);
   free( (void *) reg );
   free( (void *) mem_p );
+  free( (void *) list_p );
 
   /* return the result */
   if( reg_img != NULL && reg_x != NULL && reg_y != NULL )
@@ -2272,6 +2538,7 @@ double * LineSegmentDetection( int * n_out,
 #undef USED
 #undef RELATIVE_ERROR_FACTOR
 #undef TABSIZE
+#undef LSD_BAND_ROWS
 
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
@@ -306,50 +306,13 @@ static void process_wavelets(struct dt_iop_module_t *self,
     return;
   }
 
-  float *const restrict out = (float*)o;
-  float *restrict tmp = NULL;
-  float *restrict tmp2 = NULL;
-
-  if(!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &tmp, 4, &tmp2, 0))
-  {
-    dt_iop_copy_image_roi(out, i, piece->colors, roi_in, roi_out);
-    return;
-  }
-
-  float *buf1 = (float *)i;
-  float *buf2 = tmp;
-
-  // clear the output buffer, which will be accumulating all of the detail scales
-  dt_iop_image_fill(out, 0.0f, width, height, 4);
-
-  // now do the wavelet decomposition, immediately synthesizing the
-  // detail scale into the final output so that we don't need to store
-  // it past the current scale's iteration
-  for(int scale = 0; scale < max_scale; scale++)
-  {
-    eaw_decompose_and_synthesize(buf2, buf1, out, scale, sharp[scale], thrs[scale],
-                                 boost[scale], width, height);
-    if(scale == 0) buf1 = (float *)tmp2; // now switch to second
-                                         // scratch for buffer
-                                         // ping-pong between buf1 and
-                                         // buf2
-    float *buf3 = buf2;
-    buf2 = buf1;
-    buf1 = buf3;
-  }
-
-  // add in the final residue
-#ifdef _OPENMP
-#pragma omp parallel for simd aligned(buf1, out : 64) \
-  dt_omp_firstprivate(width, height, buf1, out) \
-  schedule(simd:static) num_threads(MIN(dt_get_num_threads(),16))
-#endif
-  for(size_t k = 0; k < (size_t)4 * width * height; k++)
-    out[k] += buf1[k];
-
-  dt_free_align(tmp);
-  dt_free_align(tmp2);
-  return;
+  // decompose, shrink and boost every detail scale and add it back to
+  // the residue; the engine runs the finest scales in cache-sized
+  // tiles so that their coarse images never go through memory
+  if(!eaw_decompose_and_synthesize((float *)o, (const float *)i, max_scale, sharp,
+                                   (const dt_aligned_pixel_t *)thrs,
+                                   (const dt_aligned_pixel_t *)boost, width, height))
+    dt_iop_copy_image_roi((float *)o, (const float *)i, piece->colors, roi_in, roi_out);
 }
 
 void process(struct dt_iop_module_t *self,
@@ -26,6 +26,7 @@
 #include "common/imagebuf.h"
 #include "common/locallaplacian.h"
 #include "common/locallaplaciancl.h"
+#include "control/conf.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
@@ -58,7 +59,16 @@ typedef struct dt_iop_bilat_params_t
   float midtone; // $MIN: 0.001 $MAX: 1.0 $DEFAULT: 0.5 $DESCRIPTION: "midtone range"
 } dt_iop_bilat_params_t;
 
-typedef dt_iop_bilat_params_t dt_iop_bilat_data_t;
+typedef struct dt_iop_bilat_data_t
+{
+  dt_iop_bilat_mode_t mode;
+  float sigma_r;
+  float sigma_s;
+  float detail;
+  float midtone;
+  // pyramid buffers of the local laplacian CPU path, kept between runs of interactive pipes
+  local_laplacian_buffers_t *ll_buffers;
+} dt_iop_bilat_data_t;
 
 typedef struct dt_iop_bilat_gui_data_t
 {
@@ -244,6 +254,13 @@ error_ll:
 #endif
 
 
+// export and thumbnail pipes run once, so only interactive pipes keep their pyramids
+static inline gboolean _keep_pyramids(const dt_dev_pixelpipe_iop_t *piece)
+{
+  return (piece->pipe->type
+          & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2)) != 0;
+}
+
 void tiling_callback(struct dt_iop_module_t *self,
                      struct dt_dev_pixelpipe_iop_t *piece,
                      const dt_iop_roi_t *roi_in,
@@ -284,10 +301,22 @@ void tiling_callback(struct dt_iop_module_t *self,
     const size_t basebuffer = sizeof(float) * channels * width * height;
     const int rad = MIN(roi_in->width, ceilf(256 * roi_in->scale / piece->iscale));
 
-    tiling->factor = 2.0f + (float)local_laplacian_memory_use(width, height) / basebuffer;
+    const size_t pyramids = local_laplacian_memory_use(width, height);
+
+    // pipes keeping their pyramids hold them after process() returned, report them as fixed
+    // overhead. pyramids kept from a larger roi are only freed on the next run.
+    if(_keep_pyramids(piece))
+    {
+      tiling->factor = 2.0f;
+      tiling->overhead = MAX(pyramids, local_laplacian_buffers_size(d->ll_buffers));
+    }
+    else
+    {
+      tiling->factor = 2.0f + (float)pyramids / basebuffer;
+      tiling->overhead = 0;
+    }
     tiling->maxbuf
         = fmax(1.0f, (float)local_laplacian_singlebuffer_size(width, height) / basebuffer);
-    tiling->overhead = 0;
     tiling->overlap = rad;
     tiling->xalign = 1;
     tiling->yalign = 1;
@@ -301,7 +330,19 @@ void commit_params(struct dt_iop_module_t *self,
 {
   dt_iop_bilat_params_t *p = (dt_iop_bilat_params_t *)p1;
   dt_iop_bilat_data_t *d = (dt_iop_bilat_data_t *)piece->data;
-  *d = *p;
+  d->mode = p->mode;
+  d->sigma_r = p->sigma_r;
+  d->sigma_s = p->sigma_s;
+  d->detail = p->detail;
+  d->midtone = p->midtone;
+
+  // don't hold on to the pyramids if they are not going to be used
+  if(d->mode != s_mode_local_laplacian && d->ll_buffers)
+  {
+    local_laplacian_buffers_free(d->ll_buffers);
+    free(d->ll_buffers);
+    d->ll_buffers = NULL;
+  }
 
 #ifdef HAVE_OPENCL
   if(d->mode == s_mode_bilateral)
@@ -325,6 +366,12 @@ void cleanup_pipe(struct dt_iop_module_t *self,
                   dt_dev_pixelpipe_t *pipe,
                   dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_bilat_data_t *d = (dt_iop_bilat_data_t *)piece->data;
+  if(d->ll_buffers)
+  {
+    local_laplacian_buffers_free(d->ll_buffers);
+    free(d->ll_buffers);
+  }
   free(piece->data);
   piece->data = NULL;
 }
@@ -353,6 +400,8 @@ void process(struct dt_iop_module_t *self,
     {
       dt_bilateral_splat(b, (float *)i);
       dt_bilateral_blur(b);
+      // the small navigation preview doesn't need the full precision of the grid
+      if(piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) dt_bilateral_compact(b);
       dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
       dt_bilateral_free(b);
     }
@@ -364,8 +413,19 @@ void process(struct dt_iop_module_t *self,
   }
   else // s_mode_local_laplacian
   {
-    local_laplacian(i, o, roi_in->width, roi_in->height,
-                    d->midtone, d->sigma_s, d->sigma_r, d->detail, 0);
+    const gboolean interactive = _keep_pyramids(piece);
+    if(interactive && !d->ll_buffers)
+      d->ll_buffers = calloc(1, sizeof(local_laplacian_buffers_t));
+
+    // fewer pyramid levels for the navigation preview if requested
+    const int level_limit =
+      (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW)
+      && dt_conf_get_bool("plugins/darkroom/bilat/preview_reduced_levels")
+      ? 6 : 0;
+
+    local_laplacian_buffered(i, o, roi_in->width, roi_in->height,
+                             d->midtone, d->sigma_s, d->sigma_r, d->detail,
+                             level_limit, interactive ? d->ll_buffers : NULL);
   }
 }
 
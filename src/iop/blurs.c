@@ -293,6 +293,109 @@ static inline void create_gauss_kernel(float *const restrict buffer,
 
 
 
+static inline void create_gauss_kernel_1d(float *const restrict buffer, const size_t width)
+{
+  // create_gauss_kernel() is the outer product of this kernel with itself
+  const float radius = (width - 1) / 2.f - 1;
+
+  float norm = 0.f;
+  for(size_t i = 0; i < width; i++)
+  {
+    const float x = (float)(i - 1) / radius - 1;
+    buffer[i] = expf(-4.f * x * x);
+    norm += buffer[i];
+  }
+
+  // normalize to respect the conservation of energy law
+  for(size_t i = 0; i < width; i++)
+    buffer[i] /= norm;
+}
+
+// Gaussian blur as two 1D convolutions, o(N) instead of o(N²) where N is the width of the kernel, with the same
+// constant boundary conditions as process(). The vertical pass goes first, reading whole rows of the input,
+// then each row is blurred in place from a copy in the per-thread scanline.
+__DT_CLONE_TARGETS__
+static void blur_gaussian_separable(const float *const restrict in, float *const restrict out,
+                                    const float *const restrict kernel, const int width, const int height,
+                                    const int radius)
+{
+  size_t padded_size;
+  float *const restrict scanlines = dt_alloc_perthread_float(4 * width, &padded_size);
+  if(!scanlines)
+  {
+    dt_print(DT_DEBUG_ALWAYS,"[blurs] out of memory, skipping blur_gaussian_separable\n");
+    return;
+  }
+
+  // vertical pass
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(in, out, kernel, width, height, radius) \
+    schedule(static)
+#endif
+  for(int i = 0; i < height; i++)
+  {
+    float *const restrict row = out + (size_t)i * width * 4;
+    for(size_t k = 0; k < 4 * width; k++) row[k] = 0.f;
+
+    for(int l = -radius; l <= radius; l++)
+    {
+      const int ii = CLAMP(i + l, 0, height - 1);
+      const float k = kernel[l + radius];
+      const float *const restrict in_row = in + (size_t)ii * width * 4;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(size_t x = 0; x < 4 * width; x++) row[x] += k * in_row[x];
+    }
+  }
+
+  // horizontal pass
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(in, out, kernel, width, height, radius, scanlines, padded_size) \
+    schedule(static)
+#endif
+  for(int i = 0; i < height; i++)
+  {
+    float *const restrict row = out + (size_t)i * width * 4;
+    float *const restrict scanline = dt_get_perthread(scanlines, padded_size);
+    for(size_t k = 0; k < 4 * width; k++) scanline[k] = row[k];
+
+    for(int j = 0; j < width; j++)
+    {
+      dt_aligned_pixel_t acc = { 0.f };
+      if(j >= radius && j < width - radius)
+      {
+        // We are in the safe area, no need to check for out-of-bounds
+        for(int m = -radius; m <= radius; m++)
+        {
+          const float k = kernel[m + radius];
+          for_four_channels(c, aligned(scanline : 64)) acc[c] += k * scanline[(size_t)(j + m) * 4 + c];
+        }
+      }
+      else
+      {
+        for(int m = -radius; m <= radius; m++)
+        {
+          const int jj = CLAMP(j + m, 0, width - 1);
+          const float k = kernel[m + radius];
+          for_four_channels(c, aligned(scanline : 64)) acc[c] += k * scanline[(size_t)jj * 4 + c];
+        }
+      }
+
+      const size_t index = ((size_t)i * width + j) * 4;
+      for_each_channel(c, aligned(acc : 16)) row[(size_t)j * 4 + c] = acc[c];
+
+      // copy alpha
+      row[(size_t)j * 4 + 3] = in[index + 3];
+    }
+  }
+
+  dt_free_align(scanlines);
+}
+
+
 static inline void build_gui_kernel(unsigned char *const buffer, const size_t width, const size_t height,
                                     dt_iop_blurs_params_t *p)
 {
@@ -581,6 +684,21 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   const int radius = MAX(roundf(p->radius / scale), 2);
   const size_t kernel_width = 2 * radius + 1;
 
+  if(p->type == DT_BLUR_GAUSSIAN)
+  {
+    // the Gauss kernel is separable
+    float *const restrict kernel = dt_alloc_align_float(kernel_width);
+    if(!kernel)
+    {
+      dt_print(DT_DEBUG_ALWAYS,"[blurs] out of memory, skipping process\n");
+      return;
+    }
+    create_gauss_kernel_1d(kernel, kernel_width);
+    blur_gaussian_separable(in, out, kernel, roi_out->width, roi_out->height, radius);
+    dt_free_align(kernel);
+    return;
+  }
+
   float *const restrict kernel = dt_alloc_align_float(kernel_width * kernel_width);
   build_pixel_kernel(kernel, kernel_width, kernel_width, p);
 
@@ -124,7 +124,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const float slope = data->slope;
 
   size_t destbuf_size;
-  float *const restrict dest_buf = dt_alloc_perthread_float(roi_out->width, &destbuf_size);
+  float *const restrict dest_buf =
+    dt_dev_pixelpipe_arena_alloc_perthread_float(piece->pipe, roi_out->width, &destbuf_size);
 
 // CLAHE
 #ifdef _OPENMP
@@ -247,7 +248,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     }
   }
 
-  dt_free_align(dest_buf);
+  dt_dev_pixelpipe_arena_free(piece->pipe, dest_buf);
 
   // Cleanup
   free(luminance);
@@ -651,25 +651,45 @@ void process(
       tmp = (float *)dt_alloc_align_float((size_t)4 * roo.width * roo.height);
     }
 
+    // per algorithm and sensor pattern throughput for -d perf,
+    // use together with --bench-module demosaic for stable numbers
+    const char *algo = "";
+    dt_times_t start_time = { 0 };
+    dt_get_perf_times(&start_time);
+
     if(demosaicing_method == DT_IOP_DEMOSAIC_PASSTHROUGH_MONOCHROME)
     {
+      algo = "passthrough monochrome";
       passthrough_monochrome(tmp, pixels, &roo, &roi);
     }
     else if(demosaicing_method == DT_IOP_DEMOSAIC_PASSTHROUGH_COLOR)
     {
+      algo = "passthrough color";
       passthrough_color(tmp, pixels, &roo, &roi, piece->pipe->dsc.filters, xtrans);
     }
     else if(piece->pipe->dsc.filters == 9u)
     {
       const int passes = (demosaicing_method == DT_IOP_DEMOSAIC_MARKESTEIJN) ? 1 : 3;
       if(demosaicing_method == DT_IOP_DEMOSAIC_MARKEST3_VNG)
+      {
+        algo = "markesteijn";
         xtrans_markesteijn_interpolate(tmp, pixels, &roo, &roi, xtrans, passes);
+      }
       else if(demosaicing_method == DT_IOP_DEMOSAIC_FDC && (qual_flags & DT_DEMOSAIC_FULL_SCALE))
+      {
+        algo = "fdc";
         xtrans_fdc_interpolate(self, tmp, pixels, &roo, &roi, xtrans);
+      }
       else if(demosaicing_method >= DT_IOP_DEMOSAIC_MARKESTEIJN && (qual_flags & DT_DEMOSAIC_FULL_SCALE))
+      {
+        algo = "markesteijn";
         xtrans_markesteijn_interpolate(tmp, pixels, &roo, &roi, xtrans, passes);
+      }
       else
+      {
+        algo = "vng";
         vng_interpolate(tmp, pixels, &roo, &roi, piece->pipe->dsc.filters, xtrans, qual_flags & DT_DEMOSAIC_ONLY_VNG_LINEAR);
+      }
     }
     else
     {
@@ -703,6 +723,7 @@ void process(
 
       if(demosaicing_method == DT_IOP_DEMOSAIC_VNG4 || (img->flags & DT_IMAGE_4BAYER))
       {
+        algo = "vng4";
         vng_interpolate(tmp, in, &roo, &roi, piece->pipe->dsc.filters, xtrans, qual_flags & DT_DEMOSAIC_ONLY_VNG_LINEAR);
         if(img->flags & DT_IMAGE_4BAYER)
         {
@@ -712,21 +733,43 @@ void process(
       }
       else if((demosaicing_method & ~DT_DEMOSAIC_DUAL) == DT_IOP_DEMOSAIC_RCD)
       {
+        algo = "rcd";
         rcd_demosaic(piece, tmp, in, &roo, &roi, piece->pipe->dsc.filters);
       }
       else if(demosaicing_method == DT_IOP_DEMOSAIC_LMMSE)
       {
+        algo = "lmmse";
         lmmse_demosaic(piece, tmp, in, &roo, &roi, piece->pipe->dsc.filters, data->lmmse_refine);
       }
       else if((demosaicing_method & ~DT_DEMOSAIC_DUAL) != DT_IOP_DEMOSAIC_AMAZE)
+      {
+        algo = "ppg";
         demosaic_ppg(tmp, in, &roo, &roi, piece->pipe->dsc.filters, data->median_thrs);
+      }
       else
+      {
+        algo = "amaze";
         amaze_demosaic(piece, in, tmp, &roi, &roo, piece->pipe->dsc.filters);
+      }
 
       if(!(img->flags & DT_IMAGE_4BAYER) && data->green_eq != DT_IOP_GREEN_EQ_NO)
         dt_free_align(in);
     }
 
+    if(darktable.unmuted & DT_DEBUG_PERF)
+    {
+      dt_times_t end_time;
+      dt_get_times(&end_time);
+      const double clock = fmax(1e-6, end_time.clock - start_time.clock);
+      const double mpix = (double)roo.width * roo.height / 1.0e6;
+      dt_print_pipe(DT_DEBUG_PERF, "demosaic CPU", piece->pipe, self, roi_in, roi_out,
+                    "%s on %s sensor, %.3fs, %.2f mpix, %.2f mpix/s\n",
+                    algo,
+                    piece->pipe->dsc.filters == 9u ? "xtrans"
+                      : (img->flags & DT_IMAGE_4BAYER) ? "4bayer" : "bayer",
+                    clock, mpix, mpix / clock);
+    }
+
     if(piece->pipe->want_detail_mask)
       dt_dev_write_scharr_mask(piece, tmp, roi_in, TRUE);
 
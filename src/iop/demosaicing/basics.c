@@ -16,6 +16,64 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+/* Common tile grid for the tile based CPU demosaicers (rcd, lmmse).
+   Tiles of 'size' pixels are placed every 'valid' pixels, the first one
+   at the image origin, so adjacent tiles overlap by size - valid pixels.
+   'overlap' is the border each tile needs to be stable and decides if a
+   further tile is needed at the right and bottom image border.
+   Keeping the tile size small enough for L2 lets the per-tile loops stay
+   cache resident, and the collapsed tile loop keeps all threads busy even
+   for narrow crops. */
+typedef struct dt_demosaic_tilegrid_t
+{
+  int width, height;
+  int size;
+  int valid;
+  int num_vertical;
+  int num_horizontal;
+} dt_demosaic_tilegrid_t;
+
+typedef struct dt_demosaic_tile_t
+{
+  int rowStart, rowEnd;
+  int colStart, colEnd;
+  gboolean partial;   // the tile is cut by the right or bottom image border
+} dt_demosaic_tile_t;
+
+static inline dt_demosaic_tilegrid_t _demosaic_tilegrid(
+        const int width,
+        const int height,
+        const int size,
+        const int valid,
+        const int overlap)
+{
+  const dt_demosaic_tilegrid_t grid =
+  {
+    .width = width,
+    .height = height,
+    .size = size,
+    .valid = valid,
+    .num_vertical = 1 + (height - 2 * overlap - 1) / valid,
+    .num_horizontal = 1 + (width - 2 * overlap - 1) / valid
+  };
+  return grid;
+}
+
+static inline dt_demosaic_tile_t _demosaic_tile(
+        const dt_demosaic_tilegrid_t *const grid,
+        const int tile_vertical,
+        const int tile_horizontal,
+        const int extent)
+{
+  dt_demosaic_tile_t tile;
+  tile.rowStart = tile_vertical * grid->valid;
+  tile.rowEnd = MIN(tile.rowStart + extent, grid->height);
+  tile.colStart = tile_horizontal * grid->valid;
+  tile.colEnd = MIN(tile.colStart + extent, grid->width);
+  tile.partial = tile.rowStart + extent > grid->height || tile.colStart + extent > grid->width;
+  return tile;
+}
+
 #define SWAP(a, b)                                                                                           \
   {                                                                                                          \
     const float tmp = (b);                                                                                   \
@@ -121,6 +121,7 @@ static inline float _calc_gamma(float val, float *table)
 #ifdef _OPENMP
   #pragma omp declare simd aligned(in, out)
 #endif
+__DT_CLONE_TARGETS__
 static void lmmse_demosaic(
         dt_dev_pixelpipe_iop_t *piece,
         float *const restrict out,
@@ -162,11 +163,13 @@ static void lmmse_demosaic(
                                          piece->pipe->dsc.processed_maximum[2])));
   const float revscaler = 1.0f / scaler;
 
-  const int num_vertical =   1 + (height - 2 * LMMSE_OVERLAP -1) / LMMSE_TILEVALID;
-  const int num_horizontal = 1 + (width  - 2 * LMMSE_OVERLAP -1) / LMMSE_TILEVALID;
+  const dt_demosaic_tilegrid_t grid =
+    _demosaic_tilegrid(width, height, DT_LMMSE_TILESIZE, LMMSE_TILEVALID, LMMSE_OVERLAP);
+  const int num_vertical = grid.num_vertical;
+  const int num_horizontal = grid.num_horizontal;
 #ifdef _OPENMP
   #pragma omp parallel \
-  dt_omp_firstprivate(width, height, out, in, scaler, revscaler, filters)
+  dt_omp_firstprivate(width, height, out, in, scaler, revscaler, filters, grid, num_vertical, num_horizontal)
 #endif
   {
     float *qix[6];
@@ -186,11 +189,11 @@ static void lmmse_demosaic(
     {
       for(int tile_horizontal = 0; tile_horizontal < num_horizontal; tile_horizontal++)
       {
-        const int rowStart = tile_vertical * LMMSE_TILEVALID;
-        const int rowEnd = MIN(rowStart + LMMSE_TILE_INT, height);
-
-        const int colStart = tile_horizontal * LMMSE_TILEVALID;
-        const int colEnd = MIN(colStart + LMMSE_TILE_INT, width);
+        const dt_demosaic_tile_t tile = _demosaic_tile(&grid, tile_vertical, tile_horizontal, LMMSE_TILE_INT);
+        const int rowStart = tile.rowStart;
+        const int rowEnd = tile.rowEnd;
+        const int colStart = tile.colStart;
+        const int colEnd = tile.colEnd;
 
         const int tileRows = MIN(rowEnd - rowStart, LMMSE_TILE_INT);
         const int tileCols = MIN(colEnd - colStart, LMMSE_TILE_INT);
@@ -19,6 +19,7 @@
 #ifdef _OPENMP
   #pragma omp declare simd aligned(in, out)
 #endif
+__DT_CLONE_TARGETS__
 static void demosaic_ppg(
         float *const out,
         const float *const in,
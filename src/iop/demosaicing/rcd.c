@@ -282,6 +282,7 @@ static void rcd_ppg_border(
 #ifdef _OPENMP
   #pragma omp declare simd aligned(in, out)
 #endif
+__DT_CLONE_TARGETS__
 static void rcd_demosaic(
         dt_dev_pixelpipe_iop_t *piece,
         float *const restrict out,
@@ -304,12 +305,14 @@ static void rcd_demosaic(
   const float scaler = fmaxf(piece->pipe->dsc.processed_maximum[0], fmaxf(piece->pipe->dsc.processed_maximum[1], piece->pipe->dsc.processed_maximum[2]));
   const float revscaler = 1.0f / scaler;
 
-  const int num_vertical = 1 + (height - 2 * RCD_BORDER -1) / RCD_TILEVALID;
-  const int num_horizontal = 1 + (width - 2 * RCD_BORDER -1) / RCD_TILEVALID;
+  const dt_demosaic_tilegrid_t grid =
+    _demosaic_tilegrid(width, height, DT_RCD_TILESIZE, RCD_TILEVALID, RCD_BORDER);
+  const int num_vertical = grid.num_vertical;
+  const int num_horizontal = grid.num_horizontal;
 
 #ifdef _OPENMP
   #pragma omp parallel \
-  dt_omp_firstprivate(width, height, filters, out, in, scaler, revscaler)
+  dt_omp_firstprivate(width, height, filters, out, in, scaler, revscaler, grid, num_vertical, num_horizontal)
 #endif
   {
     float *const VH_Dir = dt_alloc_align_float((size_t) DT_RCD_TILESIZE * DT_RCD_TILESIZE);
@@ -332,16 +335,16 @@ static void rcd_demosaic(
     {
       for(int tile_horizontal = 0; tile_horizontal < num_horizontal; tile_horizontal++)
       {
-        const int rowStart = tile_vertical * RCD_TILEVALID;
-        const int rowEnd = MIN(rowStart + DT_RCD_TILESIZE, height);
-
-        const int colStart = tile_horizontal * RCD_TILEVALID;
-        const int colEnd = MIN(colStart + DT_RCD_TILESIZE, width);
+        const dt_demosaic_tile_t tile = _demosaic_tile(&grid, tile_vertical, tile_horizontal, DT_RCD_TILESIZE);
+        const int rowStart = tile.rowStart;
+        const int rowEnd = tile.rowEnd;
+        const int colStart = tile.colStart;
+        const int colEnd = tile.colEnd;
 
         const int tileRows = MIN(rowEnd - rowStart, DT_RCD_TILESIZE);
         const int tileCols = MIN(colEnd - colStart, DT_RCD_TILESIZE);
 
-        if(rowStart + DT_RCD_TILESIZE > height || colStart + DT_RCD_TILESIZE > width)
+        if(tile.partial)
         {
           // VH_Dir is only filled for(4,4)..(height-4,width-4), but the refinement code reads (3,3)...(h-3,w-3),
           // so we need to ensure that the border is zeroed for partial tiles to get consistent results
@@ -18,6 +18,7 @@
 
 /* taken from dcraw and demosaic_ppg below */
 
+__DT_CLONE_TARGETS__
 static void lin_interpolate(
         float *out,
         const float *const in,
@@ -152,6 +153,7 @@ static inline void _ensure_abovezero(float *to, float *from, const int floats)
     to[i] = fmaxf(0.0f, from[i]);
 }
 
+__DT_CLONE_TARGETS__
 static void vng_interpolate(
         float *out,
         const float *const in,
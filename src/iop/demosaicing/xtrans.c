@@ -40,6 +40,7 @@ static inline const short *_hexmap(
 /*
    Frank Markesteijn's algorithm for Fuji X-Trans sensors
 */
+__DT_CLONE_TARGETS__
 static void xtrans_markesteijn_interpolate(
         float *out,
         const float *const in,
@@ -522,6 +523,7 @@ static void xtrans_markesteijn_interpolate(
 #undef TS
 
 #define TS 122
+__DT_CLONE_TARGETS__
 static void xtrans_fdc_interpolate(
         struct dt_iop_module_t *self,
         float *out,
@@ -789,7 +789,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING
+    | IOP_FLAGS_PIPE_DEPENDENT;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
@@ -1799,6 +1800,11 @@ static void process_nlmeans(struct dt_iop_module_t *self,
   const float compensate_p =
     nlmeans_precondition(d, piece, wb, ivoid, roi_in, scale, in, aa, bb, p);
 
+  // optional coarse-to-fine search for large search windows in interactive pipes
+  const gboolean adaptive = K >= 6
+    && !(piece->pipe->type & DT_DEV_PIXELPIPE_EXPORT)
+    && dt_conf_get_bool("plugins/darkroom/denoiseprofile/adaptive_search");
+
   const dt_aligned_pixel_t norm2 = { 1.0f, 1.0f, 1.0f, 1.0f };
   const dt_nlmeans_param_t params = { .scattering = scattering,
                                       .scale = scale,
@@ -1808,7 +1814,7 @@ static void process_nlmeans(struct dt_iop_module_t *self,
                                       .sharpness = norm,
                                       .patch_radius = P,
                                       .search_radius = K,
-                                      .decimate = 0,
+                                      .decimate = adaptive ? DT_NLMEANS_ADAPTIVE : DT_NLMEANS_EXACT,
                                       .norm = norm2 };
   nlmeans_denoise(in, ovoid, roi_in, roi_out, &params);
 
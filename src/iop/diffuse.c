@@ -1162,7 +1162,9 @@ static inline gint wavelets_process(const float *const restrict in,
                                     const int has_mask,
                                     float *const restrict HF[MAX_NUM_SCALES],
                                     float *const restrict LF_odd,
-                                    float *const restrict LF_even)
+                                    float *const restrict LF_even,
+                                    float *const restrict tempbuf,
+                                    const size_t padded_size)
 {
   gint success = TRUE;
 
@@ -1186,9 +1188,6 @@ static inline gint wavelets_process(const float *const restrict in,
   // https://jo.dreggn.org/home/2010_atrous.pdf the wavelets
   // decomposition here is the same as the equalizer/atrous module,
   float *restrict residual; // will store the temp buffer containing the last step of blur
-  // allocate a one-row temporary buffer for the decomposition
-  size_t padded_size;
-  float *const restrict tempbuf = dt_alloc_perthread_float(4 * width, &padded_size); //TODO: alloc in caller
   for(int s = 0; s < scales; ++s)
   {
     /* fprintf(stdout, "Wavelet decompose : scale %i\n", s); */
@@ -1228,7 +1227,6 @@ static inline gint wavelets_process(const float *const restrict in,
       dt_dump_pfm(name, buffer_out, width, height, 4 * sizeof(float), "diffuse");
     }
   }
-  dt_free_align(tempbuf);
 
   // will store the temp buffer NOT containing the last step of blur
   float *restrict temp = (residual == LF_even) ? LF_odd : LF_even;
@@ -1368,7 +1366,8 @@ void process(dt_iop_module_t *self,
     return;
   }
 
-  uint8_t *const restrict mask = dt_alloc_align(64, sizeof(uint8_t) * width * height);
+  dt_dev_pixelpipe_t *const pipe = piece->pipe;
+  uint8_t *const restrict mask = dt_dev_pixelpipe_arena_alloc(pipe, sizeof(uint8_t) * width * height);
 
   float *restrict in = DT_IS_ALIGNED((float *const restrict)ivoid);
   float *const restrict out = DT_IS_ALIGNED((float *const restrict)ovoid);
@@ -1390,6 +1389,7 @@ void process(dt_iop_module_t *self,
   {
     dt_print(DT_DEBUG_ALWAYS,"[diffuse] out of memory, skipping\n");
     dt_iop_copy_image_roi(ovoid, ivoid, piece->colors, roi_in, roi_out);
+    dt_dev_pixelpipe_arena_free(pipe, mask);
     return;
   }
   const float scale = fmaxf(piece->iscale / roi_in->scale, 1.f);
@@ -1406,14 +1406,18 @@ void process(dt_iop_module_t *self,
   float *restrict HF[MAX_NUM_SCALES];
   for(int s = 0; s < scales; s++)
   {
-    HF[s] = dt_alloc_align_float(width * height * 4);
+    HF[s] = dt_dev_pixelpipe_arena_alloc_float(pipe, width * height * 4);
     if(!HF[s]) out_of_memory = TRUE;
   }
 
+  // one-row temporary buffer per thread for the decomposition
+  size_t padded_size;
+  float *const restrict tempbuf = dt_dev_pixelpipe_arena_alloc_perthread_float(pipe, 4 * width, &padded_size);
+
   // PAUSE !
   // check that all buffers exist before processing,
   // because we use a lot of memory here.
-  if(!temp1 || !temp2 || !LF_odd || !LF_even || out_of_memory)
+  if(!temp1 || !temp2 || !LF_odd || !LF_even || !tempbuf || out_of_memory)
   {
     dt_control_log(_("diffuse/sharpen failed to allocate memory, check your RAM settings"));
     goto error;
@@ -1455,16 +1459,18 @@ void process(dt_iop_module_t *self,
 
     wavelets_process(temp_in, temp_out, mask,
                      roi_out->width, roi_out->height,
-                     data, final_radius, scale, scales, has_mask, HF, LF_odd, LF_even);
+                     data, final_radius, scale, scales, has_mask, HF, LF_odd, LF_even,
+                     tempbuf, padded_size);
   }
 
 error:
-  if(mask) dt_free_align(mask);
+  dt_dev_pixelpipe_arena_free(pipe, mask);
+  dt_dev_pixelpipe_arena_free(pipe, tempbuf);
   if(temp1) dt_free_align(temp1);
   if(temp2) dt_free_align(temp2);
   if(LF_even) dt_free_align(LF_even);
   if(LF_odd) dt_free_align(LF_odd);
-  for(int s = 0; s < scales; s++) if(HF[s]) dt_free_align(HF[s]);
+  for(int s = 0; s < scales; s++) dt_dev_pixelpipe_arena_free(pipe, HF[s]);
 }
 
 #if HAVE_OPENCL
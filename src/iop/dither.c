@@ -129,7 +129,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_SUPPORTS_BLENDING
+    | IOP_FLAGS_PIPE_DEPENDENT;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
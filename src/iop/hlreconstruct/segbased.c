@@ -583,20 +583,9 @@ static void _process_segmentation(dt_dev_pixelpipe_iop_t *piece,
   for(int p = 0; p < HL_RGB_PLANES; p++)
     dt_segments_combine(&isegments[p], data->combine);
 
-  if(dt_get_num_threads() >= HL_RGB_PLANES)
-  {
-#ifdef _OPENMP
-  #pragma omp parallel num_threads(HL_RGB_PLANES)
-#endif
-    {
-      dt_segmentize_plane(&isegments[dt_get_thread_num()]);
-    }
-  }
-  else
-  {
-    for(int p = 0; p < HL_RGB_PLANES; p++)
-      dt_segmentize_plane(&isegments[p]);
-  }
+  // segmentizing is parallel within the planes
+  for(int p = 0; p < HL_RGB_PLANES; p++)
+    dt_segmentize_plane(&isegments[p]);
 
   for(int p = 0; p < HL_RGB_PLANES; p++)
     _calc_plane_candidates(plane[p], refavg[p], &isegments[p], cube_coeffs[p], data->candidating);
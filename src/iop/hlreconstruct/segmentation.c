@@ -21,8 +21,8 @@
 
    Morphological closing operation supporting radius up to 8, tuned for performance
 
-   The segmentation algorithm uses a modified floodfill, while floddfilling it
-   - also takes keeps track of the surrounding rectangle of every segment and
+   The segmentation algorithm is a parallel connected component labeling, it
+   - also keeps track of the surrounding rectangle of every segment and
    - marks the segment border locations.
 
    Hanno Schwalm 2022/05
@@ -30,16 +30,10 @@
 
 #define DT_SEG_ID_MASK 0x40000
 
-typedef struct dt_pos_t
-{
-  int xpos;
-  int ypos;
-} dt_pos_t;
-
 typedef struct dt_iop_segmentation_t
 {
   uint32_t *data; // holding segment id's for every location
-  uint32_t *tmp;  // pointer to temporary buffer used for morphological operations
+  uint32_t *tmp;  // pointer to temporary buffer used for morphological operations and labeling
   int *size;      // size of each segment
   int *xmin;      // bounding rectangle for each segment
   int *xmax;
@@ -54,26 +48,6 @@ typedef struct dt_iop_segmentation_t
   int height;
 } dt_iop_segmentation_t;
 
-typedef struct dt_ff_stack_t
-{
-  int pos;
-  int size;
-  dt_pos_t *el;
-} dt_ff_stack_t;
-
-static inline void _push_stack(int xpos, int ypos, dt_ff_stack_t *stack)
-{
-  const int i = stack->pos;
-  if(i >= stack->size - 1)
-  {
-    dt_print(DT_DEBUG_ALWAYS, "[segmentation stack overflow] %i\n", stack->size);
-    return;
-  }
-  stack->el[i].xpos = xpos;
-  stack->el[i].ypos = ypos;
-  stack->pos++;
-}
-
 static inline void _clear_segment_slot(dt_iop_segmentation_t *seg, uint32_t id)
 {
   if(id > seg->slots-1)
@@ -83,15 +57,6 @@ static inline void _clear_segment_slot(dt_iop_segmentation_t *seg, uint32_t id)
   seg->val1[id] = seg->val2[id] = 0.0f;
 }
 
-static inline dt_pos_t * _pop_stack(dt_ff_stack_t *stack)
-{
-  if(stack->pos > 0)
-    stack->pos--;
-  else
-    dt_print(DT_DEBUG_ALWAYS, "[segmentation stack underflow]\n");
-  return &stack->el[stack->pos];
-}
-
 static inline uint32_t _get_segment_id(dt_iop_segmentation_t *seg, const size_t loc)
 {
   if(loc >= (size_t)(seg->width * (seg->height-seg->border)))
@@ -101,206 +66,120 @@ static inline uint32_t _get_segment_id(dt_iop_segmentation_t *seg, const size_t
   return ((id < seg->nr) && (id > 1)) ? id : 0;
 }
 
-static inline int _test_dilate(const uint32_t *img, const size_t i, const size_t w1, const int radius)
+// half widths of the rows of the discs used for dilating (radius 1-8) and eroding (radius 1-5),
+// indexed by radius and vertical distance from the center
+static const uint8_t _disc_halfwidth[9][9] =
 {
-  int retval = 0;
-  retval = img[i-w1-1] | img[i-w1] | img[i-w1+1] |
-           img[i-1]    | img[i]    | img[i+1] |
-           img[i+w1-1] | img[i+w1] | img[i+w1+1];
-  if(retval || (radius < 2)) return retval;
-
-  const size_t w2 = 2*w1;
-  retval = img[i-w2-1] | img[i-w2]   | img[i-w2+1] |
-           img[i-w1-2] | img[i-w1+2] |
-           img[i-2]    | img[i+2] |
-           img[i+w1-2] | img[i+w1+2] |
-           img[i+w2-1] | img[i+w2]   | img[i+w2+1];
-  if(retval || (radius < 3)) return retval;
-
-  const size_t w3 = 3*w1;
-  retval = img[i-w3-2] | img[i-w3-1] | img[i-w3] | img[i-w3+1] | img[i-w3+2] |
-           img[i-w2-3] | img[i-w2-2] | img[i-w2+2] | img[i-w2+3] |
-           img[i-w1-3] | img[i-w1+3] |
-           img[i-3]    | img[i+3]    |
-           img[i+w1-3] | img[i+w1+3] |
-           img[i+w2-3] | img[i+w2-2] | img[i+w2+2] | img[i+w2+3] |
-           img[i+w3-2] | img[i+w3-1] | img[i+w3] | img[i+w3+1] | img[i+w3+2]; 
-  if(retval || (radius < 4)) return retval;
-
-  const size_t w4 = 4*w1;
-  retval = img[i-w4-2] | img[i-w4-1] | img[i-w4] | img[i-w4+1] | img[i-w4+2] |
-           img[i-w3-3] | img[i-w3+3] |
-           img[i-w2-4] | img[i-w2+4] |
-           img[i-w1-4] | img[i-w1+4] |
-           img[i-4]    | img[i+4] |
-           img[i+w1-4] | img[i+w1+4] |
-           img[i+w2-4] | img[i+w2+4] |
-           img[i+w3-3] | img[i+w3+3] |
-           img[i+w4-2] | img[i+w4-1] | img[i+w4] | img[i+w4+1] | img[i+w4+2];
-  if(retval || (radius < 5)) return retval;
-
-  const size_t w5 = 5*w1;
-  retval = img[i-w5-2] | img[i-w5-1] | img[i-w5] | img[i-w5+1] | img[i-w5+2] |
-           img[i-w4-4] | img[i-w4-3] | img[i-w4+3] | img[i-w4+4] |
-           img[i-w3-4] | img[i-w3+4] |
-           img[i-w2-5] | img[i-w2+5] |
-           img[i-w1-5] | img[i-w1+5] |
-           img[i-5]    | img[i+5] |
-           img[i+w1-5] | img[i+w1+5] |
-           img[i+w2-5] | img[i+w2+5] |
-           img[i+w3-4] | img[i+w3+4] |
-           img[i+w4-4] | img[i+w4-3] | img[i+w4+3] | img[i+w4+4] |
-           img[i+w5-2] | img[i+w5-1] | img[i+w5] | img[i+w5+1] | img[i+w5+2]; 
-  if(retval || (radius < 6)) return retval;
-
-  const size_t w6 = 6*w1;
-  retval = img[i-w6-2] | img[i-w6-1] | img[i-w6] | img[i-w6+1] | img[i-w6+2] |
-           img[i-w5-4] | img[i-w5-3] | img[i-w5+3] | img[i-w5+4] |
-           img[i-w4-5] | img[i-w4+5] |
-           img[i-w3-5] | img[i-w3+5] |
-           img[i-w2-6] | img[i-w2+6] |
-           img[i-w1-6] | img[i-w1+6] |
-           img[i-6]    | img[i+6] |
-           img[i+w1-6] | img[i+w1+6] |
-           img[i+w2-6] | img[i+w2+6] |
-           img[i+w3-5] | img[i+w3+5] |
-           img[i+w4-5] | img[i+w4+5] |
-           img[i+w5-4] | img[i+w5-3] | img[i+w5+3] | img[i+w5+4] |
-           img[i+w6-2] | img[i+w6-1] | img[i+w6] | img[i+w6+1] | img[i+w6+2] ;
-  if(retval || (radius < 7)) return retval;
-
-  const size_t w7 = 7*w1;
-  retval = img[i-w7-3] | img[i-w7-2] | img[i-w7-1] | img[i-w7] | img[i-w7+1] | img[i-w7+2] | img[i-w7+3] |
-           img[i-w6-4] | img[i-w6-3] | img[i-w6+3] | img[i-w6+4] |
-           img[i-w5-6] | img[i-w5-5] | img[i-w5+5] | img[i-w5+6] |
-           img[i-w4-6] | img[i-w4+6] |
-           img[i-w3-7] | img[i-w3-6] | img[i-w3+6] | img[i-w3+7] |
-           img[i-w2-7] | img[i-w2+7] |
-           img[i-w1-7] | img[i-w1+7] |
-           img[i-7]    | img[i+7] |
-           img[i+w1-7] | img[i+w1+7] |
-           img[i+w2-7] | img[i+w2+7] |
-           img[i+w3-7] | img[i+w3-6] | img[i+w3+6] | img[i+w3+7] |
-           img[i+w4-6] | img[i+w4+6] |
-           img[i+w5-6] | img[i+w5-5] | img[i+w5+5] | img[i+w5+6] |
-           img[i+w6-4] | img[i+w6-3] | img[i+w6+3] | img[i+w6+4] |
-           img[i+w7-3] | img[i+w7-2] | img[i+w7-1] | img[i+w7] | img[i+w7+1] | img[i+w7+2] | img[i+w7+3];
-  if(retval || (radius < 8)) return retval;
-
-  const size_t w8 = 8*w1;
-  retval = img[i-w8-4] | img[i-w8-3] | img[i-w8-2] | img[i-w8-1] | img[i-w8] | img[i-w8+1] | img[i-w8+2] | img[i-w8+3] | img[i-w8+4] |
-           img[i-w7-6] | img[i-w7-5] | img[i-w7-4] | img[i-w7+4] | img[i-w7+5] | img[i-w7+6] |
-           img[i-w6-6] | img[i-w6-5] | img[i-w6+5] | img[i-w6+6] |
-           img[i-w5-7] | img[i-w5+6] |
-           img[i-w4-8] | img[i-w4-7] | img[i-w4+7] | img[i-w4+8] |
-           img[i-w3-8] | img[i-w3-7] | img[i-w3+7] | img[i-w3+8] |
-           img[i-w2-8] | img[i-w2+8] |
-           img[i-w1-8] | img[i-w1+8] |
-           img[i-8]    | img[i+8] |
-           img[i+w1-8] | img[i+w1+8] |
-           img[i+w2-8] | img[i+w2+8] |
-           img[i+w3-8] | img[i+w3-7] | img[i+w3+7] | img[i+w3+8] |
-           img[i+w4-8] | img[i+w4-7] | img[i+w4+7] | img[i+w4+8] |
-           img[i+w5-7] | img[i+w5+7] |
-           img[i+w6-6] | img[i+w6-5] | img[i+w6+5] | img[i+w6+6] |
-           img[i+w7-6] | img[i+w7-5] | img[i+w7-4] | img[i+w7+4] | img[i+w7+5] | img[i-w7+6] |
-           img[i+w8-4] | img[i+w8-3] | img[i+w8-2] | img[i+w8-1] | img[i+w8] | img[i+w8+1] | img[i+w8+2] | img[i+w8+3] | img[i+w8+4];
-  return retval;
+  { 0 },
+  { 1, 1 },
+  { 2, 2, 1 },
+  { 3, 3, 3, 2 },
+  { 4, 4, 4, 3, 2 },
+  { 5, 5, 5, 4, 4, 2 },
+  { 6, 6, 6, 5, 5, 4, 2 },
+  { 7, 7, 7, 7, 6, 6, 4, 3 },
+  { 8, 8, 8, 8, 8, 7, 6, 6, 4 }
+};
+
+// for every location the horizontal distance to the nearest set (or cleared) location in the row, clipped to 255
+static void _row_distance(const uint32_t *img,
+                          uint8_t *dist,
+                          const int w1,
+                          const int height,
+                          const gboolean set)
+{
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) \
+  dt_omp_firstprivate(img, dist, height, w1, set) \
+  schedule(static)
+#endif
+  for(int row = 0; row < height; row++)
+  {
+    const uint32_t *const in = img + (size_t)row * w1;
+    uint8_t *const out = dist + (size_t)row * w1;
+    int d = 255;
+    for(int col = 0; col < w1; col++)
+    {
+      d = ((in[col] != 0) == set) ? 0 : MIN(d + 1, 255);
+      out[col] = d;
+    }
+    d = 255;
+    for(int col = w1 - 1; col >= 0; col--)
+    {
+      d = ((in[col] != 0) == set) ? 0 : MIN(d + 1, 255);
+      out[col] = MIN(out[col], d);
+    }
+  }
 }
 
+/* The discs are convex in every row, so a location is set by dilating if in any row of the disc
+   the horizontal distance to a set location is within the half width of the disc's row.
+   Eroding is the same with the distance to a cleared location.
+*/
 static inline void _dilating(const uint32_t *img,
                              uint32_t *o,
+                             uint8_t *dist,
                              const int w1,
                              const int height,
                              const int border,
                              const int radius)
 {
+  const int r = CLAMP(radius, 1, 8);
+  _row_distance(img, dist, w1, height, TRUE);
 #ifdef _OPENMP
   #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(img, o, height, w1, border, radius) \
-  schedule(static) collapse(2)
+  dt_omp_firstprivate(dist, o, height, w1, border, r) \
+  dt_omp_sharedconst(_disc_halfwidth) \
+  schedule(static)
 #endif
   for(int row = border; row < height - border; row++)
   {
+    uint32_t *const out = o + (size_t)row * w1;
     for(int col = border; col < w1 - border; col++)
+      out[col] = 0;
+    for(int dy = -r; dy <= r; dy++)
     {
-      const size_t i = (size_t)row*w1 + col;
-      o[i] = _test_dilate(img, i, w1, radius) ? 1 : 0;
+      const uint8_t *const drow = dist + (size_t)(row + dy) * w1;
+      const uint8_t hw = _disc_halfwidth[r][abs(dy)];
+#ifdef _OPENMP
+      #pragma omp simd
+#endif
+      for(int col = border; col < w1 - border; col++)
+        out[col] |= drow[col] <= hw;
     }
   }
 }
 
-static inline int _test_erode(const uint32_t *img, const size_t i, const size_t w1, const int radius)
-{
-  int retval = 1;
-  retval =     img[i-w1-1] & img[i-w1] & img[i-w1+1] &
-               img[i-1]    & img[i]    & img[i+1] &
-               img[i+w1-1] & img[i+w1] & img[i+w1+1];
-  if((retval == 0) || (radius < 2)) return retval;
-
-  const size_t w2 = 2*w1;
-  retval = img[i-w2-1] & img[i-w2]   & img[i-w2+1] &
-           img[i-w1-2] & img[i-w1+2] &
-           img[i-2]    & img[i+2] &
-           img[i+w1-2] & img[i+w1+2] &
-           img[i+w2-1] & img[i+w2]   & img[i+w2+1];
-  if((retval == 0) || (radius < 3)) return retval;
-
-  const size_t w3 = 3*w1;
-  retval = img[i-w3-2] & img[i-w3-1] & img[i-w3] & img[i-w3+1] & img[i-w3+2] &
-           img[i-w2-3] & img[i-w2-2] & img[i-w2+2] & img[i-w2+3] &
-           img[i-w1-3] & img[i-w1+3] &
-           img[i-3]    & img[i+3]    &
-           img[i+w1-3] & img[i+w1+3] &
-           img[i+w2-3] & img[i+w2-2] & img[i+w2+2] & img[i+w2+3] &
-           img[i+w3-2] & img[i+w3-1] & img[i+w3] & img[i+w3+1] & img[i+w3+2]; 
-  if((retval == 0) || (radius < 4)) return retval;
-
-  const size_t w4 = 4*w1;
-  retval = img[i-w4-2] & img[i-w4-1] & img[i-w4] & img[i-w4+1] & img[i-w4+2] &
-           img[i-w3-3] & img[i-w3+3] &
-           img[i-w2-4] & img[i-w2+4] &
-           img[i-w1-4] & img[i-w1+4] &
-           img[i-4]    & img[i+4] &
-           img[i+w1-4] & img[i+w1+4] & 
-           img[i+w2-4] & img[i+w2+4] & 
-           img[i+w3-3] & img[i+w3+3] &
-           img[i+w4-2] & img[i+w4-1] & img[i+w4] & img[i+w4+1] & img[i+w4+2]; 
-  if((retval == 0) || (radius < 5)) return retval;
-
-  const size_t w5 = 5*w1;
-  retval = img[i-w5-2] & img[i-w5-1] & img[i-w5] & img[i-w5+1] & img[i-w5+2] &
-           img[i-w4-4] & img[i-w4-3] & img[i-w4+3] & img[i-w4+4] &
-           img[i-w3-4] & img[i-w3+4] &
-           img[i-w2-5] & img[i-w2+5] &
-           img[i-w1-5] & img[i-w1+5] &
-           img[i-5]    & img[i+5] &
-           img[i+w1-5] & img[i+w1+5] &
-           img[i+w2-5] & img[i+w2+5] &
-           img[i+w3-4] & img[i+w3+4] &
-           img[i+w4-4] & img[i+w4-3] & img[i+w4+3] & img[i+w4+4] &
-           img[i+w5-2] & img[i+w5-1] & img[i+w5] & img[i+w5+1] & img[i+w5+2]; 
-  return retval;
-}
-
 static inline void _eroding(const uint32_t *img,
                             uint32_t *o,
+                            uint8_t *dist,
                             const int w1,
                             const int height,
                             const int border,
                             const int radius)
 {
+  const int r = CLAMP(radius, 1, 5);
+  _row_distance(img, dist, w1, height, FALSE);
 #ifdef _OPENMP
   #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(img, o, height, w1, border, radius) \
-  schedule(static) collapse(2)
+  dt_omp_firstprivate(dist, o, height, w1, border, r) \
+  dt_omp_sharedconst(_disc_halfwidth) \
+  schedule(static)
 #endif
   for(int row = border; row < height - border; row++)
   {
+    uint32_t *const out = o + (size_t)row * w1;
     for(int col = border; col < w1 - border; col++)
+      out[col] = 1;
+    for(int dy = -r; dy <= r; dy++)
     {
-      const size_t i = (size_t)row*w1 + col; 
-      o[i] = _test_erode(img, i, w1, radius) ? 1 : 0;
+      const uint8_t *const drow = dist + (size_t)(row + dy) * w1;
+      const uint8_t hw = _disc_halfwidth[r][abs(dy)];
+#ifdef _OPENMP
+      #pragma omp simd
+#endif
+      for(int col = border; col < w1 - border; col++)
+        out[col] &= drow[col] > hw;
     }
   }
 }
@@ -324,270 +203,268 @@ static inline void _intimage_borderfill(uint32_t *d,
   }
 }
 
-static gboolean _floodfill_segmentize(int yin,
-                                      int xin,
-                                      dt_iop_segmentation_t *seg,
-                                      const int w,
-                                      const int h,
-                                      const int id,
-                                      dt_ff_stack_t *stack)
-{
-  if(id >= seg->slots - 2) return FALSE;
+/* Connected component labeling
 
-  const int border = seg->border;
-  uint32_t *d = seg->data;
-  int xp = 0;
-  int yp = 0;
-  size_t rp = 0;
-  int min_x = xin;
-  int max_x = xin;
-  int min_y = yin;
-  int max_y = yin;
-  int cnt = 0;
-  stack->pos = 0;
-  _clear_segment_slot(seg, id);
+   Clipped locations (data == 1) are 4-connected within the unbordered area. The rows are split into bands
+   labeled in parallel, every band has its own range of labels in a union-find table, always linking to
+   the smaller label. Labels are created in scan order, so the root of a component is the label created
+   at its first location. After merging the components crossing band boundaries, numbering the roots -
+   skipping components smaller than 4 locations - gives the same ids as floodfilling in scan order did.
 
-  _push_stack(xin, yin, stack);
-  while(stack->pos)
+   A free location next to a segment is marked as its border (DT_SEG_ID_MASK | id) by the smallest
+   neighbouring id, like the floodfill did, except for locations within two rows or columns of the
+   unbordered area towards the neighbouring segment location.
+   (The floodfill checked the column instead of the row above popped locations, so the marks in the
+   first rows depended on the filling order.)
+*/
+
+static inline uint32_t _uf_find(uint32_t *parent, uint32_t i)
+{
+  while(parent[i] != i)
   {
-    dt_pos_t *coord = _pop_stack(stack);
-    const int x = coord->xpos;
-    const int y = coord->ypos;
-    if(d[y*w+x] == 1)
-    {
-      int yUp = y - 1, yDown = y + 1;
-      gboolean lastXUp = FALSE, lastXDown = FALSE, firstXUp = FALSE, firstXDown = FALSE;
-      d[y*w+x] = id;
-      cnt++;
-      if(yUp >= border && d[yUp*w+x] == 1)
-      {
-        _push_stack(x, yUp, stack); firstXUp = lastXUp = TRUE;
-      }
-      else
-      {
-        xp = x;
-        yp = yUp;
-        rp = yp*w + xp;
-        if(xp > border+1 && d[rp] == 0)
-        {
-          min_x = MIN(min_x, xp);
-          max_x = MAX(max_x, xp);
-          min_y = MIN(min_y, yp);
-          max_y = MAX(max_y, yp);
-          d[rp] = DT_SEG_ID_MASK | id;
-        }
-      }
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
 
-      if(yDown < h-border && d[yDown*w+x] == 1)
-      {
-        _push_stack(x, yDown, stack); firstXDown = lastXDown = TRUE;
-      }
-      else
-      {
-        xp = x;
-        yp = yDown;
-        rp = yp*w + xp;
-        if(yp < h-border-2 && d[rp] == 0)
-        {
-          min_x = MIN(min_x, xp);
-          max_x = MAX(max_x, xp);
-          min_y = MIN(min_y, yp);
-          max_y = MAX(max_y, yp);
-          d[rp] = DT_SEG_ID_MASK | id;
-        }
-      }
+static inline void _uf_union(uint32_t *parent, const uint32_t a, const uint32_t b)
+{
+  const uint32_t ra = _uf_find(parent, a);
+  const uint32_t rb = _uf_find(parent, b);
+  if(ra < rb)
+    parent[rb] = ra;
+  else if(rb < ra)
+    parent[ra] = rb;
+}
 
-      int xr = x + 1;
-      while(xr < w-border && d[y*w+xr] == 1)
-      {
-        d[y*w+xr] = id;
-        cnt++;
-        if(yUp >= border && d[yUp*w + xr] == 1)
-        {
-          if(!lastXUp) { _push_stack(xr, yUp, stack); lastXUp = TRUE; }
-        }
-        else
-        {
-          xp = xr;
-          yp = yUp;
-          rp = yp*w + xp;
-          if(yp > border+1 && d[rp] == 0)
-          {
-            min_x = MIN(min_x, xp);
-            max_x = MAX(max_x, xp);
-            min_y = MIN(min_y, yp);
-            max_y = MAX(max_y, yp);
-            d[rp] = DT_SEG_ID_MASK | id;
-          }
-          lastXUp = FALSE;
-        }
+static inline int _band_row(const int band, const int bands, const int border, const int rows)
+{
+  return border + (int)((size_t)band * rows / bands);
+}
 
-        if(yDown < h-border && d[yDown*w+xr] == 1)
-        {
-          if(!lastXDown) { _push_stack(xr, yDown, stack); lastXDown = TRUE; }
-        }
-        else
-        {
-          xp = xr;
-          yp = yDown;
-          rp = yp*w + xp;
-          if(yp < h-border-2 && d[rp] == 0)
-          {
-            min_x = MIN(min_x, xp);
-            max_x = MAX(max_x, xp);
-            min_y = MIN(min_y, yp);
-            max_y = MAX(max_y, yp);
-            d[rp] = DT_SEG_ID_MASK | id;
-          }
-          lastXDown = FALSE;
-        }
-        xr++;
-      }
+// labels available for a band, a new label needs a free location to the left and above
+static inline size_t _band_labels(const int band, const int bands, const int border, const int rows, const int iwidth)
+{
+  const int brows = _band_row(band + 1, bands, border, rows) - _band_row(band, bands, border, rows);
+  return (size_t)brows * ((iwidth + 1) / 2) + 1;
+}
 
-      xp = xr;
-      yp = y;
-      rp = yp*w + xp;
-      if(xp < w-border-2 && d[rp] == 0) 
-      {
-        min_x = MIN(min_x, xp);
-        max_x = MAX(max_x, xp);
-        min_y = MIN(min_y, yp);
-        max_y = MAX(max_y, yp);
-        d[rp] = DT_SEG_ID_MASK | id;
-      }
+// User interface
+void dt_segmentize_plane(dt_iop_segmentation_t *seg)
+{
+  const int width = seg->width;
+  const int height = seg->height;
+  const int border = seg->border;
+  const int rows = height - 2 * border;
+  const int iwidth = width - 2 * border;
+  const int slots = seg->slots;
+  uint32_t *const d = seg->data;
+  uint32_t *const label = seg->tmp;
+
+  if(rows <= 0 || iwidth <= 0 || border < 1) return;
+
+  const int bands = MAX(1, MIN((int)dt_get_num_threads(), rows / 16));
+  size_t *base = calloc(2 * bands + 1, sizeof(size_t));
+  size_t *used = base ? base + bands + 1 : NULL;
+  uint32_t *parent = NULL;
+  uint32_t *size = NULL;
+  size_t *first = NULL;
+  int *bbox = NULL;
+  int id = 2;
+
+  if(!base) goto error;
+  // label 0 is used for free locations
+  base[0] = 1;
+  for(int band = 0; band < bands; band++)
+    base[band + 1] = base[band] + _band_labels(band, bands, border, rows, iwidth);
+
+  parent = dt_alloc_align(64, base[bands] * sizeof(uint32_t));
+  size = dt_alloc_align(64, base[bands] * sizeof(uint32_t));
+  first = dt_alloc_align(64, base[bands] * sizeof(size_t));
+  if(!parent || !size || !first) goto error;
 
-      int xl = x - 1;
-      lastXUp = firstXUp;
-      lastXDown = firstXDown;
-      while(xl >= border && d[y*w+xl] == 1)
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) \
+  dt_omp_firstprivate(d, label, parent, size, first, base, used, width, height, border, rows, bands) \
+  schedule(static)
+#endif
+  for(int band = 0; band < bands; band++)
+  {
+    const int r0 = _band_row(band, bands, border, rows);
+    const int r1 = _band_row(band + 1, bands, border, rows);
+    uint32_t next = base[band];
+    // the ring around the unbordered area stays free so neighbours can be checked unconditionally
+    if(band == 0)
+      memset(label + (size_t)(border - 1) * width, 0, sizeof(uint32_t) * width);
+    if(band == bands - 1)
+      memset(label + (size_t)(height - border) * width, 0, sizeof(uint32_t) * width);
+    for(int row = r0; row < r1; row++)
+    {
+      label[(size_t)row * width + border - 1] = label[(size_t)row * width + width - border] = 0;
+      for(int col = border; col < width - border; col++)
       {
-        d[y*w+xl] = id;
-        cnt++;
-        if(yUp >= border && d[yUp*w+xl] == 1)
+        const size_t i = (size_t)row * width + col;
+        if(d[i] != 1)
         {
-          if(!lastXUp) { _push_stack(xl, yUp, stack); lastXUp = TRUE; }
+          label[i] = 0;
+          continue;
         }
-        else
-        {
-          xp = xl;
-          yp = yUp;
-          rp = yp*w + xp;
-          if(yp > border+1 && d[rp] == 0)
-          {
-            min_x = MIN(min_x, xp);
-            max_x = MAX(max_x, xp);
-            min_y = MIN(min_y, yp);
-            max_y = MAX(max_y, yp);
-            d[rp] = DT_SEG_ID_MASK | id;
-          }
-          lastXUp = FALSE;
-        }
-
-        if(yDown < h-border && d[yDown*w+xl] == 1)
+        const uint32_t left = label[i-1];
+        const uint32_t up = (row > r0) ? label[i-width] : 0;
+        uint32_t l;
+        if(left)
         {
-          if(!lastXDown) { _push_stack(xl, yDown, stack); lastXDown = TRUE; }
+          l = left;
+          // if the upper left location is taken, up and left are connected already
+          if(up && !label[i-width-1]) _uf_union(parent, left, up);
         }
+        else if(up)
+          l = up;
         else
         {
-          xp = xl;
-          yp = yDown;
-          rp = yp*w + xp;
-          if(yp < h-border-2 && d[rp] == 0)
-          {
-            min_x = MIN(min_x, xp);
-            max_x = MAX(max_x, xp);
-            min_y = MIN(min_y, yp);
-            max_y = MAX(max_y, yp);
-            d[rp] = DT_SEG_ID_MASK | id;
-          }
-          lastXDown = FALSE;
+          l = next++;
+          parent[l] = l;
+          size[l] = 0;
+          first[l] = i;
         }
-        xl--;
+        label[i] = l;
+        size[l]++;
       }
+    }
+    used[band] = next;
+  }
 
-      d[y*w+x] = id;
+  // merge the components crossing band boundaries
+  for(int band = 1; band < bands; band++)
+  {
+    const size_t i0 = (size_t)_band_row(band, bands, border, rows) * width;
+    for(int col = border; col < width - border; col++)
+    {
+      const size_t i = i0 + col;
+      if(label[i] && label[i-width] && !(label[i-1] && label[i-width-1]))
+        _uf_union(parent, label[i], label[i-width]);
+    }
+  }
+
+  // all labels point to their root, roots take the size of the component and finally the segment id.
+  // To avoid oversegmentizing we only use segments with a minimum size of 4
+  for(int band = 0; band < bands; band++)
+    for(uint32_t l = base[band]; l < used[band]; l++)
+      parent[l] = parent[parent[l]];
 
-      xp = xl;
-      yp = y;
-      rp = yp*w + xp;
-      if(xp > border+1 && d[rp] == 0)
+  // the root also takes the first location of the component, the seed of the segment
+  for(int band = 0; band < bands; band++)
+    for(uint32_t l = base[band]; l < used[band]; l++)
+      if(parent[l] != l)
       {
-        min_x = MIN(min_x, xp);
-        max_x = MAX(max_x, xp);
-        min_y = MIN(min_y, yp);
-        max_y = MAX(max_y, yp);
-        d[rp] = DT_SEG_ID_MASK | id;
+        size[parent[l]] += size[l];
+        first[parent[l]] = MIN(first[parent[l]], first[l]);
       }
-    }
-  }
 
-  const gboolean success = cnt > 3;
-  if(!success) // To avoid oversegmentizing we only use segments with a minimum size of 4
-  {
-    // data in too In any case we want to revert border markings too
-    for(int row = min_y; row <= max_y; row++)
+  for(int band = 0; band < bands; band++)
+    for(uint32_t l = base[band]; l < used[band]; l++)
     {
-      for(int col = min_x; col <= max_x; col++)
+      if(parent[l] != l)
+        size[l] = size[parent[l]];
+      else if(size[l] > 3 && id < slots - 2)
       {
-        size_t loc = (size_t)w*row + col;
-        if(d[loc] == id)
-          d[loc] = 1;
-        else if(d[loc] == (id | DT_SEG_ID_MASK))
-          d[loc] = 0;
+        _clear_segment_slot(seg, id);
+        seg->size[id] = size[l];
+        seg->xmin[id] = first[l] % width;
+        seg->ymin[id] = first[l] / width;
+        size[l] = id++;
       }
+      else
+        size[l] = 1;
     }
-  }
-  else
-  {
-    seg->size[id] = cnt;
-    seg->xmin[id] = min_x;
-    seg->xmax[id] = max_x;
-    seg->ymin[id] = min_y;
-    seg->ymax[id] = max_y;
-
-    seg->nr += 1;
-    _clear_segment_slot(seg, id+1);
-  }
+  _clear_segment_slot(seg, id);
+  size[0] = 0;
 
-  return success;
-}
+  const int nseg = id;
+  bbox = dt_alloc_align(64, (size_t)bands * nseg * 4 * sizeof(int));
+  if(!bbox) goto error;
+  seg->nr = id;
+  const uint32_t *const ids = size;
 
-// User interface
-void dt_segmentize_plane(dt_iop_segmentation_t *seg)
-{
-  dt_ff_stack_t stack;  
-  const int width = seg->width;
-  const int height = seg->height;
-  stack.size = (size_t)width * height / 32;
-  stack.el = dt_alloc_align(64, stack.size * sizeof(dt_pos_t));
-  if(!stack.el)
-  {
-    dt_print(DT_DEBUG_ALWAYS, "[segmentize_plane] can't allocate segmentation stack\n");
-    return;
-  }
-  const int border = seg->border;
-  int id = 2;
-  for(int row = border; row < height - border; row++)
+  // write the ids and mark the segment borders, the bounding rectangle holds the first location
+  // and the marked borders
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) \
+  dt_omp_firstprivate(d, label, ids, bbox, nseg, width, height, border, rows, bands) \
+  schedule(static)
+#endif
+  for(int band = 0; band < bands; band++)
   {
-    for(int col = border; col < width - border; col++)
+    int *const box = bbox + (size_t)band * nseg * 4;
+    for(int k = 0; k < nseg; k++)
+    {
+      box[4*k] = box[4*k+2] = INT_MAX;
+      box[4*k+1] = box[4*k+3] = INT_MIN;
+    }
+    const int r0 = _band_row(band, bands, border, rows);
+    const int r1 = _band_row(band + 1, bands, border, rows);
+    for(int row = r0; row < r1; row++)
     {
-      if(id >= (seg->slots - 2))
-        goto finish;
-      if(seg->data[(size_t)width * row + col] == 1)
+      for(int col = border; col < width - border; col++)
       {
-        if(_floodfill_segmentize(row, col, seg, width, height, id, &stack))
-          id++;
+        const size_t i = (size_t)row * width + col;
+        const uint32_t l = label[i];
+        if(l)
+        {
+          d[i] = ids[l];
+          continue;
+        }
+        if(d[i] != 0 || !(label[i-1] | label[i+1] | label[i-width] | label[i+width])) continue;
+
+        const uint32_t below = ids[label[i+width]];
+        const uint32_t above = ids[label[i-width]];
+        const uint32_t left = ids[label[i-1]];
+        const uint32_t right = ids[label[i+1]];
+        uint32_t mark = DT_SEG_ID_MASK;
+        if(below > 1 && row > border + 1)                 mark = below;
+        if(above > 1 && row < height - border - 2)        mark = MIN(mark, above);
+        if(left > 1 && col < width - border - 2)          mark = MIN(mark, left);
+        if(right > 1 && col > border + 1)                 mark = MIN(mark, right);
+        if(mark == DT_SEG_ID_MASK) continue;
+
+        d[i] = DT_SEG_ID_MASK | mark;
+        box[4*mark]   = MIN(box[4*mark], col);
+        box[4*mark+1] = MAX(box[4*mark+1], col);
+        box[4*mark+2] = MIN(box[4*mark+2], row);
+        box[4*mark+3] = MAX(box[4*mark+3], row);
       }
     }
   }
 
-  finish:
+  for(int k = 2; k < nseg; k++)
+  {
+    seg->xmax[k] = seg->xmin[k];
+    seg->ymax[k] = seg->ymin[k];
+    for(int band = 0; band < bands; band++)
+    {
+      const int *const box = bbox + ((size_t)band * nseg + k) * 4;
+      seg->xmin[k] = MIN(seg->xmin[k], box[0]);
+      seg->xmax[k] = MAX(seg->xmax[k], box[1]);
+      seg->ymin[k] = MIN(seg->ymin[k], box[2]);
+      seg->ymax[k] = MAX(seg->ymax[k], box[3]);
+    }
+  }
 
-  if(id >= (seg->slots - 2))
+  if(id >= (slots - 2))
     dt_print(DT_DEBUG_ALWAYS, "[segmentize_plane] %ix%i number of segments exceeds maximum=%i\n",
-             (int)width, (int)height, seg->slots);
+             (int)width, (int)height, slots);
+  goto finish;
+
+  error:
+  dt_print(DT_DEBUG_ALWAYS, "[segmentize_plane] can't allocate segmentation data\n");
 
-  dt_free_align(stack.el);
+  finish:
+  free(base);
+  dt_free_align(parent);
+  dt_free_align(size);
+  dt_free_align(first);
+  dt_free_align(bbox);
 }
 
 void dt_segments_combine(dt_iop_segmentation_t *seg, const int radius)
@@ -596,18 +473,25 @@ void dt_segments_combine(dt_iop_segmentation_t *seg, const int radius)
   const int width = seg->width;
   const int height = seg->height;
   const int border = seg->border;
+  uint8_t *dist = dt_alloc_align(64, (size_t) width * height);
+  if(!dist)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[segments_combine] can't allocate distance buffer\n");
+    return;
+  }
   _intimage_borderfill(img, width, height, 0, border);
 
-  _dilating(img, seg->tmp, width, height, border, radius);
+  _dilating(img, seg->tmp, dist, width, height, border, radius);
   if(radius > 3)
   {
     _intimage_borderfill(seg->tmp, width, height, 1, border);
-    _eroding(seg->tmp, img, width, height, border, radius-3);
+    _eroding(seg->tmp, img, dist, width, height, border, radius-3);
   }
   else
     memcpy(img, seg->tmp, (size_t) width * height * sizeof(uint32_t));
 
   _intimage_borderfill(img, width, height, 0, border);
+  dt_free_align(dist);
 }
 
 void dt_segmentation_free_struct(dt_iop_segmentation_t *seg)
@@ -645,9 +529,9 @@ gboolean dt_segmentation_init_struct(dt_iop_segmentation_t *seg,
   seg->val1 =   dt_alloc_align_float(slots);
   seg->val2 =   dt_alloc_align_float(slots);
 
-  if(!seg->data || !seg->size
+  if(!seg->data || !seg->tmp || !seg->size
                 || !seg->xmin || !seg->xmax || !seg->ymin || !seg->ymax
-                || !seg->val2 || !seg->val2)
+                || !seg->val1 || !seg->val2)
   {
     dt_segmentation_free_struct(seg);
     return TRUE;
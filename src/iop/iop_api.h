@@ -212,6 +212,14 @@ DEFAULT(int, distort_transform, struct dt_iop_module_t *self, struct dt_dev_pixe
 DEFAULT(int, distort_backtransform, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, float *points,
                                     size_t points_count);
 
+/** the output as a set of independent local edits of the input, e.g. the spots of a retouch. used by the
+  * pixelpipe to recompute only the areas of the edits that changed since the module was last processed
+  * for the same roi, so process() must give the same pixels for any part of roi_out given the input
+  * modify_roi_in() asks for. two edits with the same hash must change the same pixels in the same way.
+  * returns a GArray of dt_iop_local_edit_t or NULL if the output can't be described that way. */
+OPTIONAL(GArray *, local_edits, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                const struct dt_iop_roi_t *const roi_out);
+
 OPTIONAL(void, distort_mask, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                              float *const out, const struct dt_iop_roi_t *const roi_in, const struct dt_iop_roi_t *const roi_out);
 
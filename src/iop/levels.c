@@ -124,7 +124,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_DEPRECATED;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_DEPRECATED
+    | IOP_FLAGS_PIPE_DEPENDENT;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
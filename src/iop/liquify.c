@@ -54,6 +54,11 @@ const float STAMP_RELOCATION = 0.1;     // how many radii to move
                                         // stamp forward when
                                         // following a path
 
+// process() renders the distortion map in square tiles, only where warps
+// reach, and keeps the last rendered tiles for the next run
+#define TILE_SIZE 128
+#define TILE_CACHE_ENTRIES 256          // 32 MB of cached displacements
+
 #define CONF_RADIUS "plugins/darkroom/liquify/radius"
 #define CONF_ANGLE "plugins/darkroom/liquify/angle"
 #define CONF_STRENGTH "plugins/darkroom/liquify/strength"
@@ -261,6 +266,11 @@ typedef struct
 typedef struct
 {
   int warp_kernel;
+  dt_pthread_mutex_t tile_lock;   // protects the tile cache below, shared by all pipes
+  float complex *tiles;           // TILE_CACHE_ENTRIES rendered tiles, allocated on first use
+  uint64_t tile_hash[TILE_CACHE_ENTRIES]; // tile position and warps reaching into it
+  uint64_t tile_age[TILE_CACHE_ENTRIES];  // last use, 0 for an empty entry
+  uint64_t tile_clock;
 } dt_iop_liquify_global_data_t;
 
 typedef struct
@@ -896,7 +906,9 @@ static float *build_lookup_table(const int distance,
     const float dx2 = x - crealf(cptr[-1]);
     *ptr++ = cimagf(cptr[0]) +(dx2 / dx1) * (cimagf(cptr[0]) - cimagf(cptr[-1]));
   }
-  *ptr++ = 0.0f;
+  // the bezier may end before all entries are filled, the warp is zero from there
+  while(ptr < lookup + distance + 2)
+    *ptr++ = 0.0f;
 
   dt_free_align(clookup);
   return lookup;
@@ -909,9 +921,9 @@ static void compute_round_stamp_extent(cairo_rectangle_int_t *const restrict sta
   const int iradius = round(cabsf(warp->radius - warp->point));
   assert(iradius > 0);
 
-  stamp_extent->x = stamp_extent->y = -iradius;
-  stamp_extent->x += crealf(warp->point);
-  stamp_extent->y += cimagf(warp->point);
+  // centered on the same pixel as apply_round_stamp()
+  stamp_extent->x = round(crealf(warp->point)) - iradius;
+  stamp_extent->y = round(cimagf(warp->point)) - iradius;
   stamp_extent->width = stamp_extent->height = 2 * iradius + 1;
 }
 
@@ -1029,6 +1041,104 @@ static void apply_round_stamp(const dt_liquify_warp_t *const restrict warp,
   dt_free_align((void*) lookup_table);
 }
 
+/*
+  Renders the stamp of @a warp into the part of the distortion map
+  covered by a tile, adding to what is there. The result is the same as
+  apply_round_stamp() on the whole map, restricted to the tile.
+*/
+
+static void apply_round_stamp_tile(const dt_liquify_warp_t *const restrict warp,
+                                   const float *const restrict lookup_table,
+                                   float complex *const restrict tile_map,
+                                   const cairo_rectangle_int_t *const restrict tile)
+{
+  const int iradius = round(cabsf(warp->radius - warp->point));
+
+  float complex strength = 0.5f * (warp->strength - warp->point);
+  strength = (warp->status & DT_LIQUIFY_STATUS_INTERPOLATED) ?
+    (strength * STAMP_RELOCATION) : strength;
+  const float abs_strength
+    = cabsf(strength) * (warp->type == DT_LIQUIFY_WARP_TYPE_RADIAL_SHRINK ? -1.0f : 1.0f);
+  const size_t table_size = iradius * LOOKUP_OVERSAMPLE;
+
+  const int cx = round(crealf(warp->point));
+  const int cy = round(cimagf(warp->point));
+  const int x0 = MAX(cx - iradius, tile->x);
+  const int x1 = MIN(cx + iradius + 1, tile->x + tile->width);
+  const int y0 = MAX(cy - iradius, tile->y);
+  const int y1 = MIN(cy + iradius + 1, tile->y + tile->height);
+
+  for(int py = y0; py < y1; py++)
+  {
+    const int y = abs(py - cy);
+    const float complex y_i = y * I;
+    const float y2 = y*y;
+    float complex *const row = tile_map + (size_t)(py - tile->y) * tile->width - tile->x;
+    for(int px = x0; px < x1; px++)
+    {
+      const int x = abs(px - cx);
+      const float dist = sqrtf((float)x*x + y2);
+      const size_t idist = round(dist * LOOKUP_OVERSAMPLE);
+      if(idist >= table_size) continue;
+
+      if(warp->type == DT_LIQUIFY_WARP_TYPE_LINEAR)
+        row[px] += -strength * lookup_table[idist];
+      else
+      {
+        // the quadrants of apply_round_stamp(), with x and y the distances to the center
+        const float abs_lookup = abs_strength * lookup_table[idist] / iradius;
+        if(py <= cy)
+          row[px] += (px >= cx) ? -abs_lookup * (x - y_i) : abs_lookup * (x + y_i);
+        else
+          row[px] += (px < cx) ? abs_lookup * (x - y_i) : -abs_lookup * (x + y_i);
+      }
+    }
+  }
+}
+
+// samples one row of the output, from x = min_x to max_x, at the positions given by the distortion map
+static inline void _apply_distortion_row(const struct dt_interpolation *const interpolation,
+                                         const float *const restrict in,
+                                         float *const restrict out,
+                                         const dt_iop_roi_t *const roi_in,
+                                         const dt_iop_roi_t *const roi_out,
+                                         const float complex *row,
+                                         const int ch,
+                                         const int ch_width,
+                                         const size_t y,
+                                         const size_t min_x,
+                                         const size_t max_x)
+{
+  float* out_sample = out + ch * ((y - roi_out->y) * roi_out->width - roi_out->x);
+  for(size_t x = min_x; x < max_x; x++)
+  {
+    if(*row != 0) // point actually warped?
+    {
+      if(ch == 1)
+        out_sample[x] = dt_interpolation_compute_sample(interpolation,
+                                                        in,
+                                                        x + crealf(*row) - roi_in->x,
+                                                        y + cimagf(*row) - roi_in->y,
+                                                        roi_in->width,
+                                                        roi_in->height,
+                                                        ch,
+                                                        ch_width);
+      else
+        dt_interpolation_compute_pixel4c(
+          interpolation,
+          in,
+          out_sample + ch*x,
+          x + crealf(*row) - roi_in->x,
+          y + cimagf(*row) - roi_in->y,
+          roi_in->width,
+          roi_in->height,
+          ch_width);
+
+    }
+    ++row;
+  }
+}
+
 /*
   Applies the global distortion map to the picture.  The distortion
   map maps points to the position from where the new color of the
@@ -1064,34 +1174,7 @@ static void _apply_global_distortion_map(struct dt_iop_module_t *module,
     const size_t min_x = MAX(roi_out->x, extent->x);
     const size_t max_x = MIN(roi_out->x + roi_out->width, extent->x + extent->width);
     const float complex *row = map + (y - extent->y) * extent->width + (min_x - extent->x);
-    float* out_sample = out + ch * ((y - roi_out->y) * roi_out->width - roi_out->x);
-    for(size_t x = min_x; x < max_x; x++)
-    {
-      if(*row != 0) // point actually warped?
-      {
-        if(ch == 1)
-          out_sample[x] = dt_interpolation_compute_sample(interpolation,
-                                                          in,
-                                                          x + crealf(*row) - roi_in->x,
-                                                          y + cimagf(*row) - roi_in->y,
-                                                          roi_in->width,
-                                                          roi_in->height,
-                                                          ch,
-                                                          ch_width);
-        else
-          dt_interpolation_compute_pixel4c(
-            interpolation,
-            in,
-            out_sample + ch*x,
-            x + crealf(*row) - roi_in->x,
-            y + cimagf(*row) - roi_in->y,
-            roi_in->width,
-            roi_in->height,
-            ch_width);
-
-      }
-      ++row;
-    }
+    _apply_distortion_row(interpolation, in, out, roi_in, roi_out, row, ch, ch_width, y, min_x, max_x);
   }
 }
 
@@ -1244,6 +1327,213 @@ static void _build_global_distortion_map(struct dt_iop_module_t *module,
   g_list_free_full(interpolated, free);
 }
 
+/*
+  The distortion map of process() is rendered and applied in tiles of
+  TILE_SIZE pixels on a grid fixed in piece coordinates, and only for
+  the tiles some warp reaches into: the pixels of the other tiles are
+  not moved. Each tile is identified by its position and the warps
+  reaching into it. The last rendered tiles are kept, so when a single
+  warp is edited only the tiles it touches are rendered again.
+*/
+
+static uint64_t _tile_hash(const int tx,
+                           const int ty,
+                           const dt_liquify_warp_t *const *const warps,
+                           const int *const idx,
+                           const int count)
+{
+  uint64_t hash = 5381;
+  const int pos[2] = { tx, ty };
+  const char *str = (const char *)pos;
+  for(size_t k = 0; k < sizeof(pos); k++) hash = ((hash << 5) + hash) ^ str[k];
+  for(int i = 0; i < count; i++)
+  {
+    str = (const char *)warps[idx[i]];
+    for(size_t k = 0; k < sizeof(dt_liquify_warp_t); k++) hash = ((hash << 5) + hash) ^ str[k];
+  }
+  // 0 marks an empty cache entry
+  return hash ? hash : 1;
+}
+
+static gboolean _tile_cache_get(dt_iop_liquify_global_data_t *gd,
+                                const uint64_t hash,
+                                float complex *const tile_map)
+{
+  gboolean found = FALSE;
+  const size_t tile_pixels = TILE_SIZE * TILE_SIZE;
+  dt_pthread_mutex_lock(&gd->tile_lock);
+  if(gd->tiles)
+    for(int k = 0; k < TILE_CACHE_ENTRIES; k++)
+      if(gd->tile_age[k] && gd->tile_hash[k] == hash)
+      {
+        memcpy(tile_map, gd->tiles + k * tile_pixels, sizeof(float complex) * tile_pixels);
+        gd->tile_age[k] = ++gd->tile_clock;
+        found = TRUE;
+        break;
+      }
+  dt_pthread_mutex_unlock(&gd->tile_lock);
+  return found;
+}
+
+static void _tile_cache_put(dt_iop_liquify_global_data_t *gd,
+                            const uint64_t hash,
+                            const float complex *const tile_map)
+{
+  const size_t tile_pixels = TILE_SIZE * TILE_SIZE;
+  dt_pthread_mutex_lock(&gd->tile_lock);
+  if(!gd->tiles)
+    gd->tiles = dt_alloc_align(64, sizeof(float complex) * tile_pixels * TILE_CACHE_ENTRIES);
+  if(gd->tiles)
+  {
+    // replace the least recently used entry
+    int oldest = 0;
+    for(int k = 1; k < TILE_CACHE_ENTRIES; k++)
+      if(gd->tile_age[k] < gd->tile_age[oldest]) oldest = k;
+    memcpy(gd->tiles + oldest * tile_pixels, tile_map, sizeof(float complex) * tile_pixels);
+    gd->tile_hash[oldest] = hash;
+    gd->tile_age[oldest] = ++gd->tile_clock;
+  }
+  dt_pthread_mutex_unlock(&gd->tile_lock);
+}
+
+static void _apply_tiled_distortion(struct dt_iop_module_t *module,
+                                    dt_dev_pixelpipe_iop_t *piece,
+                                    const float *const restrict in,
+                                    float *const restrict out,
+                                    const dt_iop_roi_t *const roi_in,
+                                    const dt_iop_roi_t *const roi_out,
+                                    const GSList *interpolated,
+                                    const cairo_rectangle_int_t *const extent)
+{
+  dt_iop_liquify_global_data_t *gd = (dt_iop_liquify_global_data_t *)module->global_data;
+  const int ch = piece->colors;
+  const int ch_width = ch * roi_in->width;
+
+  // the tiles covering the warps inside roi_out
+  const int x0 = MAX(roi_out->x, extent->x);
+  const int y0 = MAX(roi_out->y, extent->y);
+  const int x1 = MIN(roi_out->x + roi_out->width, extent->x + extent->width);
+  const int y1 = MIN(roi_out->y + roi_out->height, extent->y + extent->height);
+  if(x1 <= x0 || y1 <= y0) return;
+  const int tx0 = floorf((float)x0 / TILE_SIZE);
+  const int ty0 = floorf((float)y0 / TILE_SIZE);
+  const int tiles_x = (int)floorf((float)(x1 - 1) / TILE_SIZE) - tx0 + 1;
+  const int tiles_y = (int)floorf((float)(y1 - 1) / TILE_SIZE) - ty0 + 1;
+  const size_t ntiles = (size_t)tiles_x * tiles_y;
+
+  const int nwarps = g_slist_length((GSList *)interpolated);
+  const dt_liquify_warp_t **warps = malloc(sizeof(dt_liquify_warp_t *) * nwarps);
+  cairo_rectangle_int_t *tiles_of = malloc(sizeof(cairo_rectangle_int_t) * nwarps);
+  const float **lookup = calloc(nwarps, sizeof(float *));
+  int *first = calloc(ntiles + 1, sizeof(int));
+  int *filled = calloc(ntiles, sizeof(int));
+  int *idx = NULL;
+  if(!warps || !tiles_of || !lookup || !first || !filled) goto cleanup;
+
+  // the range of tiles each warp reaches into, as a rectangle in tile units
+  int w = 0;
+  for(const GSList *i = interpolated; i; i = g_slist_next(i), w++)
+  {
+    cairo_rectangle_int_t r;
+    warps[w] = (const dt_liquify_warp_t *)i->data;
+    compute_round_stamp_extent(&r, warps[w]);
+    const int ax = MAX((int)floorf((float)r.x / TILE_SIZE), tx0);
+    const int ay = MAX((int)floorf((float)r.y / TILE_SIZE), ty0);
+    const int bx = MIN((int)floorf((float)(r.x + r.width - 1) / TILE_SIZE), tx0 + tiles_x - 1);
+    const int by = MIN((int)floorf((float)(r.y + r.height - 1) / TILE_SIZE), ty0 + tiles_y - 1);
+    tiles_of[w] = (cairo_rectangle_int_t){ ax - tx0, ay - ty0, bx - ax + 1, by - ay + 1 };
+  }
+
+  // list the warps reaching into each tile, in the order they are stamped: the warps
+  // of tile t are idx[first[t]] .. idx[first[t + 1] - 1]
+  for(w = 0; w < nwarps; w++)
+    for(int ty = tiles_of[w].y; ty < tiles_of[w].y + tiles_of[w].height; ty++)
+      for(int tx = tiles_of[w].x; tx < tiles_of[w].x + tiles_of[w].width; tx++)
+        first[(size_t)ty * tiles_x + tx + 1]++;
+  for(size_t t = 0; t < ntiles; t++) first[t + 1] += first[t];
+
+  idx = malloc(sizeof(int) * MAX(first[ntiles], 1));
+  if(!idx) goto cleanup;
+  for(w = 0; w < nwarps; w++)
+    for(int ty = tiles_of[w].y; ty < tiles_of[w].y + tiles_of[w].height; ty++)
+      for(int tx = tiles_of[w].x; tx < tiles_of[w].x + tiles_of[w].width; tx++)
+      {
+        const size_t t = (size_t)ty * tiles_x + tx;
+        idx[first[t] + filled[t]++] = w;
+      }
+
+  // the lookup tables are shared by all tiles of a warp
+  for(w = 0; w < nwarps; w++)
+  {
+    const size_t iradius = round(cabsf(warps[w]->radius - warps[w]->point));
+    lookup[w] = build_lookup_table(iradius * LOOKUP_OVERSAMPLE, warps[w]->control1, warps[w]->control2);
+    if(!lookup[w])
+    {
+      dt_print(DT_DEBUG_ALWAYS,"[liquify] out of memory, skipping distortion\n");
+      goto cleanup;
+    }
+  }
+
+  size_t padded_size;
+  float complex *const tile_maps = dt_alloc_perthread(TILE_SIZE * TILE_SIZE, sizeof(float complex), &padded_size);
+  if(!tile_maps)
+  {
+    dt_print(DT_DEBUG_ALWAYS,"[liquify] out of memory, skipping distortion\n");
+    goto cleanup;
+  }
+
+  const struct dt_interpolation *const interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, roi_in, roi_out, ch, ch_width, tx0, ty0, tiles_x, ntiles, \
+                      x0, y0, x1, y1, warps, lookup, first, idx, tile_maps, padded_size, \
+                      interpolation, gd) \
+  schedule(dynamic)
+#endif
+  for(size_t t = 0; t < ntiles; t++)
+  {
+    const int count = first[t + 1] - first[t];
+    // no warp reaches into this tile, its pixels keep their place
+    if(count == 0) continue;
+
+    const int tx = tx0 + t % tiles_x;
+    const int ty = ty0 + t / tiles_x;
+    const cairo_rectangle_int_t tile = { tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE };
+    float complex *const tile_map = dt_get_perthread(tile_maps, padded_size);
+
+    const uint64_t hash = _tile_hash(tx, ty, warps, idx + first[t], count);
+    if(!_tile_cache_get(gd, hash, tile_map))
+    {
+      memset(tile_map, 0, sizeof(float complex) * TILE_SIZE * TILE_SIZE);
+      for(int i = first[t]; i < first[t + 1]; i++)
+        apply_round_stamp_tile(warps[idx[i]], lookup[idx[i]], tile_map, &tile);
+      _tile_cache_put(gd, hash, tile_map);
+    }
+
+    const int min_x = MAX(tile.x, x0);
+    const int max_x = MIN(tile.x + TILE_SIZE, x1);
+    const int min_y = MAX(tile.y, y0);
+    const int max_y = MIN(tile.y + TILE_SIZE, y1);
+    for(int y = min_y; y < max_y; y++)
+      _apply_distortion_row(interpolation, in, out, roi_in, roi_out,
+                            tile_map + (size_t)(y - tile.y) * TILE_SIZE + (min_x - tile.x),
+                            ch, ch_width, y, min_x, max_x);
+  }
+
+  dt_free_align(tile_maps);
+
+cleanup:
+  if(lookup)
+    for(int k = 0; k < nwarps; k++) dt_free_align((void *)lookup[k]);
+  free(lookup);
+  free(warps);
+  free(tiles_of);
+  free(first);
+  free(filled);
+  free(idx);
+}
+
 // 2nd pass: which roi would this operation need as input to fill the given output region?
 void modify_roi_in(struct dt_iop_module_t *module,
                     struct dt_dev_pixelpipe_iop_t *piece,
@@ -1456,19 +1746,55 @@ void process(struct dt_iop_module_t *module,
   // 1. copy the whole image (we'll change only a small part of it)
   dt_iop_copy_image_roi(out, in, piece->colors, roi_in, roi_out);
 
-  // 2. build the distortion map
+  // 2. find the warps reaching into roi_out
+  dt_iop_liquify_params_t copy_params;
+  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+  distort_paths_raw_to_piece(module, piece->pipe, roi_in->scale, &copy_params, FALSE);
+
+  GList *interpolated = interpolate_paths(&copy_params);
   cairo_rectangle_int_t map_extent;
-  float complex *map = NULL;
-  _build_global_distortion_map(module, piece, roi_in->scale, FALSE,
-                               roi_out, &map_extent, FALSE, &map);
-  if(map == NULL)
-    return;
+  GSList *interpolated_in_roi = _get_map_extent(roi_out, interpolated, &map_extent);
 
-  // 3. apply the map
+  // 3. build and apply the distortion map, tile by tile, where the warps reach
   if(map_extent.width != 0 && map_extent.height != 0)
-    _apply_global_distortion_map(module, piece, in, out, roi_in, roi_out, map, &map_extent);
+    _apply_tiled_distortion(module, piece, in, out, roi_in, roi_out, interpolated_in_roi, &map_extent);
+
+  g_slist_free(interpolated_in_roi);
+  g_list_free_full(interpolated, free);
+}
+
+GArray *local_edits(struct dt_iop_module_t *module,
+                    dt_dev_pixelpipe_iop_t *piece,
+                    const dt_iop_roi_t *const roi_out)
+{
+  // the stamps add up, so each of them is an edit on its own
+  dt_iop_liquify_params_t copy_params;
+  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+  distort_paths_raw_to_piece(module, piece->pipe, roi_out->scale, &copy_params, FALSE);
 
-  dt_free_align((void *)map);
+  GList *interpolated = interpolate_paths(&copy_params);
+  GArray *edits = g_array_sized_new(FALSE, FALSE, sizeof(dt_iop_local_edit_t), g_list_length(interpolated));
+  for(const GList *i = interpolated; i; i = g_list_next(i))
+  {
+    const dt_liquify_warp_t *warp = (dt_liquify_warp_t *)i->data;
+    cairo_rectangle_int_t r;
+    compute_round_stamp_extent(&r, warp);
+
+    // interpolated stamps are weakened, the other status bits don't change the stamp
+    const float fields[10] = { crealf(warp->point), cimagf(warp->point),
+                               crealf(warp->strength), cimagf(warp->strength),
+                               crealf(warp->radius), cimagf(warp->radius),
+                               warp->control1, warp->control2, warp->type,
+                               (warp->status & DT_LIQUIFY_STATUS_INTERPOLATED) ? 1.0f : 0.0f };
+    uint64_t hash = 5381;
+    const char *str = (const char *)fields;
+    for(size_t k = 0; k < sizeof(fields); k++) hash = ((hash << 5) + hash) ^ str[k];
+
+    const dt_iop_local_edit_t edit = { hash, r.x, r.y, r.width, r.height };
+    g_array_append_val(edits, edit);
+  }
+  g_list_free_full(interpolated, free);
+  return edits;
 }
 
 #ifdef HAVE_OPENCL
@@ -1649,6 +1975,11 @@ void init_global(dt_iop_module_so_t *module)
     (dt_iop_liquify_global_data_t *) malloc(sizeof(dt_iop_liquify_global_data_t));
   module->data = gd;
   gd->warp_kernel = dt_opencl_create_kernel(program, "warp_kernel");
+  dt_pthread_mutex_init(&gd->tile_lock, NULL);
+  gd->tiles = NULL;
+  memset(gd->tile_hash, 0, sizeof(gd->tile_hash));
+  memset(gd->tile_age, 0, sizeof(gd->tile_age));
+  gd->tile_clock = 0;
 }
 
 void cleanup_global(dt_iop_module_so_t *module)
@@ -1656,6 +1987,8 @@ void cleanup_global(dt_iop_module_so_t *module)
   // called once at shutdown
   dt_iop_liquify_global_data_t *gd = (dt_iop_liquify_global_data_t *)module->data;
   dt_opencl_free_kernel(gd->warp_kernel);
+  dt_pthread_mutex_destroy(&gd->tile_lock);
+  dt_free_align(gd->tiles);
   free(module->data);
   module->data = NULL;
 }
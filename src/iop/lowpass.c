@@ -437,6 +437,8 @@ void process(struct dt_iop_module_t *self,
     }
     dt_bilateral_splat(b, in);
     dt_bilateral_blur(b);
+    // the small navigation preview doesn't need the full precision of the grid
+    if(piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) dt_bilateral_compact(b);
     dt_bilateral_slice(b, in, out, detail);
     dt_bilateral_free(b);
   }
@@ -219,7 +219,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_NO_MASKS;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_NO_MASKS
+    | IOP_FLAGS_PIPE_DEPENDENT;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
@@ -3140,6 +3141,101 @@ void modify_roi_in(struct dt_iop_module_t *self,
   roi_in->height = CLAMP(roib - roi_in->y, 1, scheight + .5f - roi_in->y);
 }
 
+static inline gboolean _rect_intersects(const dt_iop_local_edit_t *a, const dt_iop_local_edit_t *b)
+{
+  return a->x < b->x + b->width && b->x < a->x + a->width
+      && a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+// each form is an edit, forms reading what an earlier one wrote depend on it
+GArray *local_edits(struct dt_iop_module_t *self,
+                    dt_dev_pixelpipe_iop_t *piece,
+                    const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_retouch_gui_data_t *g = (dt_iop_retouch_gui_data_t *)self->gui_data;
+  dt_develop_blend_params_t *bp = piece->blendop_data;
+
+  // the wavelet scales depend on the size of the roi and the display modes on the gui
+  if(p->num_scales > 0 || (g && (g->mask_display || g->suppress_mask || g->display_wavelet_scale)))
+    return NULL;
+
+  GArray *edits = g_array_new(FALSE, FALSE, sizeof(dt_iop_local_edit_t));
+  const dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
+  if(!grp || !(grp->type & DT_MASKS_GROUP)) return edits;
+
+  const float scale = roi_out->scale;
+
+  for(const GList *forms = grp->points; forms; forms = g_list_next(forms))
+  {
+    const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
+    if(!grpt) continue;
+    const int index = rt_get_index_from_formid(p, grpt->formid);
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, grpt->formid);
+    int fw, fh, fl, ft;
+    if(index == -1 || !form || !dt_masks_get_area(self, piece, form, &fw, &fh, &fl, &ft))
+      continue;
+
+    const dt_iop_retouch_form_data_t *rt_form = &p->rt_forms[index];
+    dt_iop_local_edit_t edit = { 0, floorf(fl * scale) - 1, floorf(ft * scale) - 1,
+                                 ceilf(fw * scale) + 2, ceilf(fh * scale) + 2 };
+    dt_iop_local_edit_t read = edit;
+    if(rt_form->algorithm == DT_IOP_RETOUCH_BLUR)
+    {
+      const int overlap = ceilf(4 * (rt_form->blur_radius * scale / piece->iscale));
+      read.x -= overlap;
+      read.y -= overlap;
+      read.width += 2 * overlap;
+      read.height += 2 * overlap;
+    }
+    else if(rt_form->algorithm == DT_IOP_RETOUCH_HEAL || rt_form->algorithm == DT_IOP_RETOUCH_CLONE)
+    {
+      int sw, sh, sl, st;
+      if(dt_masks_get_source_area(self, piece, form, &sw, &sh, &sl, &st))
+      {
+        const int x0 = MIN(read.x, floorf(sl * scale) - 1);
+        const int y0 = MIN(read.y, floorf(st * scale) - 1);
+        read.width = MAX(read.x + read.width, ceilf((sl + sw) * scale) + 1) - x0;
+        read.height = MAX(read.y + read.height, ceilf((st + sh) * scale) + 1) - y0;
+        read.x = x0;
+        read.y = y0;
+      }
+    }
+
+    // the form, how it's applied and the global settings it uses
+    const int length = dt_masks_group_get_hash_buffer_length_ext(piece->pipe->forms, form);
+    char *str = malloc(length);
+    if(!str) continue;
+    dt_masks_group_get_hash_buffer_ext(piece->pipe->forms, form, str);
+    uint64_t hash = 5381;
+    for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
+    free(str);
+
+    const char *parts[4] = { (const char *)rt_form, (const char *)&grpt->state,
+                             (const char *)&grpt->opacity, (const char *)&p->max_heal_iter };
+    const size_t sizes[4] = { sizeof(dt_iop_retouch_form_data_t), sizeof(grpt->state),
+                              sizeof(grpt->opacity), sizeof(p->max_heal_iter) };
+    for(int k = 0; k < 4; k++)
+      for(size_t i = 0; i < sizes[k]; i++) hash = ((hash << 5) + hash) ^ parts[k][i];
+
+    // and whatever the earlier forms wrote where it reads
+    for(guint j = 0; j < edits->len; j++)
+    {
+      const dt_iop_local_edit_t *earlier = &g_array_index(edits, dt_iop_local_edit_t, j);
+      if(_rect_intersects(earlier, &read))
+      {
+        const char *h = (const char *)&earlier->hash;
+        for(size_t i = 0; i < sizeof(uint64_t); i++) hash = ((hash << 5) + hash) ^ h[i];
+      }
+    }
+
+    edit.hash = hash;
+    g_array_append_val(edits, edit);
+  }
+
+  return edits;
+}
+
 //--------------------------------------------------------------------------------------------------
 // process
 //--------------------------------------------------------------------------------------------------
@@ -3550,7 +3646,8 @@ static void _retouch_fill(float *const in,
   }
 }
 
-static void _retouch_clone(float *const in,
+static void _retouch_clone(dt_dev_pixelpipe_t *pipe,
+                           float *const in,
                            dt_iop_roi_t *const roi_in,
                            float *const mask_scaled,
                            dt_iop_roi_t *const roi_mask_scaled,
@@ -3559,8 +3656,8 @@ static void _retouch_clone(float *const in,
                            const float opacity)
 {
   // alloc temp image to avoid issues when areas self-intersects
-  float *img_src =
-    dt_alloc_align_float((size_t)4 * roi_mask_scaled->width * roi_mask_scaled->height);
+  float *img_src = dt_dev_pixelpipe_arena_alloc_float
+    (pipe, (size_t)4 * roi_mask_scaled->width * roi_mask_scaled->height);
   if(img_src == NULL)
   {
     dt_print(DT_DEBUG_ALWAYS, "[retouch] error allocating memory for cloning\n");
@@ -3574,7 +3671,7 @@ static void _retouch_clone(float *const in,
   rt_copy_image_masked(img_src, in, roi_in, mask_scaled, roi_mask_scaled, opacity);
 
 cleanup:
-  if(img_src) dt_free_align(img_src);
+  dt_dev_pixelpipe_arena_free(pipe, img_src);
 }
 
 static void _retouch_blur(dt_iop_module_t *self,
@@ -3669,7 +3766,8 @@ cleanup:
   if(img_dest) dt_free_align(img_dest);
 }
 
-static void _retouch_heal(float *const in,
+static void _retouch_heal(dt_dev_pixelpipe_t *pipe,
+                          float *const in,
                           dt_iop_roi_t *const roi_in,
                           float *const mask_scaled,
                           dt_iop_roi_t *const roi_mask_scaled,
@@ -3682,10 +3780,10 @@ static void _retouch_heal(float *const in,
   float *img_dest = NULL;
 
   // alloc temp images for source and destination
-  img_src  =
-    dt_alloc_align_float((size_t)4 * roi_mask_scaled->width * roi_mask_scaled->height);
-  img_dest =
-    dt_alloc_align_float((size_t)4 * roi_mask_scaled->width * roi_mask_scaled->height);
+  img_src  = dt_dev_pixelpipe_arena_alloc_float
+    (pipe, (size_t)4 * roi_mask_scaled->width * roi_mask_scaled->height);
+  img_dest = dt_dev_pixelpipe_arena_alloc_float
+    (pipe, (size_t)4 * roi_mask_scaled->width * roi_mask_scaled->height);
   if((img_src == NULL) || (img_dest == NULL))
   {
     dt_print(DT_DEBUG_ALWAYS, "[retouch] error allocating memory for healing\n");
@@ -3704,8 +3802,8 @@ static void _retouch_heal(float *const in,
   rt_copy_image_masked(img_dest, in, roi_in, mask_scaled, roi_mask_scaled, opacity);
 
 cleanup:
-  if(img_src) dt_free_align(img_src);
-  if(img_dest) dt_free_align(img_dest);
+  dt_dev_pixelpipe_arena_free(pipe, img_src);
+  dt_dev_pixelpipe_arena_free(pipe, img_dest);
 }
 
 static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int scale1)
@@ -3847,12 +3945,12 @@ static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int s
         {
           if(algo == DT_IOP_RETOUCH_CLONE)
           {
-            _retouch_clone(layer, roi_layer, mask_scaled,
+            _retouch_clone(piece->pipe, layer, roi_layer, mask_scaled,
                            &roi_mask_scaled, dx, dy, form_opacity);
           }
           else if(algo == DT_IOP_RETOUCH_HEAL)
           {
-            _retouch_heal(layer, roi_layer, mask_scaled,
+            _retouch_heal(piece->pipe, layer, roi_layer, mask_scaled,
                           &roi_mask_scaled, dx, dy, form_opacity, p->max_heal_iter);
           }
           else if(algo == DT_IOP_RETOUCH_BLUR)
@@ -3931,7 +4029,7 @@ void process(struct dt_iop_module_t *self,
 
   // we will do all the clone, heal, etc on the input image,
   // this way the source for one algorithm can be the destination from a previous one
-  in_retouch = dt_alloc_align_float((size_t)4 * roi_rt->width * roi_rt->height);
+  in_retouch = dt_dev_pixelpipe_arena_alloc_float(piece->pipe, (size_t)4 * roi_rt->width * roi_rt->height);
   if(in_retouch == NULL)
   {
     dt_print(DT_DEBUG_ALWAYS,"[retouch] out of memory\n");
@@ -4040,7 +4138,7 @@ void process(struct dt_iop_module_t *self,
   rt_copy_in_to_out(in_retouch, roi_rt, ovoid, roi_out, 4, 0, 0);
 
 cleanup:
-  if(in_retouch) dt_free_align(in_retouch);
+  dt_dev_pixelpipe_arena_free(piece->pipe, in_retouch);
   if(dwt_p) dt_dwt_free(dwt_p);
 }
 
@@ -202,6 +202,16 @@ typedef struct dt_iop_toneequalizer_data_t
   int iterations;
   dt_iop_luminance_mask_method_t method;
   dt_iop_toneequalizer_filter_t details;
+
+  // hash of the params the luminance mask depends on, so curve-only
+  // edits keep the cached mask and only re-apply the correction LUT
+  uint64_t mask_hash;
+
+  // per-piece cache of the smoothed luminance mask, used by pipes
+  // that don't go through the GUI caches (export, thumbnails…)
+  float *mask_cache;
+  size_t mask_cache_width, mask_cache_height;
+  uint64_t mask_cache_hash;
 } dt_iop_toneequalizer_data_t;
 
 
@@ -334,7 +344,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING
+    | IOP_FLAGS_PIPE_DEPENDENT;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
@@ -996,6 +1007,43 @@ static inline void display_luminance_mask(const float *const restrict in,
 }
 
 
+static uint64_t _mask_params_hash(const dt_iop_toneequalizer_data_t *const d)
+{
+  // bernstein hash (djb2) of everything compute_luminance_mask() reads
+  // from the params. The radius depends on the roi scale, which is
+  // already covered by the upstream pipe hash.
+  const float fparams[5] = { d->blending, d->feathering, d->contrast_boost,
+                             d->exposure_boost, d->quantization };
+  const int iparams[3] = { d->iterations, (int)d->method, (int)d->details };
+
+  uint64_t hash = 5381;
+  const char *str = (const char *)fparams;
+  for(size_t i = 0; i < sizeof(fparams); i++)
+    hash = ((hash << 5) + hash) ^ str[i];
+  str = (const char *)iparams;
+  for(size_t i = 0; i < sizeof(iparams); i++)
+    hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+
+static float *_get_piece_mask_cache(dt_iop_toneequalizer_data_t *const d,
+                                    const size_t width,
+                                    const size_t height)
+{
+  // Re-allocate the per-piece cache only if the buffer size has changed
+  if(d->mask_cache_width != width || d->mask_cache_height != height)
+  {
+    dt_free_align(d->mask_cache);
+    d->mask_cache = dt_alloc_align_float(width * height);
+    d->mask_cache_width = d->mask_cache ? width : 0;
+    d->mask_cache_height = d->mask_cache ? height : 0;
+    d->mask_cache_hash = 0;
+  }
+  return d->mask_cache;
+}
+
+
 __DT_CLONE_TARGETS__
 static
 void toneeq_process(struct dt_iop_module_t *self,
@@ -1005,8 +1053,9 @@ void toneeq_process(struct dt_iop_module_t *self,
                     const dt_iop_roi_t *const roi_in,
                     const dt_iop_roi_t *const roi_out)
 {
-  const dt_iop_toneequalizer_data_t *const d =
-    (const dt_iop_toneequalizer_data_t *const)piece->data;
+  // not const, the per-piece mask cache lives in there
+  dt_iop_toneequalizer_data_t *const d =
+    (dt_iop_toneequalizer_data_t *const)piece->data;
   dt_iop_toneequalizer_gui_data_t *const g =
     (dt_iop_toneequalizer_gui_data_t *)self->gui_data;
 
@@ -1019,10 +1068,13 @@ void toneeq_process(struct dt_iop_module_t *self,
   const size_t num_elem = width * height;
   const size_t ch = 4;
 
-  // Get the hash of the upstream pipe to track changes
+  // Get the hash of the module input to track changes, combined with
+  // the mask-related params only. The nodes before this one make the
+  // input, our own piece hash would change with every curve edit.
   const int position = self->iop_order;
-  uint64_t hash = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id,
-                                              roi_out, piece->pipe, position);
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_in, piece->pipe,
+                                              g_list_index(piece->pipe->nodes, piece));
+  hash = ((hash << 5) + hash) ^ d->mask_hash;
 
   // Sanity checks
   if(width < 1 || height < 1) return;
@@ -1096,16 +1148,19 @@ void toneeq_process(struct dt_iop_module_t *self,
 
       dt_iop_gui_leave_critical_section(self);
     }
-    else // just to please GCC
+    else
     {
-      luminance = dt_alloc_align_float(num_elem);
+      luminance = _get_piece_mask_cache(d, width, height);
+      cached = TRUE;
     }
 
   }
   else
   {
-    // no interactive editing/caching : just allocate a local temp buffer
-    luminance = dt_alloc_align_float(num_elem);
+    // no interactive editing : use the per-piece cache so that reprocessing
+    // the same upstream data with the same mask params skips the filter
+    luminance = _get_piece_mask_cache(d, width, height);
+    cached = TRUE;
   }
 
   // Check if the luminance buffer exists
@@ -1156,9 +1211,17 @@ void toneeq_process(struct dt_iop_module_t *self,
         dt_iop_gui_leave_critical_section(self);
       }
     }
-    else // make it dummy-proof
+    else
     {
-      compute_luminance_mask(in, luminance, width, height, d);
+      // per-piece cache, no other thread accesses it
+      if(d->mask_cache_hash != hash)
+      {
+        compute_luminance_mask(in, luminance, width, height, d);
+        d->mask_cache_hash = hash;
+      }
+      else
+        dt_print(DT_DEBUG_PIPE, "[toneequal] reusing cached luminance mask for %s pipe\n",
+                 dt_dev_pixelpipe_type_to_str(piece->pipe->type));
     }
   }
   else
@@ -1679,6 +1742,8 @@ void commit_params(struct dt_iop_module_t *self,
   // compute the correction LUT here to spare some time in process
   // when computing several times toneequalizer with same parameters
   compute_correction_lut(d->correction_lut, d->smoothing, d->factors);
+
+  d->mask_hash = _mask_params_hash(d);
 }
 
 
@@ -1694,6 +1759,8 @@ void cleanup_pipe(struct dt_iop_module_t *self,
                   dt_dev_pixelpipe_t *pipe,
                   dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_toneequalizer_data_t *d = (dt_iop_toneequalizer_data_t *)piece->data;
+  dt_free_align(d->mask_cache);
   dt_free_align(piece->data);
   piece->data = NULL;
 }
@@ -0,0 +1,114 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2023 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark of the box mean and recursive gaussian filters at several radii, for the channel counts the
+// modules use them with: bloom and highpass (box, 1 channel), the guided filters (box, 2 channels), soften
+// (box, 4 channels), lowpass and shadows and highlights (gaussian, 4 channels). one iteration of the box mean
+// is timed, the modules run BOX_ITERATIONS of them.
+//
+// usage: darktable-bench-blurs [width] [height] [runs]
+
+#include "common/box_filters.h"
+#include "common/darktable.h"
+#include "common/gaussian.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+static void _fill(float *const buf, const size_t n)
+{
+  for(size_t k = 0; k < n; k++) buf[k] = 0.5f + 0.4f * sinf(0.001f * k) * ((k * 7 + 13) % 17) / 17.0f;
+}
+
+int main(int argc, char *argv[])
+{
+  char *argv_override[] = { "darktable-bench-blurs", "--library", ":memory:", "--conf", "write_sidecar_files=never", NULL };
+  int argc_override = sizeof(argv_override) / sizeof(*argv_override) - 1;
+
+  const int width = argc > 1 ? atoi(argv[1]) : 6000;
+  const int height = argc > 2 ? atoi(argv[2]) : 4000;
+  const int runs = argc > 3 ? atoi(argv[3]) : 3;
+
+  // init dt without gui and without data.db:
+  if(dt_init(argc_override, argv_override, FALSE, FALSE, NULL)) exit(1);
+
+  const size_t npixels = (size_t)width * height;
+  float *in = dt_alloc_align_float(4 * npixels);
+  float *out = dt_alloc_align_float(4 * npixels);
+  if(!in || !out) exit(1);
+  _fill(in, 4 * npixels);
+
+  static const int radii[] = { 2, 8, 32, 128 };
+  static const int channels[] = { 1, 2, 4 };
+  const float max[4] = { INFINITY, INFINITY, INFINITY, INFINITY };
+  const float min[4] = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
+
+  printf("%-10s %-8s %-12s %8s %10s\n", "filter", "channels", "size", "radius", "Mpix/s");
+  for(size_t c = 0; c < sizeof(channels) / sizeof(*channels); c++)
+    for(size_t r = 0; r < sizeof(radii) / sizeof(*radii); r++)
+    {
+      const int ch = channels[c];
+      double total = 0.0;
+      for(int k = 0; k < runs; k++)
+      {
+        memcpy(out, in, sizeof(float) * ch * npixels);
+        const double start = dt_get_wtime();
+        dt_box_mean(out, height, width, ch, radii[r], 1);
+        total += dt_get_wtime() - start;
+      }
+      printf("%-10s %-8d %5dx%-6d %8d %10.1f\n", "box", ch, width, height, radii[r], runs * npixels / total * 1e-6);
+    }
+
+  for(size_t c = 0; c < sizeof(channels) / sizeof(*channels); c++)
+    for(size_t r = 0; r < sizeof(radii) / sizeof(*radii); r++)
+    {
+      const int ch = channels[c];
+      dt_gaussian_t *g = dt_gaussian_init(width, height, ch, max, min, radii[r], DT_IOP_GAUSSIAN_ZERO);
+      if(!g) exit(1);
+      double total = 0.0;
+      for(int k = 0; k < runs; k++)
+      {
+        const double start = dt_get_wtime();
+        if(ch == 4)
+          dt_gaussian_blur_4c(g, in, out);
+        else
+          dt_gaussian_blur(g, in, out);
+        total += dt_get_wtime() - start;
+      }
+      dt_gaussian_free(g);
+      printf("%-10s %-8d %5dx%-6d %8d %10.1f\n", "gaussian", ch, width, height, radii[r],
+             runs * npixels / total * 1e-6);
+    }
+
+  dt_free_align(in);
+  dt_free_align(out);
+
+  dt_cleanup();
+
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
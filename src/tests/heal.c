@@ -0,0 +1,116 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2023 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark of the heal solvers: iterations and time needed to reach the residual
+// of the convergence criterion on large synthetic heal spots.
+//
+// usage: darktable-bench-heal [max iterations]
+
+#include "common/darktable.h"
+#include "common/heal.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+typedef enum mask_shape_t
+{
+  MASK_DISC,
+  MASK_STROKE
+} mask_shape_t;
+
+static void _make_stamp(float *src, float *dest, float *mask, const int width, const int height,
+                        const mask_shape_t shape)
+{
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+    {
+      const size_t k = (size_t)y * width + x;
+      for(int c = 0; c < 4; c++)
+      {
+        src[4 * k + c] = 0.3f + 0.2f * sinf(0.05f * x + c) * cosf(0.03f * y);
+        dest[4 * k + c] = 0.5f + 0.3f * sinf(0.011f * x * y / width + c) + 0.05f * ((x * 7 + y * 13) % 17) / 17.0f;
+      }
+      const float dx = (x - 0.5f * width) / (0.45f * width);
+      const float dy = (y - 0.5f * height) / (0.45f * height);
+      if(shape == MASK_DISC)
+        mask[k] = dx * dx + dy * dy < 1.0f ? 1.0f : 0.0f;
+      else
+      {
+        // a thick diagonal brush stroke
+        const float d = fabsf(dx - dy) / sqrtf(2.0f);
+        mask[k] = d < 0.1f && fabsf(dx) < 0.9f ? 1.0f : 0.0f;
+      }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  char *argv_override[] = { "darktable-bench-heal", "--library", ":memory:", "--conf", "write_sidecar_files=never", NULL };
+  int argc_override = sizeof(argv_override) / sizeof(*argv_override) - 1;
+
+  const int max_iter = argc > 1 ? atoi(argv[1]) : 2000;
+
+  // init dt without gui and without data.db:
+  if(dt_init(argc_override, argv_override, FALSE, FALSE, NULL)) exit(1);
+
+  static const int sizes[] = { 256, 512, 1024, 2048 };
+  static const char *shapes[] = { "disc", "stroke" };
+  static const char *solvers[] = { "gauss-seidel", "multigrid" };
+
+  printf("%-8s %-10s %-14s %10s %14s %10s\n", "shape", "size", "solver", "iterations", "residual", "seconds");
+  for(int shape = MASK_DISC; shape <= MASK_STROKE; shape++)
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++)
+    {
+      const int width = sizes[s];
+      const int height = sizes[s];
+      const size_t npixels = (size_t)width * height;
+      float *src = dt_alloc_align_float(4 * npixels);
+      float *dest = dt_alloc_align_float(4 * npixels);
+      float *mask = dt_alloc_align_float(npixels);
+      if(!src || !dest || !mask) exit(1);
+
+      for(int solver = DT_HEAL_SOLVER_GAUSS_SEIDEL; solver <= DT_HEAL_SOLVER_MULTIGRID; solver++)
+      {
+        _make_stamp(src, dest, mask, width, height, shape);
+        float residual = 0.0f;
+        const double start = dt_get_wtime();
+        const int iter = dt_heal_solve(src, dest, mask, width, height, 4, max_iter, solver, &residual);
+        const double end = dt_get_wtime();
+        printf("%-8s %4dx%-5d %-14s %10d %14g %10.3f\n", shapes[shape], width, height, solvers[solver], iter,
+               residual, end - start);
+      }
+
+      dt_free_align(src);
+      dt_free_align(dest);
+      dt_free_align(mask);
+    }
+
+  dt_cleanup();
+
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
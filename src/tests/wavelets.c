@@ -0,0 +1,168 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2023 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark of the wavelet code paths of the equalizer, raw denoise, retouch and denoise (profiled) modules,
+// with the finest scales fused in tiles and with every scale as a full frame pass. retouch and denoise
+// (profiled) need each scale as a whole and always use full frame passes.
+//
+// usage: darktable-bench-wavelets [width] [height] [runs]
+
+#include "common/darktable.h"
+#include "common/dwt.h"
+#include "common/eaw.h"
+#include "control/conf.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+#define SCALES 6
+
+typedef struct bench_t
+{
+  int width;
+  int height;
+  const float *image;
+  float *buf[4];
+} bench_t;
+
+static void _equalizer(bench_t *b)
+{
+  dt_aligned_pixel_t thrs[SCALES], boost[SCALES];
+  float sharp[SCALES];
+  for(int s = 0; s < SCALES; s++)
+  {
+    for_four_channels(c)
+    {
+      thrs[s][c] = 0.002f * (s + 1);
+      boost[s][c] = 1.2f;
+    }
+    sharp[s] = 0.0025f;
+  }
+  eaw_decompose_and_synthesize(b->buf[0], b->image, SCALES, sharp, (const dt_aligned_pixel_t *)thrs,
+                               (const dt_aligned_pixel_t *)boost, b->width, b->height);
+}
+
+static void _rawdenoise(bench_t *b)
+{
+  // one plane of the raw, as rawdenoise.c does for each color
+  static const float noise[5] = { 0.02f, 0.015f, 0.01f, 0.005f, 0.002f };
+  const size_t npixels = (size_t)b->width * b->height;
+  for(size_t k = 0; k < npixels; k++) b->buf[0][k] = b->image[4 * k + 1];
+  dwt_denoise(b->buf[0], b->width, b->height, 5, noise);
+}
+
+static void _retouch(bench_t *b)
+{
+  memcpy(b->buf[0], b->image, sizeof(float) * 4 * b->width * b->height);
+  dwt_params_t *p = dt_dwt_init(b->buf[0], b->width, b->height, 4, SCALES, 0, 0, NULL, 1.0f);
+  if(!p) exit(1);
+  dwt_decompose(p, NULL);
+  dt_dwt_free(p);
+}
+
+static void _denoiseprofile(bench_t *b)
+{
+  const size_t npixels = (size_t)b->width * b->height;
+  float *const out = b->buf[0];
+  float *const detail = b->buf[3];
+  const float *in = b->image;
+  float *coarse = b->buf[1];
+  memset(out, 0, sizeof(float) * 4 * npixels);
+  for(int s = 0; s < SCALES; s++)
+  {
+    dt_aligned_pixel_t sum_y2;
+    eaw_dn_decompose(coarse, in, detail, sum_y2, s, 1.0f / (1.0f + s), b->width, b->height);
+    const dt_aligned_pixel_t thrs = { 0.01f, 0.01f, 0.01f, 0.0f };
+    const dt_aligned_pixel_t boost = { 1.0f, 1.0f, 1.0f, 1.0f };
+    eaw_synthesize(out, out, detail, thrs, boost, b->width, b->height);
+    in = coarse;
+    coarse = (coarse == b->buf[1]) ? b->buf[2] : b->buf[1];
+  }
+  for(size_t k = 0; k < 4 * npixels; k++) out[k] += in[k];
+}
+
+int main(int argc, char *argv[])
+{
+  char *argv_override[] = { "darktable-bench-wavelets", "--library", ":memory:", "--conf", "write_sidecar_files=never", NULL };
+  int argc_override = sizeof(argv_override) / sizeof(*argv_override) - 1;
+
+  const int width = argc > 1 ? atoi(argv[1]) : 6000;
+  const int height = argc > 2 ? atoi(argv[2]) : 4000;
+  const int runs = argc > 3 ? atoi(argv[3]) : 3;
+
+  // init dt without gui and without data.db:
+  if(dt_init(argc_override, argv_override, FALSE, FALSE, NULL)) exit(1);
+
+  const size_t npixels = (size_t)width * height;
+  float *image = dt_alloc_align_float(4 * npixels);
+  bench_t b = { .width = width, .height = height, .image = image };
+  for(int k = 0; k < 4; k++) b.buf[k] = dt_alloc_align_float(4 * npixels);
+  if(!image || !b.buf[0] || !b.buf[1] || !b.buf[2] || !b.buf[3]) exit(1);
+
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+      for(int c = 0; c < 4; c++)
+        image[4 * ((size_t)y * width + x) + c] = 0.4f + 0.3f * sinf(0.05f * x + c) * cosf(0.03f * y)
+                                                 + 0.05f * ((x * 7 + y * 13 + c) % 17) / 17.0f;
+
+  static const struct
+  {
+    const char *name;
+    void (*run)(bench_t *b);
+  } consumers[] = { { "equalizer", _equalizer },
+                    { "rawdenoise", _rawdenoise },
+                    { "retouch", _retouch },
+                    { "denoiseprofile", _denoiseprofile } };
+
+  const int saved = dt_conf_get_int("memory/wavelet_fused_scales");
+  printf("%-16s %-12s %-10s %10s\n", "consumer", "size", "tiling", "seconds");
+  for(size_t i = 0; i < sizeof(consumers) / sizeof(*consumers); i++)
+    for(int fused = -1; fused <= 0; fused++)
+    {
+      dt_conf_set_int("memory/wavelet_fused_scales", fused);
+      // warm up
+      consumers[i].run(&b);
+      double total = 0.0;
+      for(int r = 0; r < runs; r++)
+      {
+        const double start = dt_get_wtime();
+        consumers[i].run(&b);
+        total += dt_get_wtime() - start;
+      }
+      printf("%-16s %5dx%-6d %-10s %10.3f\n", consumers[i].name, width, height, fused ? "auto" : "off",
+             total / runs);
+    }
+  dt_conf_set_int("memory/wavelet_fused_scales", saved);
+
+  dt_free_align(image);
+  for(int k = 0; k < 4; k++) dt_free_align(b.buf[k]);
+
+  dt_cleanup();
+
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
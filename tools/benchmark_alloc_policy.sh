@@ -0,0 +1,70 @@
+#!/bin/bash
+
+# MIT License
+#
+# Copyright (c) 2023 darktable developers
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# exports an image with every combination of the memory/hugepages and
+# memory/numa_placement settings and reports the mean pixelpipe time.
+# opencl is disabled so that the cpu path and its memory placement are measured.
+#
+# usage: benchmark_alloc_policy.sh <image> [<xmp>] [<runs>]
+
+. "$(dirname "$0")/common.sh"
+
+if [ $# -lt 1 ]; then
+  echo "usage: $0 <image> [<xmp>] [<runs>]"
+  exit 1
+fi
+
+image="$1"
+xmp="${2:-}"
+runs="${3:-3}"
+cli="${DARKTABLE_CLI:-darktable-cli}"
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+
+run_once()
+{
+  local hugepages="$1"
+  local placement="$2"
+  rm -f "$workdir/out.tif"
+  "$cli" "$image" $xmp "$workdir/out.tif" --core \
+    --configdir "$workdir/config" --library :memory: --disable-opencl -d perf \
+    --conf "memory/hugepages=$hugepages" \
+    --conf "memory/numa_placement=$placement" 2>&1 \
+    | sed -n 's/.*\[dev_process_export\] pixel pipeline processing took \([0-9.]*\) secs.*/\1/p'
+}
+
+printf "%-10s %-12s %s\n" "hugepages" "placement" "pipeline (s, mean of $runs)"
+for hugepages in false true; do
+  for placement in "default" "first touch" "interleave"; do
+    # warm up caches and the configdir
+    run_once "$hugepages" "$placement" > /dev/null
+    total=0
+    for i in $(seq "$runs"); do
+      t=$(run_once "$hugepages" "$placement")
+      total=$(echo "$total + ${t:-0}" | bc -l)
+    done
+    printf "%-10s %-12s %.3f\n" "$hugepages" "$placement" "$(echo "$total / $runs" | bc -l)"
+  done
+done